@@ -11,52 +11,80 @@ out VSOut
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
-uniform vec3 BezierCubeControlPoints[64];
+// Points stored x fastest from FirstControlPoint on, see ControlPointStream.
+uniform samplerBuffer ControlPoints;
+uniform int FirstControlPoint;
+uniform ivec3 LatticeSize;
 
-vec4 BernsteinBasis(float u)
+// Clamped uniform B-spline along one axis, see BSplineLattice.hpp. A lattice
+// of four points gives the cubic Bernstein basis.
+float Knot(int index, int count, int degree)
 {
-    float u2 = u*u;
-    float u3 = u*u2;
-    return vec4(
-        1 - 3*u + 3*u2 - u3,
-        3*u - 6*u2 + 3*u3,
-        3*u2 - 3*u3,
-        u3
-    );
+    return float(clamp(index - degree, 0, count - degree));
 }
 
-vec4 BernsteinDerivativeBasis(float u)
+int BSplineBasis(float u, int count, out float basis[4])
 {
-    float u2 = u*u;
-    return 3*vec4(
-        2*u - u2 - 1,
-        1 - 4*u + 3*u2,
-        2*u - 3*u2,
-        u2
-    );
+    int degree = min(3, count - 1);
+    float t = u * float(count - degree);
+    int span = clamp(int(floor(t)), 0, count - degree - 1) + degree;
+
+    float left[4];
+    float right[4];
+    basis[0] = 1.0;
+    basis[1] = 0.0;
+    basis[2] = 0.0;
+    basis[3] = 0.0;
+
+    for (int j = 1; j <= degree; ++j)
+    {
+        left[j] = t - Knot(span + 1 - j, count, degree);
+        right[j] = Knot(span + j, count, degree) - t;
+
+        float saved = 0.0;
+        for (int r = 0; r < j; ++r)
+        {
+            float temp = basis[r] / (right[r + 1] + left[j - r]);
+            basis[r] = saved + right[r + 1] * temp;
+            saved = left[j - r] * temp;
+        }
+
+        basis[j] = saved;
+    }
+
+    return span - degree;
 }
 
 vec3 GetControlPoint(int x, int y, int z)
 {
-    return BezierCubeControlPoints[16 * z + 4 * y + x];
+    int index = x + LatticeSize.x * (y + LatticeSize.y * z);
+    return texelFetch(ControlPoints, FirstControlPoint + index).xyz;
 }
 
-vec3 EvaluateBernsteinDistortion(vec3 p)
+vec3 EvaluateLatticeDistortion(vec3 p)
 {
-    vec4 basisx = BernsteinBasis(p.x);
-    vec4 basisy = BernsteinBasis(p.y);
-    vec4 basisz = BernsteinBasis(p.z);
+    float basisx[4];
+    float basisy[4];
+    float basisz[4];
+    int firstx = BSplineBasis(p.x, LatticeSize.x, basisx);
+    int firsty = BSplineBasis(p.y, LatticeSize.y, basisy);
+    int firstz = BSplineBasis(p.z, LatticeSize.z, basisz);
+
+    int countx = min(4, LatticeSize.x);
+    int county = min(4, LatticeSize.y);
+    int countz = min(4, LatticeSize.z);
 
     vec3 sum = vec3(0, 0, 0);
 
-    for (int z = 0; z < 4; ++z)
+    for (int z = 0; z < countz; ++z)
     {
-        for (int y = 0; y < 4; ++y)
+        for (int y = 0; y < county; ++y)
         {
-            for (int x = 0; x < 4; ++x)
+            for (int x = 0; x < countx; ++x)
             {
                 float basisCoefficient = basisx[x] * basisy[y] * basisz[z];
-                sum += GetControlPoint(x, y, z) * basisCoefficient;
+                sum += GetControlPoint(firstx + x, firsty + y, firstz + z)
+                    * basisCoefficient;
             }
         }
     }
@@ -69,8 +97,8 @@ void main()
     vec3 modelPosition = (model* vec4(position, 1)).xyz;
     vec3 modelNormal = (transpose(inverse(model)) * vec4(normal, 0)).xyz;
 
-    vec3 distortedPosition = EvaluateBernsteinDistortion(modelPosition);
-    vec3 distortedMovedPosition = EvaluateBernsteinDistortion(
+    vec3 distortedPosition = EvaluateLatticeDistortion(modelPosition);
+    vec3 distortedMovedPosition = EvaluateLatticeDistortion(
         modelPosition + 0.05 * modelNormal
     );
 
@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+// One particle per instance, read from the control point stream.
+layout (location = 2) in vec3 particlePosition;
+
+out VSOut
+{
+    vec3 Normal;
+} vsOut;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+void main()
+{
+    vec3 markerPosition = particlePosition + (model * vec4(position, 1)).xyz;
+    vsOut.Normal = (transpose(inverse(model)) * vec4(normal, 0)).xyz;
+    gl_Position = projection * view * vec4(markerPosition, 1.0);
+}
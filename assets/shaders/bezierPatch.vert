@@ -1,11 +1,32 @@
 #version 400 core
 
-layout (location = 0) in vec3 position;
+// A Bezier point as weighted sum of lattice points: lattice holds the index
+// of the first one and the strides along u and v, count the number of
+// weights used along each.
+layout (location = 0) in ivec3 lattice;
+layout (location = 1) in ivec2 count;
+layout (location = 2) in vec4 weightsU;
+layout (location = 3) in vec4 weightsV;
 out vec3 vPosition;
 
 uniform mat4 viewMatrix;
 uniform mat4 modelMatrix;
 
+// The lattice points of ControlPointStream, x fastest, from firstControlPoint.
+uniform samplerBuffer controlPoints;
+uniform int firstControlPoint;
+
 void main() {
+  vec3 position = vec3(0);
+  for (int u = 0; u < count.x; ++u) {
+    vec3 row = vec3(0);
+    for (int v = 0; v < count.y; ++v) {
+      int index = firstControlPoint + lattice.x + u * lattice.y + v * lattice.z;
+      row += weightsV[v] * texelFetch(controlPoints, index).xyz;
+    }
+
+    position += weightsU[u] * row;
+  }
+
   vPosition = (viewMatrix * modelMatrix * vec4(position, 1)).xyz;
 }
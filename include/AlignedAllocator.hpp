@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace application
+{
+
+/**
+ * Standard allocator returning storage aligned to TAlignment bytes, so that
+ * contiguous arrays of scalars can be loaded with aligned SIMD instructions.
+ */
+template <typename T, std::size_t TAlignment = 64>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef AlignedAllocator<U, TAlignment> other;
+    };
+
+    static const std::size_t alignment = TAlignment;
+
+    AlignedAllocator() {}
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, TAlignment>&) {}
+
+    T* allocate(std::size_t count);
+    void deallocate(T* pointer, std::size_t count);
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, TAlignment>&) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, TAlignment>&) const
+    {
+        return false;
+    }
+};
+
+template <typename T, std::size_t TAlignment>
+T* AlignedAllocator<T, TAlignment>::allocate(std::size_t count)
+{
+    // Through operator new, so replacements of it see these buffers too.
+    auto bytes = count * sizeof(T) + TAlignment + sizeof(void*);
+    auto raw = ::operator new(bytes);
+
+    auto address = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+    address = (address + TAlignment - 1) & ~(TAlignment - 1);
+
+    auto aligned = reinterpret_cast<void**>(address);
+    aligned[-1] = raw;
+    return reinterpret_cast<T*>(aligned);
+}
+
+template <typename T, std::size_t TAlignment>
+void AlignedAllocator<T, TAlignment>::deallocate(T* pointer, std::size_t)
+{
+    if (pointer)
+    {
+        ::operator delete(reinterpret_cast<void**>(pointer)[-1]);
+    }
+}
+
+}
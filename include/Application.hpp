@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "glm/glm.hpp"
 
@@ -13,12 +14,17 @@
 #include "fw/UniversalPhongEffect.hpp"
 #include "fw/Vertices.hpp"
 
+#include "Colliders.hpp"
+#include "ControlPointStream.hpp"
+#include "LatticeDeformer.hpp"
 #include "SoftBox.hpp"
 #include "SoftBoxPreview.hpp"
+#include "SoftBoxSurface.hpp"
+#include "Trajectory.hpp"
 
-#include "BezierPatch.hpp"
 #include "BezierPatchEffect.hpp"
 #include "BezierDistortionEffect.hpp"
+#include "ParticleMarkerEffect.hpp"
 
 namespace application
 {
@@ -45,18 +51,35 @@ protected:
 
     void updateProjectionMatrix();
 
-    void drawSoftBoxSide(
-        std::function<glm::ivec3(int,int)> coordTransformation
-    );
+    void drawSoftBoxSurface();
 
     void restartSimulation();
 
     void loadSoftModel();
 
+    /** Deforms the model on the CPU and writes it as an OBJ file. */
+    void exportDeformedModel();
+
+    /** Passes the enabled obstacles to the soft box, baking them if needed. */
+    void updateObstacles();
+
+    /** Opens or closes the recorder when the checkbox changes. */
+    void updateTrajectoryRecording();
+
+    void renderObstacle(
+        fw::Mesh<fw::VertexNormalTexCoords>& mesh,
+        const glm::vec3& position
+    );
+
 private:
     bool _updatePhysicsEnabled;
     std::shared_ptr<SoftBox> _softBox;
     std::shared_ptr<SoftBoxPreview> _softBoxPreview;
+    std::shared_ptr<ControlPointStream> _controlPointStream;
+
+    bool _recordTrajectory;
+    double _recordedSeconds;
+    TrajectoryRecorder _trajectoryRecorder;
 
     bool _enableGridPreview;
     bool _enableConstraintsPreview;
@@ -67,12 +90,25 @@ private:
     std::shared_ptr<fw::TexturedPhongEffect> _phongEffect;
     std::shared_ptr<fw::UniversalPhongEffect> _universalPhongEffect;
     std::shared_ptr<BezierDistortionEffect> _bezierDistortionEffect;
+    std::shared_ptr<ParticleMarkerEffect> _particleMarkerEffect;
 
     glm::vec3 _roomSize;
     std::shared_ptr<fw::Material> _roomMaterial;
     std::shared_ptr<fw::Mesh<fw::VertexNormalTexCoords>> _cube;
     std::shared_ptr<fw::Mesh<fw::VertexNormalTexCoords>> _sphere;
     std::shared_ptr<fw::Mesh<fw::VertexNormalTexCoords>> _softModel;
+    DeformableMesh _softModelRestMesh;
+    LatticeDeformer _softModelDeformer;
+
+    bool _sphereObstacleEnabled;
+    glm::vec3 _sphereObstaclePosition;
+    bool _bunnyObstacleEnabled;
+    glm::vec3 _bunnyObstaclePosition;
+    std::shared_ptr<VoxelSdf> _bunnyDistanceField;
+
+    /** Rebuilt every frame in place, applied only when changed. */
+    std::vector<Collider> _obstacleColliders;
+    std::shared_ptr<fw::Material> _obstacleMaterial;
 
     std::shared_ptr<fw::Material> _cubeOutlineMaterial;
     std::shared_ptr<fw::Mesh<fw::VertexColor>> _cubeOutline;
@@ -80,7 +116,7 @@ private:
     std::shared_ptr<fw::Grid> _grid;
 
     std::shared_ptr<BezierPatchEffect> _bezierEffect;
-    std::shared_ptr<BezierPatch> _bezierPatch;
+    std::shared_ptr<SoftBoxSurface> _softBoxSurface;
 
     std::shared_ptr<fw::Texture> _softbodyTexture;
 
@@ -89,6 +125,8 @@ private:
     bool _enableCameraRotations;
 
     glm::dvec2 _cameraRotationSensitivity;
+    glm::ivec3 _latticeSize;
+    int _latticeSpringStorage;
     GLuint _testTexture;
 };
 
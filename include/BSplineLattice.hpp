@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include "glm/glm.hpp"
+
+namespace application
+{
+
+/**
+ * Particle lattices are used as control nets of clamped uniform B-splines.
+ * Along an axis with n control points the degree is min(3, n - 1) and the
+ * knots are 0, ..., 0, 1, 2, ..., n - 3, n - 3, ..., n - 3. A net of four
+ * points is then exactly the cubic Bezier curve of the original 4x4x4 box,
+ * larger nets give one cubic piece per lattice cell.
+ */
+
+/**
+ * Converts a clamped B-spline curve into the control points of cubic
+ * Bezier segments. Segment i uses points [3i, 3i + 3], so neighbours share
+ * their end points. Curves of lower degree are elevated to cubic.
+ */
+std::vector<glm::vec3> convertBSplineToBezier(
+    const std::vector<glm::vec3>& controlPoints
+);
+
+/**
+ * Surface version of convertBSplineToBezier. Points are stored row by row
+ * with sizeV points per row; the result uses the same layout and its size
+ * is returned through bezierSizeU and bezierSizeV.
+ */
+std::vector<glm::vec3> convertBSplineSurfaceToBezier(
+    const std::vector<glm::vec3>& controlPoints,
+    int sizeU,
+    int sizeV,
+    int& bezierSizeU,
+    int& bezierSizeV
+);
+
+/**
+ * One point of convertBSplineToBezier as weighted sum of count consecutive
+ * control points from first on; count is at most four.
+ */
+struct BezierPointWeights
+{
+    int first;
+    int count;
+    float weights[4];
+};
+
+/**
+ * The conversion of convertBSplineToBezier for curves of count points as
+ * weights, one entry per Bezier point. The conversion is linear, so nets of
+ * a fixed size can be converted without repeating the knot insertion.
+ */
+std::vector<BezierPointWeights> getBSplineToBezierWeights(int count);
+
+/**
+ * Basis functions of the clamped B-spline of count control points at u, as
+ * evaluated by BezierCubeDistortion.vert. Fills basis[0..degree], zeroes
+ * the rest and returns the index of the control point of basis[0].
+ */
+int evaluateBSplineBasis(float u, int count, float basis[4]);
+
+/**
+ * Moves point p of the lattice parameter space [0, 1]^3 with the volume
+ * spanned by controlPoints, stored x fastest. Mirrors the vertex shader,
+ * evaluating all bases again on every call; see LatticeDeformer for meshes.
+ */
+glm::vec3 evaluateLatticeDistortion(
+    const std::vector<glm::vec3>& controlPoints,
+    glm::ivec3 latticeSize,
+    glm::vec3 p
+);
+
+}
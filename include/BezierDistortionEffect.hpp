@@ -7,6 +7,8 @@
 #include "fw/Material.hpp"
 #include "fw/Texture.hpp"
 
+#include "ControlPointStream.hpp"
+
 namespace application
 {
 
@@ -27,12 +29,15 @@ public:
     void setEmissionColor(glm::vec3 color);
     void setSolidColor(glm::vec3 color);
     void setSolidColor(glm::vec4 color);
-    void setDistortionControlPoints(const std::vector<glm::vec3>& points);
+    /** Reads the current region of stream, points stored x fastest. */
+    void setDistortionControlPoints(const ControlPointStream& stream);
 
 private:
     void createShaders();
 
     GLuint _controlPointsLocation;
+    GLuint _firstControlPointLocation;
+    GLuint _latticeSizeLocation;
     GLuint _lightDirectionLocation;
     GLuint _emissionColorLocation;
     GLuint _solidColorLocation;
@@ -41,7 +46,9 @@ private:
     glm::vec4 _solidColor;
     glm::vec3 _lightDirection;
 
-    std::vector<glm::vec3> _points;
+    GLuint _controlPointsTexture;
+    GLint _firstControlPoint;
+    glm::ivec3 _latticeSize;
 };
 
 }
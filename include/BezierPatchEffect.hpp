@@ -4,6 +4,7 @@
 #include "glm/glm.hpp"
 #include "fw/OpenGLHeaders.hpp"
 #include "fw/Shaders.hpp"
+#include "ControlPointStream.hpp"
 
 namespace application
 {
@@ -20,6 +21,8 @@ struct BezierPatchEffectUniformLocations {
     GLuint vPatch;
     GLuint diffuseTexture;
     GLuint normalTexture;
+    GLuint controlPoints;
+    GLuint firstControlPoint;
 };
 
 class BezierPatchEffect
@@ -40,6 +43,8 @@ public:
 
     void setDiffuseTexture(GLuint texture);
     void setNormalTexture(GLuint texture);
+    /** Lattice points read by bezierPatch.vert, the current region. */
+    void setControlPoints(const ControlPointStream& stream);
 
     void begin();
     void end();
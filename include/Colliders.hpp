@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+namespace application
+{
+
+enum class ColliderShape
+{
+    Sphere,
+    Capsule,
+    OrientedBox,
+    Plane,
+    VoxelGrid,
+    ColliderShapeCount
+};
+
+inline const char* getColliderShapeName(ColliderShape shape)
+{
+    switch (shape)
+    {
+    case ColliderShape::Sphere: return "Sphere";
+    case ColliderShape::Capsule: return "Capsule";
+    case ColliderShape::OrientedBox: return "Oriented box";
+    case ColliderShape::Plane: return "Plane";
+    case ColliderShape::VoxelGrid: return "Voxel grid";
+    default: return "Unknown";
+    }
+}
+
+/**
+ * Signed distance to a closed triangle mesh sampled at the corners of a
+ * regular grid, negative inside. Between samples the distance is
+ * interpolated trilinearly and the normal is the gradient of that
+ * interpolation. Outside the grid the distance to the grid box is added to
+ * the distance at its border.
+ */
+class VoxelSdf
+{
+public:
+    VoxelSdf();
+
+    /**
+     * Bakes the field of the triangles given by index triples. Distances are
+     * exact next to the triangles and carried outwards by sweeping the
+     * closest triangle through the grid, the sign comes from the parity of
+     * surface crossings along x. Padding is the number of cells kept around
+     * the mesh bounds.
+     */
+    void build(
+        const std::vector<glm::dvec3>& vertices,
+        const std::vector<unsigned>& indices,
+        double cellSize,
+        int padding = 2
+    );
+
+    bool empty() const { return _distance.empty(); }
+
+    /** Distance at point, with the unnormalized gradient in gradient. */
+    double sample(const glm::dvec3& point, glm::dvec3& gradient) const;
+
+    /** Corners of the sampled box. */
+    glm::dvec3 getLow() const { return _origin; }
+    glm::dvec3 getHigh() const;
+
+    const glm::ivec3& getSize() const { return _size; }
+    double getCellSize() const { return _cellSize; }
+
+private:
+    float at(int i, int j, int k) const
+    {
+        return _distance[(k * _size.y + j) * _size.x + i];
+    }
+
+    glm::dvec3 _origin;
+    double _cellSize;
+    glm::ivec3 _size;
+    std::vector<float> _distance;
+};
+
+/**
+ * Reads the first mesh of a model file through Assimp and bakes its
+ * distance field, with vertex coordinates multiplied by scale. Returns false
+ * and logs the reason when the file cannot be read.
+ */
+bool loadVoxelSdf(
+    const std::string& path,
+    double scale,
+    double cellSize,
+    VoxelSdf& sdf
+);
+
+/**
+ * Static obstacle described by a signed distance function. Fields not used
+ * by the shape are ignored; the factory functions fill in the right ones
+ * together with the bounding sphere used for culling.
+ */
+struct Collider
+{
+public:
+    Collider();
+
+    static Collider sphere(const glm::dvec3& center, double radius);
+
+    static Collider capsule(
+        const glm::dvec3& start,
+        const glm::dvec3& end,
+        double radius
+    );
+
+    /** Axes have to be orthonormal. */
+    static Collider orientedBox(
+        const glm::dvec3& center,
+        const glm::dvec3 axes[3],
+        const glm::dvec3& halfExtents
+    );
+
+    /** Particles are kept on the side normal points to. */
+    static Collider plane(const glm::dvec3& point, const glm::dvec3& normal);
+
+    /** Grid coordinates are turned by axes and then moved to position. */
+    static Collider voxelGrid(
+        const std::shared_ptr<const VoxelSdf>& grid,
+        const glm::dvec3& position,
+        const glm::dvec3 axes[3]
+    );
+
+    /**
+     * Whether the surface can be closer than margin to some point of the
+     * axis-aligned box from low to high. Tested against the bounding
+     * sphere, or against the plane itself.
+     */
+    bool mayOverlap(
+        const glm::dvec3& low,
+        const glm::dvec3& high,
+        double margin
+    ) const;
+
+    ColliderShape shape;
+
+    /** Sphere and box center, capsule start, plane point, grid position. */
+    glm::dvec3 position;
+
+    /** Capsule end. */
+    glm::dvec3 end;
+
+    /** Local frame of the box and the grid. */
+    glm::dvec3 axes[3];
+
+    /** Box half extents. */
+    glm::dvec3 halfExtents;
+
+    /** Plane normal, of unit length. */
+    glm::dvec3 normal;
+
+    /** Sphere and capsule radius. */
+    double radius;
+
+    std::shared_ptr<const VoxelSdf> grid;
+
+    glm::dvec3 boundCenter;
+    double boundRadius;
+};
+
+/** Whether both describe the same obstacle, sharing the same grid. */
+bool operator==(const Collider& a, const Collider& b);
+
+inline bool operator!=(const Collider& a, const Collider& b)
+{
+    return !(a == b);
+}
+
+/** Work done by the last collider pass of a particle system. */
+struct ColliderStatistics
+{
+    ColliderStatistics();
+
+    /** Batch and collider pairs considered and left after culling. */
+    std::size_t candidateTests;
+    std::size_t evaluatedTests;
+
+    /** Particles found inside a collider. */
+    std::size_t contacts;
+};
+
+/**
+ * Signed distances and outward normals of count particles, written to
+ * distance and normal. The analytic shapes run as plain loops over the
+ * coordinate arrays, so a batch of particles is evaluated at vector width.
+ * Normals of unit length are only guaranteed for particles inside or close
+ * to the surface.
+ */
+template <typename TPrecision>
+void evaluateCollider(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+);
+
+}
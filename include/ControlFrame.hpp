@@ -18,6 +18,8 @@ public:
     inline float getSpringConstant() { return _frameSpringConstant; }
     inline float getSpringAttenuation() { return _frameSpringAttenuation; }
 
+    void setSpringParameters(float springConstant, float attenuation);
+
 private:
     float _frameSize;
     float _frameSpringConstant;
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "fw/OpenGLHeaders.hpp"
+#include "glm/glm.hpp"
+
+namespace application
+{
+
+class SoftBox;
+
+/**
+ * Interpolated particle positions of a soft box in one GPU buffer shared by
+ * every renderer that draws the lattice. The buffer holds cRegionCount
+ * regions used in turn: update fills the next region while the GPU may
+ * still read the ones of the previous frames, and finishFrame fences the
+ * region after its last draw. Each point is stored as x, y, z, 1.
+ *
+ * With OpenGL 4.4 the buffer is mapped persistently and the positions are
+ * converted straight into it; otherwise they are converted into memory of
+ * the stream and uploaded with one glBufferSubData.
+ *
+ * Readers use the buffer as vertex attribute with getFirstPoint as base
+ * vertex, or as texture buffer of RGBA32F texels from getFirstPoint on.
+ */
+class ControlPointStream
+{
+public:
+    static const int cRegionCount = 3;
+
+    ControlPointStream();
+    ~ControlPointStream();
+
+    ControlPointStream(const ControlPointStream&) = delete;
+    ControlPointStream& operator=(const ControlPointStream&) = delete;
+
+    void destroy();
+
+    /** Writes the current positions of softBox into the next region. */
+    void update(const SoftBox& softBox);
+
+    /** Fences the current region. Call after the last draw reading it. */
+    void finishFrame();
+
+    GLuint getBuffer() const { return _buffer; }
+    GLuint getTexture() const { return _texture; }
+
+    /** Index of the first point of the current region in the buffer. */
+    GLint getFirstPoint() const
+    {
+        return static_cast<GLint>(_region * _regionPoints);
+    }
+
+    std::size_t getPointCount() const { return _pointCount; }
+    glm::ivec3 getLatticeSize() const { return _latticeSize; }
+
+    bool isPersistentlyMapped() const { return _mapping != nullptr; }
+
+    /** Updates that found their region still in use by the GPU. */
+    std::size_t getStallCount() const { return _stallCount; }
+
+private:
+    void allocate(std::size_t points);
+    void release();
+    void waitForRegion(int region);
+
+    GLuint _buffer;
+    GLuint _texture;
+    float* _mapping;
+    std::vector<float> _staging;
+    GLsync _fences[cRegionCount];
+
+    std::size_t _regionPoints;
+    std::size_t _pointCount;
+    glm::ivec3 _latticeSize;
+    int _region;
+    std::size_t _stallCount;
+};
+
+}
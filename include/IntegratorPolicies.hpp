@@ -0,0 +1,924 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "RungeKuttaODESolver.hpp"
+
+namespace application
+{
+
+/*
+ * Integrator policies advance a Hamiltonian system whose state is laid out as
+ * all generalized positions followed by the same number of momenta. TSystem
+ * has to provide:
+ *
+ *   evaluateDerivative(state, time, derivative)
+ *       fills the whole derivative, velocities followed by forces,
+ *   evaluateVelocity(state, derivative)
+ *       fills only the velocity half, which is much cheaper than forces.
+ *
+ * Output may alias input for every policy. The implicit policy needs more,
+ * see BackwardEulerIntegrator.
+ */
+
+enum class IntegratorType
+{
+    SymplecticEuler,
+    VelocityVerlet,
+    Midpoint,
+    RungeKutta4,
+    DormandPrince45,
+    BackwardEuler,
+    IntegratorTypeCount
+};
+
+inline const char* getIntegratorName(IntegratorType type)
+{
+    switch (type)
+    {
+    case IntegratorType::SymplecticEuler: return "Symplectic Euler";
+    case IntegratorType::VelocityVerlet: return "Velocity Verlet";
+    case IntegratorType::Midpoint: return "RK2 midpoint";
+    case IntegratorType::RungeKutta4: return "RK4";
+    case IntegratorType::DormandPrince45: return "Dormand-Prince 5(4)";
+    case IntegratorType::BackwardEuler: return "Backward Euler";
+    default: return "Unknown";
+    }
+}
+
+/** First order, symplectic: kicks momenta, then drifts with new velocity. */
+template <typename TPrecision>
+class SymplecticEulerIntegrator
+{
+public:
+    static const int cDerivativeEvaluations = 1;
+
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& step
+    );
+
+private:
+    StateVector<TPrecision> _derivative;
+};
+
+/**
+ * Second order, symplectic for velocity independent forces: half kick,
+ * drift, half kick. The force of the last half kick is the force of the
+ * next first one when the next step starts where this one ended, so a
+ * step costs one derivative evaluation. Velocity dependent forces of that
+ * kick see the velocity after the first half kick.
+ */
+template <typename TPrecision>
+class VelocityVerletIntegrator
+{
+public:
+    static const int cDerivativeEvaluations = 1;
+
+    VelocityVerletIntegrator();
+
+    /**
+     * Forgets the reusable force. Has to be called when the system changes
+     * in a way not visible in the state, e.g. its parameters.
+     */
+    void invalidate() { _forceValid = false; }
+
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& step
+    );
+
+private:
+    bool canReuseForce(const StateVector<TPrecision>& input) const;
+
+    StateVector<TPrecision> _derivative;
+    StateVector<TPrecision> _solution;
+    bool _forceValid;
+};
+
+/** Second order explicit Runge-Kutta midpoint method. */
+template <typename TPrecision>
+class MidpointIntegrator
+{
+public:
+    static const int cDerivativeEvaluations = 2;
+
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& step
+    );
+
+private:
+    StateVector<TPrecision> _derivative;
+    StateVector<TPrecision> _stageInput;
+};
+
+template <typename TPrecision>
+using RungeKutta4Integrator = RungeKuttaODESolver<TPrecision>;
+
+struct IntegratorStatistics
+{
+    IntegratorStatistics():
+        acceptedSteps{},
+        rejectedSteps{},
+        linearSolverIterations{},
+        lastLinearSolverIterations{}
+    {
+    }
+
+    unsigned long long acceptedSteps;
+    unsigned long long rejectedSteps;
+    unsigned long long linearSolverIterations;
+    int lastLinearSolverIterations;
+};
+
+/**
+ * Embedded Runge-Kutta 5(4) pair of Dormand and Prince. The last stage of an
+ * accepted step is the first stage of the next one (FSAL), so an accepted
+ * step costs six derivative evaluations. The step size proposed by the error
+ * controller is remembered between calls.
+ */
+template <typename TPrecision>
+class DormandPrinceIntegrator
+{
+public:
+    static const int cDerivativeEvaluations = 6;
+
+    DormandPrinceIntegrator();
+
+    void setTolerances(TPrecision absolute, TPrecision relative);
+
+    /**
+     * Forgets the reusable first stage. Has to be called when the system
+     * changes in a way not visible in the state, e.g. its parameters.
+     */
+    void invalidate() { _firstStageValid = false; }
+
+    /**
+     * Takes one error controlled step no longer than maxStep and returns its
+     * length. Rejected attempts are retried with a smaller step.
+     */
+    template <typename TSystem>
+    TPrecision adaptiveStep(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& maxStep,
+        IntegratorStatistics& statistics
+    );
+
+    /** Takes a step of exactly the given length without error control. */
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& step
+    );
+
+private:
+    static const int cStages = 7;
+
+    bool canReuseFirstStage(const StateVector<TPrecision>& input) const;
+
+    template <typename TSystem>
+    TPrecision evaluateStages(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        const TPrecision& t,
+        const TPrecision& step,
+        bool firstStageKnown
+    );
+
+    void acceptStages(StateVector<TPrecision>& output);
+
+    StateVector<TPrecision> _stages[cStages];
+    StateVector<TPrecision> _stageInput;
+    StateVector<TPrecision> _solution;
+
+    TPrecision _absoluteTolerance;
+    TPrecision _relativeTolerance;
+    TPrecision _proposedStep;
+    bool _firstStageValid;
+};
+
+/**
+ * Linearly implicit backward Euler in the form of Baraff and Witkin. Each
+ * step solves
+ *
+ *     (M - h dF/dv - h^2 dF/dx) dv = h (F + h dF/dx v)
+ *
+ * for the velocity change dv with Jacobi preconditioned conjugate gradients,
+ * starting from the previous solution. Vectors of the solve have the size of
+ * the velocity half of the state. TSystem has to provide in addition:
+ *
+ *   linearizeForces(state, step)
+ *       caches the force Jacobians at state for the given step length,
+ *   multiplySystemMatrix(vector, result)
+ *       result = (M - h dF/dv - h^2 dF/dx) vector,
+ *   multiplyPositionJacobian(vector, result)
+ *       result = h^2 dF/dx vector,
+ *   multiplyMass(vector, result)
+ *       result = M vector,
+ *   getSystemDiagonal()
+ *       diagonal of the system matrix.
+ */
+template <typename TPrecision>
+class BackwardEulerIntegrator
+{
+public:
+    static const int cDerivativeEvaluations = 1;
+
+    BackwardEulerIntegrator();
+
+    void setLinearSolverSettings(TPrecision tolerance, int maxIterations);
+
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& step,
+        IntegratorStatistics& statistics
+    );
+
+private:
+    template <typename TSystem>
+    int solve(TSystem& system);
+
+    StateVector<TPrecision> _derivative;
+    StateVector<TPrecision> _rightHandSide;
+    StateVector<TPrecision> _velocityChange;
+    StateVector<TPrecision> _residual;
+    StateVector<TPrecision> _preconditioned;
+    StateVector<TPrecision> _direction;
+    StateVector<TPrecision> _product;
+
+    TPrecision _tolerance;
+    int _maxIterations;
+};
+
+/**
+ * Holds one instance of every policy and forwards each step to the selected
+ * one. The choice is made once per step, the policy loops themselves are
+ * instantiated for the concrete system at compile time.
+ */
+template <typename TPrecision>
+class SwitchableIntegrator
+{
+public:
+    SwitchableIntegrator(
+        IntegratorType type = IntegratorType::RungeKutta4
+    );
+
+    void setType(IntegratorType type) { _type = type; }
+    IntegratorType getType() const { return _type; }
+    bool isAdaptive() const
+    {
+        return _type == IntegratorType::DormandPrince45;
+    }
+
+    bool isImplicit() const
+    {
+        return _type == IntegratorType::BackwardEuler;
+    }
+
+    void setTolerances(TPrecision absolute, TPrecision relative);
+    void setLinearSolverSettings(TPrecision tolerance, int maxIterations);
+    void invalidate()
+    {
+        _velocityVerlet.invalidate();
+        _dormandPrince45.invalidate();
+    }
+
+    const IntegratorStatistics& getStatistics() const { return _statistics; }
+    int getDerivativeEvaluationsPerStep() const;
+
+    /**
+     * Takes a step no longer than maxStep and returns its length. Only the
+     * adaptive policy may choose a shorter step.
+     */
+    template <typename TSystem>
+    TPrecision adaptiveStep(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& maxStep
+    );
+
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
+        const TPrecision& t,
+        const TPrecision& step
+    );
+
+private:
+    IntegratorType _type;
+
+    SymplecticEulerIntegrator<TPrecision> _symplecticEuler;
+    VelocityVerletIntegrator<TPrecision> _velocityVerlet;
+    MidpointIntegrator<TPrecision> _midpoint;
+    RungeKutta4Integrator<TPrecision> _rungeKutta4;
+    DormandPrinceIntegrator<TPrecision> _dormandPrince45;
+    BackwardEulerIntegrator<TPrecision> _backwardEuler;
+
+    IntegratorStatistics _statistics;
+};
+
+template <typename TPrecision>
+template <typename TSystem>
+void SymplecticEulerIntegrator<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& step
+)
+{
+    assert(input.size() == output.size());
+
+    const auto dimension = input.size();
+    const auto half = dimension / 2;
+    _derivative.resize(dimension);
+
+    system.evaluateDerivative(input, t, _derivative);
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        output[i] = input[i];
+    }
+
+    for (std::size_t i = half; i < dimension; ++i)
+    {
+        output[i] = input[i] + step * _derivative[i];
+    }
+
+    system.evaluateVelocity(output, _derivative);
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        output[i] += step * _derivative[i];
+    }
+}
+
+template <typename TPrecision>
+VelocityVerletIntegrator<TPrecision>::VelocityVerletIntegrator():
+    _forceValid{false}
+{
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+void VelocityVerletIntegrator<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& step
+)
+{
+    assert(input.size() == output.size());
+
+    const auto dimension = input.size();
+    const auto half = dimension / 2;
+    const TPrecision halfstep = step / 2;
+    _derivative.resize(dimension);
+
+    if (!canReuseForce(input))
+    {
+        system.evaluateDerivative(input, t, _derivative);
+    }
+
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        output[i] = input[i];
+    }
+
+    for (std::size_t i = half; i < dimension; ++i)
+    {
+        output[i] = input[i] + halfstep * _derivative[i];
+    }
+
+    system.evaluateVelocity(output, _derivative);
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        output[i] += step * _derivative[i];
+    }
+
+    system.evaluateDerivative(output, t + step, _derivative);
+    for (std::size_t i = half; i < dimension; ++i)
+    {
+        output[i] += halfstep * _derivative[i];
+    }
+
+    _solution.assign(output.begin(), output.end());
+    _forceValid = true;
+}
+
+template <typename TPrecision>
+bool VelocityVerletIntegrator<TPrecision>::canReuseForce(
+    const StateVector<TPrecision>& input
+) const
+{
+    return _forceValid
+        && _derivative.size() == input.size()
+        && _solution.size() == input.size()
+        && std::equal(input.begin(), input.end(), _solution.begin());
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+void MidpointIntegrator<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& step
+)
+{
+    assert(input.size() == output.size());
+
+    const auto dimension = input.size();
+    const TPrecision halfstep = step / 2;
+    _derivative.resize(dimension);
+    _stageInput.resize(dimension);
+
+    system.evaluateDerivative(input, t, _derivative);
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        _stageInput[i] = input[i] + halfstep * _derivative[i];
+    }
+
+    system.evaluateDerivative(_stageInput, t + halfstep, _derivative);
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        output[i] = input[i] + step * _derivative[i];
+    }
+}
+
+template <typename TPrecision>
+DormandPrinceIntegrator<TPrecision>::DormandPrinceIntegrator():
+    _absoluteTolerance{static_cast<TPrecision>(1e-6)},
+    _relativeTolerance{static_cast<TPrecision>(1e-4)},
+    _proposedStep{},
+    _firstStageValid{false}
+{
+}
+
+template <typename TPrecision>
+void DormandPrinceIntegrator<TPrecision>::setTolerances(
+    TPrecision absolute,
+    TPrecision relative
+)
+{
+    _absoluteTolerance = absolute;
+    _relativeTolerance = relative;
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+TPrecision DormandPrinceIntegrator<TPrecision>::adaptiveStep(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& maxStep,
+    IntegratorStatistics& statistics
+)
+{
+    const TPrecision cSafetyFactor = 0.9;
+    const TPrecision cMinimalScale = 0.2;
+    const TPrecision cMaximalScale = 5.0;
+    const TPrecision cMinimalStep = 1e-9;
+
+    auto step = _proposedStep > 0 ? std::min(_proposedStep, maxStep) : maxStep;
+    auto firstStageKnown = canReuseFirstStage(input);
+    for (;;)
+    {
+        auto error = evaluateStages(system, input, t, step, firstStageKnown);
+        auto scale = error > 0
+            ? cSafetyFactor * std::pow(error, static_cast<TPrecision>(-0.2))
+            : cMaximalScale;
+
+        scale = std::min(std::max(scale, cMinimalScale), cMaximalScale);
+        if (error <= 1 || step <= cMinimalStep)
+        {
+            ++statistics.acceptedSteps;
+            acceptStages(output);
+
+            // A step truncated by maxStep may only lower the proposal.
+            auto proposal = step * scale;
+            if (step < maxStep
+                || proposal < _proposedStep
+                || _proposedStep <= 0)
+            {
+                _proposedStep = proposal;
+            }
+
+            return step;
+        }
+
+        // Input did not change, so its derivative is still in the first stage.
+        ++statistics.rejectedSteps;
+        firstStageKnown = true;
+        step *= std::min(scale, cSafetyFactor);
+        _proposedStep = step;
+    }
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+void DormandPrinceIntegrator<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& step
+)
+{
+    evaluateStages(system, input, t, step, canReuseFirstStage(input));
+    acceptStages(output);
+}
+
+template <typename TPrecision>
+bool DormandPrinceIntegrator<TPrecision>::canReuseFirstStage(
+    const StateVector<TPrecision>& input
+) const
+{
+    return _firstStageValid
+        && _solution.size() == input.size()
+        && std::equal(input.begin(), input.end(), _solution.begin());
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+TPrecision DormandPrinceIntegrator<TPrecision>::evaluateStages(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    const TPrecision& t,
+    const TPrecision& step,
+    bool firstStageKnown
+)
+{
+    static const TPrecision c[cStages] = {
+        0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1, 1
+    };
+
+    static const TPrecision a[cStages][cStages - 1] = {
+        {},
+        {1.0/5},
+        {3.0/40, 9.0/40},
+        {44.0/45, -56.0/15, 32.0/9},
+        {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+        {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+        {35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}
+    };
+
+    // Difference between the fifth and the embedded fourth order weights.
+    static const TPrecision e[cStages] = {
+        71.0/57600, 0, -71.0/16695, 71.0/1920,
+        -17253.0/339200, 22.0/525, -1.0/40
+    };
+
+    const auto dimension = input.size();
+    for (auto& stage: _stages)
+    {
+        stage.resize(dimension);
+    }
+
+    _stageInput.resize(dimension);
+
+    if (!firstStageKnown)
+    {
+        system.evaluateDerivative(input, t, _stages[0]);
+    }
+
+    _solution.resize(dimension);
+    for (auto s = 1; s < cStages; ++s)
+    {
+        for (std::size_t i = 0; i < dimension; ++i)
+        {
+            auto increment = a[s][0] * _stages[0][i];
+            for (auto j = 1; j < s; ++j)
+            {
+                increment += a[s][j] * _stages[j][i];
+            }
+
+            _stageInput[i] = input[i] + step * increment;
+        }
+
+        system.evaluateDerivative(_stageInput, t + c[s] * step, _stages[s]);
+    }
+
+    // The last stage input is the fifth order solution.
+    _solution.swap(_stageInput);
+    _firstStageValid = false;
+
+    auto squaredErrorSum = TPrecision{};
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        auto error = TPrecision{};
+        for (auto s = 0; s < cStages; ++s)
+        {
+            error += e[s] * _stages[s][i];
+        }
+
+        auto scale = _absoluteTolerance + _relativeTolerance
+            * std::max(std::abs(input[i]), std::abs(_solution[i]));
+        auto scaledError = step * error / scale;
+        squaredErrorSum += scaledError * scaledError;
+    }
+
+    return std::sqrt(squaredErrorSum / std::max<std::size_t>(1, dimension));
+}
+
+template <typename TPrecision>
+void DormandPrinceIntegrator<TPrecision>::acceptStages(
+    StateVector<TPrecision>& output
+)
+{
+    assert(output.size() == _solution.size());
+
+    std::copy(_solution.begin(), _solution.end(), output.begin());
+    _stages[0].swap(_stages[cStages - 1]);
+    _firstStageValid = true;
+}
+
+template <typename TPrecision>
+BackwardEulerIntegrator<TPrecision>::BackwardEulerIntegrator():
+    _tolerance{static_cast<TPrecision>(1e-5)},
+    _maxIterations{200}
+{
+}
+
+template <typename TPrecision>
+void BackwardEulerIntegrator<TPrecision>::setLinearSolverSettings(
+    TPrecision tolerance,
+    int maxIterations
+)
+{
+    _tolerance = tolerance;
+    _maxIterations = maxIterations;
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+void BackwardEulerIntegrator<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& step,
+    IntegratorStatistics& statistics
+)
+{
+    assert(input.size() == output.size());
+
+    const auto dimension = input.size();
+    const auto half = dimension / 2;
+    _derivative.resize(dimension);
+    _rightHandSide.resize(half);
+    _residual.resize(half);
+    _preconditioned.resize(half);
+    _direction.resize(half);
+    _product.resize(half);
+
+    // Warm start only from a solution of the same system.
+    if (_velocityChange.size() != half)
+    {
+        _velocityChange.assign(half, TPrecision{});
+    }
+
+    system.evaluateDerivative(input, t, _derivative);
+    system.linearizeForces(input, step);
+
+    std::copy(
+        _derivative.begin(),
+        _derivative.begin() + half,
+        _residual.begin()
+    );
+
+    system.multiplyPositionJacobian(_residual, _rightHandSide);
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        _rightHandSide[i] += step * _derivative[half + i];
+    }
+
+    auto iterations = solve(system);
+    statistics.linearSolverIterations += iterations;
+    statistics.lastLinearSolverIterations = iterations;
+
+    system.multiplyMass(_velocityChange, _product);
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        output[i] = input[i];
+        output[half + i] = input[half + i] + _product[i];
+    }
+
+    system.evaluateVelocity(output, _derivative);
+    for (std::size_t i = 0; i < half; ++i)
+    {
+        output[i] += step * _derivative[i];
+    }
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+int BackwardEulerIntegrator<TPrecision>::solve(TSystem& system)
+{
+    const auto dimension = _rightHandSide.size();
+    const auto& diagonal = system.getSystemDiagonal();
+    auto& x = _velocityChange;
+    auto& r = _residual;
+    auto& z = _preconditioned;
+    auto& p = _direction;
+    auto& q = _product;
+
+    auto rightHandSideNorm = TPrecision{};
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        rightHandSideNorm += _rightHandSide[i] * _rightHandSide[i];
+    }
+
+    if (rightHandSideNorm == 0)
+    {
+        std::fill(x.begin(), x.end(), TPrecision{});
+        return 0;
+    }
+
+    const auto threshold = _tolerance * _tolerance * rightHandSideNorm;
+
+    system.multiplySystemMatrix(x, q);
+    auto residualNorm = TPrecision{};
+    auto rz = TPrecision{};
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        r[i] = _rightHandSide[i] - q[i];
+        z[i] = r[i] / diagonal[i];
+        p[i] = z[i];
+        residualNorm += r[i] * r[i];
+        rz += r[i] * z[i];
+    }
+
+    auto iteration = 0;
+    for (; iteration < _maxIterations && residualNorm > threshold; ++iteration)
+    {
+        system.multiplySystemMatrix(p, q);
+
+        auto curvature = TPrecision{};
+        for (std::size_t i = 0; i < dimension; ++i)
+        {
+            curvature += p[i] * q[i];
+        }
+
+        if (curvature <= 0)
+        {
+            break;
+        }
+
+        const auto alpha = rz / curvature;
+        auto nextRz = TPrecision{};
+        residualNorm = TPrecision{};
+        for (std::size_t i = 0; i < dimension; ++i)
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            z[i] = r[i] / diagonal[i];
+            residualNorm += r[i] * r[i];
+            nextRz += r[i] * z[i];
+        }
+
+        const auto beta = nextRz / rz;
+        rz = nextRz;
+        for (std::size_t i = 0; i < dimension; ++i)
+        {
+            p[i] = z[i] + beta * p[i];
+        }
+    }
+
+    return iteration;
+}
+
+template <typename TPrecision>
+SwitchableIntegrator<TPrecision>::SwitchableIntegrator(IntegratorType type):
+    _type{type}
+{
+}
+
+template <typename TPrecision>
+int SwitchableIntegrator<TPrecision>::getDerivativeEvaluationsPerStep() const
+{
+    switch (_type)
+    {
+    case IntegratorType::SymplecticEuler:
+        return SymplecticEulerIntegrator<TPrecision>::cDerivativeEvaluations;
+    case IntegratorType::VelocityVerlet:
+        return VelocityVerletIntegrator<TPrecision>::cDerivativeEvaluations;
+    case IntegratorType::Midpoint:
+        return MidpointIntegrator<TPrecision>::cDerivativeEvaluations;
+    case IntegratorType::DormandPrince45:
+        return DormandPrinceIntegrator<TPrecision>::cDerivativeEvaluations;
+    case IntegratorType::BackwardEuler:
+        return BackwardEulerIntegrator<TPrecision>::cDerivativeEvaluations;
+    default:
+        return RungeKutta4Integrator<TPrecision>::cDerivativeEvaluations;
+    }
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+void SwitchableIntegrator<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& step
+)
+{
+    switch (_type)
+    {
+    case IntegratorType::SymplecticEuler:
+        _symplecticEuler.step(system, input, output, t, step);
+        break;
+    case IntegratorType::VelocityVerlet:
+        _velocityVerlet.step(system, input, output, t, step);
+        break;
+    case IntegratorType::Midpoint:
+        _midpoint.step(system, input, output, t, step);
+        break;
+    case IntegratorType::DormandPrince45:
+        _dormandPrince45.step(system, input, output, t, step);
+        break;
+    case IntegratorType::BackwardEuler:
+        _backwardEuler.step(system, input, output, t, step, _statistics);
+        break;
+    default:
+        _rungeKutta4.step(system, input, output, t, step);
+        break;
+    }
+}
+
+template <typename TPrecision>
+void SwitchableIntegrator<TPrecision>::setTolerances(
+    TPrecision absolute,
+    TPrecision relative
+)
+{
+    _dormandPrince45.setTolerances(absolute, relative);
+}
+
+template <typename TPrecision>
+void SwitchableIntegrator<TPrecision>::setLinearSolverSettings(
+    TPrecision tolerance,
+    int maxIterations
+)
+{
+    _backwardEuler.setLinearSolverSettings(tolerance, maxIterations);
+}
+
+template <typename TPrecision>
+template <typename TSystem>
+TPrecision SwitchableIntegrator<TPrecision>::adaptiveStep(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
+    const TPrecision& t,
+    const TPrecision& maxStep
+)
+{
+    if (isAdaptive())
+    {
+        return _dormandPrince45.adaptiveStep(
+            system,
+            input,
+            output,
+            t,
+            maxStep,
+            _statistics
+        );
+    }
+
+    step(system, input, output, t, maxStep);
+    ++_statistics.acceptedSteps;
+    return maxStep;
+}
+
+}
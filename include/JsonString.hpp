@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+namespace application
+{
+
+/** Value as quoted JSON string, e.g. a Windows path. */
+inline std::string quoteJson(const std::string& value)
+{
+    std::string quoted{"\""};
+    for (auto character: value)
+    {
+        switch (character)
+        {
+        case '"': quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\r': quoted += "\\r"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(character) < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(
+                    escaped,
+                    sizeof(escaped),
+                    "\\u%04x",
+                    static_cast<unsigned char>(character)
+                );
+                quoted += escaped;
+            }
+            else
+            {
+                quoted += character;
+            }
+        }
+    }
+
+    return quoted + "\"";
+}
+
+}
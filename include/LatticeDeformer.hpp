@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+#include "RungeKuttaODESolver.hpp"
+#include "SpringKernels.hpp"
+#include "ThreadPool.hpp"
+
+namespace application
+{
+
+/** Triangle mesh with one normal per vertex. */
+struct DeformableMesh
+{
+    void clear();
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned> indices;
+};
+
+/** Reads the first mesh of a model file. Returns false and logs on failure. */
+bool loadDeformableMesh(const std::string& path, DeformableMesh& mesh);
+
+/** Writes mesh as Wavefront OBJ. Returns false and logs on failure. */
+bool writeDeformableMeshObj(
+    const std::string& path,
+    const DeformableMesh& mesh
+);
+
+/**
+ * Moves a mesh with the volume spanned by a lattice of control points, on
+ * the CPU and with the same result as BezierCubeDistortion.vert. Rest
+ * positions never change, so the basis functions of every vertex are
+ * evaluated once by setRestShape: each vertex keeps the first of the 4x4x4
+ * control points it depends on and the 3x4 factors of their tensor-product
+ * weights. A deformation is then only the weighted sum over those points.
+ *
+ * Normals are deformed like in the shader, as the direction between the
+ * deformed vertex and a point cNormalOffset along its rest normal.
+ */
+class LatticeDeformer
+{
+public:
+    static const float cNormalOffset;
+
+    LatticeDeformer();
+
+    LatticeDeformer(const LatticeDeformer&) = delete;
+    LatticeDeformer& operator=(const LatticeDeformer&) = delete;
+
+    /**
+     * Precomputes the weights of a rest mesh given in the lattice parameter
+     * space [0, 1]^3, that is after the model transform of the shader.
+     */
+    void setRestShape(
+        const std::vector<glm::vec3>& positions,
+        const std::vector<glm::vec3>& normals,
+        glm::ivec3 latticeSize
+    );
+
+    /**
+     * Deformed positions and normals of the rest mesh for controlPoints,
+     * stored x fastest like the particles of a SoftBox.
+     */
+    void deform(
+        const std::vector<glm::vec3>& controlPoints,
+        std::vector<glm::vec3>& positions,
+        std::vector<glm::vec3>& normals
+    );
+
+    void setThreadCount(int threadCount);
+    int getThreadCount() const { return _threadPool.getThreadCount(); }
+
+    /** Limits the instruction set, the running CPU may support less. */
+    void setSimdLevel(SimdLevel level);
+    SimdLevel getSimdLevel() const { return _simdLevel; }
+
+    std::size_t getVertexCount() const { return _firstPoint.size() / 2; }
+    glm::ivec3 getLatticeSize() const { return _latticeSize; }
+
+private:
+    void gatherControlPoints(const std::vector<glm::vec3>& controlPoints);
+
+    glm::ivec3 _latticeSize;
+
+    /** Lattice padded to at least 4 points per axis. */
+    glm::ivec3 _gridSize;
+
+    /**
+     * Two samples per vertex, the rest position and the point along the
+     * normal. For each the index of its first grid point and the basis
+     * factors along x, y and z, four each.
+     */
+    std::vector<int> _firstPoint;
+    StateVector<float> _basis;
+
+    /** Grid points as x, y, z, 0, zero where the lattice was padded. */
+    StateVector<float> _gridPoints;
+
+    ThreadPool _threadPool;
+    SimdLevel _simdLevel;
+};
+
+}
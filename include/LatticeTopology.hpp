@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include "glm/glm.hpp"
+#include "SpringKernels.hpp"
+#include "ThreadPool.hpp"
+
+namespace application
+{
+
+struct LatticeTopologyStatistics
+{
+    LatticeTopologyStatistics():
+        particles{},
+        springs{},
+        springsPerParticle{},
+        springBytes{},
+        buildSeconds{}
+    {
+    }
+
+    std::size_t particles;
+    std::size_t springs;
+    double springsPerParticle;
+    std::size_t springBytes;
+    double buildSeconds;
+};
+
+/**
+ * How the springs of a regular lattice are kept. Explicit stores every spring
+ * in a SpringBatch, Stencil stores only the lattice size, the rest length per
+ * neighbour offset and one stiffness and damping for the whole body, and
+ * sweeps the grid to find the springs.
+ */
+enum class LatticeSpringStorage
+{
+    Explicit,
+    Stencil,
+    LatticeSpringStorageCount
+};
+
+inline const char* getLatticeSpringStorageName(LatticeSpringStorage storage)
+{
+    switch (storage)
+    {
+    case LatticeSpringStorage::Explicit: return "Explicit";
+    case LatticeSpringStorage::Stencil: return "Stencil";
+    default: return "Unknown";
+    }
+}
+
+/**
+ * Springs of a regular lattice that are never materialized. The lattice has
+ * to be uniform: rest lengths follow from the edge vectors between the first
+ * particle and its x, y and z neighbours.
+ */
+template <typename TPrecision>
+struct LatticeStencil
+{
+    static const int cForwardNeighbours = 13;
+
+    LatticeStencil();
+
+    bool empty() const { return size.x * size.y * size.z == 0; }
+    std::size_t springCount() const;
+
+    glm::ivec3 size;
+    TPrecision restLength[cForwardNeighbours];
+    TPrecision stiffness;
+    TPrecision damping;
+};
+
+/**
+ * Appends the springs of a regular lattice whose particles are stored x
+ * fastest, then y, then z. Every particle is tied to its 26 neighbours, each
+ * pair exactly once: a particle owns the springs to the 13 neighbours that
+ * follow it in storage order. Slabs of constant z are built concurrently,
+ * first counted and then written to their final place, so the arrays are
+ * sized once. Rest lengths are the current distances.
+ */
+template <typename TPrecision>
+LatticeTopologyStatistics buildLatticeSprings(
+    const glm::ivec3& size,
+    const TPrecision* const position[3],
+    TPrecision springConstant,
+    TPrecision damping,
+    ThreadPool& threadPool,
+    SpringBatch<TPrecision>& springs
+);
+
+/** Captures the rest state of the lattice, see LatticeStencil. */
+template <typename TPrecision>
+LatticeTopologyStatistics buildLatticeStencil(
+    const glm::ivec3& size,
+    const TPrecision* const position[3],
+    TPrecision springConstant,
+    TPrecision damping,
+    LatticeStencil<TPrecision>& stencil
+);
+
+/*
+ * Stencil counterparts of the spring kernels. Each evaluates the springs
+ * owned by the particles of plane z, which touch only planes z and z + 1, so
+ * planes of equal parity can be processed concurrently.
+ */
+template <typename TPrecision>
+void accumulateLatticeStencilForces(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const SpringKernelFields<TPrecision>& fields
+);
+
+template <typename TPrecision>
+void linearizeLatticeStencil(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const TPrecision* const position[3],
+    TPrecision step,
+    TPrecision* const diagonal[3]
+);
+
+/**
+ * Recomputes the spring blocks from the positions the system was linearized
+ * at instead of storing them per spring.
+ */
+template <typename TPrecision>
+void accumulateLatticeStencilJacobianProduct(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const TPrecision* const position[3],
+    TPrecision step,
+    const TPrecision* const input[3],
+    TPrecision* const output[3],
+    bool includeDamping
+);
+
+}
@@ -3,6 +3,8 @@
 #include "fw/Vertices.hpp"
 #include "fw/Mesh.hpp"
 
+#include "ControlPointStream.hpp"
+
 namespace application
 {
 
@@ -19,14 +21,25 @@ public:
     void setVertices(const std::vector<fw::VertexColor>& vertices);
     void setIndices(const std::vector<GLuint>& indices);
 
+    /**
+     * Reads positions from the current region of stream instead of the
+     * vertices, all lines drawn in color. Indices refer to stream points.
+     */
+    void setPositionStream(const ControlPointStream& stream, glm::vec3 color);
+
 private:
     void createBuffers();
 
-    static const int cMaxVertices;
-    static const int cMaxIndices;
+    static const std::size_t cInitialVertices;
+    static const std::size_t cInitialIndices;
 
     GLuint _vao, _vbo, _ebo;
     GLuint _numElements;
+    bool _positionsStreamed;
+    GLint _baseVertex;
+    glm::vec3 _streamColor;
+    std::size_t _vertexCapacity;
+    std::size_t _indexCapacity;
 };
 
 }
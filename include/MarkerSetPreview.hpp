@@ -0,0 +1,36 @@
+#pragma once
+
+#include "fw/Mesh.hpp"
+
+#include "ControlPointStream.hpp"
+
+namespace application
+{
+
+/**
+ * A unit box drawn once per point of a ControlPointStream with a single
+ * instanced draw, for ParticleMarkerEffect. Only the stream holds per
+ * marker data, so any number of points is drawn without copies.
+ */
+class MarkerSetPreview:
+    public fw::IMesh
+{
+public:
+    MarkerSetPreview();
+    ~MarkerSetPreview();
+
+    virtual void destroy();
+    virtual void render() const;
+
+    /** Places one marker on every point of the current region of stream. */
+    void setPositionStream(const ControlPointStream& stream);
+
+private:
+    void createBuffers();
+
+    GLuint _vao, _vbo;
+    GLsizei _vertexCount;
+    GLsizei _instanceCount;
+};
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include "glm/glm.hpp"
+
+#include "fw/Effect.hpp"
+#include "fw/Material.hpp"
+
+namespace application
+{
+
+/**
+ * Lit markers of MarkerSetPreview. The model matrix shapes one marker, each
+ * instance is moved to its particle by the vertex shader.
+ */
+class ParticleMarkerEffect:
+    public fw::EffectBase
+{
+public:
+    ParticleMarkerEffect();
+    virtual ~ParticleMarkerEffect();
+
+    virtual void destroy() override;
+    virtual void begin() override;
+    virtual void end() override;
+
+    void setLightDirection(glm::vec3 lightDirection);
+    void setMaterial(const fw::Material& material);
+
+    void setEmissionColor(glm::vec3 color);
+    void setSolidColor(glm::vec4 color);
+
+private:
+    void createShaders();
+
+    GLuint _lightDirectionLocation;
+    GLuint _emissionColorLocation;
+    GLuint _solidColorLocation;
+
+    glm::vec3 _emissionColor;
+    glm::vec4 _solidColor;
+    glm::vec3 _lightDirection;
+};
+
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LatticeTopology.hpp"
+#include "ParticleState.hpp"
+
+namespace application
+{
+
+/**
+ * Arrays of a snapshot file. Spring batches are stored as five consecutive
+ * sections in the order of SpringBatch members.
+ */
+enum SnapshotSection
+{
+    SnapshotState,
+    SnapshotInvMass,
+    SnapshotStaticParticles,
+    SnapshotInternalSpringA,
+    SnapshotInternalSpringB,
+    SnapshotInternalRestLength,
+    SnapshotInternalStiffness,
+    SnapshotInternalDamping,
+    SnapshotAnchorSpringA,
+    SnapshotAnchorSpringB,
+    SnapshotAnchorRestLength,
+    SnapshotAnchorStiffness,
+    SnapshotAnchorDamping,
+    SnapshotSpringColorOffsets,
+    SnapshotAdjacencyOffsets,
+    SnapshotAdjacencySpring,
+    SnapshotAdjacencyNeighbour,
+    SnapshotSectionCount
+};
+
+/** Place of a section in the file, in bytes from its start. */
+struct SnapshotSectionRange
+{
+    std::uint64_t offset;
+    std::uint64_t count;
+    std::uint32_t elementSize;
+    std::uint32_t reserved;
+};
+
+/**
+ * Head of a snapshot file, followed by the sections. Every field has a fixed
+ * width and every section starts at a multiple of cAlignment bytes, so a
+ * mapped file is read in place. Values are stored in the byte order and
+ * precision of the machine and system that saved them; the precision of a
+ * section is its element size.
+ */
+struct SnapshotHeader
+{
+    static const std::uint32_t cVersion = 1;
+    static const std::uint32_t cByteOrder = 0x01020304;
+    static const std::size_t cAlignment = 64;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t fileSize;
+
+    std::uint64_t particleCount;
+    std::uint64_t particleStride;
+
+    double fixedTimestep;
+    double elasticCollisionFactor;
+    double movementAttenuationFactor;
+    double roomSize[3];
+    double contactDistance;
+    double contactStiffness;
+    double sleepKineticEnergy;
+    double sleepForce;
+    double sleepDelay;
+
+    std::int32_t maxSubsteps;
+    std::int32_t integrator;
+    std::int32_t collisionMode;
+    std::int32_t forceAccumulation;
+    std::int32_t sleeping;
+    std::int32_t stencilSize[3];
+    double stencilRestLength[LatticeStencil<double>::cForwardNeighbours];
+    double stencilStiffness;
+    double stencilDamping;
+
+    SnapshotSectionRange sections[SnapshotSectionCount];
+};
+
+/** Memory to be stored as one section. */
+struct SnapshotSectionData
+{
+    SnapshotSectionData();
+
+    template <typename TValue>
+    SnapshotSectionData(const TValue* values, std::size_t count):
+        data{values},
+        count{count},
+        elementSize{sizeof(TValue)}
+    {
+    }
+
+    const void* data;
+    std::size_t count;
+    std::size_t elementSize;
+};
+
+/**
+ * Writes header and sections to path, filling in the identification, the
+ * file size and the section ranges of header. Sections are written straight
+ * from the given memory. Returns false and logs the reason on failure.
+ */
+bool writeParticleSnapshot(
+    const std::string& path,
+    SnapshotHeader header,
+    const SnapshotSectionData sections[SnapshotSectionCount]
+);
+
+/**
+ * Snapshot file mapped read-only into memory. Opening checks the header and
+ * that every section lies inside the file; the sections themselves are
+ * neither parsed nor copied, pages are read as they are first touched.
+ */
+class ParticleSnapshot
+{
+public:
+    ParticleSnapshot();
+    ~ParticleSnapshot();
+
+    ParticleSnapshot(const ParticleSnapshot&) = delete;
+    ParticleSnapshot& operator=(const ParticleSnapshot&) = delete;
+
+    /** Returns false and logs the reason if path is not a valid snapshot. */
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return _header != nullptr; }
+
+    const SnapshotHeader& getHeader() const { return *_header; }
+
+    std::size_t getSectionCount(SnapshotSection section) const
+    {
+        return _header->sections[section].count;
+    }
+
+    /** Elements of a section, null if they are not of the size of TValue. */
+    template <typename TValue>
+    const TValue* getSection(SnapshotSection section) const
+    {
+        const auto& range = _header->sections[section];
+        return range.elementSize == sizeof(TValue)
+            ? reinterpret_cast<const TValue*>(_data + range.offset)
+            : nullptr;
+    }
+
+    /**
+     * Copies count real values of a section from element first on, converted
+     * to TValue when the snapshot was saved in another precision.
+     */
+    template <typename TValue>
+    bool readReals(
+        SnapshotSection section,
+        std::size_t first,
+        std::size_t count,
+        TValue* output
+    ) const;
+
+    /**
+     * Particles of the mapped file, without copying them. Empty if the state
+     * was not saved in TPrecision.
+     */
+    template <typename TPrecision>
+    BasicParticleStateView<TPrecision> getParticleStates() const;
+
+private:
+    const unsigned char* _data;
+    std::size_t _size;
+    const SnapshotHeader* _header;
+
+    /** Holds the file on platforms without memory mapping. */
+    std::vector<unsigned char> _buffer;
+};
+
+template <typename TValue>
+bool ParticleSnapshot::readReals(
+    SnapshotSection section,
+    std::size_t first,
+    std::size_t count,
+    TValue* output
+) const
+{
+    if (first + count > getSectionCount(section))
+    {
+        return false;
+    }
+
+    if (auto values = getSection<float>(section))
+    {
+        std::copy(values + first, values + first + count, output);
+        return true;
+    }
+
+    if (auto values = getSection<double>(section))
+    {
+        std::copy(values + first, values + first + count, output);
+        return true;
+    }
+
+    return false;
+}
+
+template <typename TPrecision>
+BasicParticleStateView<TPrecision>
+ParticleSnapshot::getParticleStates() const
+{
+    auto state = getSection<TPrecision>(SnapshotState);
+    auto invMass = getSection<TPrecision>(SnapshotInvMass);
+    if (state == nullptr || invMass == nullptr)
+    {
+        return {nullptr, nullptr, 0, 0};
+    }
+
+    return {
+        state,
+        invMass,
+        static_cast<std::size_t>(_header->particleCount),
+        static_cast<std::size_t>(_header->particleStride)
+    };
+}
+
+}
@@ -1,12 +1,23 @@
 #pragma once
 
+#include <iterator>
+#include <string>
 #include <vector>
 #include "glm/glm.hpp"
+#include "AlignedAllocator.hpp"
+#include "Colliders.hpp"
+#include "IntegratorPolicies.hpp"
+#include "LatticeTopology.hpp"
 #include "RungeKuttaODESolver.hpp"
+#include "SpatialHash.hpp"
+#include "SpringKernels.hpp"
+#include "ThreadPool.hpp"
 
 namespace application
 {
 
+class ParticleSnapshot;
+
 struct ParticleState
 {
 public:
@@ -21,19 +32,152 @@ public:
 
     glm::dvec3 position;
     glm::dvec3 momentum;
+};
 
-    glm::dvec3 velocity;
-    glm::dvec3 netForce;
+/**
+ * Blocks of the structure-of-arrays particle state. Each block holds one
+ * scalar per particle and starts at a multiple of the particle stride, so the
+ * ODE state vector is exactly the particle storage.
+ */
+enum ParticleStateField
+{
+    PositionX,
+    PositionY,
+    PositionZ,
+    MomentumX,
+    MomentumY,
+    MomentumZ,
+    ParticleStateFieldCount
 };
 
-class ParticleSystem;
+/**
+ * Read-only, ParticleState-per-element access to structure-of-arrays
+ * particle storage.
+ */
+template <typename TPrecision>
+class BasicParticleStateView
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef ParticleState value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const ParticleState* pointer;
+        typedef ParticleState reference;
+
+        const_iterator(const BasicParticleStateView* view, std::size_t index):
+            _view{view},
+            _index{index}
+        {
+        }
+
+        ParticleState operator*() const { return (*_view)[_index]; }
+        const_iterator& operator++() { ++_index; return *this; }
+        const_iterator operator++(int)
+        {
+            auto previous = *this;
+            ++_index;
+            return previous;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return _index == other._index;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return _index != other._index;
+        }
+
+    private:
+        const BasicParticleStateView* _view;
+        std::size_t _index;
+    };
+
+    BasicParticleStateView(
+        const TPrecision* state,
+        const TPrecision* invMass,
+        std::size_t count,
+        std::size_t stride
+    );
+
+    std::size_t size() const { return _count; }
+    bool empty() const { return _count == 0; }
+
+    ParticleState operator[](std::size_t index) const;
+    glm::dvec3 getPosition(std::size_t index) const;
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, _count}; }
+
+private:
+    const TPrecision* _state;
+    const TPrecision* _invMass;
+    std::size_t _count;
+    std::size_t _stride;
+};
+
+using ParticleStateView = BasicParticleStateView<double>;
+
+/**
+ * How particles leaving the room are handled. StepBisection shortens the
+ * whole step until no particle penetrates a wall, PerParticle lets the step
+ * finish and moves each offending particle back from its own time of impact.
+ */
+enum class CollisionMode
+{
+    StepBisection,
+    PerParticle,
+    CollisionModeCount
+};
+
+inline const char* getCollisionModeName(CollisionMode mode)
+{
+    switch (mode)
+    {
+    case CollisionMode::StepBisection: return "Step bisection";
+    case CollisionMode::PerParticle: return "Per particle";
+    default: return "Unknown";
+    }
+}
+
+/**
+ * How internal spring forces are summed. Scatter evaluates every spring once
+ * and adds its force to both ends, running in parallel over color classes.
+ * Gather lets every particle sum its incident springs through a CSR index,
+ * evaluating each spring twice but writing only the particle's own force.
+ */
+enum class ForceAccumulation
+{
+    Scatter,
+    Gather,
+    ForceAccumulationCount
+};
+
+inline const char* getForceAccumulationName(ForceAccumulation accumulation)
+{
+    switch (accumulation)
+    {
+    case ForceAccumulation::Scatter: return "Scatter";
+    case ForceAccumulation::Gather: return "Gather";
+    default: return "Unknown";
+    }
+}
 
 struct SpringConstraint
 {
 public:
     SpringConstraint();
 
-    glm::dvec3 getForce(const ParticleSystem& system) const;
+    glm::dvec3 getForce(
+        const glm::dvec3& positionA,
+        const glm::dvec3& positionB,
+        const glm::dvec3& velocityA,
+        const glm::dvec3& velocityB
+    ) const;
 
     double springLength;
     double springConstant;
@@ -42,23 +186,96 @@ public:
     int b;
 };
 
-class ParticleSystem:
-    public RungeKuttaODESolver<double>
+/**
+ * Particles tied by springs. TPrecision is the precision of the integrated
+ * state, TForcePrecision the one springs are stored and evaluated in. Mixed
+ * precision keeps positions and momenta in double, where the small per-step
+ * increments still add up, while the spring kernels run at float width. The
+ * public interface exchanges double values in every mode.
+ */
+template <typename TPrecision, typename TForcePrecision = TPrecision>
+class BasicParticleSystem
 {
 public:
-    ParticleSystem();
-    ~ParticleSystem();
+    BasicParticleSystem();
+    ~BasicParticleSystem();
 
-    std::vector<double> storePhysicsState() const;
+    void storePhysicsState(std::vector<double>& output) const;
     void applyPhysicsState(const std::vector<double>& state);
 
+    /**
+     * Writes particles, springs, static particles and parameters to a
+     * snapshot file, see ParticleSnapshot. Colliders, threads and integrator
+     * tolerances are left out. Returns false and logs the reason on failure.
+     */
+    bool saveSnapshot(const std::string& path) const;
+
+    /**
+     * Replaces particles, springs, static particles and parameters with
+     * those of a snapshot, copying the arrays block by block out of the
+     * mapping. Finalized topology is restored as saved instead of being
+     * colored again, and values saved in another precision are converted. A
+     * system saved asleep is restored asleep.
+     */
+    bool loadSnapshot(const ParticleSnapshot& snapshot);
+    bool loadSnapshot(const std::string& path);
+
+    /**
+     * Advances the simulation by dt. With a fixed timestep the time is
+     * accumulated and consumed in whole steps, at most maxSubsteps per call.
+     */
     void update(double dt);
 
+    /** A step of zero or less restores variable steps clamped per frame. */
+    void setFixedTimestep(double step, int maxSubsteps);
+    double getFixedTimestep() const { return _fixedTimestep; }
+
+    /**
+     * Fraction of a fixed step accumulated but not yet simulated. Rendering
+     * blends the last two physics states with it.
+     */
+    double getInterpolationFactor() const;
+    glm::dvec3 getInterpolatedPosition(std::size_t index) const;
+
+    /**
+     * Interpolated positions of all particles as float x, y, z, 1, four
+     * floats per particle, see interleavePositionsToFloat4.
+     */
+    void getInterpolatedPositions(float* output) const;
+
     void clear();
+    void reserveParticles(std::size_t count);
     void addParticle(const ParticleState& particle);
     void addConstraint(const SpringConstraint& constraint);
 
-    const std::vector<ParticleState>& getParticleStates() const;
+    /**
+     * Ties the particles, taken as a lattice of the given size, to all their
+     * neighbours. Faster than adding the springs one by one, see
+     * buildLatticeSprings. With stencil storage the springs are not stored at
+     * all, see LatticeStencil; only one lattice can be kept that way.
+     */
+    LatticeTopologyStatistics addLatticeConstraints(
+        const glm::ivec3& size,
+        const SpringConstraint& parameters,
+        LatticeSpringStorage storage = LatticeSpringStorage::Explicit
+    );
+
+    /**
+     * Prepares the spring topology for parallel evaluation. Has to be called
+     * again after constraints are added, until then forces are accumulated
+     * on a single thread by scattering.
+     */
+    void finalizeTopology();
+
+    /** Springs between particles, in the order finalizeTopology left them. */
+    const SpringBatch<TForcePrecision>& getInternalSprings() const
+    {
+        return _internalSprings;
+    }
+
+    BasicParticleStateView<TPrecision> getParticleStates() const;
+    const StateVector<TPrecision>& getPhysicsState() const { return _state; }
+    std::size_t getParticleCount() const { return _particleCount; }
 
     void setStaticParticles(const std::vector<ParticleState>& particles);
     const std::vector<ParticleState>& getStaticParticles() const;
@@ -82,30 +299,249 @@ public:
         double elasticCollisionFactor
     );
 
-protected:
-    virtual std::vector<double> evaluateDerivative(
-        const std::vector<double>& state,
-        const double& time
+    void setSimdLevel(SimdLevel level);
+    SimdLevel getSimdLevel() const { return _simdLevel; }
+
+    void setForceAccumulation(ForceAccumulation accumulation);
+    ForceAccumulation getForceAccumulation() const
+    {
+        return _forceAccumulation;
+    }
+
+    void setThreadCount(int threadCount);
+    int getThreadCount() const { return _threadPool.getThreadCount(); }
+
+    void setIntegrator(IntegratorType type);
+    IntegratorType getIntegrator() const { return _integrator.getType(); }
+
+    /** Error tolerances of the adaptive integrator. */
+    void setIntegratorTolerances(double absolute, double relative);
+
+    /** Relative residual and iteration limit of the implicit solver. */
+    void setLinearSolverSettings(double tolerance, int maxIterations);
+
+    void setCollisionMode(CollisionMode mode);
+    CollisionMode getCollisionMode() const { return _collisionMode; }
+
+    /**
+     * Particles closer than distance push each other apart with a penalty
+     * force of stiffness times the overlap, whether or not they belong to
+     * the same body. Candidate pairs are found once per step, see
+     * SpatialHash. A distance of zero turns self-collision off.
+     */
+    void setSelfCollision(double distance, double stiffness);
+    double getContactDistance() const { return _contactDistance; }
+
+    /** Candidate pairs found at the start of the last step. */
+    std::size_t getContactPairCount() const
+    {
+        return _contacts.pairCount();
+    }
+
+    /**
+     * Static obstacles besides the room walls. After every step particles
+     * found inside one are moved back to its surface and their momentum into
+     * it is reflected and scaled by the elastic collision factor. Particles
+     * are tested in batches, skipping the colliders whose bounding volume
+     * misses the batch.
+     */
+    void setColliders(const std::vector<Collider>& colliders);
+    const std::vector<Collider>& getColliders() const { return _colliders; }
+
+    const ColliderStatistics& getColliderStatistics() const
+    {
+        return _colliderStatistics;
+    }
+
+    /**
+     * Lets the system fall asleep once, for delay seconds in a row, no
+     * particle has more kinetic energy than kineticEnergy and none is pulled
+     * by a larger net force than force. A sleeping system is frozen at rest:
+     * update returns at once, skipping integration and collision handling.
+     * The whole system sleeps as one body, as it is integrated as one state;
+     * bodies meant to sleep independently belong in separate systems.
+     * A kinetic energy of zero turns sleeping off.
+     *
+     * The system wakes when its state or springs are modified through this
+     * interface, when a parameter or the static particles or the colliders
+     * change, and on wakeUp.
+     */
+    void setSleepThresholds(double kineticEnergy, double force, double delay);
+    bool isSleeping() const { return _sleeping; }
+    void wakeUp();
+
+    const IntegratorStatistics& getIntegratorStatistics() const
+    {
+        return _integrator.getStatistics();
+    }
+
+    /** Number of full derivative evaluations since construction. */
+    unsigned long long getDerivativeEvaluationCount() const
+    {
+        return _derivativeEvaluations;
+    }
+
+    /**
+     * Force evaluations of the sleep test, not part of the count above as
+     * the integrator did not ask for them.
+     */
+    unsigned long long getSleepForceEvaluationCount() const
+    {
+        return _sleepForceEvaluations;
+    }
+
+    void evaluateDerivative(
+        const StateVector<TPrecision>& state,
+        const TPrecision& time,
+        StateVector<TPrecision>& derivative
+    );
+
+    /** Fills only the velocity blocks of the derivative. */
+    void evaluateVelocity(
+        const StateVector<TPrecision>& state,
+        StateVector<TPrecision>& derivative
+    );
+
+    /*
+     * Linearized system used by the implicit integrator. Vectors hold the
+     * velocity blocks of the state, see BackwardEulerIntegrator.
+     */
+    void linearizeForces(
+        const StateVector<TPrecision>& state,
+        TPrecision step
+    );
+
+    void multiplySystemMatrix(
+        const StateVector<TPrecision>& vector,
+        StateVector<TPrecision>& result
     );
 
+    void multiplyPositionJacobian(
+        const StateVector<TPrecision>& vector,
+        StateVector<TPrecision>& result
+    );
+
+    void multiplyMass(
+        const StateVector<TPrecision>& vector,
+        StateVector<TPrecision>& result
+    ) const;
+
+    const StateVector<TPrecision>& getSystemDiagonal() const
+    {
+        return _systemDiagonal;
+    }
+
+protected:
+    void advance(double time);
     double singleStep(double maxDt);
     bool checkInterpenetration();
+    void findContacts();
     void applyImpulsesToCollidingContacts();
+    void resolveWallContacts(double dt);
+    void resolveColliderContacts();
+    void updateSleepState(double dt);
 
 private:
-    void clearForces();
-    void calculateForces();
-    void updateParticles();
-    std::vector<double> storePhysicsStateDerivative() const;
+    void calculateForces(
+        const StateVector<TPrecision>& state,
+        StateVector<TPrecision>& derivative
+    );
+
+    void updateParticles(StateVector<TPrecision>& derivative);
+
+    void accumulateSpringJacobianProduct(
+        const StateVector<TPrecision>& vector,
+        StateVector<TPrecision>& result,
+        bool includeDamping
+    );
+
+    /**
+     * Calls function(z) for every plane of the lattice stencil. Planes of
+     * equal parity do not share particles and run concurrently.
+     */
+    template <typename TFunction>
+    void forEachStencilPlane(const TFunction& function);
+
+    void resizeParticleStorage(std::size_t stride);
+
+    template <typename TValue>
+    inline TValue* field(StateVector<TValue>& state, ParticleStateField f)
+    {
+        return state.data() + f * _particleStride;
+    }
+
+    template <typename TValue>
+    inline const TValue* field(
+        const StateVector<TValue>& state,
+        ParticleStateField f
+    ) const
+    {
+        return state.data() + f * _particleStride;
+    }
 
     std::vector<ParticleState> _staticParticles;
-    std::vector<ParticleState> _particleState;
-    std::vector<SpringConstraint> _constraints;
+    SpringBatch<TForcePrecision> _internalSprings;
+    SpringBatch<TForcePrecision> _anchorSprings;
+    std::vector<std::size_t> _springColorOffsets;
+    SpringAdjacency _springAdjacency;
+    LatticeStencil<TForcePrecision> _latticeStencil;
+    SpatialHash<TForcePrecision> _spatialHash;
+    ParticleContacts _contacts;
+    TForcePrecision _contactDistance;
+    TForcePrecision _contactStiffness;
+    ForceAccumulation _forceAccumulation;
+    SimdLevel _simdLevel;
+    ThreadPool _threadPool;
+
+    std::size_t _particleCount;
+    std::size_t _particleStride;
+    StateVector<TPrecision> _state;
+    StateVector<TPrecision> _invMass;
+
+    StateVector<TPrecision> _stepStartState;
+    StateVector<TPrecision> _previousPositions;
+    SwitchableIntegrator<TPrecision> _integrator;
+    unsigned long long _derivativeEvaluations;
+    unsigned long long _sleepForceEvaluations;
+
+    /*
+     * Copies of position, velocity and output blocks in force precision.
+     * They stay empty unless the two precisions differ.
+     */
+    StateVector<TForcePrecision> _forcePositions;
+    StateVector<TForcePrecision> _forceVelocities;
+    StateVector<TForcePrecision> _forceOutput;
+
+    SpringLinearization<TForcePrecision> _internalLinearization;
+    SpringLinearization<TForcePrecision> _anchorLinearization;
+    StateVector<TForcePrecision> _linearizationPositions;
+    TForcePrecision _linearizationStep;
+    StateVector<TPrecision> _massTerm;
+    StateVector<TPrecision> _systemDiagonal;
 
     glm::dvec3 _roomSize;
+    std::vector<Collider> _colliders;
+    std::vector<const Collider*> _activeColliders;
+    ColliderStatistics _colliderStatistics;
+    CollisionMode _collisionMode;
+
+    double _fixedTimestep;
+    double _accumulatedTime;
+    int _maxSubsteps;
 
     double _elasticCollisionFactor;
     double _movementAttenuationFactor;
+
+    double _sleepKineticEnergy;
+    double _sleepForce;
+    double _sleepDelay;
+    double _restTime;
+    bool _sleeping;
+    StateVector<TPrecision> _sleepDerivative;
 };
 
+using ParticleSystem = BasicParticleSystem<double>;
+using FloatParticleSystem = BasicParticleSystem<float>;
+using MixedParticleSystem = BasicParticleSystem<double, float>;
+
 }
@@ -2,100 +2,117 @@
 
 #include <cassert>
 #include <vector>
+#include "AlignedAllocator.hpp"
 
 namespace application
 {
 
+template <typename TPrecision>
+using StateVector = std::vector<TPrecision, AlignedAllocator<TPrecision>>;
+
+/**
+ * Scratch buffers used by a single Runge-Kutta step. Owned by the caller and
+ * kept alive between steps, so once sized no further allocations happen.
+ */
+template <typename TPrecision>
+struct RungeKuttaWorkspace
+{
+    void resize(std::size_t dimension);
+
+    StateVector<TPrecision> derivative;
+    StateVector<TPrecision> stageInput;
+    StateVector<TPrecision> accumulator;
+};
+
+/**
+ * Classic fourth order Runge-Kutta integrator policy. TSystem has to provide
+ * evaluateDerivative(state, time, derivative).
+ */
 template <typename TPrecision>
 class RungeKuttaODESolver
 {
 public:
+    static const int cDerivativeEvaluations = 4;
+
     RungeKuttaODESolver();
-    virtual ~RungeKuttaODESolver() = default;
 
-protected:
-    std::vector<TPrecision> step(
-        const std::vector<TPrecision>& state,
+    /**
+     * Performs one classic RK4 step from input into output. Both vectors
+     * must already have the system dimension; output may alias input.
+     */
+    template <typename TSystem>
+    void step(
+        TSystem& system,
+        const StateVector<TPrecision>& input,
+        StateVector<TPrecision>& output,
         const TPrecision& t,
         const TPrecision& step
     );
 
-    virtual std::vector<TPrecision> evaluateDerivative(
-        const std::vector<TPrecision>& state,
-        const TPrecision& time
-    ) = 0;
-
 private:
-    std::vector<TPrecision> addVectors(
-        const std::vector<TPrecision> &lhs,
-        const std::vector<TPrecision> &rhs,
-        TPrecision lhsFactor,
-        TPrecision rhsFactor
-    );
-
-    int _dimension;
+    RungeKuttaWorkspace<TPrecision> _workspace;
 };
 
+template <typename TPrecision>
+void RungeKuttaWorkspace<TPrecision>::resize(std::size_t dimension)
+{
+    derivative.resize(dimension);
+    stageInput.resize(dimension);
+    accumulator.resize(dimension);
+}
+
 template <typename TPrecision>
 RungeKuttaODESolver<TPrecision>::RungeKuttaODESolver()
 {
 }
 
 template <typename TPrecision>
-std::vector<TPrecision> RungeKuttaODESolver<TPrecision>::step(
-    const std::vector<TPrecision>& input,
+template <typename TSystem>
+void RungeKuttaODESolver<TPrecision>::step(
+    TSystem& system,
+    const StateVector<TPrecision>& input,
+    StateVector<TPrecision>& output,
     const TPrecision& t,
     const TPrecision& step
 )
 {
-    _dimension = input.size();
-    auto halfstep = step / 2;
+    assert(input.size() == output.size());
 
-    auto k1 = evaluateDerivative(input, t);
+    const auto dimension = input.size();
+    _workspace.resize(dimension);
 
-    auto k2 = evaluateDerivative(
-        addVectors(input, k1, 1.0, halfstep),
-        t + halfstep
-    );
-
-    auto k3 = evaluateDerivative(
-        addVectors(input, k2, 1.0, halfstep),
-        t + halfstep
-    );
+    auto& k = _workspace.derivative;
+    auto& stage = _workspace.stageInput;
+    auto& sum = _workspace.accumulator;
+    const TPrecision halfstep = step / 2;
 
-    auto k4 = evaluateDerivative(
-        addVectors(input, k3, 1.0, step),
-        t + step
-    );
-
-    std::vector<TPrecision> output(_dimension);
-    for (auto i = 0; i < _dimension; ++i)
+    system.evaluateDerivative(input, t, k);
+    for (std::size_t i = 0; i < dimension; ++i)
     {
-        output[i] = input[i]
-            + (step/6.0) * (k1[i] + 2.0*k2[i] + 2.0*k3[i] + k4[i]);
+        sum[i] = k[i];
+        stage[i] = input[i] + halfstep * k[i];
     }
 
-    return output;
-}
-
-template <typename TPrecision>
-std::vector<TPrecision> RungeKuttaODESolver<TPrecision>::addVectors(
-    const std::vector<TPrecision> &lhs,
-    const std::vector<TPrecision> &rhs,
-    TPrecision lhsFactor,
-    TPrecision rhsFactor
-)
-{
-    assert(lhs.size() == rhs.size());
-    assert(lhs.size() == _dimension);
+    system.evaluateDerivative(stage, t + halfstep, k);
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        sum[i] += 2 * k[i];
+        stage[i] = input[i] + halfstep * k[i];
+    }
 
-    std::vector<TPrecision> output(_dimension);
-    for (auto i = 0; i < _dimension; ++i)
+    system.evaluateDerivative(stage, t + halfstep, k);
+    for (std::size_t i = 0; i < dimension; ++i)
     {
-        output[i] = lhsFactor * lhs[i] + rhs[i] * rhsFactor;
+        sum[i] += 2 * k[i];
+        stage[i] = input[i] + step * k[i];
     }
 
-    return output;
+    system.evaluateDerivative(stage, t + step, k);
+    const TPrecision sixthstep = step / 6;
+    for (std::size_t i = 0; i < dimension; ++i)
+    {
+        output[i] = input[i] + sixthstep * (sum[i] + k[i]);
+    }
 }
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include "glm/glm.hpp"
 #include "fw/AABB.hpp"
@@ -9,23 +10,85 @@
 namespace application
 {
 
+class TrajectoryRecorder;
+
 class SoftBox
 {
 public:
     SoftBox();
+    explicit SoftBox(const glm::ivec3& particleMatrixSize);
     ~SoftBox();
 
     void distributeUniformly(const fw::AABB<glm::dvec3>& box);
 
     glm::ivec3 getParticleMatrixSize() const;
 
-    const std::vector<ParticleState> getSoftBoxParticles() const;
-    const ParticleState& getSoftBoxParticle(glm::ivec3 index) const;
+    ParticleStateView getSoftBoxParticles() const;
+    ParticleState getSoftBoxParticle(glm::ivec3 index) const;
     int getParticleIndex(glm::ivec3 coordinate) const;
 
+    /** Positions blended between the last two physics steps for drawing. */
+    glm::dvec3 getInterpolatedPosition(glm::ivec3 index) const;
+    void getInterpolatedPositions(std::vector<glm::vec3>& positions) const;
+
+    /** As float x, y, z, 1 per particle, ready for upload to the GPU. */
+    void getInterpolatedPositions(float* output) const
+    {
+        _particleSystem.getInterpolatedPositions(output);
+    }
+
     void updateUserInterface();
     void update(double dt);
 
+    /*
+     * Settings otherwise edited through the user interface. They reach the
+     * simulation on the next applySettings call.
+     */
+    void setParticleMass(float particleMass);
+    void setSpringParameters(float springConstant, float attenuation);
+    void setFrameSpringParameters(float springConstant, float attenuation);
+    /** Kept in double, headless runs call update with exactly this step. */
+    void setFixedTimestep(double step, int maxSubsteps);
+    void setThreadCount(int threadCount);
+    void setIntegrator(IntegratorType type);
+    void setSelfCollision(bool enabled, float contactStiffness);
+    void setSleeping(bool enabled);
+    void applySettings();
+
+    /** Takes effect immediately, see ParticleSystem::setColliders. */
+    void setColliders(const std::vector<Collider>& colliders);
+
+    const std::vector<Collider>& getColliders() const
+    {
+        return _particleSystem.getColliders();
+    }
+
+    /**
+     * Saves or restores the simulation, see ParticleSystem::saveSnapshot.
+     * Snapshots of another lattice size are refused. A loaded snapshot's
+     * parameters become the settings of the box.
+     */
+    bool saveSnapshot(const std::string& path) const;
+    bool loadSnapshot(const std::string& path);
+
+    /** Appends the current particles to an open recorder as one frame. */
+    void recordTrajectory(TrajectoryRecorder& recorder, double time) const;
+
+    /** Takes effect when the lattice is rebuilt by distributeUniformly. */
+    void setLatticeSpringStorage(LatticeSpringStorage storage);
+
+    bool isSleeping() const { return _particleSystem.isSleeping(); }
+
+    std::size_t getParticleCount() const
+    {
+        return _particleSystem.getParticleCount();
+    }
+
+    const LatticeTopologyStatistics& getTopologyStatistics() const
+    {
+        return _topologyStatistics;
+    }
+
     const ControlFrame& getControlFrame() { return _controlFrame; }
 
     void applyRandomDisturbance();
@@ -34,14 +97,34 @@ private:
     void fixCurrentBoxPositionUsingSprings();
     void connectBoxToFrame();
 
+    /** Static particles at the frame corners, the ends of the frame springs. */
+    void updateFrameAnchors();
+
     float _elasticCollisionFactor;
     float _movementAttenuationFactor;
     float _particleMass;
     float _springsConstant;
     float _springsAttenuation;
+    int _threadCount;
+    int _integratorType;
+    float _absoluteTolerance;
+    float _relativeTolerance;
+    int _collisionMode;
+    bool _fixedTimestepEnabled;
+    double _fixedTimestep;
+    int _maxSubsteps;
+    int _latticeSpringStorage;
+    bool _selfCollisionEnabled;
+    float _contactStiffness;
+    bool _sleepingEnabled;
+
+    /** Half the smallest lattice spacing, set by distributeUniformly. */
+    double _contactDistance;
 
     ParticleSystem _particleSystem;
     ControlFrame _controlFrame;
+    std::vector<ParticleState> _frameAnchors;
+    LatticeTopologyStatistics _topologyStatistics;
     glm::ivec3 _particleMatrixSize;
 };
 
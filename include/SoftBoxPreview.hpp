@@ -1,28 +1,47 @@
 #pragma once
 
-#include <vector>
+#include <memory>
 
 #include "fw/GeometryChunk.hpp"
-#include "fw/Mesh.hpp"
-#include "fw/Vertices.hpp"
+#include "fw/Material.hpp"
 
+#include "ControlPointStream.hpp"
 #include "LineSetPreview.hpp"
+#include "MarkerSetPreview.hpp"
 #include "SoftBox.hpp"
 
 namespace application
 {
 
+/**
+ * Particles and springs of a soft box, both reading their positions from a
+ * ControlPointStream. The spring lines are built once per lattice size.
+ */
 class SoftBoxPreview
 {
 public:
     SoftBoxPreview();
     ~SoftBoxPreview();
 
-    std::vector<fw::GeometryChunk> render(const SoftBox& softBox) const;
+    void destroy();
+
+    /** Follows the current region of stream. */
+    void update(const SoftBox& softBox, const ControlPointStream& stream);
+
+    /** Spring lines, for any effect drawing fw::VertexColor meshes. */
+    fw::GeometryChunk getConstraintLines() const;
+
+    /** One marker per particle, for ParticleMarkerEffect. */
+    fw::GeometryChunk getParticleMarkers() const;
 
 private:
-    std::shared_ptr<fw::Mesh<fw::VertexNormalTexCoords>> _box;
+    void buildConstraintLines(const SoftBox& softBox);
+
     std::shared_ptr<LineSetPreview> _lineSetPreview;
+    std::shared_ptr<MarkerSetPreview> _markerSetPreview;
+    std::shared_ptr<fw::Material> _lineMaterial;
+    std::shared_ptr<fw::Material> _markerMaterial;
+    glm::ivec3 _latticeSize;
     float _particleMarkerSize;
 };
 
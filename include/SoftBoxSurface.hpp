@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "fw/OpenGLHeaders.hpp"
+#include "glm/glm.hpp"
+#include "BSplineLattice.hpp"
+
+namespace application
+{
+
+class ControlPointStream;
+
+/**
+ * The six sides of a soft box as cubic Bezier patches, one per lattice cell
+ * of a side, for the bezierPatch shaders. Each side is the boundary of the
+ * B-spline volume and converted with weights precomputed per axis.
+ *
+ * Every Bezier point of the box is a vertex holding its conversion weights
+ * and the lattice points they apply to. The vertices and the 16 indices of
+ * every patch are uploaded once per lattice size. bezierPatch.vert then
+ * sums the lattice points read from the ControlPointStream, so a frame
+ * uploads nothing here and draw is a single call for every patch.
+ */
+class SoftBoxSurface
+{
+public:
+    SoftBoxSurface();
+    ~SoftBoxSurface();
+
+    SoftBoxSurface(const SoftBoxSurface&) = delete;
+    SoftBoxSurface& operator=(const SoftBoxSurface&) = delete;
+
+    void destroy();
+
+    /** Rebuilds the patches if the lattice of stream changed. */
+    void update(const ControlPointStream& stream);
+
+    /**
+     * Draws every patch. The caller binds the effect with the control
+     * points of the stream and draws before the stream finishes the frame.
+     */
+    void draw() const;
+
+    std::size_t getPatchCount() const;
+    glm::ivec3 getLatticeSize() const { return _latticeSize; }
+
+private:
+    /**
+     * A Bezier point as sum of weightsU[i] weightsV[j] times lattice point
+     * first + i strideU + j strideV, for i below countU and j below countV.
+     */
+    struct PointVertex
+    {
+        glm::ivec3 lattice;
+        glm::ivec2 count;
+        glm::vec4 weightsU;
+        glm::vec4 weightsV;
+    };
+
+    void rebuild(glm::ivec3 latticeSize);
+    void addSide(
+        glm::ivec3 origin,
+        glm::ivec3 stepU,
+        glm::ivec3 stepV,
+        std::vector<PointVertex>& points,
+        std::vector<GLuint>& indices
+    );
+
+    glm::ivec3 _latticeSize;
+    std::vector<BezierPointWeights> _axisWeights[3];
+
+    GLuint _vao, _vbo, _ebo;
+    GLsizei _indexCount;
+};
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "RungeKuttaODESolver.hpp"
+#include "SpringKernels.hpp"
+#include "ThreadPool.hpp"
+
+namespace application
+{
+
+/**
+ * Pairs of particles found close to each other, as compressed sparse rows:
+ * the neighbours of particle p are neighbour[offsets[p]] up to
+ * neighbour[offsets[p+1]]. Every pair is listed from both sides.
+ */
+struct ParticleContacts
+{
+    void clear();
+    bool empty() const { return neighbour.empty(); }
+    std::size_t pairCount() const { return neighbour.size() / 2; }
+
+    std::vector<std::size_t> offsets;
+    std::vector<int> neighbour;
+};
+
+/**
+ * Uniform grid over the particles, counting-sorted by cell key so that the
+ * particles of one cell, and copies of their positions, are contiguous.
+ * Cells of the bounding box are numbered row by row, so the buckets around
+ * a cell form a few contiguous runs and a sweep in sorted order streams
+ * through memory. Sparse scenes, whose box would be mostly empty cells, hash
+ * the cells into a table of about twice the particle count instead.
+ *
+ * The sort is stable and starts from the previous order, and is skipped
+ * when no particle changed cells. Buffers are reused and only grow.
+ */
+template <typename TPrecision>
+class SpatialHash
+{
+public:
+    SpatialHash();
+
+    void update(
+        const TPrecision* const position[3],
+        std::size_t count,
+        TPrecision cellSize,
+        ThreadPool& threadPool
+    );
+
+    /**
+     * Lists for every particle the others closer than distance, which must
+     * not exceed the cell size. Rows are counted and then written to their
+     * final place, both passes running concurrently over particles.
+     */
+    void findContacts(
+        TPrecision distance,
+        ThreadPool& threadPool,
+        ParticleContacts& contacts
+    ) const;
+
+    std::size_t size() const { return _particleKeys.size(); }
+
+private:
+    /**
+     * Sorted slot ranges of the buckets around a cell. The three cells of a
+     * row along x have consecutive keys, so each row is one range unless it
+     * wraps around the table; rows sharing keys are merged.
+     */
+    struct NeighbourCells
+    {
+        glm::ivec3 cell;
+        int count;
+        std::uint32_t begin[18];
+        std::uint32_t end[18];
+    };
+
+    /** Lays out the key table for the bounding box of the particles. */
+    bool chooseTable(const TPrecision* const position[3], std::size_t count);
+
+    glm::ivec3 getCell(TPrecision x, TPrecision y, TPrecision z) const;
+    glm::ivec3 getCell(std::uint32_t slot) const;
+
+    std::uint32_t getKey(const glm::ivec3& cell) const;
+
+    void findNeighbourCells(
+        const glm::ivec3& cell,
+        NeighbourCells& cells
+    ) const;
+
+    /**
+     * Calls function(slot, q) for every sorted slot from begin to end and
+     * every other particle q closer than distance. Consecutive slots of one
+     * cell share the bucket lookups.
+     */
+    template <typename TFunction>
+    void forEachNeighbour(
+        std::uint32_t begin,
+        std::uint32_t end,
+        TPrecision distance,
+        const TFunction& function
+    ) const;
+
+    TPrecision _cellSize;
+    glm::ivec3 _gridOrigin;
+    glm::ivec3 _gridSize;
+    std::uint32_t _tableSize;
+    std::vector<std::uint32_t> _particleKeys;
+    std::vector<std::uint32_t> _cellOffsets;
+    std::vector<int> _sortedParticles;
+    std::vector<int> _previousOrder;
+    std::vector<std::uint32_t> _sortedSlot;
+    StateVector<TPrecision> _sortedPosition[3];
+};
+
+/**
+ * Penalty forces of contacts [begin, end): particles closer than distance
+ * are pushed apart by stiffness times the overlap. Each particle writes
+ * only its own force, so particle ranges can run concurrently.
+ */
+template <typename TPrecision>
+void accumulateContactForces(
+    const ParticleContacts& contacts,
+    std::size_t begin,
+    std::size_t end,
+    TPrecision distance,
+    TPrecision stiffness,
+    const SpringKernelFields<TPrecision>& fields
+);
+
+}
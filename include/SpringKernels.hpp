@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "RungeKuttaODESolver.hpp"
+
+namespace application
+{
+
+struct ParticleState;
+
+/**
+ * Springs stored as parallel arrays. For internal springs both endpoints are
+ * particle indices, for anchor springs a indexes the static particles and b
+ * the simulated ones.
+ *
+ * The kernels below are instantiated for float and double; wider SIMD paths
+ * process twice as many float springs per instruction.
+ */
+template <typename TPrecision>
+struct SpringBatch
+{
+    void clear();
+    void reserve(std::size_t count);
+    void resize(std::size_t count);
+    void add(
+        int a,
+        int b,
+        TPrecision length,
+        TPrecision constant,
+        TPrecision damping
+    );
+    std::size_t size() const { return a.size(); }
+
+    std::vector<int> a;
+    std::vector<int> b;
+    StateVector<TPrecision> restLength;
+    StateVector<TPrecision> stiffness;
+    StateVector<TPrecision> damping;
+};
+
+/** Particle arrays a spring kernel reads from and accumulates into. */
+template <typename TPrecision>
+struct SpringKernelFields
+{
+    const TPrecision* position[3];
+    const TPrecision* velocity[3];
+    TPrecision* force[3];
+};
+
+enum class SimdLevel
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+SimdLevel detectSimdLevel();
+const char* getSimdLevelName(SimdLevel level);
+
+/**
+ * Adds damped spring forces of springs [begin, end) to both endpoints.
+ * Wider instruction sets are used only if supported by the running CPU.
+ */
+template <typename TPrecision>
+void accumulateInternalSpringForces(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<TPrecision>& fields,
+    SimdLevel level
+);
+
+/**
+ * Reorders internal springs into classes in which no two springs share a
+ * particle and returns the class boundaries: class k spans
+ * [offsets[k], offsets[k+1]). Springs of one class can be evaluated
+ * concurrently without synchronization.
+ */
+template <typename TPrecision>
+std::vector<std::size_t> partitionIntoConflictFreeClasses(
+    SpringBatch<TPrecision>& springs,
+    std::size_t particleCount
+);
+
+/**
+ * Compressed sparse row index from particles to their incident springs.
+ * Entries of particle p span [offsets[p], offsets[p+1]); each names the
+ * spring and the particle on its other end.
+ */
+struct SpringAdjacency
+{
+    void clear();
+
+    std::vector<std::size_t> offsets;
+    std::vector<int> spring;
+    std::vector<int> neighbour;
+};
+
+/** Counting sort of spring endpoints, linear in springs and particles. */
+template <typename TPrecision>
+void buildSpringAdjacency(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t particleCount,
+    SpringAdjacency& adjacency
+);
+
+/**
+ * Gather form of accumulateInternalSpringForces: particles [begin, end) sum
+ * the forces of their own springs. Every spring is evaluated from both
+ * ends, but a particle writes only its own force, so any particle range
+ * can run concurrently.
+ */
+template <typename TPrecision>
+void gatherInternalSpringForces(
+    const SpringBatch<TPrecision>& springs,
+    const SpringAdjacency& adjacency,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<TPrecision>& fields
+);
+
+/** Adds damped forces of springs tying particles to static anchors. */
+template <typename TPrecision>
+void accumulateAnchorSpringForces(
+    const SpringBatch<TPrecision>& springs,
+    const std::vector<ParticleState>& anchors,
+    const SpringKernelFields<TPrecision>& fields
+);
+
+/**
+ * Spring force Jacobians linearized for an implicit step of length h. With
+ * direction d, the block of h dF/dv + h^2 dF/dx acting on the relative
+ * motion of a spring is
+ *
+ *     geometric I + (stiffness + damping - geometric) d d^T,
+ *
+ * where stiffness = h^2 k, damping = h c and geometric = h^2 k (1 - L0 / L),
+ * clamped at zero so the block stays positive semi-definite. The change of
+ * the damping force with the spring direction is neglected.
+ */
+template <typename TPrecision>
+struct SpringLinearization
+{
+    void resize(std::size_t count);
+
+    StateVector<TPrecision> direction[3];
+    StateVector<TPrecision> stiffness;
+    StateVector<TPrecision> geometric;
+    StateVector<TPrecision> damping;
+};
+
+/**
+ * Linearizes springs [begin, end) and adds their blocks to the diagonal of
+ * both endpoints.
+ */
+template <typename TPrecision>
+void linearizeInternalSprings(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const TPrecision* const position[3],
+    TPrecision step,
+    SpringLinearization<TPrecision>& linearization,
+    TPrecision* const diagonal[3]
+);
+
+template <typename TPrecision>
+void linearizeAnchorSprings(
+    const SpringBatch<TPrecision>& springs,
+    const std::vector<ParticleState>& anchors,
+    const TPrecision* const position[3],
+    TPrecision step,
+    SpringLinearization<TPrecision>& linearization,
+    TPrecision* const diagonal[3]
+);
+
+/**
+ * For springs [begin, end) adds B (input_a - input_b) to output_a and
+ * subtracts it from output_b, B being the linearized block. Damping is left
+ * out of B unless includeDamping is set.
+ */
+template <typename TPrecision>
+void accumulateInternalSpringJacobianProduct(
+    const SpringBatch<TPrecision>& springs,
+    const SpringLinearization<TPrecision>& linearization,
+    std::size_t begin,
+    std::size_t end,
+    const TPrecision* const input[3],
+    TPrecision* const output[3],
+    bool includeDamping
+);
+
+/** Adds B input_b to output_b for springs tied to static anchors. */
+template <typename TPrecision>
+void accumulateAnchorSpringJacobianProduct(
+    const SpringBatch<TPrecision>& springs,
+    const SpringLinearization<TPrecision>& linearization,
+    const TPrecision* const input[3],
+    TPrecision* const output[3],
+    bool includeDamping
+);
+
+/**
+ * Writes positions of particles [begin, end) interpolated as previous +
+ * factor (current - previous) to output as float x, y, z, 1, the layout of
+ * a vec4 array on the GPU. Current positions are only converted if previous
+ * is null.
+ */
+template <typename TPrecision>
+void interleavePositionsToFloat4(
+    const TPrecision* const current[3],
+    const TPrecision* const previous[3],
+    TPrecision factor,
+    std::size_t begin,
+    std::size_t end,
+    float* output,
+    SimdLevel level
+);
+
+}
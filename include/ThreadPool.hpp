@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace application
+{
+
+/**
+ * Persistent set of worker threads executing data-parallel loops. The
+ * calling thread takes part in every loop, so a pool of one thread runs
+ * everything inline.
+ */
+class ThreadPool
+{
+public:
+    ThreadPool(int threadCount = 1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void setThreadCount(int threadCount);
+    int getThreadCount() const;
+
+    /**
+     * Splits [0, count) into one contiguous chunk per thread and calls
+     * task(begin, end) for each of them. Returns when all chunks are done.
+     */
+    template <typename TTask>
+    void parallelFor(std::size_t count, const TTask& task);
+
+private:
+    typedef void (*TaskInvoker)(const void*, std::size_t, std::size_t);
+
+    template <typename TTask>
+    static void invokeTask(
+        const void* task,
+        std::size_t begin,
+        std::size_t end
+    );
+
+    void dispatch(std::size_t count, const void* task, TaskInvoker invoker);
+    void runChunk(int chunk);
+    void workerLoop(int chunk, unsigned seenGeneration);
+    void stopWorkers();
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _taskAvailable;
+    std::condition_variable _taskFinished;
+
+    const void* _task;
+    TaskInvoker _invoker;
+    std::size_t _count;
+    std::size_t _chunks;
+    unsigned _generation;
+    int _pendingChunks;
+    bool _stopping;
+};
+
+template <typename TTask>
+void ThreadPool::parallelFor(std::size_t count, const TTask& task)
+{
+    if (_workers.empty() || count < 2)
+    {
+        task(std::size_t{0}, count);
+        return;
+    }
+
+    dispatch(count, &task, &ThreadPool::invokeTask<TTask>);
+}
+
+template <typename TTask>
+void ThreadPool::invokeTask(
+    const void* task,
+    std::size_t begin,
+    std::size_t end
+)
+{
+    (*static_cast<const TTask*>(task))(begin, end);
+}
+
+}
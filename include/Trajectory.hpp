@@ -0,0 +1,229 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "glm/glm.hpp"
+#include "ParticleState.hpp"
+
+namespace application
+{
+
+/**
+ * Layout of a trajectory file: a TrajectoryHeader, the frames one after
+ * another, each a TrajectoryFrameHeader and its payload, then the index of
+ * frame offsets and a TrajectoryTrailer. Every keyframeInterval-th frame is
+ * a keyframe holding positions and momenta as doubles, block by block. The
+ * other frames hold only the change of positions since the previous frame,
+ * counted in steps of at most 1/65535 of the extent of the particles along
+ * each axis, rounded down to a power of two so that adding them up is exact.
+ * Changes are taken against the positions a reader reconstructs, so the
+ * rounding error stays within half a step instead of adding up. Axes whose
+ * changes all fit in a byte are stored in bytes, the others in 16 bits.
+ */
+struct TrajectoryHeader
+{
+    static const std::uint32_t cVersion = 1;
+    static const std::uint32_t cByteOrder = 0x01020304;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t particleCount;
+    std::uint32_t keyframeInterval;
+    std::uint32_t reserved;
+};
+
+struct TrajectoryFrameHeader
+{
+    static const std::uint32_t cKeyframe = 1;
+    static const std::uint32_t cDelta = 2;
+
+    std::uint32_t type;
+
+    /** Bytes per stored change along each axis, 1 or 2. */
+    std::uint8_t deltaBytes[3];
+    std::uint8_t reserved;
+
+    std::uint64_t payloadBytes;
+    double time;
+
+    /** Bounding box of the particles and the quantization step per axis. */
+    double low[3];
+    double high[3];
+    double step[3];
+};
+
+struct TrajectoryIndexEntry
+{
+    std::uint64_t offset;
+    double time;
+};
+
+/** Ends a complete file, written when the recorder is closed. */
+struct TrajectoryTrailer
+{
+    std::uint64_t indexOffset;
+    std::uint64_t frameCount;
+    char magic[8];
+};
+
+/** Decoded frame. Momenta are only known at keyframes, otherwise empty. */
+struct TrajectoryFrame
+{
+    TrajectoryFrame();
+
+    std::size_t index;
+    double time;
+    bool keyframe;
+    glm::dvec3 low;
+    glm::dvec3 high;
+    std::vector<glm::dvec3> positions;
+    std::vector<glm::dvec3> momenta;
+};
+
+/**
+ * Appends frames of a particle system to a trajectory file, see
+ * TrajectoryHeader. The simulation thread only copies the state into a
+ * pooled buffer; quantization and writing run on a thread of the recorder.
+ * When that thread falls cMaxPendingFrames behind, record waits for it
+ * rather than dropping frames.
+ */
+class TrajectoryRecorder
+{
+public:
+    static const std::size_t cMaxPendingFrames = 8;
+
+    TrajectoryRecorder();
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    /** Returns false and logs the reason if path cannot be created. */
+    bool open(
+        const std::string& path,
+        std::size_t particleCount,
+        int keyframeInterval = 60
+    );
+
+    /** Writes the pending frames and the index. False if a write failed. */
+    bool close();
+
+    bool isOpen() const { return _file != nullptr; }
+    std::size_t getFrameCount() const { return _recordedFrames; }
+
+    template <typename TPrecision, typename TForcePrecision>
+    void record(
+        const BasicParticleSystem<TPrecision, TForcePrecision>& system,
+        double time
+    );
+
+    /**
+     * Records structure-of-arrays state of the recorded particle count,
+     * with blocks stride elements apart, see ParticleStateField.
+     */
+    template <typename TPrecision>
+    void record(const TPrecision* state, std::size_t stride, double time);
+
+private:
+    struct PendingFrame
+    {
+        double time;
+        bool keyframe;
+        std::vector<double> values;
+    };
+
+    void writerLoop();
+    bool writeFrame(const PendingFrame& frame);
+    bool writeBytes(const void* data, std::size_t bytes);
+
+    std::FILE* _file;
+    std::size_t _particleCount;
+    int _keyframeInterval;
+    std::size_t _recordedFrames;
+
+    std::thread _writer;
+    std::mutex _mutex;
+    std::condition_variable _frameQueued;
+    std::condition_variable _frameWritten;
+    std::deque<PendingFrame> _pending;
+    std::vector<PendingFrame> _freeFrames;
+    bool _closing;
+
+    /** Owned by the writer thread while the file is open. */
+    std::uint64_t _offset;
+    std::vector<TrajectoryIndexEntry> _index;
+    std::vector<double> _reconstructed;
+    std::vector<std::int16_t> _quantized;
+    std::vector<unsigned char> _payload;
+    bool _failed;
+};
+
+template <typename TPrecision, typename TForcePrecision>
+void TrajectoryRecorder::record(
+    const BasicParticleSystem<TPrecision, TForcePrecision>& system,
+    double time
+)
+{
+    const auto& state = system.getPhysicsState();
+    record(state.data(), state.size() / ParticleStateFieldCount, time);
+}
+
+/**
+ * Random access to a trajectory file. Opening reads the header and the
+ * index; files whose recording was cut short have no index, the frame
+ * headers are then walked once instead. Frames are decoded on request,
+ * reading only the bytes from the keyframe before them on.
+ */
+class TrajectoryReader
+{
+public:
+    TrajectoryReader();
+
+    /** Returns false and logs the reason if path is not a trajectory. */
+    bool open(const std::string& path);
+    void close();
+
+    std::size_t getFrameCount() const { return _index.size(); }
+    std::size_t getParticleCount() const { return _particleCount; }
+    int getKeyframeInterval() const { return _keyframeInterval; }
+    double getFrameTime(std::size_t frame) const
+    {
+        return _index[frame].time;
+    }
+
+    /**
+     * Decodes frames [first, first + count) in order and passes each to
+     * function, which may keep its contents by swapping them out.
+     */
+    bool readFrames(
+        std::size_t first,
+        std::size_t count,
+        const std::function<void(TrajectoryFrame&)>& function
+    );
+
+    bool readFrame(std::size_t frame, TrajectoryFrame& output);
+
+private:
+    bool readFrameHeader(
+        std::uint64_t offset,
+        TrajectoryFrameHeader& header
+    );
+
+    std::ifstream _file;
+    std::size_t _particleCount;
+    int _keyframeInterval;
+    std::vector<TrajectoryIndexEntry> _index;
+    std::vector<unsigned char> _payload;
+};
+
+}
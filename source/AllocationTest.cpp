@@ -0,0 +1,122 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "SoftBox.hpp"
+
+namespace
+{
+
+using namespace application;
+
+/** Heap allocations made while counting is on, from any thread. */
+std::atomic<bool> gCounting{false};
+std::atomic<unsigned long long> gAllocations{0};
+
+void* allocate(std::size_t size)
+{
+    if (gCounting)
+    {
+        ++gAllocations;
+    }
+
+    if (auto memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+
+    throw std::bad_alloc{};
+}
+
+/**
+ * Settles a disturbed box for a few frames, then counts the allocations of
+ * the frames after them. Every frame applies the settings like the
+ * application does.
+ */
+bool checkSteadyStateFrames(int latticeSize, int countedFrames)
+{
+    const auto cFrame = 1.0 / 60.0;
+    const auto cWarmUpFrames = 5;
+
+    SoftBox softBox{glm::ivec3{latticeSize}};
+    softBox.distributeUniformly({{-1.0, -1.0, -1.0}, {+1.0, +1.0, +1.0}});
+    softBox.applySettings();
+    softBox.applyRandomDisturbance();
+
+    for (auto frame = 0; frame < cWarmUpFrames; ++frame)
+    {
+        softBox.applySettings();
+        softBox.update(cFrame);
+    }
+
+    gAllocations = 0;
+    gCounting = true;
+    for (auto frame = 0; frame < countedFrames; ++frame)
+    {
+        softBox.applySettings();
+        softBox.update(cFrame);
+    }
+
+    gCounting = false;
+
+    std::cout << latticeSize << "x" << latticeSize << "x" << latticeSize
+        << ": " << gAllocations << " allocations in " << countedFrames
+        << " frames" << std::endl;
+    return gAllocations == 0;
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+int main()
+{
+    auto passed = checkSteadyStateFrames(4, 60);
+    passed = checkSteadyStateFrames(32, 10) && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
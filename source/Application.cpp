@@ -1,13 +1,11 @@
 #include "Application.hpp"
 
 #include <iostream>
+#include <thread>
 
 #include "glm/gtc/matrix_transform.hpp"
 #include "imgui.h"
 
-#include "assimp/Importer.hpp"
-#include "assimp/scene.h"
-#include "assimp/postprocess.h"
 #include "easylogging++.h"
 
 #include "fw/Common.hpp"
@@ -20,16 +18,41 @@
 namespace application
 {
 
+namespace
+{
+
+/** Snapshot file of the Save and Load buttons, in the working directory. */
+const char* cSnapshotPath = "softbox.snapshot";
+
+/** Trajectory written while recording is enabled, replaced on every start. */
+const char* cTrajectoryPath = "softbox.trajectory";
+
+/** Model deformed by the lattice, written by the Export button. */
+const char* cDeformedModelPath = "softbox-deformed.obj";
+
+/** Places the model inside the lattice parameter space [0, 1]^3. */
+const glm::vec3 cSoftModelOffset{0.5f, 0.5f, 0.5f};
+
+}
+
 Application::Application():
     _roomSize{10.0f, 5.0f, 10.0f},
+    _sphereObstacleEnabled{false},
+    _sphereObstaclePosition{0.0f, -1.8f, 0.0f},
+    _bunnyObstacleEnabled{false},
+    _bunnyObstaclePosition{1.5f, -2.0f, 0.0f},
     _updatePhysicsEnabled{false},
+    _recordTrajectory{false},
+    _recordedSeconds{},
     _enableGridPreview{false},
     _enableConstraintsPreview{false},
     _enableSoftBoxRendering{false},
     _enableRoomRendering{true},
     _enableObjectRendering{true},
     _enableCameraRotations{false},
-    _cameraRotationSensitivity{0.2, 0.2}
+    _cameraRotationSensitivity{0.2, 0.2},
+    _latticeSize{4, 4, 4},
+    _latticeSpringStorage{static_cast<int>(LatticeSpringStorage::Explicit)}
 {
     setWindowSize({1920, 1080});
 }
@@ -51,10 +74,13 @@ void Application::onCreate()
     );
 
     _bezierDistortionEffect = std::make_shared<BezierDistortionEffect>();
+    _particleMarkerEffect = std::make_shared<ParticleMarkerEffect>();
 
     restartSimulation();
 
     _softBoxPreview = std::make_shared<SoftBoxPreview>();
+    _controlPointStream = std::make_shared<ControlPointStream>();
+    _controlPointStream->update(*_softBox.get());
 
     _phongEffect = std::make_shared<fw::TexturedPhongEffect>();
     _phongEffect->create();
@@ -74,6 +100,9 @@ void Application::onCreate()
     _roomMaterial = std::make_shared<fw::Material>();
     _roomMaterial->setBaseAlbedoColor({0.8f, 0.3f, 0.3f, 1.0f});
 
+    _obstacleMaterial = std::make_shared<fw::Material>();
+    _obstacleMaterial->setBaseAlbedoColor({0.3f, 0.4f, 0.8f, 1.0f});
+
     _testTexture = fw::loadTextureFromFile(
         fw::getFrameworkResourcePath("textures/checker-base.png")
     );
@@ -83,8 +112,7 @@ void Application::onCreate()
 
     updateProjectionMatrix();
 
-    _bezierPatch = std::make_shared<BezierPatch>();
-    _bezierPatch->createFlatGrid(3.0f, 3.0f);
+    _softBoxSurface = std::make_shared<SoftBoxSurface>();
     _bezierEffect = std::make_shared<BezierPatchEffect>();
     _bezierEffect->initialize("bezierPatch");
 
@@ -93,6 +121,9 @@ void Application::onCreate()
 
 void Application::onDestroy()
 {
+    _controlPointStream->destroy();
+    _softBoxSurface->destroy();
+    _softBoxPreview->destroy();
     ImGuiApplication::onDestroy();
 }
 
@@ -105,12 +136,42 @@ void Application::onUpdate(
     if (ImGui::Begin("Soft Body Simulation"))
     {
         ImGui::Checkbox("Enable physics", &_updatePhysicsEnabled);
+        ImGui::SliderInt3("Lattice size", &_latticeSize.x, 2, 128);
+
+        const char* storageNames[] = {
+            getLatticeSpringStorageName(LatticeSpringStorage::Explicit),
+            getLatticeSpringStorageName(LatticeSpringStorage::Stencil)
+        };
+
+        ImGui::Combo(
+            "Lattice springs",
+            &_latticeSpringStorage,
+            storageNames,
+            static_cast<int>(LatticeSpringStorage::LatticeSpringStorageCount)
+        );
 
         if (ImGui::Button("Restart"))
         {
             restartSimulation();
         }
 
+        if (ImGui::Button("Save snapshot"))
+        {
+            _softBox->saveSnapshot(cSnapshotPath);
+        }
+
+        if (ImGui::Button("Load snapshot"))
+        {
+            _softBox->loadSnapshot(cSnapshotPath);
+        }
+
+        ImGui::Checkbox("Record trajectory", &_recordTrajectory);
+
+        if (ImGui::Button("Export deformed model"))
+        {
+            exportDeformedModel();
+        }
+
         if (ImGui::Button("Apply random disturbance"))
         {
             _softBox->applyRandomDisturbance();
@@ -118,6 +179,25 @@ void Application::onUpdate(
 
         _softBox->updateUserInterface();
 
+        if (ImGui::CollapsingHeader("Obstacles"))
+        {
+            ImGui::Checkbox("Sphere", &_sphereObstacleEnabled);
+            ImGui::SliderFloat3(
+                "Sphere position",
+                &_sphereObstaclePosition.x,
+                -2.5f,
+                2.5f
+            );
+
+            ImGui::Checkbox("Bunny", &_bunnyObstacleEnabled);
+            ImGui::SliderFloat3(
+                "Bunny position",
+                &_bunnyObstaclePosition.x,
+                -2.5f,
+                2.5f
+            );
+        }
+
         if (ImGui::CollapsingHeader("Visual"))
         {
             ImGui::Checkbox("Grid preview", &_enableGridPreview);
@@ -130,9 +210,27 @@ void Application::onUpdate(
 
     ImGui::End();
 
+    updateObstacles();
+    updateTrajectoryRecording();
+
     if (_updatePhysicsEnabled)
     {
-        _softBox->update(std::chrono::duration<double>(deltaTime).count());
+        auto seconds = std::chrono::duration<double>(deltaTime).count();
+        _softBox->update(seconds);
+
+        if (_trajectoryRecorder.isOpen())
+        {
+            _recordedSeconds += seconds;
+            _softBox->recordTrajectory(_trajectoryRecorder, _recordedSeconds);
+        }
+    }
+
+    // Every renderer of the lattice reads this one upload.
+    _controlPointStream->update(*_softBox.get());
+
+    if (_enableSoftBoxRendering)
+    {
+        _softBoxSurface->update(*_controlPointStream.get());
     }
 }
 
@@ -158,17 +256,26 @@ void Application::onRender()
 
     if (_enableConstraintsPreview)
     {
-        for (const auto& chunk: _softBoxPreview->render(*_softBox.get()))
-        {
-            _universalPhongEffect->setMaterial(*chunk.getMaterial().get());
-
-            _universalPhongEffect->begin();
-            _universalPhongEffect->setProjectionMatrix(_projectionMatrix);
-            _universalPhongEffect->setViewMatrix(_camera.getViewMatrix());
-            _universalPhongEffect->setModelMatrix(chunk.getModelMatrix());
-            chunk.getMesh()->render();
-            _universalPhongEffect->end();
-        }
+        _softBoxPreview->update(*_softBox.get(), *_controlPointStream.get());
+
+        auto lines = _softBoxPreview->getConstraintLines();
+        _universalPhongEffect->setMaterial(*lines.getMaterial().get());
+        _universalPhongEffect->begin();
+        _universalPhongEffect->setProjectionMatrix(_projectionMatrix);
+        _universalPhongEffect->setViewMatrix(_camera.getViewMatrix());
+        _universalPhongEffect->setModelMatrix(lines.getModelMatrix());
+        lines.getMesh()->render();
+        _universalPhongEffect->end();
+
+        auto markers = _softBoxPreview->getParticleMarkers();
+        _particleMarkerEffect->setMaterial(*markers.getMaterial().get());
+        _particleMarkerEffect->setLightDirection(lightDirection);
+        _particleMarkerEffect->begin();
+        _particleMarkerEffect->setProjectionMatrix(_projectionMatrix);
+        _particleMarkerEffect->setViewMatrix(_camera.getViewMatrix());
+        _particleMarkerEffect->setModelMatrix(markers.getModelMatrix());
+        markers.getMesh()->render();
+        _particleMarkerEffect->end();
     }
 
     _universalPhongEffect->setMaterial(*_cubeOutlineMaterial.get());
@@ -198,17 +305,22 @@ void Application::onRender()
         glFrontFace(GL_CCW);
     }
 
+    if (_sphereObstacleEnabled)
+    {
+        renderObstacle(*_sphere.get(), _sphereObstaclePosition);
+    }
+
+    if (_bunnyObstacleEnabled && _softModel)
+    {
+        renderObstacle(*_softModel.get(), _bunnyObstaclePosition);
+    }
+
     if (_enableSoftBoxRendering)
     {
         glDisable(GL_CULL_FACE);
         //glDisable(GL_DEPTH_TEST);
 
-        drawSoftBoxSide([](int i, int j) { return glm::ivec3{i, j, 0}; });
-        drawSoftBoxSide([](int i, int j) { return glm::ivec3{3-i, j, 3}; });
-        drawSoftBoxSide([](int i, int j) { return glm::ivec3{0, i, j}; });
-        drawSoftBoxSide([](int i, int j) { return glm::ivec3{3, 3-i, j}; });
-        drawSoftBoxSide([](int i, int j) { return glm::ivec3{3-i, 0, j}; });
-        drawSoftBoxSide([](int i, int j) { return glm::ivec3{i, 3, j}; });
+        drawSoftBoxSurface();
 
         //glEnable(GL_DEPTH_TEST);
         glEnable(GL_CULL_FACE);
@@ -216,26 +328,21 @@ void Application::onRender()
 
     if (_enableObjectRendering)
     {
-        auto particles = _softBox->getSoftBoxParticles();
-        std::vector<glm::vec3> controlPoints;
-        std::transform(
-            std::begin(particles),
-            std::end(particles),
-            std::back_inserter(controlPoints),
-            [](const ParticleState& particle) { return particle.position; }
+        _bezierDistortionEffect->setDistortionControlPoints(
+            *_controlPointStream.get()
         );
-
-        _bezierDistortionEffect->setDistortionControlPoints(controlPoints);
         _bezierDistortionEffect->begin();
         _bezierDistortionEffect->setProjectionMatrix(_projectionMatrix);
         _bezierDistortionEffect->setViewMatrix(_camera.getViewMatrix());
         _bezierDistortionEffect->setModelMatrix(
-            glm::translate(glm::mat4{}, glm::vec3{0.5f, 0.5f, 0.5f})
+            glm::translate(glm::mat4{}, cSoftModelOffset)
         );
         _softModel->render();
         _bezierDistortionEffect->end();
     }
 
+    _controlPointStream->finishFrame();
+
     ImGuiApplication::onRender();
 }
 
@@ -296,24 +403,8 @@ void Application::updateProjectionMatrix()
     _projectionMatrix = glm::perspective(45.0f, aspectRatio, 0.5f, 100.0f);
 }
 
-void Application::drawSoftBoxSide(
-    std::function<glm::ivec3(int,int)> coordTransformation
-)
+void Application::drawSoftBoxSurface()
 {
-    std::vector<glm::vec3> controlPoints;
-    for (auto i = 0; i < 4; ++i)
-    {
-        for (auto j = 0; j < 4; ++j)
-        {
-            glm::ivec3 coord = coordTransformation(i, j);
-            controlPoints.push_back(
-                _softBox->getSoftBoxParticle(coord).position
-            );
-        }
-    }
-
-    _bezierPatch->setControlPoints(controlPoints);
-
     _bezierEffect->begin();
     _bezierEffect->setTessellationLevelBump(0);
     _bezierEffect->setPatchU(0);
@@ -325,80 +416,180 @@ void Application::drawSoftBoxSide(
     _bezierEffect->setViewMatrix(_camera.getViewMatrix());
     _bezierEffect->setProjectionMatrix(_projectionMatrix);
     _bezierEffect->setNormalTexture(_softbodyTexture->getTextureId());
-    _bezierPatch->drawPatch();
+    _bezierEffect->setControlPoints(*_controlPointStream.get());
+
+    _softBoxSurface->draw();
+
     _bezierEffect->end();
 }
 
 void Application::restartSimulation()
 {
-    _softBox = std::make_shared<SoftBox>();
+    // A trajectory holds a fixed number of particles.
+    _trajectoryRecorder.close();
+    _recordTrajectory = false;
+
+    _softBox = std::make_shared<SoftBox>(_latticeSize);
+    _softBox->setLatticeSpringStorage(
+        LatticeSpringStorage(_latticeSpringStorage)
+    );
     _softBox->distributeUniformly({
         {-1.0, -1.0, -1.0},
         {+1.0, +1.0, +1.0}
     });
 }
 
-void Application::loadSoftModel()
+void Application::updateTrajectoryRecording()
 {
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(
-        std::string(cApplicationResourcesDir) + "/models/bunny.obj",
-        aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs
-    );
-
-    if (!scene
-        || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE
-        || !scene->mRootNode)
+    if (_recordTrajectory == _trajectoryRecorder.isOpen())
     {
-        LOG(ERROR)
-            << "Assimp cannot load the scene. "
-            << importer.GetErrorString();
         return;
     }
 
-    if (scene->mNumMeshes == 0)
+    if (_recordTrajectory)
     {
-        LOG(ERROR) << "No meshes found in file.";
-        return;
+        _recordedSeconds = 0.0;
+        _recordTrajectory = _trajectoryRecorder.open(
+            cTrajectoryPath,
+            _softBox->getParticleCount()
+        );
     }
+    else
+    {
+        _trajectoryRecorder.close();
+    }
+}
 
-    aiMesh *mesh = scene->mMeshes[0];
+void Application::loadSoftModel()
+{
+    if (!loadDeformableMesh(
+            std::string(cApplicationResourcesDir) + "/models/bunny.obj",
+            _softModelRestMesh
+        ))
+    {
+        return;
+    }
 
     std::vector<fw::VertexNormalTexCoords> vertices;
-    std::vector<GLuint> indices;
 
-    for (auto i = 0; i < mesh->mNumVertices; ++i)
+    for (std::size_t i = 0; i < _softModelRestMesh.positions.size(); ++i)
     {
         fw::VertexNormalTexCoords vertex;
+        vertex.position = _softModelRestMesh.positions[i];
+        vertex.normal = _softModelRestMesh.normals[i];
+        vertices.push_back(vertex);
+    }
+
+    _softModel = std::make_shared<fw::Mesh<fw::VertexNormalTexCoords>>(
+        vertices,
+        _softModelRestMesh.indices
+    );
+}
+
+void Application::exportDeformedModel()
+{
+    if (_softModelRestMesh.positions.empty())
+    {
+        return;
+    }
+
+    // Bases are computed again only when the lattice was resized.
+    if (_softModelDeformer.getVertexCount()
+            != _softModelRestMesh.positions.size()
+        || _softModelDeformer.getLatticeSize()
+            != _softBox->getParticleMatrixSize())
+    {
+        std::vector<glm::vec3> restPositions;
+        for (const auto& position: _softModelRestMesh.positions)
+        {
+            restPositions.push_back(position + cSoftModelOffset);
+        }
 
-        vertex.position = glm::vec3(
-            mesh->mVertices[i].x,
-            mesh->mVertices[i].y,
-            mesh->mVertices[i].z
+        _softModelDeformer.setThreadCount(
+            static_cast<int>(std::thread::hardware_concurrency())
         );
+        _softModelDeformer.setRestShape(
+            restPositions,
+            _softModelRestMesh.normals,
+            _softBox->getParticleMatrixSize()
+        );
+    }
 
-        vertex.normal = glm::vec3(
-            mesh->mNormals[i].x,
-            mesh->mNormals[i].y,
-            mesh->mNormals[i].z
+    std::vector<glm::vec3> controlPoints;
+    _softBox->getInterpolatedPositions(controlPoints);
+
+    DeformableMesh deformed;
+    deformed.indices = _softModelRestMesh.indices;
+    _softModelDeformer.deform(
+        controlPoints,
+        deformed.positions,
+        deformed.normals
+    );
+
+    writeDeformableMeshObj(cDeformedModelPath, deformed);
+}
+
+void Application::updateObstacles()
+{
+    // Cell size of the baked bunny, about 1/30 of its extent.
+    const double cBunnyCellSize = 0.03;
+
+    _obstacleColliders.clear();
+    if (_sphereObstacleEnabled)
+    {
+        _obstacleColliders.push_back(Collider::sphere(
+            glm::dvec3{_sphereObstaclePosition},
+            0.5
+        ));
+    }
+
+    if (_bunnyObstacleEnabled && !_bunnyDistanceField)
+    {
+        _bunnyDistanceField = std::make_shared<VoxelSdf>();
+        loadVoxelSdf(
+            std::string(cApplicationResourcesDir) + "/models/bunny.obj",
+            1.0,
+            cBunnyCellSize,
+            *_bunnyDistanceField.get()
         );
+    }
 
-        vertices.push_back(vertex);
+    if (_bunnyObstacleEnabled && !_bunnyDistanceField->empty())
+    {
+        const glm::dvec3 axes[3] = {
+            {1.0, 0.0, 0.0},
+            {0.0, 1.0, 0.0},
+            {0.0, 0.0, 1.0}
+        };
+
+        _obstacleColliders.push_back(Collider::voxelGrid(
+            _bunnyDistanceField,
+            glm::dvec3{_bunnyObstaclePosition},
+            axes
+        ));
     }
 
-    for (auto i = 0; i < mesh->mNumFaces; ++i)
+    // Unchanged obstacles keep their collider statistics.
+    if (_obstacleColliders != _softBox->getColliders())
     {
-        aiFace face = mesh->mFaces[i];
-        for (auto j = 0; j < face.mNumIndices; ++j)
-        {
-            indices.push_back(face.mIndices[j]);
-        }
+        _softBox->setColliders(_obstacleColliders);
     }
+}
 
-    _softModel = std::make_shared<fw::Mesh<fw::VertexNormalTexCoords>>(
-        vertices,
-        indices
+void Application::renderObstacle(
+    fw::Mesh<fw::VertexNormalTexCoords>& mesh,
+    const glm::vec3& position
+)
+{
+    _universalPhongEffect->setMaterial(*_obstacleMaterial.get());
+    _universalPhongEffect->begin();
+    _universalPhongEffect->setProjectionMatrix(_projectionMatrix);
+    _universalPhongEffect->setViewMatrix(_camera.getViewMatrix());
+    _universalPhongEffect->setModelMatrix(
+        glm::translate(glm::mat4{}, position)
     );
+    mesh.render();
+    _universalPhongEffect->end();
 }
 
 }
@@ -0,0 +1,288 @@
+#include "BSplineLattice.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace application
+{
+
+namespace
+{
+
+const int cDegree = 3;
+
+std::vector<glm::vec3> elevateToCubic(const std::vector<glm::vec3>& points)
+{
+    if (points.size() == 1)
+    {
+        return {points[0], points[0], points[0], points[0]};
+    }
+
+    if (points.size() == 2)
+    {
+        return {
+            points[0],
+            (2.0f * points[0] + points[1]) / 3.0f,
+            (points[0] + 2.0f * points[1]) / 3.0f,
+            points[1]
+        };
+    }
+
+    return {
+        points[0],
+        (points[0] + 2.0f * points[1]) / 3.0f,
+        (2.0f * points[1] + points[2]) / 3.0f,
+        points[2]
+    };
+}
+
+}
+
+std::vector<glm::vec3> convertBSplineToBezier(
+    const std::vector<glm::vec3>& controlPoints
+)
+{
+    assert(!controlPoints.empty());
+
+    if (controlPoints.size() <= cDegree + 1)
+    {
+        return controlPoints.size() == cDegree + 1
+            ? controlPoints
+            : elevateToCubic(controlPoints);
+    }
+
+    const auto count = static_cast<int>(controlPoints.size());
+    const auto spans = count - cDegree;
+
+    std::vector<float> knots;
+    knots.reserve(count + cDegree + 1 + 2 * (spans - 1));
+    for (auto i = 0; i < count + cDegree + 1; ++i)
+    {
+        knots.push_back(static_cast<float>(
+            std::min(std::max(i - cDegree, 0), spans)
+        ));
+    }
+
+    // Boehm insertion raises every interior knot to multiplicity three.
+    auto points = controlPoints;
+    for (auto knot = 1; knot < spans; ++knot)
+    {
+        const auto u = static_cast<float>(knot);
+        for (auto insertion = 0; insertion < cDegree - 1; ++insertion)
+        {
+            auto span = static_cast<int>(
+                std::upper_bound(knots.begin(), knots.end(), u)
+                - knots.begin()
+            ) - 1;
+
+            std::vector<glm::vec3> inserted;
+            inserted.reserve(points.size() + 1);
+            for (auto i = 0; i <= static_cast<int>(points.size()); ++i)
+            {
+                if (i <= span - cDegree)
+                {
+                    inserted.push_back(points[i]);
+                }
+                else if (i > span)
+                {
+                    inserted.push_back(points[i - 1]);
+                }
+                else
+                {
+                    auto alpha = (u - knots[i])
+                        / (knots[i + cDegree] - knots[i]);
+                    inserted.push_back(
+                        (1.0f - alpha) * points[i - 1] + alpha * points[i]
+                    );
+                }
+            }
+
+            points.swap(inserted);
+            knots.insert(knots.begin() + span + 1, u);
+        }
+    }
+
+    assert(static_cast<int>(points.size()) == cDegree * spans + 1);
+    return points;
+}
+
+std::vector<glm::vec3> convertBSplineSurfaceToBezier(
+    const std::vector<glm::vec3>& controlPoints,
+    int sizeU,
+    int sizeV,
+    int& bezierSizeU,
+    int& bezierSizeV
+)
+{
+    assert(controlPoints.size() == static_cast<std::size_t>(sizeU * sizeV));
+
+    std::vector<glm::vec3> rows;
+    std::vector<glm::vec3> line(sizeV);
+    for (auto u = 0; u < sizeU; ++u)
+    {
+        std::copy(
+            controlPoints.begin() + u * sizeV,
+            controlPoints.begin() + (u + 1) * sizeV,
+            line.begin()
+        );
+
+        auto converted = convertBSplineToBezier(line);
+        bezierSizeV = static_cast<int>(converted.size());
+        rows.insert(rows.end(), converted.begin(), converted.end());
+    }
+
+    std::vector<glm::vec3> result;
+    line.resize(sizeU);
+    for (auto v = 0; v < bezierSizeV; ++v)
+    {
+        for (auto u = 0; u < sizeU; ++u)
+        {
+            line[u] = rows[u * bezierSizeV + v];
+        }
+
+        auto converted = convertBSplineToBezier(line);
+        bezierSizeU = static_cast<int>(converted.size());
+        result.resize(bezierSizeU * bezierSizeV);
+        for (auto u = 0; u < bezierSizeU; ++u)
+        {
+            result[u * bezierSizeV + v] = converted[u];
+        }
+    }
+
+    return result;
+}
+
+std::vector<BezierPointWeights> getBSplineToBezierWeights(int count)
+{
+    assert(count > 0);
+
+    std::vector<BezierPointWeights> result;
+
+    // Converts three unit control points at once, one per coordinate.
+    std::vector<glm::vec3> points(count);
+    for (auto first = 0; first < count; first += 3)
+    {
+        std::fill(points.begin(), points.end(), glm::vec3{});
+        for (auto axis = 0; axis < 3 && first + axis < count; ++axis)
+        {
+            points[first + axis][axis] = 1.0f;
+        }
+
+        auto converted = convertBSplineToBezier(points);
+        result.resize(converted.size(), BezierPointWeights{count, 0, {}});
+        for (std::size_t i = 0; i < converted.size(); ++i)
+        {
+            for (auto axis = 0; axis < 3 && first + axis < count; ++axis)
+            {
+                auto weight = converted[i][axis];
+                if (weight == 0.0f)
+                {
+                    continue;
+                }
+
+                // Points are visited in increasing order.
+                auto& entry = result[i];
+                if (entry.count == 0)
+                {
+                    entry.first = first + axis;
+                }
+
+                entry.count = first + axis - entry.first + 1;
+                assert(entry.count <= 4);
+                entry.weights[entry.count - 1] = weight;
+            }
+        }
+    }
+
+    return result;
+}
+
+int evaluateBSplineBasis(float u, int count, float basis[4])
+{
+    assert(count > 0);
+
+    const auto degree = std::min(cDegree, count - 1);
+    const auto spans = count - degree;
+    const auto t = u * static_cast<float>(spans);
+    const auto span = std::min(
+        std::max(static_cast<int>(std::floor(t)), 0),
+        spans - 1
+    ) + degree;
+
+    auto knot = [=](int index) {
+        return static_cast<float>(std::min(std::max(index - degree, 0), spans));
+    };
+
+    float left[cDegree + 1];
+    float right[cDegree + 1];
+    basis[0] = 1.0f;
+    basis[1] = 0.0f;
+    basis[2] = 0.0f;
+    basis[3] = 0.0f;
+
+    // Cox-de Boor recurrence of the nonzero functions, see The NURBS Book.
+    for (auto j = 1; j <= degree; ++j)
+    {
+        left[j] = t - knot(span + 1 - j);
+        right[j] = knot(span + j) - t;
+
+        auto saved = 0.0f;
+        for (auto r = 0; r < j; ++r)
+        {
+            auto temp = basis[r] / (right[r + 1] + left[j - r]);
+            basis[r] = saved + right[r + 1] * temp;
+            saved = left[j - r] * temp;
+        }
+
+        basis[j] = saved;
+    }
+
+    return span - degree;
+}
+
+glm::vec3 evaluateLatticeDistortion(
+    const std::vector<glm::vec3>& controlPoints,
+    glm::ivec3 latticeSize,
+    glm::vec3 p
+)
+{
+    assert(
+        controlPoints.size() == static_cast<std::size_t>(
+            latticeSize.x * latticeSize.y * latticeSize.z
+        )
+    );
+
+    float basis[3][cDegree + 1];
+    glm::ivec3 first;
+    glm::ivec3 count;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        first[axis] = evaluateBSplineBasis(
+            p[axis],
+            latticeSize[axis],
+            basis[axis]
+        );
+        count[axis] = std::min(cDegree + 1, latticeSize[axis]);
+    }
+
+    glm::vec3 sum{};
+    for (auto z = 0; z < count.z; ++z)
+    {
+        for (auto y = 0; y < count.y; ++y)
+        {
+            for (auto x = 0; x < count.x; ++x)
+            {
+                const auto index = first.x + x
+                    + latticeSize.x * (first.y + y
+                        + latticeSize.y * (first.z + z));
+
+                sum += controlPoints[index]
+                    * (basis[0][x] * basis[1][y] * basis[2][z]);
+            }
+        }
+    }
+
+    return sum;
+}
+
+}
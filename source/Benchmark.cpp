@@ -0,0 +1,2021 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BSplineLattice.hpp"
+#include "Colliders.hpp"
+#include "JsonString.hpp"
+#include "LatticeDeformer.hpp"
+#include "ParticleSnapshot.hpp"
+#include "ParticleState.hpp"
+#include "SpatialHash.hpp"
+#include "Trajectory.hpp"
+
+namespace
+{
+
+using namespace application;
+
+struct BenchmarkOptions
+{
+    BenchmarkOptions():
+        minLatticeSize{16},
+        maxLatticeSize{128},
+        maxThreads{static_cast<int>(std::thread::hardware_concurrency())},
+        repetitions{5},
+        integratorStep{0.001},
+        frameStep{1.0 / 60},
+        absoluteTolerance{1e-6},
+        relativeTolerance{1e-4},
+        springConstant{30.0},
+        particleMass{0.015},
+        simulatedSeconds{1.0},
+        dropLatticeSize{16},
+        dropSpeed{12.0},
+        hotPathMinLatticeSize{4},
+        hotPathMaxLatticeSize{128},
+        precisionLatticeSize{16},
+        precisionSimulatedSeconds{10.0},
+        precisionCheckpoints{10},
+        collapseLatticeSize{64},
+        collapseSteps{100},
+        collapseSpeed{2.0},
+        contactStiffness{1000.0},
+        obstacleLatticeSize{32},
+        maxObstacles{1024},
+        sleepBodies{32},
+        sleepLatticeSize{6},
+        sleepSimulatedSeconds{5.0},
+        snapshotLatticeSize{216},
+        snapshotPath{"benchmark.snapshot"},
+        recordingLatticeSize{32},
+        recordingSteps{300},
+        keyframeInterval{60},
+        trajectoryPath{"benchmark.trajectory"},
+        deformVertices{100000},
+        deformMaxLatticeSize{16},
+        uploadMaxLatticeSize{64},
+        surfaceMaxLatticeSize{64}
+    {
+        maxThreads = std::max(maxThreads, 1);
+    }
+
+    int minLatticeSize;
+    int maxLatticeSize;
+    int maxThreads;
+    int repetitions;
+    double integratorStep;
+    double frameStep;
+    double absoluteTolerance;
+    double relativeTolerance;
+    double springConstant;
+    double particleMass;
+    double simulatedSeconds;
+    int dropLatticeSize;
+    double dropSpeed;
+    int hotPathMinLatticeSize;
+    int hotPathMaxLatticeSize;
+    int precisionLatticeSize;
+    double precisionSimulatedSeconds;
+    int precisionCheckpoints;
+    int collapseLatticeSize;
+    int collapseSteps;
+    double collapseSpeed;
+    double contactStiffness;
+    int obstacleLatticeSize;
+    int maxObstacles;
+    int sleepBodies;
+    int sleepLatticeSize;
+    double sleepSimulatedSeconds;
+    int snapshotLatticeSize;
+    std::string snapshotPath;
+    int recordingLatticeSize;
+    int recordingSteps;
+    int keyframeInterval;
+    std::string trajectoryPath;
+    int deformVertices;
+    int deformMaxLatticeSize;
+    int uploadMaxLatticeSize;
+    int surfaceMaxLatticeSize;
+};
+
+/** Exposes the collision passes, which ParticleSystem keeps protected. */
+class InstrumentedParticleSystem:
+    public ParticleSystem
+{
+public:
+    using ParticleSystem::checkInterpenetration;
+    using ParticleSystem::applyImpulsesToCollidingContacts;
+    using ParticleSystem::resolveColliderContacts;
+};
+
+template <typename TSystem>
+void addLatticeParticles(TSystem& system, int size)
+{
+    const double spacing = 2.0 / (size - 1);
+    system.reserveParticles(size * size * size);
+    for (auto z = 0; z < size; ++z)
+    for (auto y = 0; y < size; ++y)
+    for (auto x = 0; x < size; ++x)
+    {
+        system.addParticle({
+            {x * spacing - 1.0, y * spacing - 1.0, z * spacing - 1.0},
+            {0.001 * std::sin(x + 2.0 * y), 0.001 * std::cos(z + 1.0 * x), 0.0},
+            1.0 / 0.015
+        });
+    }
+}
+
+template <typename TSystem>
+void setLatticeParameters(TSystem& system)
+{
+    system.updateSoftBoxParticlesMass(0.015);
+    system.updateSoftBoxConstraints(30.0, 1.0);
+    system.updateEnvironmentConstant(0.05, 1.0);
+}
+
+/**
+ * Fills system with a size^3 lattice through addLatticeConstraints, the
+ * builder the simulation uses.
+ */
+template <typename TSystem>
+LatticeTopologyStatistics buildLatticeInPlace(
+    TSystem& system,
+    int size,
+    LatticeSpringStorage storage
+)
+{
+    addLatticeParticles(system, size);
+    auto statistics = system.addLatticeConstraints(
+        glm::ivec3{size},
+        SpringConstraint{},
+        storage
+    );
+
+    system.finalizeTopology();
+    setLatticeParameters(system);
+
+    return statistics;
+}
+
+/**
+ * Explicit lattice of buildLatticeInPlace, returning the number of springs.
+ * The first springs are also copied to sampledSprings when it is given.
+ */
+std::size_t buildLattice(
+    ParticleSystem& system,
+    int size,
+    std::vector<SpringConstraint>* sampledSprings = nullptr,
+    std::size_t maxSampledSprings = 0
+)
+{
+    auto statistics = buildLatticeInPlace(
+        system,
+        size,
+        LatticeSpringStorage::Explicit
+    );
+
+    if (sampledSprings)
+    {
+        const auto& springs = system.getInternalSprings();
+        const auto count = std::min(springs.size(), maxSampledSprings);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            SpringConstraint constraint;
+            constraint.a = springs.a[i];
+            constraint.b = springs.b[i];
+            constraint.springLength = springs.restLength[i];
+            constraint.springConstant = springs.stiffness[i];
+            constraint.attenuationFactor = springs.damping[i];
+            sampledSprings->push_back(constraint);
+        }
+    }
+
+    return statistics.springs;
+}
+
+template <typename TFunction>
+double measureBestSeconds(int repetitions, const TFunction& function)
+{
+    auto best = 0.0;
+    for (auto i = 0; i < repetitions; ++i)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        auto elapsed = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start
+        ).count();
+
+        best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+
+    return best;
+}
+
+void runForceScalingBenchmark(const BenchmarkOptions& options)
+{
+    std::cout << "  \"forceAccumulationScaling\": [";
+
+    auto first = true;
+    for (auto size = options.minLatticeSize;
+        size <= options.maxLatticeSize;
+        size *= 2)
+    {
+        ParticleSystem system;
+        buildLattice(system, size);
+
+        ParticleSystem stencilSystem;
+        buildLatticeInPlace(
+            stencilSystem,
+            size,
+            LatticeSpringStorage::Stencil
+        );
+
+        auto state = system.getParticleStates();
+        auto input = system.getPhysicsState();
+        StateVector<double> derivative;
+        system.evaluateDerivative(input, 0.0, derivative);
+
+        for (auto threads = 1; threads <= options.maxThreads; threads *= 2)
+        {
+            system.setThreadCount(threads);
+            for (auto mode = 0;
+                mode < static_cast<int>(ForceAccumulation::ForceAccumulationCount);
+                ++mode)
+            {
+                auto accumulation = ForceAccumulation(mode);
+                system.setForceAccumulation(accumulation);
+                auto seconds = measureBestSeconds(options.repetitions, [&]() {
+                    system.evaluateDerivative(input, 0.0, derivative);
+                });
+
+                std::cout << (first ? "" : ",") << "\n    {"
+                    << "\"latticeSize\": " << size
+                    << ", \"particles\": " << state.size()
+                    << ", \"threads\": " << threads
+                    << ", \"accumulation\": \""
+                    << getForceAccumulationName(accumulation) << "\""
+                    << ", \"secondsPerEvaluation\": " << seconds
+                    << ", \"nsPerParticle\": " << 1e9 * seconds / state.size()
+                    << "}";
+
+                first = false;
+            }
+
+            stencilSystem.setThreadCount(threads);
+            auto seconds = measureBestSeconds(options.repetitions, [&]() {
+                stencilSystem.evaluateDerivative(input, 0.0, derivative);
+            });
+
+            std::cout << ",\n    {"
+                << "\"latticeSize\": " << size
+                << ", \"particles\": " << state.size()
+                << ", \"threads\": " << threads
+                << ", \"accumulation\": \"Stencil\""
+                << ", \"secondsPerEvaluation\": " << seconds
+                << ", \"nsPerParticle\": " << 1e9 * seconds / state.size()
+                << "}";
+        }
+    }
+
+    std::cout << "\n  ]";
+}
+
+template <typename TSystem>
+void simulate(
+    TSystem& system,
+    const std::vector<double>& initialState,
+    double step,
+    double duration
+)
+{
+    system.applyPhysicsState(initialState);
+    auto steps = static_cast<int>(std::round(duration / step));
+    for (auto i = 0; i < steps; ++i)
+    {
+        system.update(step);
+    }
+}
+
+/** RMS and largest distance between the particles of two stored states. */
+void measurePositionDrift(
+    const std::vector<double>& state,
+    const std::vector<double>& referenceState,
+    double& rmsDrift,
+    double& maxDrift
+)
+{
+    const auto particles = state.size() / ParticleStateFieldCount;
+
+    auto squaredDriftSum = 0.0;
+    maxDrift = 0.0;
+    for (std::size_t i = 0; i < particles; ++i)
+    {
+        auto offset = i * ParticleStateFieldCount;
+        auto squaredDrift = 0.0;
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            auto delta = state[offset + PositionX + axis]
+                - referenceState[offset + PositionX + axis];
+            squaredDrift += delta * delta;
+        }
+
+        squaredDriftSum += squaredDrift;
+        maxDrift = std::max(maxDrift, std::sqrt(squaredDrift));
+    }
+
+    rmsDrift = std::sqrt(
+        squaredDriftSum / std::max<std::size_t>(1, particles)
+    );
+}
+
+void runIntegratorBenchmark(const BenchmarkOptions& options)
+{
+    const int cReferenceRefinement = 10;
+    const auto size = options.minLatticeSize;
+
+    ParticleSystem system;
+    buildLattice(system, size);
+    system.updateSoftBoxParticlesMass(options.particleMass);
+    system.updateSoftBoxConstraints(options.springConstant, 1.0);
+
+    std::vector<double> initialState;
+    system.storePhysicsState(initialState);
+
+    std::vector<double> referenceState;
+    std::vector<double> finalState;
+    system.setIntegratorTolerances(
+        options.absoluteTolerance,
+        options.relativeTolerance
+    );
+
+    system.setIntegrator(IntegratorType::RungeKutta4);
+    simulate(
+        system,
+        initialState,
+        options.integratorStep / cReferenceRefinement,
+        options.simulatedSeconds
+    );
+    system.storePhysicsState(referenceState);
+
+    std::cout << "  \"integrators\": {"
+        << "\n    \"latticeSize\": " << size
+        << ",\n    \"particles\": " << system.getParticleCount()
+        << ",\n    \"springConstant\": " << options.springConstant
+        << ",\n    \"particleMass\": " << options.particleMass
+        << ",\n    \"step\": " << options.integratorStep
+        << ",\n    \"frameStep\": " << options.frameStep
+        << ",\n    \"absoluteTolerance\": " << options.absoluteTolerance
+        << ",\n    \"relativeTolerance\": " << options.relativeTolerance
+        << ",\n    \"simulatedSeconds\": " << options.simulatedSeconds
+        << ",\n    \"reference\": \"" << getIntegratorName(
+            IntegratorType::RungeKutta4
+        ) << " with step / " << cReferenceRefinement << "\""
+        << ",\n    \"policies\": [";
+
+    for (auto type = 0;
+        type < static_cast<int>(IntegratorType::IntegratorTypeCount);
+        ++type)
+    {
+        system.setIntegrator(IntegratorType(type));
+
+        // Adaptive and implicit integrators choose their steps within frames.
+        auto fixedStep = IntegratorType(type) != IntegratorType::DormandPrince45
+            && IntegratorType(type) != IntegratorType::BackwardEuler;
+        auto frameStep = fixedStep
+            ? options.integratorStep
+            : options.frameStep;
+
+        auto evaluationsBefore = system.getDerivativeEvaluationCount();
+        auto statisticsBefore = system.getIntegratorStatistics();
+        simulate(
+            system,
+            initialState,
+            frameStep,
+            options.simulatedSeconds
+        );
+
+        auto evaluations =
+            system.getDerivativeEvaluationCount() - evaluationsBefore;
+        auto acceptedSteps = system.getIntegratorStatistics().acceptedSteps
+            - statisticsBefore.acceptedSteps;
+        auto rejectedSteps = system.getIntegratorStatistics().rejectedSteps
+            - statisticsBefore.rejectedSteps;
+        auto linearSolverIterations =
+            system.getIntegratorStatistics().linearSolverIterations
+            - statisticsBefore.linearSolverIterations;
+        system.storePhysicsState(finalState);
+
+        auto seconds = measureBestSeconds(options.repetitions, [&]() {
+            simulate(
+                system,
+                initialState,
+                frameStep,
+                options.simulatedSeconds
+            );
+        });
+
+        double rmsDrift;
+        double maxDrift;
+        measurePositionDrift(finalState, referenceState, rmsDrift, maxDrift);
+
+        std::cout << (type == 0 ? "" : ",") << "\n      {"
+            << "\"integrator\": \"" << getIntegratorName(IntegratorType(type))
+            << "\", \"derivativeEvaluationsPerSimulatedSecond\": "
+            << evaluations / options.simulatedSeconds
+            << ", \"acceptedSteps\": " << acceptedSteps
+            << ", \"rejectedSteps\": " << rejectedSteps
+            << ", \"linearSolverIterationsPerStep\": "
+            << static_cast<double>(linearSolverIterations)
+                / std::max<unsigned long long>(1, acceptedSteps)
+            << ", \"secondsPerSimulatedSecond\": "
+            << seconds / options.simulatedSeconds
+            << ", \"rmsPositionDrift\": " << rmsDrift
+            << ", \"maxPositionDrift\": " << maxDrift
+            << "}";
+    }
+
+    std::cout << "\n    ]\n  }";
+}
+
+void runCollisionBenchmark(const BenchmarkOptions& options)
+{
+    const auto size = options.dropLatticeSize;
+
+    ParticleSystem system;
+    buildLattice(system, size);
+
+    // The lattice starts in the middle of the room and falls onto the floor.
+    std::vector<double> initialState;
+    system.storePhysicsState(initialState);
+    for (std::size_t i = 0; i < system.getParticleCount(); ++i)
+    {
+        initialState[i * ParticleStateFieldCount + MomentumY] =
+            -0.015 * options.dropSpeed;
+    }
+
+    std::cout << "  \"wallCollisions\": {"
+        << "\n    \"latticeSize\": " << size
+        << ",\n    \"particles\": " << system.getParticleCount()
+        << ",\n    \"dropSpeed\": " << options.dropSpeed
+        << ",\n    \"step\": " << options.integratorStep
+        << ",\n    \"simulatedSeconds\": " << options.simulatedSeconds
+        << ",\n    \"modes\": [";
+
+    std::vector<double> finalState;
+    for (auto mode = 0;
+        mode < static_cast<int>(CollisionMode::CollisionModeCount);
+        ++mode)
+    {
+        system.setCollisionMode(CollisionMode(mode));
+
+        auto evaluationsBefore = system.getDerivativeEvaluationCount();
+        auto seconds = measureBestSeconds(options.repetitions, [&]() {
+            simulate(
+                system,
+                initialState,
+                options.integratorStep,
+                options.simulatedSeconds
+            );
+        });
+
+        auto evaluations = (system.getDerivativeEvaluationCount()
+            - evaluationsBefore) / options.repetitions;
+        system.storePhysicsState(finalState);
+
+        auto lowestPosition = 0.0;
+        for (std::size_t i = 0; i < system.getParticleCount(); ++i)
+        {
+            lowestPosition = std::min(
+                lowestPosition,
+                finalState[i * ParticleStateFieldCount + PositionY]
+            );
+        }
+
+        std::cout << (mode == 0 ? "" : ",") << "\n      {"
+            << "\"mode\": \"" << getCollisionModeName(CollisionMode(mode))
+            << "\", \"derivativeEvaluationsPerSimulatedSecond\": "
+            << evaluations / options.simulatedSeconds
+            << ", \"secondsPerSimulatedSecond\": "
+            << seconds / options.simulatedSeconds
+            << ", \"lowestPosition\": " << lowestPosition
+            << "}";
+    }
+
+    std::cout << "\n    ]\n  }";
+}
+
+void runHotPathBenchmark(const BenchmarkOptions& options)
+{
+    const std::size_t cMaxSampledSprings = 1 << 20;
+    const double cStep = 0.001;
+
+    std::cout << "  \"hotPaths\": [";
+
+    auto first = true;
+    for (auto size = options.hotPathMinLatticeSize;
+        size <= options.hotPathMaxLatticeSize;
+        size *= 2)
+    {
+        InstrumentedParticleSystem system;
+        std::vector<SpringConstraint> sampledSprings;
+        auto springs = buildLattice(
+            system,
+            size,
+            &sampledSprings,
+            cMaxSampledSprings
+        );
+
+        const auto particles = system.getParticleCount();
+        auto input = system.getPhysicsState();
+        StateVector<double> output(input.size());
+        StateVector<double> derivative;
+        system.evaluateDerivative(input, 0.0, derivative);
+
+        // Sums results so the compiler cannot drop the measured work.
+        volatile double sink = 0.0;
+
+        auto view = system.getParticleStates();
+        std::vector<ParticleState> sampledParticles(
+            std::begin(view),
+            std::end(view)
+        );
+
+        auto getForceSeconds = measureBestSeconds(options.repetitions, [&]() {
+            glm::dvec3 total{};
+            for (const auto& spring: sampledSprings)
+            {
+                const auto& a = sampledParticles[spring.a];
+                const auto& b = sampledParticles[spring.b];
+                total += spring.getForce(
+                    a.position,
+                    b.position,
+                    a.invMass * a.momentum,
+                    b.invMass * b.momentum
+                );
+            }
+
+            sink = sink + total.x + total.y + total.z;
+        });
+
+        auto derivativeSeconds = measureBestSeconds(
+            options.repetitions,
+            [&]() { system.evaluateDerivative(input, 0.0, derivative); }
+        );
+
+        RungeKuttaODESolver<double> solver;
+        auto stepSeconds = measureBestSeconds(options.repetitions, [&]() {
+            solver.step(system, input, output, 0.0, cStep);
+        });
+
+        auto interpenetrationSeconds = measureBestSeconds(
+            options.repetitions,
+            [&]() { sink = sink + system.checkInterpenetration(); }
+        );
+
+        auto impulseSeconds = measureBestSeconds(
+            options.repetitions,
+            [&]() { system.applyImpulsesToCollidingContacts(); }
+        );
+
+        std::vector<double> packedState;
+        auto storeSeconds = measureBestSeconds(
+            options.repetitions,
+            [&]() { system.storePhysicsState(packedState); }
+        );
+
+        auto applySeconds = measureBestSeconds(
+            options.repetitions,
+            [&]() { system.applyPhysicsState(packedState); }
+        );
+
+        auto nsPerParticle = [particles](double seconds) {
+            return 1e9 * seconds / std::max<std::size_t>(1, particles);
+        };
+
+        auto nsPerSpring = [](double seconds, std::size_t count) {
+            return 1e9 * seconds / std::max<std::size_t>(1, count);
+        };
+
+        std::cout << (first ? "" : ",") << "\n    {"
+            << "\"latticeSize\": " << size
+            << ", \"particles\": " << particles
+            << ", \"springs\": " << springs
+            << ", \"getForceNsPerSpring\": "
+            << nsPerSpring(getForceSeconds, sampledSprings.size())
+            << ", \"derivativeNsPerParticle\": "
+            << nsPerParticle(derivativeSeconds)
+            << ", \"derivativeNsPerSpring\": "
+            << nsPerSpring(derivativeSeconds, springs)
+            << ", \"rk4StepNsPerParticle\": " << nsPerParticle(stepSeconds)
+            << ", \"checkInterpenetrationNsPerParticle\": "
+            << nsPerParticle(interpenetrationSeconds)
+            << ", \"applyImpulsesNsPerParticle\": "
+            << nsPerParticle(impulseSeconds)
+            << ", \"storeStateNsPerParticle\": "
+            << nsPerParticle(storeSeconds)
+            << ", \"applyStateNsPerParticle\": "
+            << nsPerParticle(applySeconds)
+            << "}";
+
+        first = false;
+    }
+
+    std::cout << "\n  ]";
+}
+
+struct PrecisionTrajectory
+{
+    std::vector<std::vector<double>> checkpoints;
+    double seconds;
+    std::size_t stateBytes;
+    std::size_t springBytes;
+};
+
+/**
+ * Simulates the benchmark lattice in the precision of TSystem and stores the
+ * state at evenly spaced checkpoints.
+ */
+template <typename TSystem>
+PrecisionTrajectory recordPrecisionTrajectory(
+    const BenchmarkOptions& options
+)
+{
+    TSystem system;
+    auto topology = buildLatticeInPlace(
+        system,
+        options.precisionLatticeSize,
+        LatticeSpringStorage::Explicit
+    );
+    system.setIntegrator(IntegratorType::RungeKutta4);
+
+    PrecisionTrajectory trajectory;
+    trajectory.stateBytes = system.getPhysicsState().size()
+        * sizeof(system.getPhysicsState()[0]);
+    trajectory.springBytes = topology.springBytes;
+
+    const auto interval = options.precisionSimulatedSeconds
+        / options.precisionCheckpoints;
+    auto steps = static_cast<int>(
+        std::round(interval / options.integratorStep)
+    );
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto c = 0; c < options.precisionCheckpoints; ++c)
+    {
+        for (auto i = 0; i < steps; ++i)
+        {
+            system.update(options.integratorStep);
+        }
+
+        trajectory.checkpoints.emplace_back();
+        system.storePhysicsState(trajectory.checkpoints.back());
+    }
+
+    trajectory.seconds = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start
+    ).count();
+
+    return trajectory;
+}
+
+void printPrecisionTrajectory(
+    const char* name,
+    const PrecisionTrajectory& trajectory,
+    const PrecisionTrajectory& reference,
+    const BenchmarkOptions& options
+)
+{
+    std::cout << "\n      {"
+        << "\"precision\": \"" << name << "\""
+        << ", \"secondsPerSimulatedSecond\": "
+        << trajectory.seconds / options.precisionSimulatedSeconds
+        << ", \"stateBytes\": " << trajectory.stateBytes
+        << ", \"springBytes\": " << trajectory.springBytes
+        << ", \"checkpoints\": [";
+
+    const auto interval = options.precisionSimulatedSeconds
+        / options.precisionCheckpoints;
+    for (std::size_t c = 0; c < trajectory.checkpoints.size(); ++c)
+    {
+        double rmsDrift;
+        double maxDrift;
+        measurePositionDrift(
+            trajectory.checkpoints[c],
+            reference.checkpoints[c],
+            rmsDrift,
+            maxDrift
+        );
+
+        std::cout << (c == 0 ? "" : ", ")
+            << "{\"time\": " << (c + 1) * interval
+            << ", \"rmsPositionDrift\": " << rmsDrift
+            << ", \"maxPositionDrift\": " << maxDrift
+            << "}";
+    }
+
+    std::cout << "]}";
+}
+
+/**
+ * Long runs of the same lattice in double, float and mixed precision. The
+ * drift is measured against the double trajectory.
+ */
+void runPrecisionBenchmark(const BenchmarkOptions& options)
+{
+    auto reference = recordPrecisionTrajectory<ParticleSystem>(options);
+    auto single = recordPrecisionTrajectory<FloatParticleSystem>(options);
+    auto mixed = recordPrecisionTrajectory<MixedParticleSystem>(options);
+
+    std::cout << "  \"precision\": {"
+        << "\n    \"latticeSize\": " << options.precisionLatticeSize
+        << ",\n    \"integrator\": \""
+        << getIntegratorName(IntegratorType::RungeKutta4) << "\""
+        << ",\n    \"step\": " << options.integratorStep
+        << ",\n    \"simulatedSeconds\": "
+        << options.precisionSimulatedSeconds
+        << ",\n    \"modes\": [";
+
+    printPrecisionTrajectory("Double", reference, reference, options);
+    std::cout << ",";
+    printPrecisionTrajectory("Float", single, reference, options);
+    std::cout << ",";
+    printPrecisionTrajectory("Mixed", mixed, reference, options);
+
+    std::cout << "\n    ]\n  }";
+}
+
+/** Smallest distance between particles closer than distance, or distance. */
+double findClosestPair(
+    const std::vector<double>& state,
+    double distance,
+    SpatialHash<double>& hash,
+    ParticleContacts& contacts,
+    ThreadPool& threadPool
+)
+{
+    const auto particles = state.size() / ParticleStateFieldCount;
+    std::vector<double> positions[3];
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        positions[axis].resize(particles);
+        for (std::size_t i = 0; i < particles; ++i)
+        {
+            positions[axis][i] =
+                state[i * ParticleStateFieldCount + PositionX + axis];
+        }
+    }
+
+    const double* position[] = {
+        positions[0].data(),
+        positions[1].data(),
+        positions[2].data()
+    };
+
+    hash.update(position, particles, distance, threadPool);
+    hash.findContacts(distance, threadPool, contacts);
+
+    auto closest = distance;
+    for (std::size_t p = 0; p < particles; ++p)
+    {
+        for (auto e = contacts.offsets[p]; e < contacts.offsets[p + 1]; ++e)
+        {
+            auto q = contacts.neighbour[e];
+            closest = std::min(closest, glm::length(glm::dvec3{
+                positions[0][p] - positions[0][q],
+                positions[1][p] - positions[1][q],
+                positions[2][p] - positions[2][q]
+            }));
+        }
+    }
+
+    return closest;
+}
+
+/**
+ * Lattices with weak springs whose halves are thrown against each other, so
+ * the body collapses onto itself. Without self-collision the layers pass
+ * through each other. Also times the broadphase on its own.
+ */
+void runSelfCollisionBenchmark(const BenchmarkOptions& options)
+{
+    const int cClosestPairInterval = 10;
+
+    std::cout << "  \"selfCollision\": {"
+        << "\n    \"step\": " << options.integratorStep
+        << ",\n    \"steps\": " << options.collapseSteps
+        << ",\n    \"collapseSpeed\": " << options.collapseSpeed
+        << ",\n    \"contactStiffness\": " << options.contactStiffness
+        << ",\n    \"runs\": [";
+
+    ThreadPool threadPool;
+    SpatialHash<double> hash;
+    ParticleContacts contacts;
+
+    auto first = true;
+    for (auto size = options.minLatticeSize;
+        size <= options.collapseLatticeSize;
+        size *= 2)
+    {
+        ParticleSystem system;
+        buildLatticeInPlace(system, size, LatticeSpringStorage::Stencil);
+        system.updateSoftBoxConstraints(1.0, 0.1);
+        system.setIntegrator(IntegratorType::RungeKutta4);
+
+        std::vector<double> initialState;
+        system.storePhysicsState(initialState);
+        for (std::size_t i = 0; i < system.getParticleCount(); ++i)
+        {
+            const auto offset = i * ParticleStateFieldCount;
+            initialState[offset + MomentumY] = -0.015 * options.collapseSpeed
+                * (initialState[offset + PositionY] > 0.0 ? 1.0 : -1.0);
+        }
+
+        const auto contactDistance = 0.5 * 2.0 / (size - 1);
+        std::vector<double> state;
+        for (auto enabled = 0; enabled <= 1; ++enabled)
+        {
+            system.setSelfCollision(
+                enabled ? contactDistance : 0.0,
+                options.contactStiffness
+            );
+
+            system.applyPhysicsState(initialState);
+            auto closestPair = contactDistance;
+            std::size_t maxContactPairs = 0;
+            auto seconds = 0.0;
+            for (auto i = 0; i < options.collapseSteps; ++i)
+            {
+                seconds += measureBestSeconds(1, [&]() {
+                    system.update(options.integratorStep);
+                });
+
+                maxContactPairs = std::max(
+                    maxContactPairs,
+                    system.getContactPairCount()
+                );
+
+                if (i % cClosestPairInterval != 0
+                    && i + 1 != options.collapseSteps)
+                {
+                    continue;
+                }
+
+                system.storePhysicsState(state);
+                closestPair = std::min(
+                    closestPair,
+                    findClosestPair(
+                        state,
+                        contactDistance,
+                        hash,
+                        contacts,
+                        threadPool
+                    )
+                );
+            }
+
+            // Broadphase alone, on the final state.
+            auto broadphaseSeconds = measureBestSeconds(
+                options.repetitions,
+                [&]() {
+                    findClosestPair(
+                        state,
+                        1.5 * contactDistance,
+                        hash,
+                        contacts,
+                        threadPool
+                    );
+                }
+            );
+
+            std::cout << (first ? "" : ",") << "\n      {"
+                << "\"latticeSize\": " << size
+                << ", \"particles\": " << system.getParticleCount()
+                << ", \"selfCollision\": " << (enabled ? "true" : "false")
+                << ", \"contactDistance\": " << contactDistance
+                << ", \"secondsPerStep\": " << seconds / options.collapseSteps
+                << ", \"maxContactPairs\": " << maxContactPairs
+                << ", \"closestPair\": " << closestPair
+                << ", \"broadphaseSeconds\": " << broadphaseSeconds
+                << ", \"broadphaseNsPerParticle\": "
+                << 1e9 * broadphaseSeconds / system.getParticleCount()
+                << "}";
+
+            first = false;
+        }
+    }
+
+    std::cout << "\n    ]\n  }";
+}
+
+/** Latitude-longitude triangulation of a sphere around the origin. */
+void createSphereMesh(
+    double radius,
+    int rings,
+    int segments,
+    std::vector<glm::dvec3>& vertices,
+    std::vector<unsigned>& indices
+)
+{
+    const double pi = std::acos(-1.0);
+
+    vertices.clear();
+    indices.clear();
+    for (auto ring = 0; ring <= rings; ++ring)
+    for (auto segment = 0; segment < segments; ++segment)
+    {
+        const auto polar = pi * ring / rings;
+        const auto azimuth = 2.0 * pi * segment / segments;
+        vertices.push_back(radius * glm::dvec3{
+            std::sin(polar) * std::cos(azimuth),
+            std::cos(polar),
+            std::sin(polar) * std::sin(azimuth)
+        });
+    }
+
+    for (auto ring = 0; ring < rings; ++ring)
+    for (auto segment = 0; segment < segments; ++segment)
+    {
+        const unsigned next = (segment + 1) % segments;
+        const unsigned a = ring * segments + segment;
+        const unsigned b = ring * segments + next;
+        const unsigned c = (ring + 1) * segments + segment;
+        const unsigned d = (ring + 1) * segments + next;
+        indices.insert(indices.end(), {a, c, b, b, c, d});
+    }
+}
+
+/**
+ * Small analytic obstacles scattered over the room, cycling through the
+ * bounded shapes.
+ */
+std::vector<Collider> scatterColliders(int count, std::mt19937& generator)
+{
+    std::uniform_real_distribution<double> x{-5.0, 5.0};
+    std::uniform_real_distribution<double> y{-2.5, 2.5};
+    std::uniform_real_distribution<double> z{-5.0, 5.0};
+    std::uniform_real_distribution<double> size{0.05, 0.2};
+    std::uniform_real_distribution<double> angle{0.0, 3.14};
+
+    std::vector<Collider> colliders;
+    for (auto i = 0; i < count; ++i)
+    {
+        const glm::dvec3 center{x(generator), y(generator), z(generator)};
+        const auto radius = size(generator);
+        const auto turn = angle(generator);
+        const glm::dvec3 axes[3] = {
+            {std::cos(turn), std::sin(turn), 0.0},
+            {-std::sin(turn), std::cos(turn), 0.0},
+            {0.0, 0.0, 1.0}
+        };
+
+        switch (i % 3)
+        {
+        case 0:
+            colliders.push_back(Collider::sphere(center, radius));
+            break;
+        case 1:
+            colliders.push_back(Collider::capsule(
+                center - radius * axes[0],
+                center + radius * axes[0],
+                0.5 * radius
+            ));
+            break;
+        default:
+            colliders.push_back(Collider::orientedBox(
+                center,
+                axes,
+                glm::dvec3{radius, 0.5 * radius, radius}
+            ));
+            break;
+        }
+    }
+
+    return colliders;
+}
+
+void runObstacleBenchmark(const BenchmarkOptions& options)
+{
+    const auto size = options.obstacleLatticeSize;
+    const double cMeshRadius = 0.6;
+    const double cMeshCellSize = 0.05;
+
+    InstrumentedParticleSystem system;
+    buildLatticeInPlace(system, size, LatticeSpringStorage::Stencil);
+
+    std::vector<double> initialState;
+    system.storePhysicsState(initialState);
+
+    // A baked sphere in the middle of the lattice provides the contacts.
+    std::vector<glm::dvec3> vertices;
+    std::vector<unsigned> indices;
+    createSphereMesh(cMeshRadius, 32, 64, vertices, indices);
+
+    auto grid = std::make_shared<VoxelSdf>();
+    auto bakeSeconds = measureBestSeconds(1, [&]() {
+        grid->build(vertices, indices, cMeshCellSize);
+    });
+
+    const glm::dvec3 identity[3] = {
+        {1.0, 0.0, 0.0},
+        {0.0, 1.0, 0.0},
+        {0.0, 0.0, 1.0}
+    };
+
+    std::cout << "  \"obstacles\": {"
+        << "\n    \"latticeSize\": " << size
+        << ",\n    \"particles\": " << system.getParticleCount()
+        << ",\n    \"meshTriangles\": " << indices.size() / 3
+        << ",\n    \"meshGridCells\": "
+        << grid->getSize().x * grid->getSize().y * grid->getSize().z
+        << ",\n    \"meshBakeSeconds\": " << bakeSeconds
+        << ",\n    \"runs\": [";
+
+    std::mt19937 generator{7};
+    std::vector<double> distance(system.getParticleCount());
+    std::vector<double> normal[3];
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        normal[axis].resize(system.getParticleCount());
+    }
+
+    auto first = true;
+    for (auto count = 2; count <= std::max(2, options.maxObstacles); count *= 4)
+    {
+        std::vector<Collider> colliders{
+            Collider::voxelGrid(grid, glm::dvec3{}, identity),
+            Collider::plane({0.0, -2.5, 0.0}, {0.0, 1.0, 0.0})
+        };
+
+        auto scattered = scatterColliders(count - 2, generator);
+        colliders.insert(colliders.end(), scattered.begin(), scattered.end());
+
+        system.applyPhysicsState(initialState);
+        system.setColliders(colliders);
+        system.resolveColliderContacts();
+        const auto statistics = system.getColliderStatistics();
+
+        auto seconds = measureBestSeconds(options.repetitions, [&]() {
+            system.resolveColliderContacts();
+        });
+
+        // Every collider evaluated for every particle, without the cull.
+        const auto& state = system.getPhysicsState();
+        const auto stride = state.size() / ParticleStateFieldCount;
+        const double* const position[3] = {
+            state.data() + PositionX * stride,
+            state.data() + PositionY * stride,
+            state.data() + PositionZ * stride
+        };
+        double* const normalBlocks[3] = {
+            normal[0].data(),
+            normal[1].data(),
+            normal[2].data()
+        };
+
+        auto unculledSeconds = measureBestSeconds(options.repetitions, [&]() {
+            for (const auto& collider: colliders)
+            {
+                evaluateCollider(
+                    collider,
+                    position,
+                    system.getParticleCount(),
+                    distance.data(),
+                    normalBlocks
+                );
+            }
+        });
+
+        const auto particles = static_cast<double>(system.getParticleCount());
+        std::cout << (first ? "" : ",") << "\n      {"
+            << "\"colliders\": " << colliders.size()
+            << ", \"contacts\": " << statistics.contacts
+            << ", \"evaluatedFraction\": "
+            << static_cast<double>(statistics.evaluatedTests)
+                / statistics.candidateTests
+            << ", \"nsPerParticle\": " << 1e9 * seconds / particles
+            << ", \"unculledNsPerParticle\": "
+            << 1e9 * unculledSeconds / particles
+            << "}";
+
+        first = false;
+    }
+
+    std::cout << "\n    ]\n  }";
+}
+
+/**
+ * Many small bodies disturbed by different amounts settle down, simulated
+ * frame by frame with and without sleeping. Reports the frame cost and the
+ * number of sleeping bodies every simulated second, then how the cost
+ * reacts to waking a single body.
+ */
+void runSleepingBenchmark(const BenchmarkOptions& options)
+{
+    const double cSleepKineticEnergy = 1e-6;
+    const double cSleepForce = 1e-3;
+    const double cSleepDelay = 0.5;
+
+    std::vector<std::unique_ptr<ParticleSystem>> bodies;
+    std::vector<std::vector<double>> initialStates;
+    std::mt19937 generator{11};
+    std::uniform_real_distribution<double> disturbance{-1.0, 1.0};
+    for (auto b = 0; b < options.sleepBodies; ++b)
+    {
+        bodies.emplace_back(new ParticleSystem{});
+        auto& body = *bodies.back();
+        buildLatticeInPlace(
+            body,
+            options.sleepLatticeSize,
+            LatticeSpringStorage::Explicit
+        );
+        body.setIntegrator(IntegratorType::RungeKutta4);
+        body.setFixedTimestep(
+            options.integratorStep,
+            static_cast<int>(
+                std::ceil(options.frameStep / options.integratorStep)
+            ) + 1
+        );
+
+        std::vector<double> state;
+        body.storePhysicsState(state);
+        const auto scale = options.particleMass * b / options.sleepBodies;
+        for (std::size_t i = 0; i < body.getParticleCount(); ++i)
+        {
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                state[i * ParticleStateFieldCount + MomentumX + axis] =
+                    scale * disturbance(generator);
+            }
+        }
+
+        initialStates.push_back(state);
+    }
+
+    std::cout << "  \"sleeping\": {"
+        << "\n    \"bodies\": " << options.sleepBodies
+        << ",\n    \"latticeSize\": " << options.sleepLatticeSize
+        << ",\n    \"frameStep\": " << options.frameStep
+        << ",\n    \"fixedStep\": " << options.integratorStep
+        << ",\n    \"runs\": [";
+
+    const auto framesPerSecond = static_cast<int>(
+        std::round(1.0 / options.frameStep)
+    );
+    const auto seconds = static_cast<int>(
+        std::ceil(options.sleepSimulatedSeconds)
+    );
+
+    auto countSleeping = [&]() {
+        return std::count_if(
+            bodies.begin(),
+            bodies.end(),
+            [](const std::unique_ptr<ParticleSystem>& body) {
+                return body->isSleeping();
+            }
+        );
+    };
+
+    auto simulateFrame = [&]() {
+        return measureBestSeconds(1, [&]() {
+            for (auto& body: bodies)
+            {
+                body->update(options.frameStep);
+            }
+        });
+    };
+
+    // Integrator evaluations and sleep tests are counted apart.
+    auto sumEvaluations = [&]() {
+        std::pair<unsigned long long, unsigned long long> sum{};
+        for (const auto& body: bodies)
+        {
+            sum.first += body->getDerivativeEvaluationCount();
+            sum.second += body->getSleepForceEvaluationCount();
+        }
+
+        return sum;
+    };
+
+    for (auto enabled = 0; enabled <= 1; ++enabled)
+    {
+        for (std::size_t b = 0; b < bodies.size(); ++b)
+        {
+            bodies[b]->setSleepThresholds(
+                enabled ? cSleepKineticEnergy : 0.0,
+                cSleepForce,
+                cSleepDelay
+            );
+            bodies[b]->applyPhysicsState(initialStates[b]);
+        }
+
+        std::cout << (enabled ? "," : "") << "\n      {"
+            << "\"sleeping\": " << (enabled ? "true" : "false")
+            << ", \"seconds\": [";
+
+        const auto startEvaluations = sumEvaluations();
+        for (auto second = 0; second < seconds; ++second)
+        {
+            auto frameSeconds = 0.0;
+            for (auto frame = 0; frame < framesPerSecond; ++frame)
+            {
+                frameSeconds += simulateFrame();
+            }
+
+            std::cout << (second == 0 ? "" : ", ")
+                << "{\"second\": " << second + 1
+                << ", \"sleepingBodies\": " << countSleeping()
+                << ", \"frameSeconds\": " << frameSeconds / framesPerSecond
+                << "}";
+        }
+
+        const auto endEvaluations = sumEvaluations();
+        std::cout << "], \"derivativeEvaluations\": "
+            << endEvaluations.first - startEvaluations.first
+            << ", \"sleepForceEvaluations\": "
+            << endEvaluations.second - startEvaluations.second;
+
+        // One disturbed body has to be simulated again, alone.
+        bodies.front()->applyRandomDisturbance();
+        std::cout << ", \"afterWakingOne\": {"
+            << "\"sleepingBodies\": " << countSleeping()
+            << ", \"frameSeconds\": " << simulateFrame()
+            << "}}";
+    }
+
+    std::cout << "\n    ]\n  }";
+}
+
+/**
+ * Saves lattices of up to about ten million particles to a snapshot file and
+ * loads them into another system, next to a plain copy of the same state in
+ * memory. The file is read back from the page cache. Explicit springs are
+ * only stored for the smaller lattices, so the largest runs fit in a few
+ * gigabytes.
+ */
+void runSnapshotBenchmark(const BenchmarkOptions& options)
+{
+    const int cMaxExplicitLatticeSize = 64;
+    const double cBytesPerGigabyte = 1e9;
+
+    std::vector<int> sizes;
+    for (auto size = options.minLatticeSize;
+        size < options.snapshotLatticeSize;
+        size *= 2)
+    {
+        sizes.push_back(size);
+    }
+
+    sizes.push_back(options.snapshotLatticeSize);
+
+    std::cout << "  \"snapshots\": {"
+        << "\n    \"path\": " << quoteJson(options.snapshotPath)
+        << ",\n    \"runs\": [";
+
+    auto first = true;
+    for (auto size: sizes)
+    {
+        for (auto s = 0;
+            s < static_cast<int>(LatticeSpringStorage::LatticeSpringStorageCount);
+            ++s)
+        {
+            const auto storage = LatticeSpringStorage(s);
+            if (storage == LatticeSpringStorage::Explicit
+                && size > cMaxExplicitLatticeSize)
+            {
+                continue;
+            }
+
+            ParticleSystem source;
+            buildLatticeInPlace(source, size, storage);
+            source.applyRandomDisturbance();
+
+            auto saved = true;
+            const auto saveSeconds = measureBestSeconds(
+                options.repetitions,
+                [&]() {
+                    saved = source.saveSnapshot(options.snapshotPath) && saved;
+                }
+            );
+
+            std::uint64_t bytes = 0;
+            ParticleSnapshot snapshot;
+            const auto openSeconds = measureBestSeconds(
+                options.repetitions,
+                [&]() {
+                    if (snapshot.open(options.snapshotPath))
+                    {
+                        bytes = snapshot.getHeader().fileSize;
+                    }
+                }
+            );
+
+            snapshot.close();
+
+            ParticleSystem target;
+            auto loaded = true;
+            const auto loadSeconds = measureBestSeconds(
+                options.repetitions,
+                [&]() {
+                    loaded = target.loadSnapshot(options.snapshotPath)
+                        && loaded;
+                }
+            );
+
+            StateVector<double> copy;
+            const auto copySeconds = measureBestSeconds(
+                options.repetitions,
+                [&]() { copy = source.getPhysicsState(); }
+            );
+
+            const auto identical = saved
+                && loaded
+                && target.getPhysicsState() == source.getPhysicsState();
+
+            std::cout << (first ? "" : ",") << "\n      {"
+                << "\"latticeSize\": " << size
+                << ", \"particles\": " << source.getParticleCount()
+                << ", \"springStorage\": \""
+                << getLatticeSpringStorageName(storage) << "\""
+                << ", \"bytes\": " << bytes
+                << ", \"saveSeconds\": " << saveSeconds
+                << ", \"openSeconds\": " << openSeconds
+                << ", \"loadSeconds\": " << loadSeconds
+                << ", \"stateCopySeconds\": " << copySeconds
+                << ", \"saveGBPerSecond\": "
+                << bytes / cBytesPerGigabyte / saveSeconds
+                << ", \"loadGBPerSecond\": "
+                << bytes / cBytesPerGigabyte / loadSeconds
+                << ", \"identical\": " << (identical ? "true" : "false")
+                << "}";
+
+            first = false;
+        }
+    }
+
+    std::remove(options.snapshotPath.c_str());
+    std::cout << "\n    ]\n  }";
+}
+
+/**
+ * Cost of recording every step of a disturbed lattice to a trajectory,
+ * against the same steps unrecorded, then how much of the file has to be
+ * decoded to reach frames in the middle of it. Positions are compared with
+ * the ones kept in memory while recording.
+ */
+void runRecordingBenchmark(const BenchmarkOptions& options)
+{
+    const auto size = options.recordingLatticeSize;
+    const auto steps = options.recordingSteps;
+
+    ParticleSystem reference;
+    buildLatticeInPlace(reference, size, LatticeSpringStorage::Explicit);
+    reference.setIntegrator(IntegratorType::RungeKutta4);
+    reference.setFixedTimestep(options.integratorStep, 1);
+
+    std::vector<double> initialState;
+    reference.applyRandomDisturbance();
+    reference.storePhysicsState(initialState);
+
+    std::vector<std::vector<double>> states(steps);
+    auto runSteps = [&](TrajectoryRecorder* recorder, bool keepStates) {
+        reference.applyPhysicsState(initialState);
+        return measureBestSeconds(1, [&]() {
+            for (auto step = 0; step < steps; ++step)
+            {
+                reference.update(options.integratorStep);
+                if (recorder != nullptr)
+                {
+                    recorder->record(reference, step * options.integratorStep);
+                }
+
+                if (keepStates)
+                {
+                    reference.storePhysicsState(states[step]);
+                }
+            }
+
+            if (recorder != nullptr)
+            {
+                recorder->close();
+            }
+        });
+    };
+
+    auto plainSeconds = 0.0;
+    auto recordedSeconds = 0.0;
+    for (auto repetition = 0; repetition < options.repetitions; ++repetition)
+    {
+        const auto plain = runSteps(nullptr, false);
+
+        TrajectoryRecorder recorder;
+        recorder.open(
+            options.trajectoryPath,
+            reference.getParticleCount(),
+            options.keyframeInterval
+        );
+
+        const auto recorded = runSteps(&recorder, false);
+        plainSeconds = repetition == 0 ? plain : std::min(plainSeconds, plain);
+        recordedSeconds = repetition == 0
+            ? recorded
+            : std::min(recordedSeconds, recorded);
+    }
+
+    // Once more, keeping the states to check the decoded positions.
+    TrajectoryRecorder recorder;
+    recorder.open(
+        options.trajectoryPath,
+        reference.getParticleCount(),
+        options.keyframeInterval
+    );
+    runSteps(&recorder, true);
+
+    TrajectoryReader reader;
+    reader.open(options.trajectoryPath);
+
+    std::ifstream file{
+        options.trajectoryPath,
+        std::ios::binary | std::ios::ate
+    };
+    const auto bytes = static_cast<double>(file.tellg());
+    const auto particles = reference.getParticleCount();
+
+    auto maxError = 0.0;
+    auto maxRelativeError = 0.0;
+    auto checkFrame = [&](TrajectoryFrame& frame) {
+        const auto& state = states[frame.index];
+        for (std::size_t i = 0; i < particles; ++i)
+        {
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                const auto error = std::abs(
+                    frame.positions[i][axis]
+                    - state[i * ParticleStateFieldCount + PositionX + axis]
+                );
+                const auto extent = frame.high[axis] - frame.low[axis];
+
+                maxError = std::max(maxError, error);
+                maxRelativeError = std::max(
+                    maxRelativeError,
+                    error / std::max(extent, 10e-9)
+                );
+            }
+        }
+    };
+
+    const auto decodeAllSeconds = measureBestSeconds(1, [&]() {
+        reader.readFrames(0, reader.getFrameCount(), checkFrame);
+    });
+
+    // The last frame before a keyframe needs the most deltas decoded.
+    const auto seekFrame = std::min<std::size_t>(
+        reader.getFrameCount() - 1,
+        options.keyframeInterval - 1
+    );
+
+    TrajectoryFrame frame;
+    const auto seekSeconds = measureBestSeconds(options.repetitions, [&]() {
+        reader.readFrame(seekFrame, frame);
+    });
+
+    reader.close();
+    std::remove(options.trajectoryPath.c_str());
+
+    const auto rawFrameBytes = 3.0 * sizeof(double) * particles;
+    std::cout << "  \"recording\": {"
+        << "\n    \"latticeSize\": " << size
+        << ",\n    \"particles\": " << particles
+        << ",\n    \"steps\": " << steps
+        << ",\n    \"keyframeInterval\": " << options.keyframeInterval
+        << ",\n    \"stepSeconds\": " << plainSeconds / steps
+        << ",\n    \"recordedStepSeconds\": " << recordedSeconds / steps
+        << ",\n    \"overhead\": " << recordedSeconds / plainSeconds - 1.0
+        << ",\n    \"bytesPerFrame\": " << bytes / steps
+        << ",\n    \"rawPositionBytesPerFrame\": " << rawFrameBytes
+        << ",\n    \"maxPositionError\": " << maxError
+        << ",\n    \"maxErrorPerExtent\": " << maxRelativeError
+        << ",\n    \"decodeAllSeconds\": " << decodeAllSeconds
+        << ",\n    \"seekFrame\": " << seekFrame
+        << ",\n    \"seekSeconds\": " << seekSeconds
+        << "\n  }";
+}
+
+/**
+ * Mesh deformation by lattices of growing size: the evaluation of the
+ * vertex shader, bases included, against LatticeDeformer with precomputed
+ * bases for every instruction set and thread count. Vertices are scattered
+ * through the lattice with random normals.
+ */
+void runDeformationBenchmark(const BenchmarkOptions& options)
+{
+    std::mt19937 generator{13};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+    std::uniform_real_distribution<float> disturbance{-0.05f, 0.05f};
+
+    const auto vertices = static_cast<std::size_t>(options.deformVertices);
+    std::vector<glm::vec3> restPositions(vertices);
+    std::vector<glm::vec3> restNormals(vertices);
+    for (std::size_t i = 0; i < vertices; ++i)
+    {
+        restPositions[i] = {unit(generator), unit(generator), unit(generator)};
+        restNormals[i] = glm::normalize(glm::vec3{
+            unit(generator) - 0.5f,
+            unit(generator) - 0.5f,
+            unit(generator) - 0.5f
+        });
+    }
+
+    std::cout << "  \"deformation\": [";
+
+    auto first = true;
+    for (auto size = 4; size <= options.deformMaxLatticeSize; size *= 2)
+    {
+        const glm::ivec3 latticeSize{size};
+        std::vector<glm::vec3> controlPoints;
+        for (auto z = 0; z < size; ++z)
+        {
+            for (auto y = 0; y < size; ++y)
+            {
+                for (auto x = 0; x < size; ++x)
+                {
+                    controlPoints.push_back(
+                        glm::vec3{
+                            static_cast<float>(x),
+                            static_cast<float>(y),
+                            static_cast<float>(z)
+                        } / static_cast<float>(size - 1)
+                        + glm::vec3{
+                            disturbance(generator),
+                            disturbance(generator),
+                            disturbance(generator)
+                        }
+                    );
+                }
+            }
+        }
+
+        std::vector<glm::vec3> expected(vertices);
+        auto shaderSeconds = measureBestSeconds(options.repetitions, [&]() {
+            for (std::size_t i = 0; i < vertices; ++i)
+            {
+                expected[i] = evaluateLatticeDistortion(
+                    controlPoints,
+                    latticeSize,
+                    restPositions[i]
+                );
+                evaluateLatticeDistortion(
+                    controlPoints,
+                    latticeSize,
+                    restPositions[i]
+                        + LatticeDeformer::cNormalOffset * restNormals[i]
+                );
+            }
+        });
+
+        LatticeDeformer deformer;
+        auto restShapeSeconds = measureBestSeconds(1, [&]() {
+            deformer.setRestShape(restPositions, restNormals, latticeSize);
+        });
+
+        std::cout << (first ? "" : ",") << "\n    {"
+            << "\"latticeSize\": " << size
+            << ", \"vertices\": " << vertices
+            << ", \"shaderEvaluationSeconds\": " << shaderSeconds
+            << ", \"restShapeSeconds\": " << restShapeSeconds
+            << ", \"deformations\": [";
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        auto firstRun = true;
+        for (auto level = 0;
+            level <= static_cast<int>(detectSimdLevel());
+            ++level)
+        {
+            deformer.setSimdLevel(SimdLevel(level));
+            for (auto threads = 1; threads <= options.maxThreads; threads *= 2)
+            {
+                deformer.setThreadCount(threads);
+                auto seconds = measureBestSeconds(options.repetitions, [&]() {
+                    deformer.deform(controlPoints, positions, normals);
+                });
+
+                auto maxError = 0.0f;
+                for (std::size_t i = 0; i < vertices; ++i)
+                {
+                    maxError = std::max(
+                        maxError,
+                        glm::length(positions[i] - expected[i])
+                    );
+                }
+
+                std::cout << (firstRun ? "" : ",") << "\n      {"
+                    << "\"simd\": \""
+                    << getSimdLevelName(deformer.getSimdLevel()) << "\""
+                    << ", \"threads\": " << threads
+                    << ", \"seconds\": " << seconds
+                    << ", \"nsPerVertex\": " << 1e9 * seconds / vertices
+                    << ", \"speedup\": " << shaderSeconds / seconds
+                    << ", \"maxPositionError\": " << maxError
+                    << "}";
+
+                firstRun = false;
+            }
+        }
+
+        std::cout << "\n    ]}";
+        first = false;
+    }
+
+    std::cout << "\n  ]";
+}
+
+/**
+ * Conversion of the interpolated positions into the float x, y, z, 1 layout
+ * of the GPU stream, against the per-particle glm::vec3 path it replaced.
+ * The systems stop halfway into a fixed step so both paths interpolate.
+ */
+template <typename TSystem>
+void runPositionUploadBenchmark(
+    const BenchmarkOptions& options,
+    const char* precision,
+    bool& first
+)
+{
+    for (auto size = options.minLatticeSize;
+        size <= options.uploadMaxLatticeSize;
+        size *= 2)
+    {
+        TSystem system;
+        buildLatticeInPlace(system, size, LatticeSpringStorage::Stencil);
+        system.setFixedTimestep(options.integratorStep, 2);
+        system.update(1.5 * options.integratorStep);
+
+        const auto particles = system.getParticleCount();
+        std::vector<glm::vec3> expected(particles);
+        auto perParticleSeconds = measureBestSeconds(
+            options.repetitions,
+            [&]() {
+                for (std::size_t i = 0; i < particles; ++i)
+                {
+                    expected[i] = system.getInterpolatedPosition(i);
+                }
+            }
+        );
+
+        std::cout << (first ? "" : ",") << "\n    {"
+            << "\"precision\": \"" << precision << "\""
+            << ", \"latticeSize\": " << size
+            << ", \"particles\": " << particles
+            << ", \"perParticleSeconds\": " << perParticleSeconds
+            << ", \"conversions\": [";
+
+        std::vector<float> output(4 * particles);
+        for (auto level = 0;
+            level <= static_cast<int>(detectSimdLevel());
+            ++level)
+        {
+            system.setSimdLevel(SimdLevel(level));
+            auto seconds = measureBestSeconds(options.repetitions, [&]() {
+                system.getInterpolatedPositions(output.data());
+            });
+
+            auto maxError = 0.0f;
+            for (std::size_t i = 0; i < particles; ++i)
+            {
+                const glm::vec3 position{
+                    output[4 * i],
+                    output[4 * i + 1],
+                    output[4 * i + 2]
+                };
+                maxError = std::max(
+                    maxError,
+                    glm::length(position - expected[i])
+                );
+            }
+
+            std::cout << (level == 0 ? "" : ",") << "\n      {"
+                << "\"simd\": \""
+                << getSimdLevelName(SimdLevel(level)) << "\""
+                << ", \"seconds\": " << seconds
+                << ", \"nsPerParticle\": " << 1e9 * seconds / particles
+                << ", \"speedup\": " << perParticleSeconds / seconds
+                << ", \"maxPositionError\": " << maxError
+                << "}";
+        }
+
+        std::cout << "\n    ]}";
+        first = false;
+    }
+}
+
+void runPositionUploadBenchmark(const BenchmarkOptions& options)
+{
+    std::cout << "  \"positionUpload\": [";
+
+    auto first = true;
+    runPositionUploadBenchmark<ParticleSystem>(options, "double", first);
+    runPositionUploadBenchmark<FloatParticleSystem>(options, "float", first);
+
+    std::cout << "\n  ]";
+}
+
+/**
+ * One side of a lattice converted to Bezier patches by knot insertion, as
+ * every frame did before, and with the weights bezierPatch.vert applies.
+ */
+void runSurfaceConversionBenchmark(const BenchmarkOptions& options)
+{
+    std::mt19937 generator{17};
+    std::uniform_real_distribution<float> coordinate{-1.0f, 1.0f};
+
+    std::cout << "  \"surfaceConversion\": [";
+
+    auto first = true;
+    for (auto size = 4; size <= options.surfaceMaxLatticeSize; size *= 2)
+    {
+        std::vector<glm::vec3> latticePoints(size * size);
+        for (auto& point: latticePoints)
+        {
+            point = {
+                coordinate(generator),
+                coordinate(generator),
+                coordinate(generator)
+            };
+        }
+
+        auto bezierSizeU = 0;
+        auto bezierSizeV = 0;
+        std::vector<glm::vec3> expected;
+        auto insertionSeconds = measureBestSeconds(options.repetitions, [&]() {
+            expected = convertBSplineSurfaceToBezier(
+                latticePoints,
+                size,
+                size,
+                bezierSizeU,
+                bezierSizeV
+            );
+        });
+
+        auto weights = getBSplineToBezierWeights(size);
+        const auto bezier = static_cast<int>(weights.size());
+        std::vector<glm::vec3> rows(size * bezier);
+        std::vector<glm::vec3> points(bezier * bezier);
+        auto weightsSeconds = measureBestSeconds(options.repetitions, [&]() {
+            for (auto u = 0; u < size; ++u)
+            {
+                for (auto v = 0; v < bezier; ++v)
+                {
+                    glm::vec3 point{};
+                    for (auto k = 0; k < weights[v].count; ++k)
+                    {
+                        point += weights[v].weights[k]
+                            * latticePoints[u * size + weights[v].first + k];
+                    }
+
+                    rows[u * bezier + v] = point;
+                }
+            }
+
+            for (auto u = 0; u < bezier; ++u)
+            {
+                for (auto v = 0; v < bezier; ++v)
+                {
+                    glm::vec3 point{};
+                    for (auto k = 0; k < weights[u].count; ++k)
+                    {
+                        point += weights[u].weights[k]
+                            * rows[(weights[u].first + k) * bezier + v];
+                    }
+
+                    points[u * bezier + v] = point;
+                }
+            }
+        });
+
+        auto maxError = 0.0f;
+        for (std::size_t i = 0; i < points.size(); ++i)
+        {
+            maxError = std::max(maxError, glm::length(points[i] - expected[i]));
+        }
+
+        std::cout << (first ? "" : ",") << "\n    {"
+            << "\"latticeSize\": " << size
+            << ", \"patches\": " << (bezier / 3) * (bezier / 3)
+            << ", \"knotInsertionSeconds\": " << insertionSeconds
+            << ", \"weightsSeconds\": " << weightsSeconds
+            << ", \"speedup\": " << insertionSeconds / weightsSeconds
+            << ", \"maxPointError\": " << maxError
+            << "}";
+
+        first = false;
+    }
+
+    std::cout << "\n  ]";
+}
+
+BenchmarkOptions parseOptions(int argc, const char* argv[])
+{
+    BenchmarkOptions options;
+    for (auto i = 1; i + 1 < argc; i += 2)
+    {
+        auto value = std::atoi(argv[i + 1]);
+        if (!std::strcmp(argv[i], "--min-lattice"))
+        {
+            options.minLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--max-lattice"))
+        {
+            options.maxLatticeSize = value;
+        }
+        else if (!std::strcmp(argv[i], "--max-threads"))
+        {
+            options.maxThreads = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--repetitions"))
+        {
+            options.repetitions = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--integrator-step"))
+        {
+            options.integratorStep = std::min(std::atof(argv[i + 1]), 0.01);
+        }
+        else if (!std::strcmp(argv[i], "--absolute-tolerance"))
+        {
+            options.absoluteTolerance = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--relative-tolerance"))
+        {
+            options.relativeTolerance = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--spring-constant"))
+        {
+            options.springConstant = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--particle-mass"))
+        {
+            options.particleMass = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--simulated-seconds"))
+        {
+            options.simulatedSeconds = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--hot-path-min-lattice"))
+        {
+            options.hotPathMinLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--hot-path-max-lattice"))
+        {
+            options.hotPathMaxLatticeSize = value;
+        }
+        else if (!std::strcmp(argv[i], "--drop-lattice"))
+        {
+            options.dropLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--drop-speed"))
+        {
+            options.dropSpeed = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--precision-lattice"))
+        {
+            options.precisionLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--precision-seconds"))
+        {
+            options.precisionSimulatedSeconds = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--precision-checkpoints"))
+        {
+            options.precisionCheckpoints = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--collapse-lattice"))
+        {
+            options.collapseLatticeSize = value;
+        }
+        else if (!std::strcmp(argv[i], "--collapse-steps"))
+        {
+            options.collapseSteps = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--collapse-speed"))
+        {
+            options.collapseSpeed = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--contact-stiffness"))
+        {
+            options.contactStiffness = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--obstacle-lattice"))
+        {
+            options.obstacleLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--max-obstacles"))
+        {
+            options.maxObstacles = value;
+        }
+        else if (!std::strcmp(argv[i], "--sleep-bodies"))
+        {
+            options.sleepBodies = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--sleep-lattice"))
+        {
+            options.sleepLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--sleep-seconds"))
+        {
+            options.sleepSimulatedSeconds = std::atof(argv[i + 1]);
+        }
+        else if (!std::strcmp(argv[i], "--snapshot-lattice"))
+        {
+            options.snapshotLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--snapshot-path"))
+        {
+            options.snapshotPath = argv[i + 1];
+        }
+        else if (!std::strcmp(argv[i], "--recording-lattice"))
+        {
+            options.recordingLatticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(argv[i], "--recording-steps"))
+        {
+            options.recordingSteps = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--keyframe-interval"))
+        {
+            options.keyframeInterval = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--trajectory-path"))
+        {
+            options.trajectoryPath = argv[i + 1];
+        }
+        else if (!std::strcmp(argv[i], "--deform-vertices"))
+        {
+            options.deformVertices = std::max(value, 1);
+        }
+        else if (!std::strcmp(argv[i], "--deform-max-lattice"))
+        {
+            options.deformMaxLatticeSize = std::max(value, 4);
+        }
+        else if (!std::strcmp(argv[i], "--upload-max-lattice"))
+        {
+            options.uploadMaxLatticeSize = value;
+        }
+        else if (!std::strcmp(argv[i], "--surface-max-lattice"))
+        {
+            options.surfaceMaxLatticeSize = value;
+        }
+        else
+        {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+        }
+    }
+
+    return options;
+}
+
+}
+
+int main(int argc, const char* argv[])
+{
+    auto options = parseOptions(argc, argv);
+
+    std::cout << "{\n";
+    runForceScalingBenchmark(options);
+    std::cout << ",\n";
+    runIntegratorBenchmark(options);
+    std::cout << ",\n";
+    runCollisionBenchmark(options);
+    std::cout << ",\n";
+    runHotPathBenchmark(options);
+    std::cout << ",\n";
+    runPrecisionBenchmark(options);
+    std::cout << ",\n";
+    runSelfCollisionBenchmark(options);
+    std::cout << ",\n";
+    runObstacleBenchmark(options);
+    std::cout << ",\n";
+    runSleepingBenchmark(options);
+    std::cout << ",\n";
+    runSnapshotBenchmark(options);
+    std::cout << ",\n";
+    runRecordingBenchmark(options);
+    std::cout << ",\n";
+    runDeformationBenchmark(options);
+    std::cout << ",\n";
+    runPositionUploadBenchmark(options);
+    std::cout << ",\n";
+    runSurfaceConversionBenchmark(options);
+    std::cout << "\n}" << std::endl;
+
+    return EXIT_SUCCESS;
+}
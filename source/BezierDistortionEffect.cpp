@@ -8,13 +8,26 @@ namespace application
 
 BezierDistortionEffect::BezierDistortionEffect():
     _solidColor{1.0, 0.0, 0.0, 1.0},
-    _lightDirection{0.0, 1.0, 0.0}
+    _lightDirection{0.0, 1.0, 0.0},
+    _controlPointsTexture{},
+    _firstControlPoint{},
+    _latticeSize{}
 {
     createShaders();
 
     _controlPointsLocation = glGetUniformLocation(
         _shaderProgram->getId(),
-        "BezierCubeControlPoints"
+        "ControlPoints"
+    );
+
+    _firstControlPointLocation = glGetUniformLocation(
+        _shaderProgram->getId(),
+        "FirstControlPoint"
+    );
+
+    _latticeSizeLocation = glGetUniformLocation(
+        _shaderProgram->getId(),
+        "LatticeSize"
     );
 
     _lightDirectionLocation = glGetUniformLocation(
@@ -45,7 +58,11 @@ void BezierDistortionEffect::begin()
 {
     _shaderProgram->use();
 
-    glUniform3fv(_controlPointsLocation, 64, glm::value_ptr(_points[0]));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, _controlPointsTexture);
+    glUniform1i(_controlPointsLocation, 0);
+    glUniform1i(_firstControlPointLocation, _firstControlPoint);
+    glUniform3iv(_latticeSizeLocation, 1, glm::value_ptr(_latticeSize));
     glUniform3fv(_lightDirectionLocation, 1, glm::value_ptr(_lightDirection));
     glUniform3fv(_emissionColorLocation, 1, glm::value_ptr(_emissionColor));
     glUniform4fv(_solidColorLocation, 1, glm::value_ptr(_solidColor));
@@ -82,10 +99,13 @@ void BezierDistortionEffect::setSolidColor(glm::vec4 color)
 }
 
 void BezierDistortionEffect::setDistortionControlPoints(
-    const std::vector<glm::vec3>& points
+    const ControlPointStream& stream
 )
 {
-    _points = points;
+    // The texture views the whole stream, the region is picked by offset.
+    _controlPointsTexture = stream.getTexture();
+    _firstControlPoint = stream.getFirstPoint();
+    _latticeSize = stream.getLatticeSize();
 }
 
 void BezierDistortionEffect::createShaders()
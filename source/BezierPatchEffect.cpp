@@ -52,6 +52,7 @@ void BezierPatchEffect::initialize(string shaderName)
     _shaderProgram->use();
     glUniform1i(_uniforms.diffuseTexture, 0);
     glUniform1i(_uniforms.normalTexture, 1);
+    glUniform1i(_uniforms.controlPoints, 2);
 }
 
 void BezierPatchEffect::setProjectionMatrix(const glm::mat4 &projection)
@@ -135,6 +136,13 @@ void BezierPatchEffect::setNormalTexture(GLuint texture) {
   glBindTexture(GL_TEXTURE_2D, texture);
 }
 
+void BezierPatchEffect::setControlPoints(const ControlPointStream& stream) {
+  // The texture views the whole stream, the region is picked by offset.
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, stream.getTexture());
+  glUniform1i(_uniforms.firstControlPoint, stream.getFirstPoint());
+}
+
 void BezierPatchEffect::begin() {
   glUseProgram(_shaderProgram->getId());
 }
@@ -166,6 +174,10 @@ void BezierPatchEffect::getUniformLocations() {
     glGetUniformLocation(_shaderProgram->getId(), "diffuseTexture");
   _uniforms.normalTexture =
     glGetUniformLocation(_shaderProgram->getId(), "normalTexture");
+  _uniforms.controlPoints =
+    glGetUniformLocation(_shaderProgram->getId(), "controlPoints");
+  _uniforms.firstControlPoint =
+    glGetUniformLocation(_shaderProgram->getId(), "firstControlPoint");
 }
 
 }
@@ -0,0 +1,847 @@
+#include "Colliders.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "assimp/Importer.hpp"
+#include "assimp/postprocess.h"
+#include "assimp/scene.h"
+#include "easylogging++.h"
+
+namespace application
+{
+
+namespace
+{
+
+const double cMinimalNormalLength = 10e-12;
+
+glm::dvec3 getClosestPointOnTriangle(
+    const glm::dvec3& point,
+    const glm::dvec3& a,
+    const glm::dvec3& b,
+    const glm::dvec3& c
+)
+{
+    // Voronoi regions of the vertices, then the edges, then the face.
+    const auto ab = b - a;
+    const auto ac = c - a;
+    const auto ap = point - a;
+    const auto d1 = glm::dot(ab, ap);
+    const auto d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0)
+    {
+        return a;
+    }
+
+    const auto bp = point - b;
+    const auto d3 = glm::dot(ab, bp);
+    const auto d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3)
+    {
+        return b;
+    }
+
+    const auto vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    {
+        return a + (d1 / (d1 - d3)) * ab;
+    }
+
+    const auto cp = point - c;
+    const auto d5 = glm::dot(ab, cp);
+    const auto d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6)
+    {
+        return c;
+    }
+
+    const auto vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    {
+        return a + (d2 / (d2 - d6)) * ac;
+    }
+
+    const auto va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+    {
+        return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+    }
+
+    const auto denominator = 1.0 / (va + vb + vc);
+    return a + (vb * denominator) * ab + (vc * denominator) * ac;
+}
+
+/** Twice the signed area of the triangle pqr projected on the yz plane. */
+double getOrientationYZ(
+    double py,
+    double pz,
+    const glm::dvec3& q,
+    const glm::dvec3& r
+)
+{
+    return (q.y - py) * (r.z - pz) - (q.z - pz) * (r.y - py);
+}
+
+template <typename TPrecision>
+void evaluateSphere(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+)
+{
+    const auto centerX = static_cast<TPrecision>(collider.position.x);
+    const auto centerY = static_cast<TPrecision>(collider.position.y);
+    const auto centerZ = static_cast<TPrecision>(collider.position.z);
+    const auto radius = static_cast<TPrecision>(collider.radius);
+    const auto minimalLength = static_cast<TPrecision>(cMinimalNormalLength);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto relationX = position[0][i] - centerX;
+        const auto relationY = position[1][i] - centerY;
+        const auto relationZ = position[2][i] - centerZ;
+        const auto length = std::sqrt(
+            relationX * relationX
+            + relationY * relationY
+            + relationZ * relationZ
+        );
+
+        const auto inverseLength = 1 / std::max(length, minimalLength);
+        distance[i] = length - radius;
+        normal[0][i] = relationX * inverseLength;
+        normal[1][i] = relationY * inverseLength;
+        normal[2][i] = relationZ * inverseLength;
+    }
+}
+
+template <typename TPrecision>
+void evaluateCapsule(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+)
+{
+    const auto segment = collider.end - collider.position;
+    const auto squaredLength = glm::dot(segment, segment);
+    const auto inverseSquaredLength = static_cast<TPrecision>(
+        squaredLength > 0.0 ? 1.0 / squaredLength : 0.0
+    );
+
+    const auto startX = static_cast<TPrecision>(collider.position.x);
+    const auto startY = static_cast<TPrecision>(collider.position.y);
+    const auto startZ = static_cast<TPrecision>(collider.position.z);
+    const auto segmentX = static_cast<TPrecision>(segment.x);
+    const auto segmentY = static_cast<TPrecision>(segment.y);
+    const auto segmentZ = static_cast<TPrecision>(segment.z);
+    const auto radius = static_cast<TPrecision>(collider.radius);
+    const auto minimalLength = static_cast<TPrecision>(cMinimalNormalLength);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto offsetX = position[0][i] - startX;
+        const auto offsetY = position[1][i] - startY;
+        const auto offsetZ = position[2][i] - startZ;
+        const auto projection = std::min<TPrecision>(1, std::max<TPrecision>(
+            0,
+            (offsetX * segmentX + offsetY * segmentY + offsetZ * segmentZ)
+                * inverseSquaredLength
+        ));
+
+        const auto relationX = offsetX - projection * segmentX;
+        const auto relationY = offsetY - projection * segmentY;
+        const auto relationZ = offsetZ - projection * segmentZ;
+        const auto length = std::sqrt(
+            relationX * relationX
+            + relationY * relationY
+            + relationZ * relationZ
+        );
+
+        const auto inverseLength = 1 / std::max(length, minimalLength);
+        distance[i] = length - radius;
+        normal[0][i] = relationX * inverseLength;
+        normal[1][i] = relationY * inverseLength;
+        normal[2][i] = relationZ * inverseLength;
+    }
+}
+
+template <typename TPrecision>
+void evaluateOrientedBox(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+)
+{
+    TPrecision axes[3][3];
+    TPrecision halfExtents[3];
+    TPrecision center[3];
+    for (auto a = 0; a < 3; ++a)
+    {
+        for (auto c = 0; c < 3; ++c)
+        {
+            axes[a][c] = static_cast<TPrecision>(collider.axes[a][c]);
+        }
+
+        halfExtents[a] = static_cast<TPrecision>(collider.halfExtents[a]);
+        center[a] = static_cast<TPrecision>(collider.position[a]);
+    }
+
+    const auto minimalLength = static_cast<TPrecision>(cMinimalNormalLength);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto offsetX = position[0][i] - center[0];
+        const auto offsetY = position[1][i] - center[1];
+        const auto offsetZ = position[2][i] - center[2];
+
+        TPrecision local[3];
+        TPrecision excess[3];
+        TPrecision outside[3];
+        for (auto a = 0; a < 3; ++a)
+        {
+            local[a] = offsetX * axes[a][0]
+                + offsetY * axes[a][1]
+                + offsetZ * axes[a][2];
+            excess[a] = std::abs(local[a]) - halfExtents[a];
+            outside[a] = std::max<TPrecision>(excess[a], 0);
+        }
+
+        const auto outsideLength = std::sqrt(
+            outside[0] * outside[0]
+            + outside[1] * outside[1]
+            + outside[2] * outside[2]
+        );
+        const auto largestExcess = std::max(
+            excess[0],
+            std::max(excess[1], excess[2])
+        );
+        distance[i] = outsideLength + std::min<TPrecision>(largestExcess, 0);
+
+        // Outside the normal points away from the closest point, inside
+        // towards the closest face.
+        const auto inverseLength = 1 / std::max(outsideLength, minimalLength);
+        TPrecision localNormal[3];
+        for (auto a = 0; a < 3; ++a)
+        {
+            const auto magnitude = outsideLength > 0
+                ? outside[a] * inverseLength
+                : static_cast<TPrecision>(excess[a] == largestExcess);
+            localNormal[a] = std::copysign(magnitude, local[a]);
+        }
+
+        for (auto c = 0; c < 3; ++c)
+        {
+            normal[c][i] = localNormal[0] * axes[0][c]
+                + localNormal[1] * axes[1][c]
+                + localNormal[2] * axes[2][c];
+        }
+    }
+}
+
+template <typename TPrecision>
+void evaluatePlane(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+)
+{
+    const auto normalX = static_cast<TPrecision>(collider.normal.x);
+    const auto normalY = static_cast<TPrecision>(collider.normal.y);
+    const auto normalZ = static_cast<TPrecision>(collider.normal.z);
+    const auto offset = static_cast<TPrecision>(
+        glm::dot(collider.normal, collider.position)
+    );
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        distance[i] = position[0][i] * normalX
+            + position[1][i] * normalY
+            + position[2][i] * normalZ
+            - offset;
+        normal[0][i] = normalX;
+        normal[1][i] = normalY;
+        normal[2][i] = normalZ;
+    }
+}
+
+template <typename TPrecision>
+void evaluateVoxelGrid(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto offset = glm::dvec3{
+            position[0][i],
+            position[1][i],
+            position[2][i]
+        } - collider.position;
+
+        glm::dvec3 gradient;
+        distance[i] = static_cast<TPrecision>(collider.grid->sample(
+            {
+                glm::dot(offset, collider.axes[0]),
+                glm::dot(offset, collider.axes[1]),
+                glm::dot(offset, collider.axes[2])
+            },
+            gradient
+        ));
+
+        auto worldGradient = gradient.x * collider.axes[0]
+            + gradient.y * collider.axes[1]
+            + gradient.z * collider.axes[2];
+        worldGradient /= std::max(
+            glm::length(worldGradient),
+            cMinimalNormalLength
+        );
+
+        normal[0][i] = static_cast<TPrecision>(worldGradient.x);
+        normal[1][i] = static_cast<TPrecision>(worldGradient.y);
+        normal[2][i] = static_cast<TPrecision>(worldGradient.z);
+    }
+}
+
+}
+
+VoxelSdf::VoxelSdf():
+    _origin{},
+    _cellSize{1.0},
+    _size{}
+{
+}
+
+void VoxelSdf::build(
+    const std::vector<glm::dvec3>& vertices,
+    const std::vector<unsigned>& indices,
+    double cellSize,
+    int padding
+)
+{
+    _distance.clear();
+    if (vertices.empty() || indices.size() < 3)
+    {
+        _size = glm::ivec3{};
+        return;
+    }
+
+    auto low = vertices[0];
+    auto high = vertices[0];
+    for (const auto& vertex: vertices)
+    {
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            low[axis] = std::min(low[axis], vertex[axis]);
+            high[axis] = std::max(high[axis], vertex[axis]);
+        }
+    }
+
+    _cellSize = cellSize;
+    _origin = low - glm::dvec3{padding * cellSize};
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        _size[axis] = std::max(2, static_cast<int>(
+            std::ceil((high[axis] - low[axis]) / cellSize)
+        ) + 1 + 2 * padding);
+    }
+
+    const auto cellCount = static_cast<std::size_t>(_size.x)
+        * _size.y * _size.z;
+    const auto getIndex = [this](int i, int j, int k) {
+        return (static_cast<std::size_t>(k) * _size.y + j) * _size.x + i;
+    };
+    const auto getPoint = [this](int i, int j, int k) {
+        return _origin + _cellSize * glm::dvec3{
+            static_cast<double>(i),
+            static_cast<double>(j),
+            static_cast<double>(k)
+        };
+    };
+
+    const auto triangleCount = indices.size() / 3;
+    const auto getDistance = [&](std::size_t triangle, int i, int j, int k) {
+        const auto point = getPoint(i, j, k);
+        return glm::length(point - getClosestPointOnTriangle(
+            point,
+            vertices[indices[3 * triangle + 0]],
+            vertices[indices[3 * triangle + 1]],
+            vertices[indices[3 * triangle + 2]]
+        ));
+    };
+
+    const auto farAway = std::numeric_limits<double>::max();
+    std::vector<double> distance(cellCount, farAway);
+    std::vector<int> closest(cellCount, -1);
+    std::vector<int> crossings(cellCount, 0);
+
+    // The ray through each grid row is moved off the lattice a little, so it
+    // does not pass exactly through edges of axis-aligned meshes.
+    const auto rayOffsetY = 0.7071e-6 * cellSize;
+    const auto rayOffsetZ = 0.5773e-6 * cellSize;
+
+    for (std::size_t t = 0; t < triangleCount; ++t)
+    {
+        const auto& a = vertices[indices[3 * t + 0]];
+        const auto& b = vertices[indices[3 * t + 1]];
+        const auto& c = vertices[indices[3 * t + 2]];
+
+        glm::ivec3 first;
+        glm::ivec3 last;
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            auto lowest = std::min(a[axis], std::min(b[axis], c[axis]));
+            auto highest = std::max(a[axis], std::max(b[axis], c[axis]));
+            first[axis] = std::max(0, static_cast<int>(std::floor(
+                (lowest - _origin[axis]) / cellSize
+            )) - 1);
+            last[axis] = std::min(_size[axis] - 1, static_cast<int>(std::ceil(
+                (highest - _origin[axis]) / cellSize
+            )) + 1);
+        }
+
+        for (auto k = first.z; k <= last.z; ++k)
+        for (auto j = first.y; j <= last.y; ++j)
+        for (auto i = first.x; i <= last.x; ++i)
+        {
+            auto d = getDistance(t, i, j, k);
+            auto index = getIndex(i, j, k);
+            if (d < distance[index])
+            {
+                distance[index] = d;
+                closest[index] = static_cast<int>(t);
+            }
+        }
+
+        for (auto k = first.z; k <= last.z; ++k)
+        for (auto j = first.y; j <= last.y; ++j)
+        {
+            auto y = _origin.y + j * cellSize + rayOffsetY;
+            auto z = _origin.z + k * cellSize + rayOffsetZ;
+            auto weightA = getOrientationYZ(y, z, b, c);
+            auto weightB = getOrientationYZ(y, z, c, a);
+            auto weightC = getOrientationYZ(y, z, a, b);
+            bool inside = (weightA > 0.0 && weightB > 0.0 && weightC > 0.0)
+                || (weightA < 0.0 && weightB < 0.0 && weightC < 0.0);
+            if (!inside)
+            {
+                continue;
+            }
+
+            // Grid points at or past the crossing have passed the surface.
+            auto x = (weightA * a.x + weightB * b.x + weightC * c.x)
+                / (weightA + weightB + weightC);
+            auto i = std::max(0, static_cast<int>(std::ceil(
+                (x - _origin.x) / cellSize
+            )));
+            if (i < _size.x)
+            {
+                ++crossings[getIndex(i, j, k)];
+            }
+        }
+    }
+
+    // Two rounds of sweeps in all eight diagonal directions, offering each
+    // point the closest triangles of its already visited neighbours.
+    for (auto round = 0; round < 2; ++round)
+    for (auto direction = 0; direction < 8; ++direction)
+    {
+        const glm::ivec3 step{
+            (direction & 1) ? -1 : 1,
+            (direction & 2) ? -1 : 1,
+            (direction & 4) ? -1 : 1
+        };
+        const glm::ivec3 start{
+            step.x > 0 ? 0 : _size.x - 1,
+            step.y > 0 ? 0 : _size.y - 1,
+            step.z > 0 ? 0 : _size.z - 1
+        };
+
+        for (auto k = start.z; k >= 0 && k < _size.z; k += step.z)
+        for (auto j = start.y; j >= 0 && j < _size.y; j += step.y)
+        for (auto i = start.x; i >= 0 && i < _size.x; i += step.x)
+        {
+            auto index = getIndex(i, j, k);
+            for (auto neighbour = 1; neighbour < 8; ++neighbour)
+            {
+                auto ni = i - ((neighbour & 1) ? step.x : 0);
+                auto nj = j - ((neighbour & 2) ? step.y : 0);
+                auto nk = k - ((neighbour & 4) ? step.z : 0);
+                if (ni < 0 || ni >= _size.x
+                    || nj < 0 || nj >= _size.y
+                    || nk < 0 || nk >= _size.z)
+                {
+                    continue;
+                }
+
+                auto triangle = closest[getIndex(ni, nj, nk)];
+                if (triangle < 0 || triangle == closest[index])
+                {
+                    continue;
+                }
+
+                auto d = getDistance(triangle, i, j, k);
+                if (d < distance[index])
+                {
+                    distance[index] = d;
+                    closest[index] = triangle;
+                }
+            }
+        }
+    }
+
+    _distance.resize(cellCount);
+    for (auto k = 0; k < _size.z; ++k)
+    for (auto j = 0; j < _size.y; ++j)
+    {
+        auto crossed = 0;
+        for (auto i = 0; i < _size.x; ++i)
+        {
+            auto index = getIndex(i, j, k);
+            crossed += crossings[index];
+            _distance[index] = static_cast<float>(
+                (crossed % 2 == 1) ? -distance[index] : distance[index]
+            );
+        }
+    }
+}
+
+double VoxelSdf::sample(const glm::dvec3& point, glm::dvec3& gradient) const
+{
+    if (_distance.empty())
+    {
+        gradient = glm::dvec3{};
+        return std::numeric_limits<double>::max();
+    }
+
+    glm::ivec3 cell;
+    glm::dvec3 fraction;
+    glm::dvec3 outside;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto unclamped = (point[axis] - _origin[axis]) / _cellSize;
+        auto local = std::max(0.0, std::min(
+            static_cast<double>(_size[axis] - 1),
+            unclamped
+        ));
+
+        cell[axis] = std::min(_size[axis] - 2, static_cast<int>(local));
+        fraction[axis] = local - cell[axis];
+        outside[axis] = (unclamped - local) * _cellSize;
+    }
+
+    const auto c000 = at(cell.x, cell.y, cell.z);
+    const auto c100 = at(cell.x + 1, cell.y, cell.z);
+    const auto c010 = at(cell.x, cell.y + 1, cell.z);
+    const auto c110 = at(cell.x + 1, cell.y + 1, cell.z);
+    const auto c001 = at(cell.x, cell.y, cell.z + 1);
+    const auto c101 = at(cell.x + 1, cell.y, cell.z + 1);
+    const auto c011 = at(cell.x, cell.y + 1, cell.z + 1);
+    const auto c111 = at(cell.x + 1, cell.y + 1, cell.z + 1);
+
+    const auto fx = fraction.x;
+    const auto fy = fraction.y;
+    const auto fz = fraction.z;
+
+    const auto c00 = c000 + fx * (c100 - c000);
+    const auto c10 = c010 + fx * (c110 - c010);
+    const auto c01 = c001 + fx * (c101 - c001);
+    const auto c11 = c011 + fx * (c111 - c011);
+    const auto c0 = c00 + fy * (c10 - c00);
+    const auto c1 = c01 + fy * (c11 - c01);
+    auto distance = c0 + fz * (c1 - c0);
+
+    gradient = glm::dvec3{
+        (1 - fy) * (1 - fz) * (c100 - c000)
+            + fy * (1 - fz) * (c110 - c010)
+            + (1 - fy) * fz * (c101 - c001)
+            + fy * fz * (c111 - c011),
+        (1 - fz) * (c10 - c00) + fz * (c11 - c01),
+        c1 - c0
+    } / _cellSize;
+
+    const auto outsideLength = glm::length(outside);
+    if (outsideLength > 0.0)
+    {
+        distance += outsideLength;
+        gradient = outside;
+    }
+
+    return distance;
+}
+
+glm::dvec3 VoxelSdf::getHigh() const
+{
+    return _origin + _cellSize * glm::dvec3{
+        static_cast<double>(std::max(0, _size.x - 1)),
+        static_cast<double>(std::max(0, _size.y - 1)),
+        static_cast<double>(std::max(0, _size.z - 1))
+    };
+}
+
+bool loadVoxelSdf(
+    const std::string& path,
+    double scale,
+    double cellSize,
+    VoxelSdf& sdf
+)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(
+        path,
+        aiProcess_Triangulate | aiProcess_JoinIdenticalVertices
+    );
+
+    if (!scene
+        || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE
+        || !scene->mRootNode)
+    {
+        LOG(ERROR)
+            << "Assimp cannot load the scene. "
+            << importer.GetErrorString();
+        return false;
+    }
+
+    if (scene->mNumMeshes == 0)
+    {
+        LOG(ERROR) << "No meshes found in file.";
+        return false;
+    }
+
+    const aiMesh* mesh = scene->mMeshes[0];
+
+    std::vector<glm::dvec3> vertices;
+    std::vector<unsigned> indices;
+    vertices.reserve(mesh->mNumVertices);
+    for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+    {
+        vertices.push_back(scale * glm::dvec3{
+            mesh->mVertices[i].x,
+            mesh->mVertices[i].y,
+            mesh->mVertices[i].z
+        });
+    }
+
+    for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        if (face.mNumIndices != 3)
+        {
+            continue;
+        }
+
+        for (unsigned j = 0; j < face.mNumIndices; ++j)
+        {
+            indices.push_back(face.mIndices[j]);
+        }
+    }
+
+    sdf.build(vertices, indices, cellSize);
+    return !sdf.empty();
+}
+
+Collider::Collider():
+    shape{ColliderShape::Sphere},
+    position{},
+    end{},
+    axes{{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}},
+    halfExtents{},
+    normal{0.0, 1.0, 0.0},
+    radius{},
+    boundCenter{},
+    boundRadius{}
+{
+}
+
+Collider Collider::sphere(const glm::dvec3& center, double radius)
+{
+    Collider collider;
+    collider.shape = ColliderShape::Sphere;
+    collider.position = center;
+    collider.radius = radius;
+    collider.boundCenter = center;
+    collider.boundRadius = radius;
+    return collider;
+}
+
+Collider Collider::capsule(
+    const glm::dvec3& start,
+    const glm::dvec3& end,
+    double radius
+)
+{
+    Collider collider;
+    collider.shape = ColliderShape::Capsule;
+    collider.position = start;
+    collider.end = end;
+    collider.radius = radius;
+    collider.boundCenter = 0.5 * (start + end);
+    collider.boundRadius = 0.5 * glm::length(end - start) + radius;
+    return collider;
+}
+
+Collider Collider::orientedBox(
+    const glm::dvec3& center,
+    const glm::dvec3 axes[3],
+    const glm::dvec3& halfExtents
+)
+{
+    Collider collider;
+    collider.shape = ColliderShape::OrientedBox;
+    collider.position = center;
+    std::copy(axes, axes + 3, collider.axes);
+    collider.halfExtents = halfExtents;
+    collider.boundCenter = center;
+    collider.boundRadius = glm::length(halfExtents);
+    return collider;
+}
+
+Collider Collider::plane(const glm::dvec3& point, const glm::dvec3& normal)
+{
+    Collider collider;
+    collider.shape = ColliderShape::Plane;
+    collider.position = point;
+    collider.normal = glm::normalize(normal);
+    collider.boundCenter = point;
+    collider.boundRadius = std::numeric_limits<double>::infinity();
+    return collider;
+}
+
+Collider Collider::voxelGrid(
+    const std::shared_ptr<const VoxelSdf>& grid,
+    const glm::dvec3& position,
+    const glm::dvec3 axes[3]
+)
+{
+    Collider collider;
+    collider.shape = ColliderShape::VoxelGrid;
+    collider.position = position;
+    std::copy(axes, axes + 3, collider.axes);
+    collider.grid = grid;
+
+    const auto localCenter = 0.5 * (grid->getLow() + grid->getHigh());
+    collider.boundCenter = position
+        + localCenter.x * axes[0]
+        + localCenter.y * axes[1]
+        + localCenter.z * axes[2];
+    collider.boundRadius = 0.5 * glm::length(grid->getHigh() - grid->getLow());
+    return collider;
+}
+
+bool Collider::mayOverlap(
+    const glm::dvec3& low,
+    const glm::dvec3& high,
+    double margin
+) const
+{
+    if (shape == ColliderShape::Plane)
+    {
+        const auto center = 0.5 * (low + high);
+        const auto halfSize = 0.5 * (high - low);
+        const auto closest = glm::dot(normal, center - position)
+            - std::abs(normal.x) * halfSize.x
+            - std::abs(normal.y) * halfSize.y
+            - std::abs(normal.z) * halfSize.z;
+        return closest < margin;
+    }
+
+    double squaredDistance = 0.0;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        const auto outside = std::max(
+            low[axis] - boundCenter[axis],
+            boundCenter[axis] - high[axis]
+        );
+
+        if (outside > 0.0)
+        {
+            squaredDistance += outside * outside;
+        }
+    }
+
+    const auto reach = boundRadius + margin;
+    return squaredDistance < reach * reach;
+}
+
+bool operator==(const Collider& a, const Collider& b)
+{
+    return a.shape == b.shape
+        && a.position == b.position
+        && a.end == b.end
+        && a.axes[0] == b.axes[0]
+        && a.axes[1] == b.axes[1]
+        && a.axes[2] == b.axes[2]
+        && a.halfExtents == b.halfExtents
+        && a.normal == b.normal
+        && a.radius == b.radius
+        && a.grid == b.grid;
+}
+
+ColliderStatistics::ColliderStatistics():
+    candidateTests{},
+    evaluatedTests{},
+    contacts{}
+{
+}
+
+template <typename TPrecision>
+void evaluateCollider(
+    const Collider& collider,
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision* distance,
+    TPrecision* const normal[3]
+)
+{
+    switch (collider.shape)
+    {
+    case ColliderShape::Sphere:
+        evaluateSphere(collider, position, count, distance, normal);
+        break;
+    case ColliderShape::Capsule:
+        evaluateCapsule(collider, position, count, distance, normal);
+        break;
+    case ColliderShape::OrientedBox:
+        evaluateOrientedBox(collider, position, count, distance, normal);
+        break;
+    case ColliderShape::Plane:
+        evaluatePlane(collider, position, count, distance, normal);
+        break;
+    case ColliderShape::VoxelGrid:
+        evaluateVoxelGrid(collider, position, count, distance, normal);
+        break;
+    default:
+        std::fill(
+            distance,
+            distance + count,
+            std::numeric_limits<TPrecision>::max()
+        );
+        break;
+    }
+}
+
+template void evaluateCollider(
+    const Collider&,
+    const float* const[3],
+    std::size_t,
+    float*,
+    float* const[3]
+);
+
+template void evaluateCollider(
+    const Collider&,
+    const double* const[3],
+    std::size_t,
+    double*,
+    double* const[3]
+);
+
+}
@@ -15,6 +15,12 @@ ControlFrame::ControlFrame():
 {
 }
 
+void ControlFrame::setSpringParameters(float springConstant, float attenuation)
+{
+    _frameSpringConstant = springConstant;
+    _frameSpringAttenuation = attenuation;
+}
+
 void ControlFrame::updateUserInterface()
 {
     if (ImGui::CollapsingHeader("Control frame"))
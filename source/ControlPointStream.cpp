@@ -0,0 +1,197 @@
+#include "ControlPointStream.hpp"
+#include <algorithm>
+#include "easylogging++.h"
+#include "SoftBox.hpp"
+
+namespace application
+{
+
+namespace
+{
+
+const std::size_t cFloatsPerPoint = 4;
+
+/** Regions are rounded to whole 64-byte lines of points. */
+const std::size_t cRegionPointAlignment = 4;
+
+bool supportsBufferStorage()
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major > 4 || (major == 4 && minor >= 4);
+}
+
+}
+
+ControlPointStream::ControlPointStream():
+    _buffer{},
+    _texture{},
+    _mapping{nullptr},
+    _fences{},
+    _regionPoints{},
+    _pointCount{},
+    _latticeSize{},
+    _region{},
+    _stallCount{}
+{
+}
+
+ControlPointStream::~ControlPointStream()
+{
+}
+
+void ControlPointStream::destroy()
+{
+    release();
+}
+
+void ControlPointStream::update(const SoftBox& softBox)
+{
+    const auto points = softBox.getParticleCount();
+    if (points > _regionPoints || _buffer == 0)
+    {
+        allocate(points);
+    }
+
+    _region = (_region + 1) % cRegionCount;
+    _pointCount = points;
+    _latticeSize = softBox.getParticleMatrixSize();
+
+    const auto offset = cFloatsPerPoint * _region * _regionPoints;
+    if (_mapping != nullptr)
+    {
+        waitForRegion(_region);
+        softBox.getInterpolatedPositions(_mapping + offset);
+        return;
+    }
+
+    // Without persistent mapping the driver orders the upload after the
+    // draws still reading the region.
+    softBox.getInterpolatedPositions(_staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    glBufferSubData(
+        GL_ARRAY_BUFFER,
+        sizeof(float) * offset,
+        sizeof(float) * cFloatsPerPoint * points,
+        _staging.data()
+    );
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ControlPointStream::finishFrame()
+{
+    if (_mapping == nullptr)
+    {
+        return;
+    }
+
+    if (_fences[_region])
+    {
+        glDeleteSync(_fences[_region]);
+    }
+
+    _fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ControlPointStream::allocate(std::size_t points)
+{
+    release();
+
+    _regionPoints = std::max<std::size_t>(
+        (points + cRegionPointAlignment - 1)
+            / cRegionPointAlignment * cRegionPointAlignment,
+        cRegionPointAlignment
+    );
+
+    const auto bytes = static_cast<GLsizeiptr>(
+        sizeof(float) * cFloatsPerPoint * cRegionCount * _regionPoints
+    );
+
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+
+    if (supportsBufferStorage())
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT
+            | GL_MAP_PERSISTENT_BIT
+            | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+        _mapping = static_cast<float*>(
+            glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags)
+        );
+    }
+
+    if (_mapping == nullptr)
+    {
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        _staging.resize(cFloatsPerPoint * _regionPoints);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, _texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    LOG(DEBUG) << "Control point stream of " << cRegionCount << " x "
+        << _regionPoints << " points, "
+        << (_mapping != nullptr ? "persistently mapped" : "uploaded");
+}
+
+void ControlPointStream::release()
+{
+    for (auto region = 0; region < cRegionCount; ++region)
+    {
+        if (_fences[region])
+        {
+            glDeleteSync(_fences[region]);
+            _fences[region] = nullptr;
+        }
+    }
+
+    if (_mapping != nullptr)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _mapping = nullptr;
+    }
+
+    glDeleteTextures(1, &_texture);
+    glDeleteBuffers(1, &_buffer);
+    _texture = 0;
+    _buffer = 0;
+    _regionPoints = 0;
+    _region = 0;
+    _staging.clear();
+}
+
+void ControlPointStream::waitForRegion(int region)
+{
+    auto fence = _fences[region];
+    if (!fence)
+    {
+        return;
+    }
+
+    // The fence was set cRegionCount - 1 frames ago and is normally done.
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        ++_stallCount;
+        const GLuint64 cTimeoutNanoseconds = 1000000000;
+        glClientWaitSync(
+            fence,
+            GL_SYNC_FLUSH_COMMANDS_BIT,
+            cTimeoutNanoseconds
+        );
+    }
+
+    glDeleteSync(fence);
+    _fences[region] = nullptr;
+}
+
+}
@@ -0,0 +1,497 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include "BSplineLattice.hpp"
+#include "JsonString.hpp"
+#include "LatticeDeformer.hpp"
+#include "SoftBox.hpp"
+#include "Trajectory.hpp"
+
+namespace
+{
+
+using namespace application;
+
+struct HeadlessOptions
+{
+    HeadlessOptions():
+        latticeSize{4},
+        particleMass{0.015f},
+        springConstant{30.0f},
+        springAttenuation{1.0f},
+        frameSpringConstant{10.0f},
+        frameSpringAttenuation{0.0f},
+        step{0.001},
+        steps{1000},
+        threads{1},
+        integrator{IntegratorType::RungeKutta4},
+        stencil{false},
+        contactStiffness{},
+        sleeping{false},
+        keyframeInterval{60},
+        meshOffset{0.5f}
+    {
+    }
+
+    int latticeSize;
+
+    /** In the precision SoftBox applies them, so reported as applied. */
+    float particleMass;
+    float springConstant;
+    float springAttenuation;
+    float frameSpringConstant;
+    float frameSpringAttenuation;
+    double step;
+    int steps;
+    int threads;
+    IntegratorType integrator;
+    bool stencil;
+    float contactStiffness;
+    bool sleeping;
+
+    /** Snapshot to start from and to store the final state in, if given. */
+    std::string loadSnapshot;
+    std::string saveSnapshot;
+
+    /** Trajectory of every step, written if a path is given. */
+    std::string record;
+    int keyframeInterval;
+
+    /**
+     * Model deformed by the final lattice and the OBJ file it is written
+     * to, if given. The model is moved by meshOffset into the lattice, like
+     * by the model matrix of the application.
+     */
+    std::string deformMesh;
+    std::string exportMesh;
+    float meshOffset;
+};
+
+/** Text that is a whole number in the range of int. */
+bool parseInteger(const char* text, int& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    const auto parsed = std::strtol(text, &end, 10);
+    if (end == text
+        || *end != '\0'
+        || errno == ERANGE
+        || parsed < std::numeric_limits<int>::min()
+        || parsed > std::numeric_limits<int>::max())
+    {
+        return false;
+    }
+
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+/** Text that is a number finite in TReal. */
+template <typename TReal>
+bool parseReal(const char* text, TReal& value)
+{
+    char* end = nullptr;
+    errno = 0;
+    const auto parsed = static_cast<TReal>(std::strtod(text, &end));
+    if (end == text
+        || *end != '\0'
+        || errno == ERANGE
+        || !std::isfinite(parsed))
+    {
+        return false;
+    }
+
+    value = parsed;
+    return true;
+}
+
+/** Values of --integrator, in the order of IntegratorType. */
+const char* cIntegratorOptions[] = {
+    "symplectic-euler",
+    "velocity-verlet",
+    "midpoint",
+    "rk4",
+    "dormand-prince",
+    "backward-euler"
+};
+
+static_assert(
+    sizeof(cIntegratorOptions) / sizeof(cIntegratorOptions[0])
+        == static_cast<std::size_t>(IntegratorType::IntegratorTypeCount),
+    "Every integrator needs an option value"
+);
+
+bool parseIntegrator(const char* text, IntegratorType& type)
+{
+    const auto count = static_cast<int>(IntegratorType::IntegratorTypeCount);
+    for (auto i = 0; i < count; ++i)
+    {
+        if (!std::strcmp(text, cIntegratorOptions[i]))
+        {
+            type = IntegratorType(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void printUsage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [--option value]...\n"
+        << "  --lattice n                   particles along each edge\n"
+        << "  --particle-mass m             kg\n"
+        << "  --spring-constant k\n"
+        << "  --spring-attenuation c\n"
+        << "  --frame-spring-constant k\n"
+        << "  --frame-spring-attenuation c\n"
+        << "  --dt seconds                  length of every step\n"
+        << "  --steps n\n"
+        << "  --threads n\n"
+        << "  --integrator name             symplectic-euler,\n"
+        << "                                velocity-verlet, midpoint, rk4,\n"
+        << "                                dormand-prince, backward-euler\n"
+        << "  --stencil 0|1                 matrix-free lattice springs\n"
+        << "  --contact-stiffness k         self collision if positive\n"
+        << "  --sleep 0|1\n"
+        << "  --load-snapshot path\n"
+        << "  --save-snapshot path\n"
+        << "  --record path                 trajectory of every step\n"
+        << "  --keyframe-interval n\n"
+        << "  --deform-mesh path\n"
+        << "  --export-mesh path            OBJ of the deformed mesh\n"
+        << "  --mesh-offset d" << std::endl;
+}
+
+/** False on unknown options and on missing or malformed values. */
+bool parseOptions(int argc, const char* argv[], HeadlessOptions& options)
+{
+    for (auto i = 1; i < argc; i += 2)
+    {
+        const auto name = argv[i];
+        if (i + 1 == argc)
+        {
+            std::cerr << "Option " << name << " has no value" << std::endl;
+            return false;
+        }
+
+        const auto text = argv[i + 1];
+        auto parsed = true;
+        auto value = 0;
+        if (!std::strcmp(name, "--lattice"))
+        {
+            parsed = parseInteger(text, value);
+            options.latticeSize = std::max(value, 2);
+        }
+        else if (!std::strcmp(name, "--particle-mass"))
+        {
+            parsed = parseReal(text, options.particleMass);
+        }
+        else if (!std::strcmp(name, "--spring-constant"))
+        {
+            parsed = parseReal(text, options.springConstant);
+        }
+        else if (!std::strcmp(name, "--spring-attenuation"))
+        {
+            parsed = parseReal(text, options.springAttenuation);
+        }
+        else if (!std::strcmp(name, "--frame-spring-constant"))
+        {
+            parsed = parseReal(text, options.frameSpringConstant);
+        }
+        else if (!std::strcmp(name, "--frame-spring-attenuation"))
+        {
+            parsed = parseReal(text, options.frameSpringAttenuation);
+        }
+        else if (!std::strcmp(name, "--dt"))
+        {
+            parsed = parseReal(text, options.step);
+        }
+        else if (!std::strcmp(name, "--steps"))
+        {
+            parsed = parseInteger(text, value);
+            options.steps = std::max(value, 0);
+        }
+        else if (!std::strcmp(name, "--threads"))
+        {
+            parsed = parseInteger(text, value);
+            options.threads = std::max(value, 1);
+        }
+        else if (!std::strcmp(name, "--integrator"))
+        {
+            parsed = parseIntegrator(text, options.integrator);
+        }
+        else if (!std::strcmp(name, "--stencil"))
+        {
+            parsed = parseInteger(text, value);
+            options.stencil = value != 0;
+        }
+        else if (!std::strcmp(name, "--contact-stiffness"))
+        {
+            parsed = parseReal(text, options.contactStiffness);
+        }
+        else if (!std::strcmp(name, "--sleep"))
+        {
+            parsed = parseInteger(text, value);
+            options.sleeping = value != 0;
+        }
+        else if (!std::strcmp(name, "--load-snapshot"))
+        {
+            options.loadSnapshot = text;
+        }
+        else if (!std::strcmp(name, "--save-snapshot"))
+        {
+            options.saveSnapshot = text;
+        }
+        else if (!std::strcmp(name, "--record"))
+        {
+            options.record = text;
+        }
+        else if (!std::strcmp(name, "--keyframe-interval"))
+        {
+            parsed = parseInteger(text, value);
+            options.keyframeInterval = std::max(value, 1);
+        }
+        else if (!std::strcmp(name, "--deform-mesh"))
+        {
+            options.deformMesh = text;
+        }
+        else if (!std::strcmp(name, "--export-mesh"))
+        {
+            options.exportMesh = text;
+        }
+        else if (!std::strcmp(name, "--mesh-offset"))
+        {
+            parsed = parseReal(text, options.meshOffset);
+        }
+        else
+        {
+            std::cerr << "Unknown option " << name << std::endl;
+            return false;
+        }
+
+        if (!parsed)
+        {
+            std::cerr << "Invalid value " << text << " of " << name
+                << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+int main(int argc, const char* argv[])
+{
+    HeadlessOptions options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (options.step <= 0.0)
+    {
+        std::cerr << "The step has to be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    SoftBox softBox{glm::ivec3{options.latticeSize}};
+    softBox.setThreadCount(options.threads);
+    softBox.setLatticeSpringStorage(
+        options.stencil
+            ? LatticeSpringStorage::Stencil
+            : LatticeSpringStorage::Explicit
+    );
+    softBox.distributeUniformly({
+        {-1.0, -1.0, -1.0},
+        {+1.0, +1.0, +1.0}
+    });
+
+    // Every update call advances exactly one step of the requested length.
+    softBox.setParticleMass(options.particleMass);
+    softBox.setSpringParameters(
+        options.springConstant,
+        options.springAttenuation
+    );
+    softBox.setFrameSpringParameters(
+        options.frameSpringConstant,
+        options.frameSpringAttenuation
+    );
+    softBox.setFixedTimestep(options.step, 1);
+    softBox.setIntegrator(options.integrator);
+    softBox.setSelfCollision(
+        options.contactStiffness > 0.0f,
+        options.contactStiffness
+    );
+    softBox.setSleeping(options.sleeping);
+    softBox.applySettings();
+
+    // The snapshot replaces the state and the parameters set above.
+    if (!options.loadSnapshot.empty()
+        && !softBox.loadSnapshot(options.loadSnapshot))
+    {
+        std::cerr << "Cannot load " << options.loadSnapshot << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    TrajectoryRecorder recorder;
+    if (!options.record.empty()
+        && !recorder.open(
+            options.record,
+            softBox.getParticleCount(),
+            options.keyframeInterval
+        ))
+    {
+        std::cerr << "Cannot record " << options.record << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (auto i = 0; i < options.steps; ++i)
+    {
+        softBox.update(options.step);
+        if (recorder.isOpen())
+        {
+            softBox.recordTrajectory(recorder, (i + 1) * options.step);
+        }
+    }
+
+    auto seconds = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start
+    ).count();
+
+    auto recordedFrames = recorder.getFrameCount();
+    if (recorder.isOpen() && !recorder.close())
+    {
+        std::cerr << "Cannot write " << options.record << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!options.saveSnapshot.empty()
+        && !softBox.saveSnapshot(options.saveSnapshot))
+    {
+        std::cerr << "Cannot save " << options.saveSnapshot << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Deformed on the CPU and compared with the evaluation of the shader.
+    DeformableMesh mesh;
+    auto restShapeSeconds = 0.0;
+    auto deformSeconds = 0.0;
+    auto deformMaxError = 0.0f;
+    if (!options.deformMesh.empty())
+    {
+        if (!loadDeformableMesh(options.deformMesh, mesh))
+        {
+            std::cerr << "Cannot load " << options.deformMesh << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::vector<glm::vec3> restPositions;
+        restPositions.reserve(mesh.positions.size());
+        for (const auto& position: mesh.positions)
+        {
+            restPositions.push_back(position + glm::vec3{options.meshOffset});
+        }
+
+        LatticeDeformer deformer;
+        deformer.setThreadCount(options.threads);
+
+        std::vector<glm::vec3> controlPoints;
+        softBox.getInterpolatedPositions(controlPoints);
+
+        auto deformStart = std::chrono::high_resolution_clock::now();
+        deformer.setRestShape(
+            restPositions,
+            mesh.normals,
+            softBox.getParticleMatrixSize()
+        );
+
+        auto deformMiddle = std::chrono::high_resolution_clock::now();
+        deformer.deform(controlPoints, mesh.positions, mesh.normals);
+
+        auto deformEnd = std::chrono::high_resolution_clock::now();
+        restShapeSeconds = std::chrono::duration<double>(
+            deformMiddle - deformStart
+        ).count();
+        deformSeconds = std::chrono::duration<double>(
+            deformEnd - deformMiddle
+        ).count();
+
+        for (std::size_t i = 0; i < restPositions.size(); ++i)
+        {
+            auto expected = evaluateLatticeDistortion(
+                controlPoints,
+                softBox.getParticleMatrixSize(),
+                restPositions[i]
+            );
+
+            deformMaxError = std::max(
+                deformMaxError,
+                glm::length(mesh.positions[i] - expected)
+            );
+        }
+
+        if (!options.exportMesh.empty()
+            && !writeDeformableMeshObj(options.exportMesh, mesh))
+        {
+            std::cerr << "Cannot export " << options.exportMesh << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto& topology = softBox.getTopologyStatistics();
+    auto particles = softBox.getParticleCount();
+    auto stepsPerSecond = seconds > 0.0 ? options.steps / seconds : 0.0;
+
+    std::cout << "{"
+        << "\n  \"latticeSize\": " << options.latticeSize
+        << ",\n  \"particles\": " << particles
+        << ",\n  \"springStorage\": \""
+        << (options.stencil ? "Stencil" : "Explicit") << "\""
+        << ",\n  \"springs\": " << topology.springs
+        << ",\n  \"springsPerParticle\": " << topology.springsPerParticle
+        << ",\n  \"springBytes\": " << topology.springBytes
+        << ",\n  \"topologyBuildSeconds\": " << topology.buildSeconds
+        << ",\n  \"particleMass\": " << options.particleMass
+        << ",\n  \"springConstant\": " << options.springConstant
+        << ",\n  \"springAttenuation\": " << options.springAttenuation
+        << ",\n  \"frameSpringConstant\": " << options.frameSpringConstant
+        << ",\n  \"frameSpringAttenuation\": "
+        << options.frameSpringAttenuation
+        << ",\n  \"step\": " << options.step
+        << ",\n  \"steps\": " << options.steps
+        << ",\n  \"threads\": " << options.threads
+        << ",\n  \"integrator\": \""
+        << getIntegratorName(options.integrator) << "\""
+        << ",\n  \"contactStiffness\": " << options.contactStiffness
+        << ",\n  \"sleepingEnabled\": "
+        << (options.sleeping ? "true" : "false")
+        << ",\n  \"sleeping\": " << (softBox.isSleeping() ? "true" : "false")
+        << ",\n  \"loadedSnapshot\": " << quoteJson(options.loadSnapshot)
+        << ",\n  \"savedSnapshot\": " << quoteJson(options.saveSnapshot)
+        << ",\n  \"trajectory\": " << quoteJson(options.record)
+        << ",\n  \"recordedFrames\": " << recordedFrames
+        << ",\n  \"deformedMesh\": " << quoteJson(options.deformMesh)
+        << ",\n  \"deformedVertices\": " << mesh.positions.size()
+        << ",\n  \"restShapeSeconds\": " << restShapeSeconds
+        << ",\n  \"deformSeconds\": " << deformSeconds
+        << ",\n  \"deformMaxError\": " << deformMaxError
+        << ",\n  \"exportedMesh\": " << quoteJson(options.exportMesh)
+        << ",\n  \"wallSeconds\": " << seconds
+        << ",\n  \"simulatedSeconds\": " << options.steps * options.step
+        << ",\n  \"stepsPerSecond\": " << stepsPerSecond
+        << ",\n  \"particleUpdatesPerSecond\": " << stepsPerSecond * particles
+        << "\n}" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,527 @@
+#include "LatticeDeformer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include "assimp/Importer.hpp"
+#include "assimp/postprocess.h"
+#include "assimp/scene.h"
+#include "easylogging++.h"
+#include "BSplineLattice.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LATTICE_DEFORMER_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace application
+{
+
+namespace
+{
+
+const int cBasisSize = 4;
+const int cSampleBasis = 3 * cBasisSize;
+const int cGridPointFloats = 4;
+
+/** Arrays of a LatticeDeformer read by the kernels. */
+struct DeformerKernelData
+{
+    const int* firstPoint;
+    const float* basis;
+    const float* gridPoints;
+    int rowStride;
+    int sliceStride;
+};
+
+inline const float* getGridRow(
+    const DeformerKernelData& data,
+    std::size_t sample,
+    int y,
+    int z
+)
+{
+    return data.gridPoints + cGridPointFloats * (
+        data.firstPoint[sample] + y * data.rowStride + z * data.sliceStride
+    );
+}
+
+/** Position from the first sample, normal towards the second one. */
+inline void storeVertex(
+    const float position[3],
+    const float offsetPosition[3],
+    glm::vec3& outputPosition,
+    glm::vec3& outputNormal
+)
+{
+    glm::vec3 normal{
+        offsetPosition[0] - position[0],
+        offsetPosition[1] - position[1],
+        offsetPosition[2] - position[2]
+    };
+
+    const auto length = glm::length(normal);
+    outputPosition = glm::vec3{position[0], position[1], position[2]};
+    outputNormal = length > 0.0f ? normal / length : normal;
+}
+
+inline void evaluateSampleScalar(
+    const DeformerKernelData& data,
+    std::size_t sample,
+    float output[3]
+)
+{
+    const auto basisX = data.basis + cSampleBasis * sample;
+    const auto basisY = basisX + cBasisSize;
+    const auto basisZ = basisY + cBasisSize;
+
+    output[0] = output[1] = output[2] = 0.0f;
+    for (auto z = 0; z < cBasisSize; ++z)
+    {
+        for (auto y = 0; y < cBasisSize; ++y)
+        {
+            const auto row = getGridRow(data, sample, y, z);
+            const auto weight = basisY[y] * basisZ[z];
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                output[axis] += weight * (
+                    basisX[0] * row[axis]
+                    + basisX[1] * row[cGridPointFloats + axis]
+                    + basisX[2] * row[2 * cGridPointFloats + axis]
+                    + basisX[3] * row[3 * cGridPointFloats + axis]
+                );
+            }
+        }
+    }
+}
+
+void deformVerticesScalar(
+    const DeformerKernelData& data,
+    std::size_t begin,
+    std::size_t end,
+    glm::vec3* positions,
+    glm::vec3* normals
+)
+{
+    float position[3];
+    float offsetPosition[3];
+    for (auto i = begin; i < end; ++i)
+    {
+        evaluateSampleScalar(data, 2 * i, position);
+        evaluateSampleScalar(data, 2 * i + 1, offsetPosition);
+        storeVertex(position, offsetPosition, positions[i], normals[i]);
+    }
+}
+
+#ifdef LATTICE_DEFORMER_X86_DISPATCH
+
+/** Two grid points per register, four rows of x summed in one step. */
+__attribute__((target("avx2")))
+inline __m128 evaluateSampleAVX2(
+    const DeformerKernelData& data,
+    std::size_t sample
+)
+{
+    const auto basisX = data.basis + cSampleBasis * sample;
+    const auto basisY = basisX + cBasisSize;
+    const auto basisZ = basisY + cBasisSize;
+
+    const auto weights01 = _mm256_setr_ps(
+        basisX[0], basisX[0], basisX[0], basisX[0],
+        basisX[1], basisX[1], basisX[1], basisX[1]
+    );
+    const auto weights23 = _mm256_setr_ps(
+        basisX[2], basisX[2], basisX[2], basisX[2],
+        basisX[3], basisX[3], basisX[3], basisX[3]
+    );
+
+    auto sum = _mm256_setzero_ps();
+    for (auto z = 0; z < cBasisSize; ++z)
+    {
+        for (auto y = 0; y < cBasisSize; ++y)
+        {
+            const auto row = getGridRow(data, sample, y, z);
+            const auto rowSum = _mm256_add_ps(
+                _mm256_mul_ps(_mm256_loadu_ps(row), weights01),
+                _mm256_mul_ps(_mm256_loadu_ps(row + 8), weights23)
+            );
+
+            sum = _mm256_add_ps(
+                sum,
+                _mm256_mul_ps(rowSum, _mm256_set1_ps(basisY[y] * basisZ[z]))
+            );
+        }
+    }
+
+    return _mm_add_ps(
+        _mm256_castps256_ps128(sum),
+        _mm256_extractf128_ps(sum, 1)
+    );
+}
+
+__attribute__((target("avx2")))
+void deformVerticesAVX2(
+    const DeformerKernelData& data,
+    std::size_t begin,
+    std::size_t end,
+    glm::vec3* positions,
+    glm::vec3* normals
+)
+{
+    alignas(16) float position[4];
+    alignas(16) float offsetPosition[4];
+    for (auto i = begin; i < end; ++i)
+    {
+        _mm_store_ps(position, evaluateSampleAVX2(data, 2 * i));
+        _mm_store_ps(offsetPosition, evaluateSampleAVX2(data, 2 * i + 1));
+        storeVertex(position, offsetPosition, positions[i], normals[i]);
+    }
+}
+
+/** A whole row of four grid points per register. */
+__attribute__((target("avx512f")))
+inline __m128 evaluateSampleAVX512(
+    const DeformerKernelData& data,
+    std::size_t sample
+)
+{
+    const auto basisX = data.basis + cSampleBasis * sample;
+    const auto basisY = basisX + cBasisSize;
+    const auto basisZ = basisY + cBasisSize;
+
+    const auto weightsX = _mm512_setr_ps(
+        basisX[0], basisX[0], basisX[0], basisX[0],
+        basisX[1], basisX[1], basisX[1], basisX[1],
+        basisX[2], basisX[2], basisX[2], basisX[2],
+        basisX[3], basisX[3], basisX[3], basisX[3]
+    );
+
+    auto sum = _mm512_setzero_ps();
+    for (auto z = 0; z < cBasisSize; ++z)
+    {
+        for (auto y = 0; y < cBasisSize; ++y)
+        {
+            const auto row = getGridRow(data, sample, y, z);
+            sum = _mm512_fmadd_ps(
+                _mm512_loadu_ps(row),
+                _mm512_mul_ps(weightsX, _mm512_set1_ps(basisY[y] * basisZ[z])),
+                sum
+            );
+        }
+    }
+
+    return _mm_add_ps(
+        _mm_add_ps(
+            _mm512_extractf32x4_ps(sum, 0),
+            _mm512_extractf32x4_ps(sum, 1)
+        ),
+        _mm_add_ps(
+            _mm512_extractf32x4_ps(sum, 2),
+            _mm512_extractf32x4_ps(sum, 3)
+        )
+    );
+}
+
+__attribute__((target("avx512f")))
+void deformVerticesAVX512(
+    const DeformerKernelData& data,
+    std::size_t begin,
+    std::size_t end,
+    glm::vec3* positions,
+    glm::vec3* normals
+)
+{
+    alignas(16) float position[4];
+    alignas(16) float offsetPosition[4];
+    for (auto i = begin; i < end; ++i)
+    {
+        _mm_store_ps(position, evaluateSampleAVX512(data, 2 * i));
+        _mm_store_ps(offsetPosition, evaluateSampleAVX512(data, 2 * i + 1));
+        storeVertex(position, offsetPosition, positions[i], normals[i]);
+    }
+}
+
+#endif
+
+void deformVertices(
+    const DeformerKernelData& data,
+    std::size_t begin,
+    std::size_t end,
+    glm::vec3* positions,
+    glm::vec3* normals,
+    SimdLevel level
+)
+{
+#ifdef LATTICE_DEFORMER_X86_DISPATCH
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+        deformVerticesAVX512(data, begin, end, positions, normals);
+        return;
+    case SimdLevel::AVX2:
+        deformVerticesAVX2(data, begin, end, positions, normals);
+        return;
+    default:
+        break;
+    }
+#endif
+
+    deformVerticesScalar(data, begin, end, positions, normals);
+}
+
+}
+
+void DeformableMesh::clear()
+{
+    positions.clear();
+    normals.clear();
+    indices.clear();
+}
+
+bool loadDeformableMesh(const std::string& path, DeformableMesh& mesh)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(
+        path,
+        aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs
+    );
+
+    if (!scene
+        || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE
+        || !scene->mRootNode)
+    {
+        LOG(ERROR)
+            << "Assimp cannot load the scene. "
+            << importer.GetErrorString();
+        return false;
+    }
+
+    if (scene->mNumMeshes == 0)
+    {
+        LOG(ERROR) << "No meshes found in file.";
+        return false;
+    }
+
+    const aiMesh* source = scene->mMeshes[0];
+
+    mesh.clear();
+    mesh.positions.reserve(source->mNumVertices);
+    mesh.normals.reserve(source->mNumVertices);
+    for (unsigned i = 0; i < source->mNumVertices; ++i)
+    {
+        mesh.positions.emplace_back(
+            source->mVertices[i].x,
+            source->mVertices[i].y,
+            source->mVertices[i].z
+        );
+
+        mesh.normals.emplace_back(
+            source->mNormals[i].x,
+            source->mNormals[i].y,
+            source->mNormals[i].z
+        );
+    }
+
+    for (unsigned i = 0; i < source->mNumFaces; ++i)
+    {
+        const aiFace& face = source->mFaces[i];
+        for (unsigned j = 0; j < face.mNumIndices; ++j)
+        {
+            mesh.indices.push_back(face.mIndices[j]);
+        }
+    }
+
+    return true;
+}
+
+bool writeDeformableMeshObj(
+    const std::string& path,
+    const DeformableMesh& mesh
+)
+{
+    auto file = std::fopen(path.c_str(), "w");
+    if (!file)
+    {
+        LOG(ERROR) << "Cannot open " << path << " for writing.";
+        return false;
+    }
+
+    for (const auto& position: mesh.positions)
+    {
+        std::fprintf(
+            file,
+            "v %.9g %.9g %.9g\n",
+            position.x,
+            position.y,
+            position.z
+        );
+    }
+
+    for (const auto& normal: mesh.normals)
+    {
+        std::fprintf(file, "vn %.9g %.9g %.9g\n", normal.x, normal.y, normal.z);
+    }
+
+    // OBJ indices start at one; vertex and normal indices are the same.
+    for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        const auto a = mesh.indices[i] + 1;
+        const auto b = mesh.indices[i + 1] + 1;
+        const auto c = mesh.indices[i + 2] + 1;
+        std::fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+    }
+
+    if (std::fclose(file) != 0)
+    {
+        LOG(ERROR) << "Cannot write mesh " << path << ".";
+        return false;
+    }
+
+    return true;
+}
+
+const float LatticeDeformer::cNormalOffset = 0.05f;
+
+LatticeDeformer::LatticeDeformer():
+    _latticeSize{},
+    _gridSize{},
+    _simdLevel{detectSimdLevel()}
+{
+}
+
+void LatticeDeformer::setRestShape(
+    const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec3>& normals,
+    glm::ivec3 latticeSize
+)
+{
+    assert(positions.size() == normals.size());
+    assert(latticeSize.x > 0 && latticeSize.y > 0 && latticeSize.z > 0);
+
+    _latticeSize = latticeSize;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        _gridSize[axis] = std::max(latticeSize[axis], cBasisSize);
+    }
+
+    // Padding points carry zero weight and stay zero.
+    _gridPoints.assign(
+        cGridPointFloats * _gridSize.x * _gridSize.y * _gridSize.z,
+        0.0f
+    );
+
+    const auto samples = 2 * positions.size();
+    _firstPoint.resize(samples);
+    _basis.resize(cSampleBasis * samples);
+
+    _threadPool.parallelFor(
+        positions.size(),
+        [&](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i)
+            {
+                const glm::vec3 points[] = {
+                    positions[i],
+                    positions[i] + cNormalOffset * normals[i]
+                };
+
+                for (auto s = 0; s < 2; ++s)
+                {
+                    const auto sample = 2 * i + s;
+                    const auto basis = _basis.data() + cSampleBasis * sample;
+
+                    glm::ivec3 first;
+                    for (auto axis = 0; axis < 3; ++axis)
+                    {
+                        first[axis] = evaluateBSplineBasis(
+                            points[s][axis],
+                            latticeSize[axis],
+                            basis + cBasisSize * axis
+                        );
+                    }
+
+                    _firstPoint[sample] = first.x
+                        + _gridSize.x * (first.y + _gridSize.y * first.z);
+                }
+            }
+        }
+    );
+}
+
+void LatticeDeformer::deform(
+    const std::vector<glm::vec3>& controlPoints,
+    std::vector<glm::vec3>& positions,
+    std::vector<glm::vec3>& normals
+)
+{
+    gatherControlPoints(controlPoints);
+
+    const auto vertices = getVertexCount();
+    positions.resize(vertices);
+    normals.resize(vertices);
+
+    const DeformerKernelData data = {
+        _firstPoint.data(),
+        _basis.data(),
+        _gridPoints.data(),
+        _gridSize.x,
+        _gridSize.x * _gridSize.y
+    };
+
+    _threadPool.parallelFor(
+        vertices,
+        [&](std::size_t begin, std::size_t end) {
+            deformVertices(
+                data,
+                begin,
+                end,
+                positions.data(),
+                normals.data(),
+                _simdLevel
+            );
+        }
+    );
+}
+
+void LatticeDeformer::setThreadCount(int threadCount)
+{
+    _threadPool.setThreadCount(threadCount);
+}
+
+void LatticeDeformer::setSimdLevel(SimdLevel level)
+{
+    _simdLevel = std::min(level, detectSimdLevel());
+}
+
+void LatticeDeformer::gatherControlPoints(
+    const std::vector<glm::vec3>& controlPoints
+)
+{
+    assert(
+        controlPoints.size() == static_cast<std::size_t>(
+            _latticeSize.x * _latticeSize.y * _latticeSize.z
+        )
+    );
+
+    for (auto z = 0; z < _latticeSize.z; ++z)
+    {
+        for (auto y = 0; y < _latticeSize.y; ++y)
+        {
+            for (auto x = 0; x < _latticeSize.x; ++x)
+            {
+                const auto& point = controlPoints[
+                    x + _latticeSize.x * (y + _latticeSize.y * z)
+                ];
+                auto output = _gridPoints.data() + cGridPointFloats * (
+                    x + _gridSize.x * (y + _gridSize.y * z)
+                );
+
+                output[0] = point.x;
+                output[1] = point.y;
+                output[2] = point.z;
+                output[3] = 0.0f;
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,506 @@
+#include "LatticeTopology.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace application
+{
+
+namespace
+{
+
+const int cForwardNeighbours = LatticeStencil<double>::cForwardNeighbours;
+const double cMinimalSpringLength = 10e-4;
+
+/** Offsets (dx, dy, dz) of the neighbours following a particle. */
+const int cForwardOffsets[cForwardNeighbours][3] = {
+    {+1,  0,  0},
+    {-1, +1,  0}, { 0, +1,  0}, {+1, +1,  0},
+    {-1, -1, +1}, { 0, -1, +1}, {+1, -1, +1},
+    {-1,  0, +1}, { 0,  0, +1}, {+1,  0, +1},
+    {-1, +1, +1}, { 0, +1, +1}, {+1, +1, +1}
+};
+
+inline bool isInside(const glm::ivec3& size, int x, int y, int z)
+{
+    return x >= 0 && x < size.x
+        && y >= 0 && y < size.y
+        && z >= 0 && z < size.z;
+}
+
+std::size_t countSlabSprings(const glm::ivec3& size, int z)
+{
+    std::size_t count = 0;
+    for (auto y = 0; y < size.y; ++y)
+    for (auto x = 0; x < size.x; ++x)
+    for (const auto& offset: cForwardOffsets)
+    {
+        if (isInside(size, x + offset[0], y + offset[1], z + offset[2]))
+        {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Calls function(a, b, count, k) for every run of springs owned by plane z:
+ * particles a to a + count - 1 tied to the ones at b onwards, k being the
+ * neighbour offset. A run is one row swept over the x range where the
+ * neighbour exists, so both ends are contiguous and need no bounds checks.
+ */
+template <typename TPrecision, typename TFunction>
+inline void forEachStencilRun(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const TFunction& function
+)
+{
+    const auto& size = stencil.size;
+    for (auto y = 0; y < size.y; ++y)
+    {
+        const auto row = (z * size.y + y) * size.x;
+        for (auto k = 0; k < cForwardNeighbours; ++k)
+        {
+            const auto& offset = cForwardOffsets[k];
+            if (y + offset[1] < 0
+                || y + offset[1] >= size.y
+                || z + offset[2] >= size.z)
+            {
+                continue;
+            }
+
+            const auto delta =
+                (offset[2] * size.y + offset[1]) * size.x + offset[0];
+            const auto xBegin = std::max(0, -offset[0]);
+            const auto xEnd = std::min(size.x, size.x - offset[0]);
+            function(row + xBegin, row + xBegin + delta, xEnd - xBegin, k);
+        }
+    }
+}
+
+/** Block of a stencil spring, see SpringLinearization. */
+template <typename TPrecision>
+struct StencilSpringBlock
+{
+    TPrecision direction[3];
+    TPrecision geometric;
+    TPrecision along;
+};
+
+template <typename TPrecision>
+inline StencilSpringBlock<TPrecision> linearizeStencilSpring(
+    const LatticeStencil<TPrecision>& stencil,
+    int a,
+    int b,
+    int k,
+    const TPrecision* const position[3],
+    TPrecision step,
+    bool includeDamping
+)
+{
+    TPrecision relation[3];
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        relation[axis] = position[axis][b] - position[axis][a];
+    }
+
+    const auto length = std::sqrt(
+        relation[0] * relation[0]
+        + relation[1] * relation[1]
+        + relation[2] * relation[2]
+    );
+
+    StencilSpringBlock<TPrecision> block{{1, 0, 0}, 0, 0};
+    if (length > cMinimalSpringLength)
+    {
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            block.direction[axis] = relation[axis] / length;
+        }
+    }
+
+    const auto stiffness = step * step * stencil.stiffness;
+    const auto stretch = length > cMinimalSpringLength
+        ? 1 - stencil.restLength[k] / length
+        : TPrecision{0};
+
+    block.geometric = stiffness * std::max(stretch, TPrecision{0});
+    block.along = stiffness - block.geometric
+        + (includeDamping ? step * stencil.damping : TPrecision{0});
+
+    return block;
+}
+
+}
+
+template <typename TPrecision>
+LatticeStencil<TPrecision>::LatticeStencil():
+    size{0, 0, 0},
+    restLength{},
+    stiffness{},
+    damping{}
+{
+}
+
+template <typename TPrecision>
+std::size_t LatticeStencil<TPrecision>::springCount() const
+{
+    std::size_t count = 0;
+    for (auto z = 0; z < size.z; ++z)
+    {
+        count += countSlabSprings(size, z);
+    }
+
+    return count;
+}
+
+template <typename TPrecision>
+LatticeTopologyStatistics buildLatticeSprings(
+    const glm::ivec3& size,
+    const TPrecision* const position[3],
+    TPrecision springConstant,
+    TPrecision damping,
+    ThreadPool& threadPool,
+    SpringBatch<TPrecision>& springs
+)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::size_t> slabOffsets(size.z + 1, 0);
+    threadPool.parallelFor(
+        size.z,
+        [&](std::size_t begin, std::size_t end) {
+            for (auto z = begin; z < end; ++z)
+            {
+                slabOffsets[z + 1] =
+                    countSlabSprings(size, static_cast<int>(z));
+            }
+        }
+    );
+
+    slabOffsets[0] = springs.size();
+    for (auto z = 0; z < size.z; ++z)
+    {
+        slabOffsets[z + 1] += slabOffsets[z];
+    }
+
+    springs.resize(slabOffsets[size.z]);
+    threadPool.parallelFor(
+        size.z,
+        [&](std::size_t begin, std::size_t end) {
+            for (auto z = static_cast<int>(begin);
+                z < static_cast<int>(end);
+                ++z)
+            {
+                auto spring = slabOffsets[z];
+                for (auto y = 0; y < size.y; ++y)
+                for (auto x = 0; x < size.x; ++x)
+                {
+                    auto a = (z * size.y + y) * size.x + x;
+                    for (const auto& offset: cForwardOffsets)
+                    {
+                        auto nx = x + offset[0];
+                        auto ny = y + offset[1];
+                        auto nz = z + offset[2];
+                        if (!isInside(size, nx, ny, nz))
+                        {
+                            continue;
+                        }
+
+                        auto b = (nz * size.y + ny) * size.x + nx;
+                        auto dx = position[0][b] - position[0][a];
+                        auto dy = position[1][b] - position[1][a];
+                        auto dz = position[2][b] - position[2][a];
+
+                        springs.a[spring] = a;
+                        springs.b[spring] = b;
+                        springs.restLength[spring] =
+                            std::sqrt(dx * dx + dy * dy + dz * dz);
+                        springs.stiffness[spring] = springConstant;
+                        springs.damping[spring] = damping;
+                        ++spring;
+                    }
+                }
+            }
+        }
+    );
+
+    LatticeTopologyStatistics statistics;
+    statistics.particles = static_cast<std::size_t>(size.x) * size.y * size.z;
+    statistics.springs = slabOffsets[size.z] - slabOffsets[0];
+    statistics.springsPerParticle = statistics.particles > 0
+        ? static_cast<double>(statistics.springs) / statistics.particles
+        : 0.0;
+    statistics.springBytes = statistics.springs
+        * (2 * sizeof(int) + 3 * sizeof(TPrecision));
+    statistics.buildSeconds = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start
+    ).count();
+
+    return statistics;
+}
+
+template <typename TPrecision>
+LatticeTopologyStatistics buildLatticeStencil(
+    const glm::ivec3& size,
+    const TPrecision* const position[3],
+    TPrecision springConstant,
+    TPrecision damping,
+    LatticeStencil<TPrecision>& stencil
+)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Edge vectors from the first particle to its neighbours along x, y, z.
+    glm::dvec3 edge[3];
+    const int step[] = {1, size.x, size.x * size.y};
+    const int extent[] = {size.x, size.y, size.z};
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        if (extent[axis] > 1)
+        {
+            edge[axis] = {
+                position[0][step[axis]] - position[0][0],
+                position[1][step[axis]] - position[1][0],
+                position[2][step[axis]] - position[2][0]
+            };
+        }
+    }
+
+    stencil.size = size;
+    stencil.stiffness = springConstant;
+    stencil.damping = damping;
+    for (auto k = 0; k < cForwardNeighbours; ++k)
+    {
+        const auto& offset = cForwardOffsets[k];
+        stencil.restLength[k] = glm::length(
+            static_cast<double>(offset[0]) * edge[0]
+            + static_cast<double>(offset[1]) * edge[1]
+            + static_cast<double>(offset[2]) * edge[2]
+        );
+    }
+
+    LatticeTopologyStatistics statistics;
+    statistics.particles = static_cast<std::size_t>(size.x) * size.y * size.z;
+    statistics.springs = stencil.springCount();
+    statistics.springsPerParticle = statistics.particles > 0
+        ? static_cast<double>(statistics.springs) / statistics.particles
+        : 0.0;
+    statistics.springBytes = sizeof(LatticeStencil<TPrecision>);
+    statistics.buildSeconds = std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - start
+    ).count();
+
+    return statistics;
+}
+
+template <typename TPrecision>
+void accumulateLatticeStencilForces(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const SpringKernelFields<TPrecision>& fields
+)
+{
+    // Forces of a run are computed into a buffer first and then added to
+    // both ends in separate loops, which keeps every loop free of the
+    // dependence between neighbouring particles and lets it vectorize.
+    const int cChunk = 64;
+    TPrecision force[3][cChunk];
+
+    const auto stiffness = stencil.stiffness;
+    const auto damping = stencil.damping;
+
+    forEachStencilRun(stencil, z, [&](int a, int b, int count, int k) {
+        const auto restLength = stencil.restLength[k];
+        for (auto chunk = 0; chunk < count; chunk += cChunk)
+        {
+            const auto length = std::min(cChunk, count - chunk);
+            const auto first = a + chunk;
+            const auto second = b + chunk;
+
+            for (auto i = 0; i < length; ++i)
+            {
+                const auto relationX =
+                    fields.position[0][second + i] - fields.position[0][first + i];
+                const auto relationY =
+                    fields.position[1][second + i] - fields.position[1][first + i];
+                const auto relationZ =
+                    fields.position[2][second + i] - fields.position[2][first + i];
+                const auto springLength = std::sqrt(
+                    relationX * relationX
+                    + relationY * relationY
+                    + relationZ * relationZ
+                );
+
+                const auto valid = springLength > cMinimalSpringLength;
+                const auto invLength =
+                    valid ? 1 / springLength : TPrecision{0};
+                const auto directionX =
+                    valid ? relationX * invLength : TPrecision{1};
+                const auto directionY = relationY * invLength;
+                const auto directionZ = relationZ * invLength;
+
+                const auto approachSpeed =
+                    (fields.velocity[0][second + i]
+                        - fields.velocity[0][first + i]) * directionX
+                    + (fields.velocity[1][second + i]
+                        - fields.velocity[1][first + i]) * directionY
+                    + (fields.velocity[2][second + i]
+                        - fields.velocity[2][first + i]) * directionZ;
+
+                const auto magnitude =
+                    stiffness * (springLength - restLength)
+                    + damping * approachSpeed;
+
+                force[0][i] = magnitude * directionX;
+                force[1][i] = magnitude * directionY;
+                force[2][i] = magnitude * directionZ;
+            }
+
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                const auto output = fields.force[axis];
+                for (auto i = 0; i < length; ++i)
+                {
+                    output[first + i] += force[axis][i];
+                }
+
+                for (auto i = 0; i < length; ++i)
+                {
+                    output[second + i] -= force[axis][i];
+                }
+            }
+        }
+    });
+}
+
+template <typename TPrecision>
+void linearizeLatticeStencil(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const TPrecision* const position[3],
+    TPrecision step,
+    TPrecision* const diagonal[3]
+)
+{
+    forEachStencilRun(stencil, z, [&](int a, int b, int count, int k) {
+        for (auto i = 0; i < count; ++i)
+        {
+            const auto block = linearizeStencilSpring(
+                stencil,
+                a + i,
+                b + i,
+                k,
+                position,
+                step,
+                true
+            );
+
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                const auto direction = block.direction[axis];
+                const auto value = block.geometric
+                    + block.along * direction * direction;
+
+                diagonal[axis][a + i] += value;
+                diagonal[axis][b + i] += value;
+            }
+        }
+    });
+}
+
+template <typename TPrecision>
+void accumulateLatticeStencilJacobianProduct(
+    const LatticeStencil<TPrecision>& stencil,
+    int z,
+    const TPrecision* const position[3],
+    TPrecision step,
+    const TPrecision* const input[3],
+    TPrecision* const output[3],
+    bool includeDamping
+)
+{
+    forEachStencilRun(stencil, z, [&](int a, int b, int count, int k) {
+        for (auto i = 0; i < count; ++i)
+        {
+            const auto block = linearizeStencilSpring(
+                stencil,
+                a + i,
+                b + i,
+                k,
+                position,
+                step,
+                includeDamping
+            );
+
+            TPrecision relative[3];
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                relative[axis] = input[axis][a + i] - input[axis][b + i];
+            }
+
+            const auto projection = block.along * (
+                block.direction[0] * relative[0]
+                + block.direction[1] * relative[1]
+                + block.direction[2] * relative[2]
+            );
+
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                const auto product = block.geometric * relative[axis]
+                    + projection * block.direction[axis];
+
+                output[axis][a + i] += product;
+                output[axis][b + i] -= product;
+            }
+        }
+    });
+}
+
+#define INSTANTIATE_LATTICE_TOPOLOGY(TPrecision) \
+    template struct LatticeStencil<TPrecision>; \
+    template LatticeTopologyStatistics buildLatticeSprings( \
+        const glm::ivec3&, \
+        const TPrecision* const[3], \
+        TPrecision, \
+        TPrecision, \
+        ThreadPool&, \
+        SpringBatch<TPrecision>& \
+    ); \
+    template LatticeTopologyStatistics buildLatticeStencil( \
+        const glm::ivec3&, \
+        const TPrecision* const[3], \
+        TPrecision, \
+        TPrecision, \
+        LatticeStencil<TPrecision>& \
+    ); \
+    template void accumulateLatticeStencilForces( \
+        const LatticeStencil<TPrecision>&, \
+        int, \
+        const SpringKernelFields<TPrecision>& \
+    ); \
+    template void linearizeLatticeStencil( \
+        const LatticeStencil<TPrecision>&, \
+        int, \
+        const TPrecision* const[3], \
+        TPrecision, \
+        TPrecision* const[3] \
+    ); \
+    template void accumulateLatticeStencilJacobianProduct( \
+        const LatticeStencil<TPrecision>&, \
+        int, \
+        const TPrecision* const[3], \
+        TPrecision, \
+        const TPrecision* const[3], \
+        TPrecision* const[3], \
+        bool \
+    );
+
+INSTANTIATE_LATTICE_TOPOLOGY(float)
+INSTANTIATE_LATTICE_TOPOLOGY(double)
+
+#undef INSTANTIATE_LATTICE_TOPOLOGY
+
+}
@@ -4,14 +4,28 @@
 namespace application
 {
 
-const int LineSetPreview::cMaxVertices = 4*4*4+10;
-const int LineSetPreview::cMaxIndices = 24*2*3*3*3+10;
+namespace
+{
+
+/** Attributes of fw::VertexColor. */
+const GLuint cPositionAttribute = 0;
+const GLuint cColorAttribute = 1;
+
+}
+
+const std::size_t LineSetPreview::cInitialVertices = 4*4*4+10;
+const std::size_t LineSetPreview::cInitialIndices = 24*2*3*3*3+10;
 
 LineSetPreview::LineSetPreview():
     _vao{},
     _vbo{},
     _ebo{},
-    _numElements{}
+    _numElements{},
+    _positionsStreamed{false},
+    _baseVertex{},
+    _streamColor{},
+    _vertexCapacity{cInitialVertices},
+    _indexCapacity{cInitialIndices}
 {
     createBuffers();
 }
@@ -27,37 +41,109 @@ void LineSetPreview::destroy()
 void LineSetPreview::render() const
 {
     glBindVertexArray(_vao);
-    glDrawElements(GL_LINES, _numElements, GL_UNSIGNED_INT, 0);
+    if (_positionsStreamed)
+    {
+        glVertexAttrib3f(
+            cColorAttribute,
+            _streamColor.x,
+            _streamColor.y,
+            _streamColor.z
+        );
+    }
+
+    glDrawElementsBaseVertex(
+        GL_LINES,
+        _numElements,
+        GL_UNSIGNED_INT,
+        nullptr,
+        _baseVertex
+    );
     glBindVertexArray(0);
 }
 
 void LineSetPreview::setVertices(const std::vector<fw::VertexColor>& vertices)
 {
+    _positionsStreamed = false;
+    _baseVertex = 0;
+
     glBindVertexArray(_vao);
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
 
-    glBufferSubData(
-        GL_ARRAY_BUFFER,
-        0,
-        sizeof(fw::VertexColor) * vertices.size(),
-        vertices.data()
-    );
+    // Buffers grow to the largest lattice seen so far.
+    if (vertices.size() > _vertexCapacity)
+    {
+        _vertexCapacity = vertices.size();
+        glBufferData(
+            GL_ARRAY_BUFFER,
+            sizeof(fw::VertexColor) * _vertexCapacity,
+            vertices.data(),
+            GL_DYNAMIC_DRAW
+        );
+    }
+    else
+    {
+        glBufferSubData(
+            GL_ARRAY_BUFFER,
+            0,
+            sizeof(fw::VertexColor) * vertices.size(),
+            vertices.data()
+        );
+    }
 
     fw::VertexColor::setupAttribPointers();
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 }
 
+void LineSetPreview::setPositionStream(
+    const ControlPointStream& stream,
+    glm::vec3 color
+)
+{
+    // Points of the stream are four floats, the fourth is skipped. The
+    // buffer is attached again as the stream replaces it when it grows.
+    _positionsStreamed = true;
+    _baseVertex = stream.getFirstPoint();
+    _streamColor = color;
+
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+    glVertexAttribPointer(
+        cPositionAttribute,
+        3,
+        GL_FLOAT,
+        GL_FALSE,
+        4 * sizeof(GLfloat),
+        nullptr
+    );
+    glDisableVertexAttribArray(cColorAttribute);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
 void LineSetPreview::setIndices(const std::vector<GLuint>& indices)
 {
     glBindVertexArray(_vao);
 
-    glBufferSubData(
-        GL_ELEMENT_ARRAY_BUFFER,
-        0,
-        sizeof(GLuint) * indices.size(),
-        indices.data()
-    );
+    if (indices.size() > _indexCapacity)
+    {
+        _indexCapacity = indices.size();
+        glBufferData(
+            GL_ELEMENT_ARRAY_BUFFER,
+            sizeof(GLuint) * _indexCapacity,
+            indices.data(),
+            GL_STATIC_DRAW
+        );
+    }
+    else
+    {
+        glBufferSubData(
+            GL_ELEMENT_ARRAY_BUFFER,
+            0,
+            sizeof(GLuint) * indices.size(),
+            indices.data()
+        );
+    }
 
     glBindVertexArray(0);
 
@@ -74,7 +160,7 @@ void LineSetPreview::createBuffers()
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(
         GL_ARRAY_BUFFER,
-        sizeof(fw::VertexColor) * cMaxVertices,
+        sizeof(fw::VertexColor) * _vertexCapacity,
         nullptr,
         GL_DYNAMIC_DRAW
     );
@@ -85,7 +171,7 @@ void LineSetPreview::createBuffers()
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
     glBufferData(
         GL_ELEMENT_ARRAY_BUFFER,
-        sizeof(GLuint) * cMaxIndices,
+        sizeof(GLuint) * _indexCapacity,
         nullptr,
         GL_STATIC_DRAW
     );
@@ -0,0 +1,151 @@
+#include "MarkerSetPreview.hpp"
+#include <vector>
+#include "easylogging++.h"
+
+namespace application
+{
+
+namespace
+{
+
+/** Inputs of ParticleMarker.vert. */
+const GLuint cPositionAttribute = 0;
+const GLuint cNormalAttribute = 1;
+const GLuint cInstancePositionAttribute = 2;
+
+/** Position and normal of each vertex, two triangles per face. */
+std::vector<glm::vec3> createUnitBox()
+{
+    std::vector<glm::vec3> vertices;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        for (auto sign = -1; sign <= 1; sign += 2)
+        {
+            glm::vec3 normal{};
+            normal[axis] = static_cast<float>(sign);
+
+            // Counter-clockwise seen from outside the box.
+            glm::vec3 tangent{};
+            glm::vec3 bitangent{};
+            tangent[(axis + (sign > 0 ? 1 : 2)) % 3] = 0.5f;
+            bitangent[(axis + (sign > 0 ? 2 : 1)) % 3] = 0.5f;
+
+            const auto center = 0.5f * normal;
+            const glm::vec3 corners[] = {
+                center - tangent - bitangent,
+                center + tangent - bitangent,
+                center + tangent + bitangent,
+                center - tangent + bitangent
+            };
+
+            for (auto corner: {0, 1, 2, 0, 2, 3})
+            {
+                vertices.push_back(corners[corner]);
+                vertices.push_back(normal);
+            }
+        }
+    }
+
+    return vertices;
+}
+
+}
+
+MarkerSetPreview::MarkerSetPreview():
+    _vao{},
+    _vbo{},
+    _vertexCount{},
+    _instanceCount{}
+{
+    createBuffers();
+}
+
+MarkerSetPreview::~MarkerSetPreview()
+{
+}
+
+void MarkerSetPreview::destroy()
+{
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+    _vao = 0;
+    _vbo = 0;
+}
+
+void MarkerSetPreview::render() const
+{
+    glBindVertexArray(_vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, _vertexCount, _instanceCount);
+    glBindVertexArray(0);
+}
+
+void MarkerSetPreview::setPositionStream(const ControlPointStream& stream)
+{
+    // Instanced attributes have no base vertex before OpenGL 4.2, so the
+    // current region is selected through the attribute offset.
+    const auto offset = sizeof(GLfloat) * 4 * stream.getFirstPoint();
+    _instanceCount = static_cast<GLsizei>(stream.getPointCount());
+
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+    glVertexAttribPointer(
+        cInstancePositionAttribute,
+        3,
+        GL_FLOAT,
+        GL_FALSE,
+        4 * sizeof(GLfloat),
+        reinterpret_cast<const void*>(offset)
+    );
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void MarkerSetPreview::createBuffers()
+{
+    auto vertices = createUnitBox();
+    _vertexCount = static_cast<GLsizei>(vertices.size() / 2);
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(
+        GL_ARRAY_BUFFER,
+        sizeof(glm::vec3) * vertices.size(),
+        vertices.data(),
+        GL_STATIC_DRAW
+    );
+
+    glEnableVertexAttribArray(cPositionAttribute);
+    glVertexAttribPointer(
+        cPositionAttribute,
+        3,
+        GL_FLOAT,
+        GL_FALSE,
+        2 * sizeof(glm::vec3),
+        nullptr
+    );
+
+    glEnableVertexAttribArray(cNormalAttribute);
+    glVertexAttribPointer(
+        cNormalAttribute,
+        3,
+        GL_FLOAT,
+        GL_FALSE,
+        2 * sizeof(glm::vec3),
+        reinterpret_cast<const void*>(sizeof(glm::vec3))
+    );
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glEnableVertexAttribArray(cInstancePositionAttribute);
+    glVertexAttribDivisor(cInstancePositionAttribute, 1);
+
+    glBindVertexArray(0);
+
+    LOG(DEBUG) << "Created marker buffers: vao=" << _vao
+        << " containing " << _vertexCount << " vertices.";
+}
+
+}
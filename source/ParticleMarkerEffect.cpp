@@ -0,0 +1,97 @@
+#include "ParticleMarkerEffect.hpp"
+#include <string>
+#include <glm/gtc/type_ptr.hpp>
+#include "Config.hpp"
+
+namespace application
+{
+
+ParticleMarkerEffect::ParticleMarkerEffect():
+    _emissionColor{},
+    _solidColor{1.0, 0.0, 0.0, 1.0},
+    _lightDirection{0.0, 1.0, 0.0}
+{
+    createShaders();
+
+    _lightDirectionLocation = glGetUniformLocation(
+        _shaderProgram->getId(),
+        "LightDirection"
+    );
+
+    _emissionColorLocation = glGetUniformLocation(
+        _shaderProgram->getId(),
+        "EmissionColor"
+    );
+
+    _solidColorLocation = glGetUniformLocation(
+        _shaderProgram->getId(),
+        "SolidColor"
+    );
+}
+
+ParticleMarkerEffect::~ParticleMarkerEffect()
+{
+}
+
+void ParticleMarkerEffect::destroy()
+{
+}
+
+void ParticleMarkerEffect::begin()
+{
+    _shaderProgram->use();
+
+    glUniform3fv(_lightDirectionLocation, 1, glm::value_ptr(_lightDirection));
+    glUniform3fv(_emissionColorLocation, 1, glm::value_ptr(_emissionColor));
+    glUniform4fv(_solidColorLocation, 1, glm::value_ptr(_solidColor));
+}
+
+void ParticleMarkerEffect::end()
+{
+}
+
+void ParticleMarkerEffect::setLightDirection(glm::vec3 lightDirection)
+{
+    _lightDirection = lightDirection;
+}
+
+void ParticleMarkerEffect::setMaterial(const fw::Material& material)
+{
+    setEmissionColor(material.getEmissionColor());
+    setSolidColor(material.getBaseAlbedoColor());
+}
+
+void ParticleMarkerEffect::setEmissionColor(glm::vec3 color)
+{
+    _emissionColor = color;
+}
+
+void ParticleMarkerEffect::setSolidColor(glm::vec4 color)
+{
+    _solidColor = color;
+}
+
+void ParticleMarkerEffect::createShaders()
+{
+    std::string vertName = std::string(cApplicationResourcesDir) + "shaders/"
+      + "ParticleMarker.vert";
+
+    // Lit like the distorted model, so the fragment shader is shared.
+    std::string fragName = std::string(cApplicationResourcesDir) + "shaders/"
+      + "BezierCubeDistortion.frag";
+
+    std::shared_ptr<fw::Shader> vs = std::make_shared<fw::Shader>();
+    vs->addSourceFromFile(vertName);
+    vs->compile(GL_VERTEX_SHADER);
+
+    std::shared_ptr<fw::Shader> fs = std::make_shared<fw::Shader>();
+    fs->addSourceFromFile(fragName);
+    fs->compile(GL_FRAGMENT_SHADER);
+
+    _shaderProgram = std::make_shared<fw::ShaderProgram>();
+    _shaderProgram->attach(vs.get());
+    _shaderProgram->attach(fs.get());
+    _shaderProgram->link();
+}
+
+}
@@ -0,0 +1,247 @@
+#include "ParticleSnapshot.hpp"
+#include <cstdio>
+#include <cstring>
+#include "easylogging++.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace application
+{
+
+namespace
+{
+
+const char cSnapshotMagic[] = {'S', 'B', 'S', 'N', 'A', 'P', '\r', '\n'};
+
+static_assert(
+    sizeof(cSnapshotMagic) == sizeof(SnapshotHeader::magic),
+    "The magic fills the header field"
+);
+
+std::uint64_t alignSnapshotOffset(std::uint64_t offset)
+{
+    const std::uint64_t alignment = SnapshotHeader::cAlignment;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/** Writes zeros up to offset, then bytes of data. */
+bool writeSnapshotBlock(
+    std::FILE* file,
+    std::uint64_t& position,
+    std::uint64_t offset,
+    const void* data,
+    std::uint64_t bytes
+)
+{
+    const char cPadding[SnapshotHeader::cAlignment] = {};
+    const auto padding = static_cast<std::size_t>(offset - position);
+    if (std::fwrite(cPadding, 1, padding, file) != padding)
+    {
+        return false;
+    }
+
+    const auto size = static_cast<std::size_t>(bytes);
+    position = offset + bytes;
+    return size == 0 || std::fwrite(data, 1, size, file) == size;
+}
+
+}
+
+SnapshotSectionData::SnapshotSectionData():
+    data{nullptr},
+    count{},
+    elementSize{}
+{
+}
+
+bool writeParticleSnapshot(
+    const std::string& path,
+    SnapshotHeader header,
+    const SnapshotSectionData sections[SnapshotSectionCount]
+)
+{
+    std::memcpy(header.magic, cSnapshotMagic, sizeof(header.magic));
+    header.version = SnapshotHeader::cVersion;
+    header.byteOrder = SnapshotHeader::cByteOrder;
+
+    auto offset = alignSnapshotOffset(sizeof(SnapshotHeader));
+    for (auto s = 0; s < SnapshotSectionCount; ++s)
+    {
+        auto& range = header.sections[s];
+        range.offset = offset;
+        range.count = sections[s].count;
+        range.elementSize =
+            static_cast<std::uint32_t>(sections[s].elementSize);
+        range.reserved = 0;
+        offset = alignSnapshotOffset(offset + range.count * range.elementSize);
+    }
+
+    header.fileSize = offset;
+
+    auto file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        LOG(ERROR) << "Cannot open " << path << " for writing.";
+        return false;
+    }
+
+    std::uint64_t position = 0;
+    auto written = writeSnapshotBlock(
+        file,
+        position,
+        0,
+        &header,
+        sizeof(header)
+    );
+
+    for (auto s = 0; written && s < SnapshotSectionCount; ++s)
+    {
+        const auto& range = header.sections[s];
+        written = writeSnapshotBlock(
+            file,
+            position,
+            range.offset,
+            sections[s].data,
+            range.count * range.elementSize
+        );
+    }
+
+    written = written
+        && writeSnapshotBlock(file, position, header.fileSize, nullptr, 0);
+
+    if (std::fclose(file) != 0 || !written)
+    {
+        LOG(ERROR) << "Cannot write snapshot " << path << ".";
+        return false;
+    }
+
+    return true;
+}
+
+ParticleSnapshot::ParticleSnapshot():
+    _data{nullptr},
+    _size{},
+    _header{nullptr}
+{
+}
+
+ParticleSnapshot::~ParticleSnapshot()
+{
+    close();
+}
+
+bool ParticleSnapshot::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file)
+    {
+        LOG(ERROR) << "Cannot open snapshot " << path << ".";
+        return false;
+    }
+
+    _buffer.resize(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(_buffer.data()), _buffer.size());
+    _data = _buffer.data();
+    _size = _buffer.size();
+#else
+    auto descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        LOG(ERROR) << "Cannot open snapshot " << path << ".";
+        return false;
+    }
+
+    struct stat status;
+    auto mapping = MAP_FAILED;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+    {
+        mapping = mmap(
+            nullptr,
+            static_cast<std::size_t>(status.st_size),
+            PROT_READ,
+            MAP_PRIVATE,
+            descriptor,
+            0
+        );
+    }
+
+    ::close(descriptor);
+    if (mapping == MAP_FAILED)
+    {
+        LOG(ERROR) << "Cannot map snapshot " << path << ".";
+        return false;
+    }
+
+    _data = static_cast<const unsigned char*>(mapping);
+    _size = static_cast<std::size_t>(status.st_size);
+    madvise(mapping, _size, MADV_SEQUENTIAL);
+#endif
+
+    auto header = reinterpret_cast<const SnapshotHeader*>(_data);
+    const char* problem = nullptr;
+    if (_size < sizeof(SnapshotHeader)
+        || std::memcmp(header->magic, cSnapshotMagic, sizeof(cSnapshotMagic)))
+    {
+        problem = "is not a particle snapshot";
+    }
+    else if (header->version != SnapshotHeader::cVersion
+        || header->byteOrder != SnapshotHeader::cByteOrder)
+    {
+        problem = "was saved in another version or byte order";
+    }
+    else if (header->fileSize != _size)
+    {
+        problem = "is truncated";
+    }
+
+    for (auto s = 0; problem == nullptr && s < SnapshotSectionCount; ++s)
+    {
+        const auto& range = header->sections[s];
+        if (range.offset % SnapshotHeader::cAlignment != 0
+            || range.offset > _size
+            || (range.count > 0 && range.elementSize == 0)
+            || (range.count > 0
+                && range.count > (_size - range.offset) / range.elementSize))
+        {
+            problem = "has a damaged section table";
+        }
+    }
+
+    if (problem != nullptr)
+    {
+        LOG(ERROR) << "Snapshot " << path << " " << problem << ".";
+        close();
+        return false;
+    }
+
+    _header = header;
+    return true;
+}
+
+void ParticleSnapshot::close()
+{
+#ifndef _WIN32
+    if (_data != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(_data), _size);
+    }
+#endif
+
+    _buffer.clear();
+    _data = nullptr;
+    _size = 0;
+    _header = nullptr;
+}
+
+}
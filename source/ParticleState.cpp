@@ -1,10 +1,231 @@
 #include "ParticleState.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <iterator>
 #include <random>
+#include <type_traits>
 #include "easylogging++.h"
+#include "ParticleSnapshot.hpp"
 
 namespace application
 {
 
+namespace
+{
+
+/**
+ * Whether filling [first, last) with value would change it. Snapshots may
+ * restore values that are not uniform, so every one is compared.
+ */
+template <typename TIterator, typename TValue>
+inline bool changesUniformValue(TIterator first, TIterator last, TValue value)
+{
+    using Value = typename std::iterator_traits<TIterator>::value_type;
+    const auto converted = static_cast<Value>(value);
+    return std::any_of(first, last, [=](Value current) {
+        return current != converted;
+    });
+}
+
+/**
+ * Returns count values of data in the precision of scratch. They are copied
+ * into scratch only if the precisions differ.
+ */
+template <typename TValue>
+inline const TValue* convertPrecision(
+    const TValue* data,
+    std::size_t,
+    StateVector<TValue>&
+)
+{
+    return data;
+}
+
+template <typename TTarget, typename TSource>
+inline const TTarget* convertPrecision(
+    const TSource* data,
+    std::size_t count,
+    StateVector<TTarget>& scratch
+)
+{
+    scratch.assign(data, data + count);
+    return scratch.data();
+}
+
+/**
+ * Returns where values to be added to count elements of output are summed:
+ * output itself, or zeroed scratch of another precision that
+ * commitAccumulation adds to output afterwards.
+ */
+template <typename TValue>
+inline TValue* beginAccumulation(
+    TValue* output,
+    std::size_t,
+    StateVector<TValue>&
+)
+{
+    return output;
+}
+
+template <typename TTarget, typename TSource>
+inline TTarget* beginAccumulation(
+    TSource*,
+    std::size_t count,
+    StateVector<TTarget>& scratch
+)
+{
+    scratch.assign(count, TTarget{0});
+    return scratch.data();
+}
+
+template <typename TValue>
+inline void commitAccumulation(TValue*, const TValue*, std::size_t)
+{
+}
+
+template <typename TTarget, typename TSource>
+inline void commitAccumulation(
+    TTarget* output,
+    const TSource* accumulated,
+    std::size_t count
+)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        output[i] += accumulated[i];
+    }
+}
+
+/** Sections of a spring batch, starting at first, see SnapshotSection. */
+template <typename TPrecision>
+void describeSpringSections(
+    const SpringBatch<TPrecision>& springs,
+    SnapshotSection first,
+    SnapshotSectionData sections[SnapshotSectionCount]
+)
+{
+    const auto count = springs.size();
+    sections[first] = {springs.a.data(), count};
+    sections[first + 1] = {springs.b.data(), count};
+    sections[first + 2] = {springs.restLength.data(), count};
+    sections[first + 3] = {springs.stiffness.data(), count};
+    sections[first + 4] = {springs.damping.data(), count};
+}
+
+/** True if every value of [first, last) lies in [0, size). */
+template <typename TIterator>
+inline bool allIndicesBelow(TIterator first, TIterator last, std::size_t size)
+{
+    return std::all_of(first, last, [=](int index){
+        return index >= 0 && static_cast<std::size_t>(index) < size;
+    });
+}
+
+/**
+ * Reads a spring batch whose a endpoints index aCount elements and b
+ * endpoints bCount elements. Fails on any endpoint out of range.
+ */
+template <typename TPrecision>
+bool readSpringSections(
+    const ParticleSnapshot& snapshot,
+    SnapshotSection first,
+    std::size_t aCount,
+    std::size_t bCount,
+    SpringBatch<TPrecision>& springs
+)
+{
+    const auto count = snapshot.getSectionCount(first);
+    const auto a = snapshot.getSection<int>(first);
+    const auto b = snapshot.getSection<int>(SnapshotSection(first + 1));
+    if (a == nullptr
+        || b == nullptr
+        || snapshot.getSectionCount(SnapshotSection(first + 1)) != count
+        || !allIndicesBelow(a, a + count, aCount)
+        || !allIndicesBelow(b, b + count, bCount))
+    {
+        return false;
+    }
+
+    springs.resize(count);
+    std::copy(a, a + count, springs.a.begin());
+    std::copy(b, b + count, springs.b.begin());
+    return snapshot.readReals(
+            SnapshotSection(first + 2),
+            0,
+            count,
+            springs.restLength.data()
+        )
+        && snapshot.readReals(
+            SnapshotSection(first + 3),
+            0,
+            count,
+            springs.stiffness.data()
+        )
+        && snapshot.readReals(
+            SnapshotSection(first + 4),
+            0,
+            count,
+            springs.damping.data()
+        );
+}
+
+/** Copies a whole section of elements stored as TValue. */
+template <typename TValue>
+bool readSnapshotSection(
+    const ParticleSnapshot& snapshot,
+    SnapshotSection section,
+    std::vector<TValue>& values
+)
+{
+    const auto data = snapshot.getSection<TValue>(section);
+    if (data == nullptr)
+    {
+        return false;
+    }
+
+    values.assign(data, data + snapshot.getSectionCount(section));
+    return true;
+}
+
+/** True if offsets start at zero, never decrease and end at size. */
+inline bool isOffsetTable(
+    const std::vector<std::size_t>& offsets,
+    std::size_t size
+)
+{
+    return !offsets.empty()
+        && offsets.front() == 0
+        && offsets.back() == size
+        && std::is_sorted(offsets.begin(), offsets.end());
+}
+
+/**
+ * Checks loaded coloring and adjacency against the springs they describe,
+ * an empty coloring only turns the colored passes off.
+ */
+template <typename TPrecision>
+bool isConsistentTopology(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t particleCount,
+    const std::vector<std::size_t>& colorOffsets,
+    const SpringAdjacency& adjacency
+)
+{
+    const auto& spring = adjacency.spring;
+    const auto& neighbour = adjacency.neighbour;
+    return (colorOffsets.empty() || isOffsetTable(colorOffsets, springs.size()))
+        && adjacency.offsets.size() == particleCount + 1
+        && isOffsetTable(adjacency.offsets, 2 * springs.size())
+        && spring.size() == 2 * springs.size()
+        && neighbour.size() == spring.size()
+        && allIndicesBelow(spring.begin(), spring.end(), springs.size())
+        && allIndicesBelow(neighbour.begin(), neighbour.end(), particleCount);
+}
+
+}
+
 ParticleState::ParticleState()
 {
 }
@@ -14,9 +235,9 @@ ParticleState::ParticleState(
     const glm::dvec3& momentum,
     double invMass
 ):
+    invMass{invMass},
     position{position},
-    momentum{momentum},
-    invMass{invMass}
+    momentum{momentum}
 {
 }
 
@@ -29,115 +250,576 @@ SpringConstraint::SpringConstraint():
 {
 }
 
-glm::dvec3 SpringConstraint::getForce(const ParticleSystem& system) const
+template <typename TPrecision>
+BasicParticleStateView<TPrecision>::BasicParticleStateView(
+    const TPrecision* state,
+    const TPrecision* invMass,
+    std::size_t count,
+    std::size_t stride
+):
+    _state{state},
+    _invMass{invMass},
+    _count{count},
+    _stride{stride}
 {
-    ParticleState A;
-    ParticleState B;
+}
+
+template <typename TPrecision>
+ParticleState BasicParticleStateView<TPrecision>::operator[](
+    std::size_t index
+) const
+{
+    return {
+        getPosition(index),
+        {
+            _state[MomentumX * _stride + index],
+            _state[MomentumY * _stride + index],
+            _state[MomentumZ * _stride + index]
+        },
+        _invMass[index]
+    };
+}
+
+template <typename TPrecision>
+glm::dvec3 BasicParticleStateView<TPrecision>::getPosition(
+    std::size_t index
+) const
+{
+    return {
+        _state[PositionX * _stride + index],
+        _state[PositionY * _stride + index],
+        _state[PositionZ * _stride + index]
+    };
+}
+
+glm::dvec3 SpringConstraint::getForce(
+    const glm::dvec3& positionA,
+    const glm::dvec3& positionB,
+    const glm::dvec3& velocityA,
+    const glm::dvec3& velocityB
+) const
+{
+    auto relation = positionB - positionA;
+    auto relationDirection = glm::length(relation) > 10e-4
+        ? glm::normalize(relation)
+        : glm::dvec3{1.0, 0.0, 0.0};
+
+    auto springCurrentLength = glm::length(relation);
+    auto approachSpeed = glm::dot(velocityB - velocityA, relationDirection);
+    auto springForce =
+        - (springCurrentLength - springLength) * springConstant
+        - approachSpeed * attenuationFactor;
 
-    if (a >= 0)
+    return -relationDirection * springForce;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+BasicParticleSystem<TPrecision, TForcePrecision>::BasicParticleSystem():
+    _contactDistance{},
+    _contactStiffness{},
+    _forceAccumulation{ForceAccumulation::Scatter},
+    _simdLevel{detectSimdLevel()},
+    _particleCount{},
+    _particleStride{},
+    _derivativeEvaluations{},
+    _sleepForceEvaluations{},
+    _linearizationStep{},
+    _roomSize{10.0, 5.0, 10.0},
+    _collisionMode{CollisionMode::StepBisection},
+    _fixedTimestep{},
+    _accumulatedTime{},
+    _maxSubsteps{1},
+    _sleepKineticEnergy{},
+    _sleepForce{},
+    _sleepDelay{},
+    _restTime{},
+    _sleeping{false}
+{
+}
+
+template <typename TPrecision, typename TForcePrecision>
+BasicParticleSystem<TPrecision, TForcePrecision>::~BasicParticleSystem()
+{
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::storePhysicsState(
+    std::vector<double>& output
+) const
+{
+    output.resize(ParticleStateFieldCount * _particleCount);
+
+    auto storedFields = 0;
+    for (std::size_t i = 0; i < _particleCount; ++i)
     {
-        A = system.getParticleStates()[a];
+        for (auto f = 0; f < ParticleStateFieldCount; ++f)
+        {
+            output[storedFields++] = _state[f * _particleStride + i];
+        }
     }
-    else
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::applyPhysicsState(
+    const std::vector<double>& state
+)
+{
+    wakeUp();
+    _previousPositions.clear();
+
+    std::size_t appliedFields = 0;
+    std::size_t appliedParticles = 0;
+    while (appliedFields + ParticleStateFieldCount - 1 < state.size()
+        && appliedParticles < _particleCount)
     {
-        A = system.getStaticParticles()[-a-1];
+        for (auto f = 0; f < ParticleStateFieldCount; ++f)
+        {
+            _state[f * _particleStride + appliedParticles] =
+                state[appliedFields++];
+        }
+
+        ++appliedParticles;
     }
+}
+
+template <typename TPrecision, typename TForcePrecision>
+bool BasicParticleSystem<TPrecision, TForcePrecision>::saveSnapshot(
+    const std::string& path
+) const
+{
+    static_assert(
+        std::is_trivially_copyable<ParticleState>::value,
+        "Static particles are stored as they lie in memory"
+    );
 
-    if (b >= 0)
+    SnapshotHeader header{};
+    header.particleCount = _particleCount;
+    header.particleStride = _particleStride;
+    header.fixedTimestep = _fixedTimestep;
+    header.elasticCollisionFactor = _elasticCollisionFactor;
+    header.movementAttenuationFactor = _movementAttenuationFactor;
+    header.contactDistance = _contactDistance;
+    header.contactStiffness = _contactStiffness;
+    header.sleepKineticEnergy = _sleepKineticEnergy;
+    header.sleepForce = _sleepForce;
+    header.sleepDelay = _sleepDelay;
+    header.maxSubsteps = _maxSubsteps;
+    header.integrator = static_cast<std::int32_t>(getIntegrator());
+    header.collisionMode = static_cast<std::int32_t>(_collisionMode);
+    header.forceAccumulation = static_cast<std::int32_t>(_forceAccumulation);
+    header.sleeping = _sleeping;
+    for (auto axis = 0; axis < 3; ++axis)
     {
-        B = system.getParticleStates()[b];
+        header.roomSize[axis] = _roomSize[axis];
+        header.stencilSize[axis] = _latticeStencil.size[axis];
     }
-    else
+
+    const auto cForwardNeighbours =
+        LatticeStencil<TForcePrecision>::cForwardNeighbours;
+    for (auto n = 0; n < cForwardNeighbours; ++n)
     {
-        B = system.getStaticParticles()[-b-1];
+        header.stencilRestLength[n] = _latticeStencil.restLength[n];
     }
 
-    auto relation = B.position - A.position;
-    auto relationDirection = glm::length(relation) > 10e-4
-        ? glm::normalize(relation)
-        : glm::dvec3{1.0, 0.0, 0.0};
+    header.stencilStiffness = _latticeStencil.stiffness;
+    header.stencilDamping = _latticeStencil.damping;
 
-    auto springCurrentLength = glm::length(relation);
-    auto springForce =
-        - (springCurrentLength - springLength) * springConstant;
+    SnapshotSectionData sections[SnapshotSectionCount];
+    sections[SnapshotState] = {_state.data(), _state.size()};
+    sections[SnapshotInvMass] = {_invMass.data(), _invMass.size()};
+    sections[SnapshotStaticParticles] = {
+        _staticParticles.data(),
+        _staticParticles.size()
+    };
 
-    return -relationDirection * springForce;
+    describeSpringSections(_internalSprings, SnapshotInternalSpringA, sections);
+    describeSpringSections(_anchorSprings, SnapshotAnchorSpringA, sections);
+    sections[SnapshotSpringColorOffsets] = {
+        _springColorOffsets.data(),
+        _springColorOffsets.size()
+    };
+
+    sections[SnapshotAdjacencyOffsets] = {
+        _springAdjacency.offsets.data(),
+        _springAdjacency.offsets.size()
+    };
+
+    sections[SnapshotAdjacencySpring] = {
+        _springAdjacency.spring.data(),
+        _springAdjacency.spring.size()
+    };
+
+    sections[SnapshotAdjacencyNeighbour] = {
+        _springAdjacency.neighbour.data(),
+        _springAdjacency.neighbour.size()
+    };
+
+    return writeParticleSnapshot(path, header, sections);
 }
 
-ParticleSystem::ParticleSystem():
-    _roomSize{10.0, 5.0, 10.0}
+template <typename TPrecision, typename TForcePrecision>
+bool BasicParticleSystem<TPrecision, TForcePrecision>::loadSnapshot(
+    const ParticleSnapshot& snapshot
+)
 {
+    if (!snapshot.isOpen())
+    {
+        return false;
+    }
+
+    const auto& header = snapshot.getHeader();
+    const auto count = static_cast<std::size_t>(header.particleCount);
+    const auto stride = static_cast<std::size_t>(header.particleStride);
+    auto stencilParticles = 1.0;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        stencilParticles *= std::max(header.stencilSize[axis], 0);
+    }
+
+    if (stride < count
+        || snapshot.getSectionCount(SnapshotState)
+            < ParticleStateFieldCount * stride
+        || stencilParticles > static_cast<double>(count)
+        || header.integrator < 0
+        || header.integrator
+            >= static_cast<int>(IntegratorType::IntegratorTypeCount)
+        || header.collisionMode < 0
+        || header.collisionMode
+            >= static_cast<int>(CollisionMode::CollisionModeCount)
+        || header.forceAccumulation < 0
+        || header.forceAccumulation
+            >= static_cast<int>(ForceAccumulation::ForceAccumulationCount))
+    {
+        LOG(ERROR) << "Snapshot does not describe a valid particle system.";
+        return false;
+    }
+
+    // Storage large enough is overwritten in place, only padding is zeroed.
+    _integrator.invalidate();
+    wakeUp();
+    _previousPositions.clear();
+    _contacts.clear();
+    _particleCount = 0;
+    if (count > _particleStride)
+    {
+        _state.clear();
+        _invMass.clear();
+        _particleStride = 0;
+        resizeParticleStorage(count);
+    }
+
+    auto loaded = true;
+    for (auto f = 0; loaded && f < ParticleStateFieldCount; ++f)
+    {
+        const auto block = field(_state, ParticleStateField(f));
+        loaded = snapshot.readReals(SnapshotState, f * stride, count, block);
+        std::fill(block + count, block + _particleStride, TPrecision{0});
+    }
+
+    std::fill(
+        _invMass.begin() + count,
+        _invMass.begin() + _particleStride,
+        TPrecision{0}
+    );
+
+    const auto staticParticles =
+        snapshot.getSection<ParticleState>(SnapshotStaticParticles);
+    const auto staticCount = snapshot.getSectionCount(SnapshotStaticParticles);
+
+    loaded = loaded
+        && staticParticles != nullptr
+        && snapshot.readReals(SnapshotInvMass, 0, count, _invMass.data())
+        && readSpringSections(
+            snapshot,
+            SnapshotInternalSpringA,
+            count,
+            count,
+            _internalSprings
+        )
+        && readSpringSections(
+            snapshot,
+            SnapshotAnchorSpringA,
+            staticCount,
+            count,
+            _anchorSprings
+        );
+
+    if (!loaded)
+    {
+        LOG(ERROR) << "Snapshot sections do not match its header.";
+        clear();
+        return false;
+    }
+
+    _particleCount = count;
+    _staticParticles.assign(staticParticles, staticParticles + staticCount);
+
+    // Topology saved with another word size or not matching the springs is
+    // colored again.
+    if (!readSnapshotSection(
+            snapshot,
+            SnapshotSpringColorOffsets,
+            _springColorOffsets
+        )
+        || !readSnapshotSection(
+            snapshot,
+            SnapshotAdjacencyOffsets,
+            _springAdjacency.offsets
+        )
+        || !readSnapshotSection(
+            snapshot,
+            SnapshotAdjacencySpring,
+            _springAdjacency.spring
+        )
+        || !readSnapshotSection(
+            snapshot,
+            SnapshotAdjacencyNeighbour,
+            _springAdjacency.neighbour
+        )
+        || !isConsistentTopology(
+            _internalSprings,
+            _particleCount,
+            _springColorOffsets,
+            _springAdjacency
+        ))
+    {
+        finalizeTopology();
+    }
+
+    _latticeStencil.size = {
+        header.stencilSize[0],
+        header.stencilSize[1],
+        header.stencilSize[2]
+    };
+
+    const auto cForwardNeighbours =
+        LatticeStencil<TForcePrecision>::cForwardNeighbours;
+    for (auto n = 0; n < cForwardNeighbours; ++n)
+    {
+        _latticeStencil.restLength[n] =
+            static_cast<TForcePrecision>(header.stencilRestLength[n]);
+    }
+
+    _latticeStencil.stiffness =
+        static_cast<TForcePrecision>(header.stencilStiffness);
+    _latticeStencil.damping =
+        static_cast<TForcePrecision>(header.stencilDamping);
+
+    _roomSize = {header.roomSize[0], header.roomSize[1], header.roomSize[2]};
+    _accumulatedTime = 0.0;
+    setFixedTimestep(header.fixedTimestep, header.maxSubsteps);
+    setIntegrator(IntegratorType(header.integrator));
+    setCollisionMode(CollisionMode(header.collisionMode));
+    setForceAccumulation(ForceAccumulation(header.forceAccumulation));
+    updateEnvironmentConstant(
+        header.movementAttenuationFactor,
+        header.elasticCollisionFactor
+    );
+
+    setSelfCollision(header.contactDistance, header.contactStiffness);
+    setSleepThresholds(
+        header.sleepKineticEnergy,
+        header.sleepForce,
+        header.sleepDelay
+    );
+
+    _sleeping = header.sleeping != 0;
+    return true;
 }
 
-ParticleSystem::~ParticleSystem()
+template <typename TPrecision, typename TForcePrecision>
+bool BasicParticleSystem<TPrecision, TForcePrecision>::loadSnapshot(
+    const std::string& path
+)
 {
+    ParticleSnapshot snapshot;
+    return snapshot.open(path) && loadSnapshot(snapshot);
 }
 
-std::vector<double> ParticleSystem::storePhysicsState() const
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::update(double dt)
 {
-    std::vector<double> output;
+    if (_sleeping)
+    {
+        return;
+    }
 
-    for (const auto& particle: _particleState)
+    if (_fixedTimestep <= 0.0)
     {
-        output.push_back(particle.position.x);
-        output.push_back(particle.position.y);
-        output.push_back(particle.position.z);
+        const double cMaxExplicitFrameStep = 0.01;
+        const double cMaxFrameStep = 0.1;
 
-        output.push_back(particle.momentum.x);
-        output.push_back(particle.momentum.y);
-        output.push_back(particle.momentum.z);
+        auto explicitFixedStep =
+            !_integrator.isAdaptive() && !_integrator.isImplicit();
+        advance(std::min(
+            dt,
+            explicitFixedStep ? cMaxExplicitFrameStep : cMaxFrameStep
+        ));
+
+        updateSleepState(dt);
+        return;
     }
 
-    return output;
+    // Rounding must not postpone a step when dt equals the fixed step.
+    const double cTimeTolerance = 1e-9;
+
+    _accumulatedTime += dt;
+    for (auto substep = 0;
+        substep < _maxSubsteps
+            && _accumulatedTime + cTimeTolerance >= _fixedTimestep;
+        ++substep)
+    {
+        // Position blocks lead the state, see ParticleStateField.
+        _previousPositions.assign(
+            _state.begin(),
+            _state.begin() + MomentumX * _particleStride
+        );
+
+        advance(_fixedTimestep);
+        _accumulatedTime -= _fixedTimestep;
+    }
+
+    // Time the substep cap did not allow to simulate is dropped.
+    _accumulatedTime = std::max(
+        0.0,
+        std::min(_accumulatedTime, _fixedTimestep)
+    );
+
+    updateSleepState(dt);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setFixedTimestep(
+    double step,
+    int maxSubsteps
+)
+{
+    _fixedTimestep = step;
+    _maxSubsteps = std::max(maxSubsteps, 1);
+    _accumulatedTime = std::min(_accumulatedTime, std::max(step, 0.0));
 }
 
-void ParticleSystem::applyPhysicsState(const std::vector<double>& state)
+template <typename TPrecision, typename TForcePrecision>
+double
+BasicParticleSystem<TPrecision, TForcePrecision>::getInterpolationFactor() const
 {
-    const int fieldsPerParticle = 6;
-    auto appliedFields = 0;
-    auto appliedParticles = 0;
-    while (appliedFields + fieldsPerParticle - 1 < state.size())
+    return _fixedTimestep > 0.0 ? _accumulatedTime / _fixedTimestep : 1.0;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+glm::dvec3
+BasicParticleSystem<TPrecision, TForcePrecision>::getInterpolatedPosition(
+    std::size_t index
+) const
+{
+    glm::dvec3 current{
+        _state[PositionX * _particleStride + index],
+        _state[PositionY * _particleStride + index],
+        _state[PositionZ * _particleStride + index]
+    };
+
+    if (_fixedTimestep <= 0.0
+        || _previousPositions.size() != MomentumX * _particleStride)
     {
-        _particleState[appliedParticles].position.x = state[appliedFields++];
-        _particleState[appliedParticles].position.y = state[appliedFields++];
-        _particleState[appliedParticles].position.z = state[appliedFields++];
-        _particleState[appliedParticles].momentum.x = state[appliedFields++];
-        _particleState[appliedParticles].momentum.y = state[appliedFields++];
-        _particleState[appliedParticles].momentum.z = state[appliedFields++];
-        ++appliedParticles;
+        return current;
     }
+
+    glm::dvec3 previous{
+        _previousPositions[PositionX * _particleStride + index],
+        _previousPositions[PositionY * _particleStride + index],
+        _previousPositions[PositionZ * _particleStride + index]
+    };
+
+    auto factor = getInterpolationFactor();
+    return previous + factor * (current - previous);
 }
 
-void ParticleSystem::update(double dt)
+template <typename TPrecision, typename TForcePrecision>
+void
+BasicParticleSystem<TPrecision, TForcePrecision>::getInterpolatedPositions(
+    float* output
+) const
 {
-    auto physicsStep = std::min(dt, 0.01);
+    const TPrecision* current[3];
+    const TPrecision* previous[3];
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        current[axis] = _state.data() + (PositionX + axis) * _particleStride;
+        previous[axis] = _previousPositions.data()
+            + (PositionX + axis) * _particleStride;
+    }
+
+    const auto interpolated = _fixedTimestep > 0.0
+        && _previousPositions.size() == MomentumX * _particleStride;
+
+    interleavePositionsToFloat4(
+        current,
+        interpolated ? previous : nullptr,
+        static_cast<TPrecision>(getInterpolationFactor()),
+        0,
+        _particleCount,
+        output,
+        _simdLevel
+    );
+}
 
-    auto availableTime = physicsStep;
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::advance(double time)
+{
+    const double cMaxImplicitStep = 1.0 / 60;
+
+    auto maxStep = _integrator.isImplicit()
+        ? std::min(time, cMaxImplicitStep)
+        : time;
+
+    auto availableTime = time;
     while (availableTime > 10e-6)
     {
-        availableTime -= singleStep(availableTime);
+        availableTime -= singleStep(std::min(availableTime, maxStep));
+        resolveColliderContacts();
     }
 }
 
-double ParticleSystem::singleStep(double maxDt)
+template <typename TPrecision, typename TForcePrecision>
+double BasicParticleSystem<TPrecision, TForcePrecision>::singleStep(
+    double maxDt
+)
 {
-    auto physicsState = storePhysicsState();
-    auto newPhysicsState = step(physicsState, 0.0, maxDt);
-    applyPhysicsState(newPhysicsState);
+    _stepStartState = _state;
+    findContacts();
+
+    double takenDt = _integrator.adaptiveStep(
+        *this,
+        _stepStartState,
+        _state,
+        0.0,
+        maxDt
+    );
+
+    if (_collisionMode == CollisionMode::PerParticle)
+    {
+        resolveWallContacts(takenDt);
+        return takenDt;
+    }
 
     auto interpenetration = checkInterpenetration();
     if (interpenetration)
     {
         const double cTimeTolerance = 10e-3;
-        auto stepLowerLimit = 0.001;
-        auto stepUpperLimit = maxDt;
-        std::vector<double> lastPhysicsState;
+        auto stepLowerLimit = std::min(0.001, takenDt / 2);
+        auto stepUpperLimit = takenDt;
 
         while ((stepUpperLimit - stepLowerLimit) > cTimeTolerance)
         {
             auto midpointStep = (stepUpperLimit + stepLowerLimit) / 2.0;
-            lastPhysicsState = step(physicsState, 0.0, midpointStep);
-            applyPhysicsState(lastPhysicsState);
+            _integrator.step(
+                *this,
+                _stepStartState,
+                _state,
+                0.0,
+                midpointStep
+            );
+
             if (checkInterpenetration())
             {
                 stepUpperLimit = midpointStep;
@@ -149,261 +831,1328 @@ double ParticleSystem::singleStep(double maxDt)
         }
 
         auto chosenTouchTime = stepLowerLimit;
-        auto touchPhysicsState = step(physicsState, 0.0, chosenTouchTime);
+        _integrator.step(
+            *this,
+            _stepStartState,
+            _state,
+            0.0,
+            chosenTouchTime
+        );
 
-        applyPhysicsState(touchPhysicsState);
         applyImpulsesToCollidingContacts();
 
         return chosenTouchTime;
     }
 
-    return maxDt;
+    return takenDt;
 }
 
-void ParticleSystem::clear()
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::clear()
 {
-    _particleState.clear();
+    _integrator.invalidate();
+    wakeUp();
+    _previousPositions.clear();
+    _internalSprings.clear();
+    _anchorSprings.clear();
+    _springColorOffsets.clear();
+    _springAdjacency.clear();
+    _contacts.clear();
+    _latticeStencil = LatticeStencil<TForcePrecision>{};
+    _particleCount = 0;
+    std::fill(std::begin(_state), std::end(_state), 0.0);
+    std::fill(std::begin(_invMass), std::end(_invMass), 0.0);
 }
 
-void ParticleSystem::addParticle(const ParticleState& particle)
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::reserveParticles(
+    std::size_t count
+)
 {
-    _particleState.push_back(particle);
+    if (count > _particleStride)
+    {
+        resizeParticleStorage(count);
+    }
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::addParticle(
+    const ParticleState& particle
+)
+{
+    _integrator.invalidate();
+    wakeUp();
+    _previousPositions.clear();
+
+    if (_particleCount == _particleStride)
+    {
+        resizeParticleStorage(std::max<std::size_t>(8, 2 * _particleStride));
+    }
+
+    auto index = _particleCount++;
+    _state[PositionX * _particleStride + index] = particle.position.x;
+    _state[PositionY * _particleStride + index] = particle.position.y;
+    _state[PositionZ * _particleStride + index] = particle.position.z;
+    _state[MomentumX * _particleStride + index] = particle.momentum.x;
+    _state[MomentumY * _particleStride + index] = particle.momentum.y;
+    _state[MomentumZ * _particleStride + index] = particle.momentum.z;
+    _invMass[index] = particle.invMass;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::addConstraint(
+    const SpringConstraint& constraint
+)
+{
+    _integrator.invalidate();
+    wakeUp();
+
+    if (constraint.a >= 0 && constraint.b >= 0)
+    {
+        _springColorOffsets.clear();
+        _internalSprings.add(
+            constraint.a,
+            constraint.b,
+            constraint.springLength,
+            constraint.springConstant,
+            constraint.attenuationFactor
+        );
+
+        return;
+    }
+
+    assert(constraint.a >= 0 || constraint.b >= 0);
+
+    auto anchor = constraint.a < 0 ? constraint.a : constraint.b;
+    auto particle = constraint.a < 0 ? constraint.b : constraint.a;
+    _anchorSprings.add(
+        -anchor-1,
+        particle,
+        constraint.springLength,
+        constraint.springConstant,
+        constraint.attenuationFactor
+    );
+}
+
+template <typename TPrecision, typename TForcePrecision>
+LatticeTopologyStatistics
+BasicParticleSystem<TPrecision, TForcePrecision>::addLatticeConstraints(
+    const glm::ivec3& size,
+    const SpringConstraint& parameters,
+    LatticeSpringStorage storage
+)
+{
+    assert(
+        static_cast<std::size_t>(size.x) * size.y * size.z <= _particleCount
+    );
+
+    _integrator.invalidate();
+    wakeUp();
+    _springColorOffsets.clear();
+
+    auto positions = convertPrecision(
+        field(_state, PositionX),
+        3 * _particleStride,
+        _forcePositions
+    );
+
+    const TForcePrecision* position[] = {
+        positions,
+        positions + _particleStride,
+        positions + 2 * _particleStride
+    };
+
+    const auto springConstant =
+        static_cast<TForcePrecision>(parameters.springConstant);
+    const auto damping =
+        static_cast<TForcePrecision>(parameters.attenuationFactor);
+
+    if (storage == LatticeSpringStorage::Stencil)
+    {
+        assert(_latticeStencil.empty());
+        return buildLatticeStencil(
+            size,
+            position,
+            springConstant,
+            damping,
+            _latticeStencil
+        );
+    }
+
+    return buildLatticeSprings(
+        size,
+        position,
+        springConstant,
+        damping,
+        _threadPool,
+        _internalSprings
+    );
 }
 
-void ParticleSystem::addConstraint(const SpringConstraint& constraint)
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::finalizeTopology()
 {
-    _constraints.push_back(constraint);
+    _springColorOffsets = partitionIntoConflictFreeClasses(
+        _internalSprings,
+        _particleCount
+    );
+
+    // Built after coloring, which reorders the springs.
+    buildSpringAdjacency(_internalSprings, _particleCount, _springAdjacency);
 }
 
-const std::vector<ParticleState>& ParticleSystem::getParticleStates() const
+template <typename TPrecision, typename TForcePrecision>
+BasicParticleStateView<TPrecision>
+BasicParticleSystem<TPrecision, TForcePrecision>::getParticleStates() const
 {
-    return _particleState;
+    return {_state.data(), _invMass.data(), _particleCount, _particleStride};
 }
 
-void ParticleSystem::setStaticParticles(
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setStaticParticles(
     const std::vector<ParticleState>& particles
 )
 {
+    const auto moved = particles.size() != _staticParticles.size()
+        || !std::equal(
+            particles.begin(),
+            particles.end(),
+            _staticParticles.begin(),
+            [](const ParticleState& a, const ParticleState& b) {
+                return a.position == b.position
+                    && a.momentum == b.momentum
+                    && a.invMass == b.invMass;
+            }
+        );
+
+    // The first stage cached by Dormand-Prince stays valid across frames
+    // unless the anchors actually moved.
+    if (moved)
+    {
+        _integrator.invalidate();
+        wakeUp();
+    }
+
     _staticParticles = particles;
 }
 
-const std::vector<ParticleState>& ParticleSystem::getStaticParticles() const
+template <typename TPrecision, typename TForcePrecision>
+const std::vector<ParticleState>&
+BasicParticleSystem<TPrecision, TForcePrecision>::getStaticParticles() const
 {
     return _staticParticles;
 }
 
-std::vector<double> ParticleSystem::evaluateDerivative(
-    const std::vector<double>& state,
-    const double& time
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::evaluateDerivative(
+    const StateVector<TPrecision>& state,
+    const TPrecision& /* time */,
+    StateVector<TPrecision>& derivative
 )
 {
-    applyPhysicsState(state);
-    clearForces();
-    calculateForces();
-    updateParticles();
-    return storePhysicsStateDerivative();
+    ++_derivativeEvaluations;
+    evaluateVelocity(state, derivative);
+    updateParticles(derivative);
+    calculateForces(state, derivative);
 }
 
-void ParticleSystem::clearForces()
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::evaluateVelocity(
+    const StateVector<TPrecision>& state,
+    StateVector<TPrecision>& derivative
+)
 {
-    for (auto& particle: _particleState)
+    derivative.resize(state.size());
+    for (auto axis = 0; axis < 3; ++axis)
     {
-        particle.netForce = {0, 0, 0};
+        auto momentum = field(state, ParticleStateField(MomentumX + axis));
+        auto velocity = field(derivative, ParticleStateField(PositionX + axis));
+
+        for (std::size_t i = 0; i < _particleStride; ++i)
+        {
+            velocity[i] = _invMass[i] * momentum[i];
+        }
     }
 }
 
-void ParticleSystem::calculateForces()
+template <typename TPrecision, typename TForcePrecision>
+template <typename TFunction>
+void BasicParticleSystem<TPrecision, TForcePrecision>::forEachStencilPlane(
+    const TFunction& function
+)
 {
-    for (const auto& constraint: _constraints)
+    const auto planes = _latticeStencil.size.z;
+    if (_threadPool.getThreadCount() == 1)
     {
-        auto force = constraint.getForce(*this);
+        for (auto z = 0; z < planes; ++z)
+        {
+            function(z);
+        }
+
+        return;
+    }
+
+    for (auto parity = 0; parity <= 1; ++parity)
+    {
+        _threadPool.parallelFor(
+            (planes - parity + 1) / 2,
+            [&](std::size_t begin, std::size_t end) {
+                for (auto i = begin; i < end; ++i)
+                {
+                    function(parity + 2 * static_cast<int>(i));
+                }
+            }
+        );
+    }
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::linearizeForces(
+    const StateVector<TPrecision>& state,
+    TPrecision step
+)
+{
+    auto positions = convertPrecision(
+        field(state, PositionX),
+        3 * _particleStride,
+        _forcePositions
+    );
+
+    const TForcePrecision* position[] = {
+        positions,
+        positions + _particleStride,
+        positions + 2 * _particleStride
+    };
+
+    const auto springStep = static_cast<TForcePrecision>(step);
+
+    _massTerm.resize(_particleStride);
+    for (std::size_t i = 0; i < _particleStride; ++i)
+    {
+        // Unused slots and immovable particles get identity rows.
+        _massTerm[i] = _invMass[i] > 0.0
+            ? 1.0 / _invMass[i] + step * _movementAttenuationFactor
+            : 1.0;
+    }
+
+    _systemDiagonal.resize(3 * _particleStride);
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        std::copy(
+            _massTerm.begin(),
+            _massTerm.end(),
+            _systemDiagonal.data() + axis * _particleStride
+        );
+    }
 
-        if (constraint.a >= 0)
+    auto blocks = beginAccumulation(
+        _systemDiagonal.data(),
+        3 * _particleStride,
+        _forceOutput
+    );
+
+    TForcePrecision* diagonal[] = {
+        blocks,
+        blocks + _particleStride,
+        blocks + 2 * _particleStride
+    };
+
+    _internalLinearization.resize(_internalSprings.size());
+    if (_threadPool.getThreadCount() > 1 && !_springColorOffsets.empty())
+    {
+        for (std::size_t c = 0; c + 1 < _springColorOffsets.size(); ++c)
         {
-            _particleState[constraint.a].netForce += force;
+            auto classBegin = _springColorOffsets[c];
+            _threadPool.parallelFor(
+                _springColorOffsets[c + 1] - classBegin,
+                [&](std::size_t begin, std::size_t end) {
+                    linearizeInternalSprings(
+                        _internalSprings,
+                        classBegin + begin,
+                        classBegin + end,
+                        position,
+                        springStep,
+                        _internalLinearization,
+                        diagonal
+                    );
+                }
+            );
         }
+    }
+    else
+    {
+        linearizeInternalSprings(
+            _internalSprings,
+            0,
+            _internalSprings.size(),
+            position,
+            springStep,
+            _internalLinearization,
+            diagonal
+        );
+    }
+
+    if (!_latticeStencil.empty())
+    {
+        // The stencil keeps no per-spring blocks, products recompute them
+        // from these positions.
+        _linearizationPositions.assign(
+            positions,
+            positions + 3 * _particleStride
+        );
+        _linearizationStep = springStep;
+
+        forEachStencilPlane([&](int z) {
+            linearizeLatticeStencil(
+                _latticeStencil,
+                z,
+                position,
+                springStep,
+                diagonal
+            );
+        });
+    }
+
+    _anchorLinearization.resize(_anchorSprings.size());
+    linearizeAnchorSprings(
+        _anchorSprings,
+        _staticParticles,
+        position,
+        springStep,
+        _anchorLinearization,
+        diagonal
+    );
 
-        if (constraint.b >= 0)
+    commitAccumulation(_systemDiagonal.data(), blocks, 3 * _particleStride);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::multiplySystemMatrix(
+    const StateVector<TPrecision>& vector,
+    StateVector<TPrecision>& result
+)
+{
+    result.resize(vector.size());
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto input = vector.data() + axis * _particleStride;
+        auto output = result.data() + axis * _particleStride;
+        for (std::size_t i = 0; i < _particleStride; ++i)
         {
-            _particleState[constraint.b].netForce -= force;
+            output[i] = _massTerm[i] * input[i];
         }
     }
+
+    accumulateSpringJacobianProduct(vector, result, true);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::multiplyPositionJacobian(
+    const StateVector<TPrecision>& vector,
+    StateVector<TPrecision>& result
+)
+{
+    result.assign(vector.size(), 0.0);
+    accumulateSpringJacobianProduct(vector, result, false);
+
+    // Spring blocks are the negated Jacobian, see SpringLinearization.
+    for (auto& value: result)
+    {
+        value = -value;
+    }
 }
 
-void ParticleSystem::updateParticles()
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::multiplyMass(
+    const StateVector<TPrecision>& vector,
+    StateVector<TPrecision>& result
+) const
 {
-    for (auto& particle: _particleState)
+    result.resize(vector.size());
+    for (auto axis = 0; axis < 3; ++axis)
     {
-        particle.velocity = particle.invMass * particle.momentum;
-        particle.netForce += -_movementAttenuationFactor * particle.velocity;
+        auto input = vector.data() + axis * _particleStride;
+        auto output = result.data() + axis * _particleStride;
+        for (std::size_t i = 0; i < _particleStride; ++i)
+        {
+            output[i] = _invMass[i] > 0.0 ? input[i] / _invMass[i] : 0.0;
+        }
     }
 }
 
-std::vector<double> ParticleSystem::storePhysicsStateDerivative() const
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>
+    ::accumulateSpringJacobianProduct(
+    const StateVector<TPrecision>& vector,
+    StateVector<TPrecision>& result,
+    bool includeDamping
+)
 {
-    std::vector<double> output;
+    auto inputs = convertPrecision(
+        vector.data(),
+        3 * _particleStride,
+        _forceVelocities
+    );
 
-    for (const auto& particle: _particleState)
+    auto outputs = beginAccumulation(
+        result.data(),
+        3 * _particleStride,
+        _forceOutput
+    );
+
+    const TForcePrecision* input[] = {
+        inputs,
+        inputs + _particleStride,
+        inputs + 2 * _particleStride
+    };
+
+    TForcePrecision* output[] = {
+        outputs,
+        outputs + _particleStride,
+        outputs + 2 * _particleStride
+    };
+
+    if (_threadPool.getThreadCount() > 1 && !_springColorOffsets.empty())
     {
-        output.push_back(particle.velocity.x);
-        output.push_back(particle.velocity.y);
-        output.push_back(particle.velocity.z);
+        for (std::size_t c = 0; c + 1 < _springColorOffsets.size(); ++c)
+        {
+            auto classBegin = _springColorOffsets[c];
+            _threadPool.parallelFor(
+                _springColorOffsets[c + 1] - classBegin,
+                [&](std::size_t begin, std::size_t end) {
+                    accumulateInternalSpringJacobianProduct(
+                        _internalSprings,
+                        _internalLinearization,
+                        classBegin + begin,
+                        classBegin + end,
+                        input,
+                        output,
+                        includeDamping
+                    );
+                }
+            );
+        }
+    }
+    else
+    {
+        accumulateInternalSpringJacobianProduct(
+            _internalSprings,
+            _internalLinearization,
+            0,
+            _internalSprings.size(),
+            input,
+            output,
+            includeDamping
+        );
+    }
+
+    if (!_latticeStencil.empty())
+    {
+        const TForcePrecision* position[] = {
+            field(_linearizationPositions, PositionX),
+            field(_linearizationPositions, PositionY),
+            field(_linearizationPositions, PositionZ)
+        };
 
-        output.push_back(particle.netForce.x);
-        output.push_back(particle.netForce.y);
-        output.push_back(particle.netForce.z);
+        forEachStencilPlane([&](int z) {
+            accumulateLatticeStencilJacobianProduct(
+                _latticeStencil,
+                z,
+                position,
+                _linearizationStep,
+                input,
+                output,
+                includeDamping
+            );
+        });
     }
 
-    return output;
+    accumulateAnchorSpringJacobianProduct(
+        _anchorSprings,
+        _anchorLinearization,
+        input,
+        output,
+        includeDamping
+    );
+
+    commitAccumulation(result.data(), outputs, 3 * _particleStride);
 }
 
-void ParticleSystem::applyRandomDisturbance()
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::calculateForces(
+    const StateVector<TPrecision>& state,
+    StateVector<TPrecision>& derivative
+)
 {
-    std::random_device randomDevice;
-    std::default_random_engine randomEngine(randomDevice());
-    std::uniform_int_distribution<double> uniformDist(-1, 1);
-    for (auto& particle: _particleState)
+    const auto blockSize = 3 * _particleStride;
+    auto positions = convertPrecision(
+        field(state, PositionX),
+        blockSize,
+        _forcePositions
+    );
+    auto velocities = convertPrecision(
+        field(derivative, PositionX),
+        blockSize,
+        _forceVelocities
+    );
+    auto forces = beginAccumulation(
+        field(derivative, MomentumX),
+        blockSize,
+        _forceOutput
+    );
+
+    SpringKernelFields<TForcePrecision> fields{
+        {
+            positions,
+            positions + _particleStride,
+            positions + 2 * _particleStride
+        },
+        {
+            velocities,
+            velocities + _particleStride,
+            velocities + 2 * _particleStride
+        },
+        {
+            forces,
+            forces + _particleStride,
+            forces + 2 * _particleStride
+        }
+    };
+
+    if (_forceAccumulation == ForceAccumulation::Gather
+        && !_springColorOffsets.empty())
+    {
+        _threadPool.parallelFor(
+            _particleCount,
+            [&](std::size_t begin, std::size_t end) {
+                gatherInternalSpringForces(
+                    _internalSprings,
+                    _springAdjacency,
+                    begin,
+                    end,
+                    fields
+                );
+            }
+        );
+    }
+    else if (_threadPool.getThreadCount() > 1 && !_springColorOffsets.empty())
     {
-        particle.momentum.x = uniformDist(randomEngine);
-        particle.momentum.y = uniformDist(randomEngine);
-        particle.momentum.z = uniformDist(randomEngine);
+        for (std::size_t c = 0; c + 1 < _springColorOffsets.size(); ++c)
+        {
+            auto classBegin = _springColorOffsets[c];
+            _threadPool.parallelFor(
+                _springColorOffsets[c + 1] - classBegin,
+                [&](std::size_t begin, std::size_t end) {
+                    accumulateInternalSpringForces(
+                        _internalSprings,
+                        classBegin + begin,
+                        classBegin + end,
+                        fields,
+                        _simdLevel
+                    );
+                }
+            );
+        }
     }
+    else
+    {
+        accumulateInternalSpringForces(
+            _internalSprings,
+            0,
+            _internalSprings.size(),
+            fields,
+            _simdLevel
+        );
+    }
+
+    if (!_latticeStencil.empty())
+    {
+        forEachStencilPlane([&](int z) {
+            accumulateLatticeStencilForces(_latticeStencil, z, fields);
+        });
+    }
+
+    accumulateAnchorSpringForces(_anchorSprings, _staticParticles, fields);
+
+    if (!_contacts.empty())
+    {
+        _threadPool.parallelFor(
+            _particleCount,
+            [&](std::size_t begin, std::size_t end) {
+                accumulateContactForces(
+                    _contacts,
+                    begin,
+                    end,
+                    _contactDistance,
+                    _contactStiffness,
+                    fields
+                );
+            }
+        );
+    }
+
+    commitAccumulation(field(derivative, MomentumX), forces, blockSize);
 }
 
-void ParticleSystem::updateSoftBoxParticlesMass(double particleMass)
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::updateParticles(
+    StateVector<TPrecision>& derivative
+)
 {
-    for (auto& particle: _particleState)
+    for (auto axis = 0; axis < 3; ++axis)
     {
-        particle.invMass = 1.0 / particleMass;
+        auto velocity = field(derivative, ParticleStateField(PositionX + axis));
+        auto force = field(derivative, ParticleStateField(MomentumX + axis));
+
+        for (std::size_t i = 0; i < _particleStride; ++i)
+        {
+            force[i] = -_movementAttenuationFactor * velocity[i];
+        }
     }
 }
 
-void ParticleSystem::updateSoftBoxConstraints(
-    double springConstant,
-    double springAttenuation
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::resizeParticleStorage(
+    std::size_t stride
 )
 {
-    for (auto& constraint: _constraints)
+    const std::size_t cLanesPerCacheLine =
+        AlignedAllocator<TPrecision>::alignment / sizeof(TPrecision);
+    stride = (stride + cLanesPerCacheLine - 1)
+        / cLanesPerCacheLine * cLanesPerCacheLine;
+
+    StateVector<TPrecision> state(ParticleStateFieldCount * stride, 0.0);
+    for (auto f = 0; f < ParticleStateFieldCount; ++f)
     {
-        if (constraint.a < 0 || constraint.b < 0)
+        std::copy(
+            _state.data() + f * _particleStride,
+            _state.data() + f * _particleStride + _particleCount,
+            state.data() + f * stride
+        );
+    }
+
+    _invMass.resize(stride, 0.0);
+    _state.swap(state);
+    _particleStride = stride;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::applyRandomDisturbance()
+{
+    wakeUp();
+
+    std::random_device randomDevice;
+    std::default_random_engine randomEngine(randomDevice());
+    std::uniform_real_distribution<double> uniformDist(-1, 1);
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto momentum = field(_state, ParticleStateField(MomentumX + axis));
+        for (std::size_t i = 0; i < _particleCount; ++i)
         {
-            continue;
+            momentum[i] = uniformDist(randomEngine);
         }
+    }
+}
 
-        constraint.springConstant = springConstant;
-        constraint.attenuationFactor = springAttenuation;
+template <typename TPrecision, typename TForcePrecision>
+void
+BasicParticleSystem<TPrecision, TForcePrecision>::updateSoftBoxParticlesMass(
+    double particleMass
+)
+{
+    const auto begin = std::begin(_invMass);
+    const auto end = std::begin(_invMass) + _particleCount;
+    if (!changesUniformValue(begin, end, 1.0 / particleMass))
+    {
+        return;
     }
+
+    // Unchanged settings keep the integrator's cached first stage.
+    _integrator.invalidate();
+    wakeUp();
+    std::fill(begin, end, 1.0 / particleMass);
 }
 
-void ParticleSystem::updateFrameConstraints(
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::updateSoftBoxConstraints(
     double springConstant,
     double springAttenuation
 )
 {
-    for (auto& constraint: _constraints)
+    auto& stiffness = _internalSprings.stiffness;
+    auto& damping = _internalSprings.damping;
+    if (!changesUniformValue(stiffness.begin(), stiffness.end(), springConstant)
+        && !changesUniformValue(
+            damping.begin(),
+            damping.end(),
+            springAttenuation
+        )
+        && _latticeStencil.stiffness
+            == static_cast<TForcePrecision>(springConstant)
+        && _latticeStencil.damping
+            == static_cast<TForcePrecision>(springAttenuation))
     {
-        if (constraint.a >= 0 && constraint.b >= 0)
-        {
-            continue;
-        }
+        return;
+    }
 
-        constraint.springConstant = springConstant;
-        constraint.attenuationFactor = springAttenuation;
+    _integrator.invalidate();
+    wakeUp();
+
+    std::fill(stiffness.begin(), stiffness.end(), springConstant);
+    std::fill(damping.begin(), damping.end(), springAttenuation);
+    _latticeStencil.stiffness = springConstant;
+    _latticeStencil.damping = springAttenuation;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::updateFrameConstraints(
+    double springConstant,
+    double springAttenuation
+)
+{
+    auto& stiffness = _anchorSprings.stiffness;
+    auto& damping = _anchorSprings.damping;
+    if (!changesUniformValue(stiffness.begin(), stiffness.end(), springConstant)
+        && !changesUniformValue(
+            damping.begin(),
+            damping.end(),
+            springAttenuation
+        ))
+    {
+        return;
     }
+
+    _integrator.invalidate();
+    wakeUp();
+
+    std::fill(stiffness.begin(), stiffness.end(), springConstant);
+    std::fill(damping.begin(), damping.end(), springAttenuation);
 }
 
-void ParticleSystem::updateEnvironmentConstant(
+template <typename TPrecision, typename TForcePrecision>
+void
+BasicParticleSystem<TPrecision, TForcePrecision>::updateEnvironmentConstant(
     double movementAttenuationFactor,
     double elasticCollisionFactor
 )
 {
+    if (movementAttenuationFactor != _movementAttenuationFactor
+        || elasticCollisionFactor != _elasticCollisionFactor)
+    {
+        _integrator.invalidate();
+        wakeUp();
+    }
+
     _movementAttenuationFactor = movementAttenuationFactor;
     _elasticCollisionFactor = elasticCollisionFactor;
 }
 
-bool ParticleSystem::checkInterpenetration()
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setSimdLevel(
+    SimdLevel level
+)
 {
-    auto minPosition = -0.5 * _roomSize;
-    auto maxPosition = +0.5 * _roomSize;
-    for (const auto& particle: _particleState)
+    _simdLevel = level;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setForceAccumulation(
+    ForceAccumulation accumulation
+)
+{
+    _forceAccumulation = accumulation;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setThreadCount(
+    int threadCount
+)
+{
+    _threadPool.setThreadCount(threadCount);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setIntegrator(
+    IntegratorType type
+)
+{
+    _integrator.setType(type);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setIntegratorTolerances(
+    double absolute,
+    double relative
+)
+{
+    _integrator.setTolerances(absolute, relative);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setLinearSolverSettings(
+    double tolerance,
+    int maxIterations
+)
+{
+    _integrator.setLinearSolverSettings(tolerance, maxIterations);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setCollisionMode(
+    CollisionMode mode
+)
+{
+    _collisionMode = mode;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setSelfCollision(
+    double distance,
+    double stiffness
+)
+{
+    const auto contactDistance = static_cast<TForcePrecision>(
+        std::max(distance, 0.0)
+    );
+    const auto contactStiffness = static_cast<TForcePrecision>(stiffness);
+    if (contactDistance != _contactDistance
+        || contactStiffness != _contactStiffness)
     {
-        if (glm::any(glm::lessThan(particle.position, minPosition)))
-        {
-            return true;
-        }
+        _integrator.invalidate();
+        wakeUp();
+    }
 
-        if (glm::any(glm::greaterThan(particle.position, maxPosition)))
+    _contactDistance = contactDistance;
+    _contactStiffness = contactStiffness;
+    _contacts.clear();
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::findContacts()
+{
+    // Candidates are searched a bit further than the contact distance, so
+    // pairs closing in during the step are not missed.
+    const TForcePrecision cSearchMargin = 1.5;
+
+    if (_contactDistance <= 0)
+    {
+        _contacts.clear();
+        return;
+    }
+
+    auto positions = convertPrecision(
+        field(_state, PositionX),
+        3 * _particleStride,
+        _forcePositions
+    );
+
+    const TForcePrecision* position[] = {
+        positions,
+        positions + _particleStride,
+        positions + 2 * _particleStride
+    };
+
+    const auto searchDistance = cSearchMargin * _contactDistance;
+    _spatialHash.update(position, _particleCount, searchDistance, _threadPool);
+    _spatialHash.findContacts(searchDistance, _threadPool, _contacts);
+}
+
+template <typename TPrecision, typename TForcePrecision>
+bool BasicParticleSystem<TPrecision, TForcePrecision>::checkInterpenetration()
+{
+    auto maxPosition = +0.5 * _roomSize;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto position = field(_state, ParticleStateField(PositionX + axis));
+        for (std::size_t i = 0; i < _particleCount; ++i)
         {
-            return true;
+            if (std::abs(position[i]) > maxPosition[axis])
+            {
+                return true;
+            }
         }
     }
 
     return false;
 }
 
-void ParticleSystem::applyImpulsesToCollidingContacts()
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>
+    ::applyImpulsesToCollidingContacts()
 {
     auto epsilon = 10e-5;
-    for (auto& particle: _particleState)
+    TPrecision* position[] = {
+        field(_state, PositionX),
+        field(_state, PositionY),
+        field(_state, PositionZ)
+    };
+
+    TPrecision* momentum[] = {
+        field(_state, MomentumX),
+        field(_state, MomentumY),
+        field(_state, MomentumZ)
+    };
+
+    for (std::size_t i = 0; i < _particleCount; ++i)
     {
         bool applyPentalty = false;
-        if (particle.position.x < -_roomSize.x / 2 + epsilon)
+        for (auto axis = 0; axis < 3; ++axis)
         {
-            if (particle.momentum.x < 0.0f)
+            if (position[axis][i] < -_roomSize[axis] / 2 + epsilon)
+            {
+                if (momentum[axis][i] < 0.0f)
+                {
+                    momentum[axis][i] = -momentum[axis][i];
+                }
+
+                applyPentalty = true;
+            } else if (position[axis][i] > _roomSize[axis] / 2 - epsilon)
             {
-                particle.momentum.x = -particle.momentum.x;
+                if (momentum[axis][i] > 0.0f)
+                {
+                    momentum[axis][i] = -momentum[axis][i];
+                }
+
+                applyPentalty = true;
             }
-            applyPentalty = true;
-        } else if (particle.position.x > _roomSize.x / 2 - epsilon)
+        }
+
+        if (applyPentalty)
         {
-            if (particle.momentum.x > 0.0f)
+            for (auto axis = 0; axis < 3; ++axis)
             {
-                particle.momentum.x = -particle.momentum.x;
+                momentum[axis][i] *= _elasticCollisionFactor;
             }
-            applyPentalty = true;
         }
+    }
+}
 
-        if (particle.position.y < -_roomSize.y / 2 + epsilon)
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::resolveWallContacts(
+    double dt
+)
+{
+    auto maxPosition = +0.5 * _roomSize;
+    for (std::size_t i = 0; i < _particleCount; ++i)
+    {
+        bool applyPenalty = false;
+        double impactFraction[3];
+        for (auto axis = 0; axis < 3; ++axis)
         {
-            if (particle.momentum.y < 0.0f)
+            auto start = _stepStartState[
+                (PositionX + axis) * _particleStride + i
+            ];
+            auto end = _state[(PositionX + axis) * _particleStride + i];
+            impactFraction[axis] = 1.0;
+
+            if (std::abs(end) <= maxPosition[axis])
             {
-                particle.momentum.y = -particle.momentum.y;
+                continue;
             }
 
-            applyPentalty = true;
-        } else if (particle.position.y > _roomSize.y / 2 - epsilon)
-        {
-            if (particle.momentum.y > 0.0f)
+            // The path within the step is taken as a straight line.
+            auto wall = std::copysign(maxPosition[axis], end);
+            auto travel = end - start;
+            impactFraction[axis] = std::abs(travel) > 0.0
+                ? std::max(0.0, std::min(1.0, (wall - start) / travel))
+                : 0.0;
+
+            auto& momentum = _state[(MomentumX + axis) * _particleStride + i];
+            if (momentum * wall > 0.0)
             {
-                particle.momentum.y = -particle.momentum.y;
+                momentum = -momentum;
             }
 
-            applyPentalty = true;
+            applyPenalty = true;
+        }
+
+        if (!applyPenalty)
+        {
+            continue;
         }
 
-        if (particle.position.z < -_roomSize.z / 2 + epsilon)
+        for (auto axis = 0; axis < 3; ++axis)
         {
-            if (particle.momentum.z < 0.0f)
+            auto& position = _state[(PositionX + axis) * _particleStride + i];
+            auto& momentum = _state[(MomentumX + axis) * _particleStride + i];
+            momentum *= _elasticCollisionFactor;
+
+            // Move off the wall with the bounced velocity for the rest of
+            // the step.
+            if (impactFraction[axis] < 1.0)
             {
-                particle.momentum.z = -particle.momentum.z;
+                auto wall = std::copysign(maxPosition[axis], position);
+                auto remainingTime = (1.0 - impactFraction[axis]) * dt;
+                position = std::max(
+                    -maxPosition[axis],
+                    std::min(
+                        maxPosition[axis],
+                        wall + _invMass[i] * momentum * remainingTime
+                    )
+                );
             }
+        }
+    }
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setColliders(
+    const std::vector<Collider>& colliders
+)
+{
+    if (colliders != _colliders)
+    {
+        wakeUp();
+    }
+
+    _colliders = colliders;
+    _colliderStatistics = ColliderStatistics{};
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>
+    ::resolveColliderContacts()
+{
+    // Small enough for the batch results to stay in L1, large enough for
+    // the cull to pay off.
+    const std::size_t cBatchSize = 64;
+
+    _colliderStatistics = ColliderStatistics{};
+    if (_colliders.empty() || _particleCount == 0)
+    {
+        return;
+    }
+
+    // The colliders missing all particles are dropped before the batches.
+    glm::dvec3 sceneLow;
+    glm::dvec3 sceneHigh;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        const auto positions = _state.data()
+            + (PositionX + axis) * _particleStride;
+        const auto range = std::minmax_element(
+            positions,
+            positions + _particleCount
+        );
+        sceneLow[axis] = *range.first;
+        sceneHigh[axis] = *range.second;
+    }
 
-            applyPentalty = true;
-        } else if (particle.position.z > _roomSize.z / 2 - epsilon)
+    _activeColliders.clear();
+    for (const auto& collider: _colliders)
+    {
+        if (collider.mayOverlap(sceneLow, sceneHigh, 0.0))
         {
-            if (particle.momentum.z > 0.0f)
+            _activeColliders.push_back(&collider);
+        }
+    }
+
+    const auto batchCount = (_particleCount + cBatchSize - 1) / cBatchSize;
+    const auto bounce = static_cast<TPrecision>(1.0 + _elasticCollisionFactor);
+    std::atomic<std::size_t> evaluatedTests{0};
+    std::atomic<std::size_t> contacts{0};
+
+    _threadPool.parallelFor(
+        batchCount,
+        [&](std::size_t first, std::size_t last) {
+            TPrecision distance[cBatchSize];
+            TPrecision normalX[cBatchSize];
+            TPrecision normalY[cBatchSize];
+            TPrecision normalZ[cBatchSize];
+            TPrecision* const normal[3] = {normalX, normalY, normalZ};
+            std::size_t evaluated = 0;
+            std::size_t found = 0;
+
+            for (auto batch = first; batch < last; ++batch)
             {
-                particle.momentum.z = -particle.momentum.z;
+                const auto begin = batch * cBatchSize;
+                const auto count = std::min(cBatchSize, _particleCount - begin);
+                TPrecision* const position[3] = {
+                    field(_state, PositionX) + begin,
+                    field(_state, PositionY) + begin,
+                    field(_state, PositionZ) + begin
+                };
+                TPrecision* const momentum[3] = {
+                    field(_state, MomentumX) + begin,
+                    field(_state, MomentumY) + begin,
+                    field(_state, MomentumZ) + begin
+                };
+
+                glm::dvec3 low;
+                glm::dvec3 high;
+                for (auto axis = 0; axis < 3; ++axis)
+                {
+                    const auto range = std::minmax_element(
+                        position[axis],
+                        position[axis] + count
+                    );
+                    low[axis] = *range.first;
+                    high[axis] = *range.second;
+                }
+
+                for (auto collider: _activeColliders)
+                {
+                    if (!collider->mayOverlap(low, high, 0.0))
+                    {
+                        continue;
+                    }
+
+                    ++evaluated;
+                    evaluateCollider(
+                        *collider,
+                        position,
+                        count,
+                        distance,
+                        normal
+                    );
+
+                    for (std::size_t i = 0; i < count; ++i)
+                    {
+                        if (distance[i] >= 0)
+                        {
+                            continue;
+                        }
+
+                        ++found;
+                        TPrecision normalMomentum = 0;
+                        for (auto axis = 0; axis < 3; ++axis)
+                        {
+                            position[axis][i] -= distance[i] * normal[axis][i];
+                            normalMomentum +=
+                                momentum[axis][i] * normal[axis][i];
+                        }
+
+                        if (normalMomentum >= 0)
+                        {
+                            continue;
+                        }
+
+                        for (auto axis = 0; axis < 3; ++axis)
+                        {
+                            momentum[axis][i] -=
+                                bounce * normalMomentum * normal[axis][i];
+                        }
+                    }
+                }
             }
 
-            applyPentalty = true;
+            evaluatedTests += evaluated;
+            contacts += found;
         }
+    );
 
-        if (applyPentalty)
-        {
-            particle.momentum = _elasticCollisionFactor * particle.momentum;
-        }
+    _colliderStatistics.candidateTests = batchCount * _colliders.size();
+    _colliderStatistics.evaluatedTests = evaluatedTests;
+    _colliderStatistics.contacts = contacts;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::setSleepThresholds(
+    double kineticEnergy,
+    double force,
+    double delay
+)
+{
+    _sleepKineticEnergy = std::max(kineticEnergy, 0.0);
+    _sleepForce = std::max(force, 0.0);
+    _sleepDelay = std::max(delay, 0.0);
+    if (_sleepKineticEnergy <= 0.0)
+    {
+        wakeUp();
+    }
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::wakeUp()
+{
+    _sleeping = false;
+    _restTime = 0.0;
+}
+
+template <typename TPrecision, typename TForcePrecision>
+void BasicParticleSystem<TPrecision, TForcePrecision>::updateSleepState(
+    double dt
+)
+{
+    if (_sleepKineticEnergy <= 0.0 || _particleCount == 0)
+    {
+        return;
     }
+
+    // Kinetic energy first, the residual force costs a derivative evaluation.
+    const auto momentumX = field(_state, MomentumX);
+    const auto momentumY = field(_state, MomentumY);
+    const auto momentumZ = field(_state, MomentumZ);
+    TPrecision maxEnergy = 0;
+    for (std::size_t i = 0; i < _particleCount; ++i)
+    {
+        maxEnergy = std::max(
+            maxEnergy,
+            (momentumX[i] * momentumX[i]
+                + momentumY[i] * momentumY[i]
+                + momentumZ[i] * momentumZ[i]) * _invMass[i]
+        );
+    }
+
+    if (0.5 * maxEnergy > _sleepKineticEnergy)
+    {
+        _restTime = 0.0;
+        return;
+    }
+
+    // evaluateDerivative without its count, see getSleepForceEvaluationCount.
+    ++_sleepForceEvaluations;
+    evaluateVelocity(_state, _sleepDerivative);
+    updateParticles(_sleepDerivative);
+    calculateForces(_state, _sleepDerivative);
+
+    const auto forceX = field(_sleepDerivative, MomentumX);
+    const auto forceY = field(_sleepDerivative, MomentumY);
+    const auto forceZ = field(_sleepDerivative, MomentumZ);
+    TPrecision maxSquaredForce = 0;
+    for (std::size_t i = 0; i < _particleCount; ++i)
+    {
+        maxSquaredForce = std::max(
+            maxSquaredForce,
+            forceX[i] * forceX[i]
+                + forceY[i] * forceY[i]
+                + forceZ[i] * forceZ[i]
+        );
+    }
+
+    if (maxSquaredForce > _sleepForce * _sleepForce)
+    {
+        _restTime = 0.0;
+        return;
+    }
+
+    _restTime += dt;
+    if (_restTime < _sleepDelay)
+    {
+        return;
+    }
+
+    // Frozen at rest, and drawn without blending towards older positions.
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto momentum = field(_state, ParticleStateField(MomentumX + axis));
+        std::fill(momentum, momentum + _particleCount, 0.0);
+    }
+
+    _previousPositions.assign(
+        _state.begin(),
+        _state.begin() + MomentumX * _particleStride
+    );
+
+    _accumulatedTime = 0.0;
+    _sleeping = true;
 }
 
+template class BasicParticleStateView<float>;
+template class BasicParticleStateView<double>;
+
+template class BasicParticleSystem<double>;
+template class BasicParticleSystem<float>;
+template class BasicParticleSystem<double, float>;
+
 }
@@ -1,18 +1,41 @@
 #include "SoftBox.hpp"
 #include "imgui.h"
+#include "easylogging++.h"
+#include "ParticleSnapshot.hpp"
+#include "Trajectory.hpp"
+#include <algorithm>
 #include <cassert>
 #include <random>
+#include <thread>
 
 namespace application
 {
 
 SoftBox::SoftBox():
-    _particleMatrixSize{4, 4, 4},
+    SoftBox{{4, 4, 4}}
+{
+}
+
+SoftBox::SoftBox(const glm::ivec3& particleMatrixSize):
+    _particleMatrixSize{particleMatrixSize},
     _particleMass{0.015f},
     _springsConstant{30.0f},
     _springsAttenuation{1.0f},
     _elasticCollisionFactor{1.0f},
-    _movementAttenuationFactor{0.05f}
+    _movementAttenuationFactor{0.05f},
+    _threadCount{1},
+    _integratorType{static_cast<int>(IntegratorType::RungeKutta4)},
+    _absoluteTolerance{1e-6f},
+    _relativeTolerance{1e-4f},
+    _collisionMode{static_cast<int>(CollisionMode::StepBisection)},
+    _fixedTimestepEnabled{false},
+    _fixedTimestep{0.005},
+    _maxSubsteps{8},
+    _latticeSpringStorage{static_cast<int>(LatticeSpringStorage::Explicit)},
+    _selfCollisionEnabled{false},
+    _contactStiffness{200.0f},
+    _sleepingEnabled{false},
+    _contactDistance{}
 {
 }
 
@@ -23,6 +46,13 @@ SoftBox::~SoftBox()
 void SoftBox::distributeUniformly(const fw::AABB<glm::dvec3>& box)
 {
     _particleSystem.clear();
+    _particleSystem.setThreadCount(_threadCount);
+    auto spacing = (box.max - box.min) / glm::dvec3{_particleMatrixSize - 1};
+    _contactDistance = 0.5 * std::min({spacing.x, spacing.y, spacing.z});
+
+    _particleSystem.reserveParticles(
+        _particleMatrixSize.x * _particleMatrixSize.y * _particleMatrixSize.z
+    );
 
     for (auto z = 0; z < _particleMatrixSize.z; ++z)
     {
@@ -59,6 +89,8 @@ void SoftBox::distributeUniformly(const fw::AABB<glm::dvec3>& box)
 
     fixCurrentBoxPositionUsingSprings();
     connectBoxToFrame();
+    updateFrameAnchors();
+    _particleSystem.finalizeTopology();
 }
 
 glm::ivec3 SoftBox::getParticleMatrixSize() const
@@ -66,16 +98,30 @@ glm::ivec3 SoftBox::getParticleMatrixSize() const
     return _particleMatrixSize;
 }
 
-const std::vector<ParticleState> SoftBox::getSoftBoxParticles() const
+ParticleStateView SoftBox::getSoftBoxParticles() const
 {
     return _particleSystem.getParticleStates();
 }
 
-const ParticleState& SoftBox::getSoftBoxParticle(glm::ivec3 index) const
+ParticleState SoftBox::getSoftBoxParticle(glm::ivec3 index) const
 {
     return getSoftBoxParticles()[getParticleIndex(index)];
 }
 
+glm::dvec3 SoftBox::getInterpolatedPosition(glm::ivec3 index) const
+{
+    return _particleSystem.getInterpolatedPosition(getParticleIndex(index));
+}
+
+void SoftBox::getInterpolatedPositions(std::vector<glm::vec3>& positions) const
+{
+    positions.resize(_particleSystem.getParticleCount());
+    for (std::size_t i = 0; i < positions.size(); ++i)
+    {
+        positions[i] = _particleSystem.getInterpolatedPosition(i);
+    }
+}
+
 int SoftBox::getParticleIndex(glm::ivec3 coordinate) const
 {
     assert(coordinate.x >= 0 && coordinate.x < _particleMatrixSize.x);
@@ -107,6 +153,18 @@ void SoftBox::updateUserInterface()
             0.0f,
             1.0f
         );
+
+        const char* collisionModeNames[] = {
+            getCollisionModeName(CollisionMode::StepBisection),
+            getCollisionModeName(CollisionMode::PerParticle)
+        };
+
+        ImGui::Combo(
+            "Wall collisions",
+            &_collisionMode,
+            collisionModeNames,
+            static_cast<int>(CollisionMode::CollisionModeCount)
+        );
     }
 
     if (ImGui::CollapsingHeader("Soft-box settings"))
@@ -120,10 +178,259 @@ void SoftBox::updateUserInterface()
 
         ImGui::SliderFloat("Spring constant", &_springsConstant, 0.01f, 100.0f);
         ImGui::SliderFloat("Attenuation", &_springsAttenuation, 0.f, 100.0f);
+
+        ImGui::Checkbox("Self collision", &_selfCollisionEnabled);
+        if (_selfCollisionEnabled)
+        {
+            ImGui::SliderFloat(
+                "Contact stiffness",
+                &_contactStiffness,
+                1.0f,
+                10000.0f,
+                "%.1f",
+                10.0f
+            );
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Performance"))
+    {
+        ImGui::Checkbox("Fixed timestep", &_fixedTimestepEnabled);
+        if (_fixedTimestepEnabled)
+        {
+            // Written back only when edited, so set steps stay exact.
+            auto fixedTimestep = static_cast<float>(_fixedTimestep);
+            if (ImGui::SliderFloat(
+                "Timestep (s)",
+                &fixedTimestep,
+                0.001f,
+                0.01f,
+                "%.4f"
+            ))
+            {
+                _fixedTimestep = fixedTimestep;
+            }
+
+            ImGui::SliderInt("Max substeps", &_maxSubsteps, 1, 32);
+        }
+
+        ImGui::Checkbox("Sleep when settled", &_sleepingEnabled);
+        if (_particleSystem.isSleeping())
+        {
+            ImGui::Text("Soft box is sleeping");
+        }
+
+        ImGui::SliderInt(
+            "Simulation threads",
+            &_threadCount,
+            1,
+            std::max(1, static_cast<int>(std::thread::hardware_concurrency()))
+        );
+
+        const char* integratorNames[] = {
+            getIntegratorName(IntegratorType::SymplecticEuler),
+            getIntegratorName(IntegratorType::VelocityVerlet),
+            getIntegratorName(IntegratorType::Midpoint),
+            getIntegratorName(IntegratorType::RungeKutta4),
+            getIntegratorName(IntegratorType::DormandPrince45),
+            getIntegratorName(IntegratorType::BackwardEuler)
+        };
+
+        ImGui::Combo(
+            "Integrator",
+            &_integratorType,
+            integratorNames,
+            static_cast<int>(IntegratorType::IntegratorTypeCount)
+        );
+
+        if (_particleSystem.getIntegrator() == IntegratorType::DormandPrince45)
+        {
+            ImGui::SliderFloat(
+                "Absolute tolerance",
+                &_absoluteTolerance,
+                1e-9f,
+                1e-2f,
+                "%.1e",
+                10.0f
+            );
+
+            ImGui::SliderFloat(
+                "Relative tolerance",
+                &_relativeTolerance,
+                1e-9f,
+                1e-2f,
+                "%.1e",
+                10.0f
+            );
+
+            const auto& statistics = _particleSystem.getIntegratorStatistics();
+            ImGui::Text("Accepted steps: %llu", statistics.acceptedSteps);
+            ImGui::Text("Rejected steps: %llu", statistics.rejectedSteps);
+        }
+
+        if (_particleSystem.getIntegrator() == IntegratorType::BackwardEuler)
+        {
+            const auto& statistics = _particleSystem.getIntegratorStatistics();
+            ImGui::Text(
+                "CG iterations in last step: %d",
+                statistics.lastLinearSolverIterations
+            );
+        }
     }
 
     _controlFrame.updateUserInterface();
+    applySettings();
+}
+
+void SoftBox::setParticleMass(float particleMass)
+{
+    _particleMass = particleMass;
+}
+
+void SoftBox::setSpringParameters(float springConstant, float attenuation)
+{
+    _springsConstant = springConstant;
+    _springsAttenuation = attenuation;
+}
+
+void SoftBox::setFrameSpringParameters(float springConstant, float attenuation)
+{
+    _controlFrame.setSpringParameters(springConstant, attenuation);
+}
+
+void SoftBox::setFixedTimestep(double step, int maxSubsteps)
+{
+    _fixedTimestepEnabled = step > 0.0;
+    _fixedTimestep = step;
+    _maxSubsteps = maxSubsteps;
+}
+
+void SoftBox::setThreadCount(int threadCount)
+{
+    _threadCount = threadCount;
+}
+
+void SoftBox::setIntegrator(IntegratorType type)
+{
+    _integratorType = static_cast<int>(type);
+}
+
+void SoftBox::setSelfCollision(bool enabled, float contactStiffness)
+{
+    _selfCollisionEnabled = enabled;
+    _contactStiffness = contactStiffness;
+}
 
+void SoftBox::setSleeping(bool enabled)
+{
+    _sleepingEnabled = enabled;
+}
+
+void SoftBox::setColliders(const std::vector<Collider>& colliders)
+{
+    _particleSystem.setColliders(colliders);
+}
+
+bool SoftBox::saveSnapshot(const std::string& path) const
+{
+    return _particleSystem.saveSnapshot(path);
+}
+
+bool SoftBox::loadSnapshot(const std::string& path)
+{
+    ParticleSnapshot snapshot;
+    if (!snapshot.open(path))
+    {
+        return false;
+    }
+
+    const auto particles = static_cast<std::uint64_t>(_particleMatrixSize.x)
+        * _particleMatrixSize.y * _particleMatrixSize.z;
+    if (snapshot.getHeader().particleCount != particles)
+    {
+        LOG(ERROR) << "Snapshot " << path << " holds "
+            << snapshot.getHeader().particleCount << " particles, the box "
+            << particles << ".";
+        return false;
+    }
+
+    if (!_particleSystem.loadSnapshot(snapshot))
+    {
+        return false;
+    }
+
+    // Restored parameters become the settings, applySettings keeps them.
+    const auto& header = snapshot.getHeader();
+    _movementAttenuationFactor =
+        static_cast<float>(header.movementAttenuationFactor);
+    _elasticCollisionFactor = static_cast<float>(header.elasticCollisionFactor);
+    _collisionMode = header.collisionMode;
+    _integratorType = header.integrator;
+
+    _fixedTimestepEnabled = header.fixedTimestep > 0.0;
+    if (_fixedTimestepEnabled)
+    {
+        _fixedTimestep = header.fixedTimestep;
+    }
+
+    _maxSubsteps = header.maxSubsteps;
+    _selfCollisionEnabled = header.contactDistance > 0.0;
+    if (_selfCollisionEnabled)
+    {
+        _contactDistance = header.contactDistance;
+    }
+
+    _contactStiffness = static_cast<float>(header.contactStiffness);
+    _sleepingEnabled = header.sleepKineticEnergy > 0.0;
+
+    double invMass{};
+    if (snapshot.readReals(SnapshotInvMass, 0, 1, &invMass) && invMass > 0.0)
+    {
+        _particleMass = static_cast<float>(1.0 / invMass);
+    }
+
+    // Lattices without explicit springs keep their constants in the stencil.
+    double springConstant = header.stencilStiffness;
+    double springAttenuation = header.stencilDamping;
+    snapshot.readReals(SnapshotInternalStiffness, 0, 1, &springConstant);
+    snapshot.readReals(SnapshotInternalDamping, 0, 1, &springAttenuation);
+    _springsConstant = static_cast<float>(springConstant);
+    _springsAttenuation = static_cast<float>(springAttenuation);
+
+    double frameSpringConstant{};
+    double frameSpringAttenuation{};
+    if (snapshot.readReals(SnapshotAnchorStiffness, 0, 1, &frameSpringConstant)
+        && snapshot.readReals(
+            SnapshotAnchorDamping,
+            0,
+            1,
+            &frameSpringAttenuation
+        ))
+    {
+        _controlFrame.setSpringParameters(
+            static_cast<float>(frameSpringConstant),
+            static_cast<float>(frameSpringAttenuation)
+        );
+    }
+
+    return true;
+}
+
+void SoftBox::recordTrajectory(
+    TrajectoryRecorder& recorder,
+    double time
+) const
+{
+    recorder.record(_particleSystem, time);
+}
+
+void SoftBox::setLatticeSpringStorage(LatticeSpringStorage storage)
+{
+    _latticeSpringStorage = static_cast<int>(storage);
+}
+
+void SoftBox::applySettings()
+{
     _particleSystem.updateSoftBoxParticlesMass(_particleMass);
     _particleSystem.updateSoftBoxConstraints(
         _springsConstant,
@@ -139,11 +446,45 @@ void SoftBox::updateUserInterface()
         _movementAttenuationFactor,
         _elasticCollisionFactor
     );
+
+    _particleSystem.setCollisionMode(CollisionMode(_collisionMode));
+    _particleSystem.setSelfCollision(
+        _selfCollisionEnabled ? _contactDistance : 0.0,
+        _contactStiffness
+    );
+
+    _particleSystem.setFixedTimestep(
+        _fixedTimestepEnabled ? _fixedTimestep : 0.0,
+        _maxSubsteps
+    );
+
+    // About 1 cm/s for the default particle mass, held for half a second.
+    const double cSleepKineticEnergy = 1e-6;
+    const double cSleepForce = 1e-3;
+    const double cSleepDelay = 0.5;
+    _particleSystem.setSleepThresholds(
+        _sleepingEnabled ? cSleepKineticEnergy : 0.0,
+        cSleepForce,
+        cSleepDelay
+    );
+
+    _particleSystem.setThreadCount(_threadCount);
+    _particleSystem.setIntegrator(IntegratorType(_integratorType));
+    _particleSystem.setIntegratorTolerances(
+        _absoluteTolerance,
+        _relativeTolerance
+    );
 }
 
 void SoftBox::update(double dt)
 {
-    std::vector<ParticleState> staticParticles;
+    updateFrameAnchors();
+    _particleSystem.update(dt);
+}
+
+void SoftBox::updateFrameAnchors()
+{
+    _frameAnchors.clear();
     auto frameTransform = _controlFrame.getModelMatrix();
     for (auto zsign = 0; zsign <= 1; ++zsign)
     {
@@ -158,52 +499,33 @@ void SoftBox::update(double dt)
                 };
 
                 glm::vec3 fixedPoint{frameTransform * glm::vec4{local, 1.0}};
-                staticParticles.push_back({fixedPoint, {0,0,0}});
+                _frameAnchors.push_back({fixedPoint, {0,0,0}});
             }
         }
     }
 
-    _particleSystem.setStaticParticles(staticParticles);
-    _particleSystem.update(dt);
+    _particleSystem.setStaticParticles(_frameAnchors);
 }
 
 void SoftBox::fixCurrentBoxPositionUsingSprings()
 {
-    auto matrixSize = getParticleMatrixSize();
-    for (auto z = 0; z < matrixSize.z; ++z)
-    for (auto y = 0; y < matrixSize.y; ++y)
-    for (auto x = 0; x < matrixSize.x; ++x)
-    {
-        auto& mainParticle = getSoftBoxParticle({x, y, z});
-        auto mainIndex = getParticleIndex({x, y, z});
-
-        for (auto i = -1; i <= 1; ++i)
-        for (auto j = -1; j <= 1; ++j)
-        for (auto k = 0; k <= 1; ++k)
-        {
-            if (i == 0 && j == 0 && k == 0) { continue; }
-            if (x + i < 0 || x + i >= matrixSize.x
-                || y + j < 0 || y + j >= matrixSize.y
-                || z + k < 0 || z + k >= matrixSize.z)
-            {
-                continue;
-            }
-
-            glm::ivec3 coordinate{x + i, y + j, z + k};
-            auto& otherParticle = getSoftBoxParticle(coordinate);
-            auto otherIndex = getParticleIndex(coordinate);
-
-            SpringConstraint constraint;
-            constraint.springLength = glm::length(
-                mainParticle.position - otherParticle.position
-            );
-
-            constraint.a = mainIndex;
-            constraint.b = otherIndex;
+    _topologyStatistics = _particleSystem.addLatticeConstraints(
+        _particleMatrixSize,
+        SpringConstraint{},
+        LatticeSpringStorage(_latticeSpringStorage)
+    );
 
-            _particleSystem.addConstraint(constraint);
-        }
-    }
+    LOG(INFO) << "Built lattice "
+        << _particleMatrixSize.x << "x"
+        << _particleMatrixSize.y << "x"
+        << _particleMatrixSize.z << " ("
+        << getLatticeSpringStorageName(
+            LatticeSpringStorage(_latticeSpringStorage)
+        ) << "): "
+        << _topologyStatistics.springs << " springs, "
+        << _topologyStatistics.springsPerParticle << " per particle, "
+        << _topologyStatistics.springBytes / (1024.0 * 1024.0) << " MiB in "
+        << _topologyStatistics.buildSeconds << " s";
 }
 
 void SoftBox::applyRandomDisturbance()
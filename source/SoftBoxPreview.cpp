@@ -1,90 +1,97 @@
 #include "SoftBoxPreview.hpp"
+#include <vector>
 #include "glm/gtc/matrix_transform.hpp"
-#include "fw/DebugShapes.hpp"
 
 namespace application
 {
 SoftBoxPreview::SoftBoxPreview():
+    _latticeSize{},
     _particleMarkerSize{0.03f}
 {
-    _box = fw::createBox({1.0f, 1.0f, 1.0f});
     _lineSetPreview = std::make_shared<LineSetPreview>();
+    _markerSetPreview = std::make_shared<MarkerSetPreview>();
+
+    _lineMaterial = std::make_shared<fw::Material>();
+    _lineMaterial->setEmissionColor({1.0f, 0.0f, 0.0f});
+
+    _markerMaterial = std::make_shared<fw::Material>();
+    _markerMaterial->setEmissionColor({0.7f, 0.0f, 0.0f});
+    _markerMaterial->setBaseAlbedoColor({1.0f, 0.0f, 0.0f, 1.0f});
 }
 
 SoftBoxPreview::~SoftBoxPreview()
 {
 }
 
-std::vector<fw::GeometryChunk> SoftBoxPreview::render(
-    const SoftBox& softBox
-) const
+void SoftBoxPreview::destroy()
+{
+    _lineSetPreview->destroy();
+    _markerSetPreview->destroy();
+}
+
+void SoftBoxPreview::update(
+    const SoftBox& softBox,
+    const ControlPointStream& stream
+)
+{
+    if (softBox.getParticleMatrixSize() != _latticeSize)
+    {
+        buildConstraintLines(softBox);
+    }
+
+    _lineSetPreview->setPositionStream(stream, {1.0f, 0.0f, 0.0f});
+    _markerSetPreview->setPositionStream(stream);
+}
+
+fw::GeometryChunk SoftBoxPreview::getConstraintLines() const
 {
-    std::vector<fw::GeometryChunk> chunks;
+    return {_lineSetPreview, _lineMaterial, {}};
+}
 
-    glm::mat4 softBoxParticleMarkerScaling = glm::scale(
+fw::GeometryChunk SoftBoxPreview::getParticleMarkers() const
+{
+    auto markerScaling = glm::scale(
         glm::mat4{},
         {_particleMarkerSize, _particleMarkerSize, _particleMarkerSize}
     );
 
-    std::shared_ptr<fw::Material> markerMaterial =
-        std::make_shared<fw::Material>();
-    markerMaterial->setEmissionColor({0.7f, 0.0f, 0.0f});
-    markerMaterial->setBaseAlbedoColor({1.0f, 0.0f, 0.0f, 1.0f});
-
-    const auto& particles = softBox.getSoftBoxParticles();
-    for (const auto& particle: particles)
-    {
-        glm::mat4 translationMatrix = glm::translate(
-            glm::mat4{},
-            glm::vec3{particle.position}
-        );
+    return {_markerSetPreview, _markerMaterial, markerScaling};
+}
 
-        auto modelMatrix = translationMatrix * softBoxParticleMarkerScaling;
-        chunks.push_back({_box, markerMaterial, modelMatrix});
-    }
+void SoftBoxPreview::buildConstraintLines(const SoftBox& softBox)
+{
+    _latticeSize = softBox.getParticleMatrixSize();
 
-    std::shared_ptr<fw::Material> lineMaterial =
-        std::make_shared<fw::Material>();
-    lineMaterial->setEmissionColor({1.0f, 0.0f, 0.0f});
+    // One line to the next particle along each axis, each spring once.
+    const glm::ivec3 steps[] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
 
-    std::vector<fw::VertexColor> vertices;
     std::vector<GLuint> indices;
+    indices.reserve(
+        2 * 3 * static_cast<std::size_t>(_latticeSize.x)
+            * _latticeSize.y * _latticeSize.z
+    );
 
-    auto matrixSize = softBox.getParticleMatrixSize();
-    for (auto z = 0; z < matrixSize.z; ++z)
-    for (auto y = 0; y < matrixSize.y; ++y)
-    for (auto x = 0; x < matrixSize.x; ++x)
+    for (auto z = 0; z < _latticeSize.z; ++z)
+    for (auto y = 0; y < _latticeSize.y; ++y)
+    for (auto x = 0; x < _latticeSize.x; ++x)
     {
-        auto mainParticle = softBox.getSoftBoxParticle({x, y, z});
-        auto currentIndex = softBox.getParticleIndex({x, y, z});
-        vertices.push_back({mainParticle.position, {1.0f, 0.0f, 0.0f}});
-
-        for (auto i = -1; i <= 1; ++i)
-        for (auto j = -1; j <= 1; ++j)
-        for (auto k = 0; k <= 1; ++k)
+        const glm::ivec3 current{x, y, z};
+        for (const auto& step: steps)
         {
-            if (i == 0 && j == 0 && k == 0) { continue; }
-            if ((i != 0 ? 1 : 0) + (j != 0 ? 1 : 0) + (k != 0 ? 1 : 0) != 1)
-            {
-                continue;
-            }
-            if (x + i < 0 || x + i >= matrixSize.x
-                || y + j < 0 || y + j >= matrixSize.y
-                || z + k < 0 || z + k >= matrixSize.z)
+            auto next = current + step;
+            if (next.x >= _latticeSize.x
+                || next.y >= _latticeSize.y
+                || next.z >= _latticeSize.z)
             {
                 continue;
             }
 
-            indices.push_back(currentIndex);
-            indices.push_back(softBox.getParticleIndex({x + i, y + j, z + k}));
+            indices.push_back(softBox.getParticleIndex(current));
+            indices.push_back(softBox.getParticleIndex(next));
         }
     }
 
-    _lineSetPreview->setVertices(vertices);
     _lineSetPreview->setIndices(indices);
-
-    chunks.push_back({_lineSetPreview, lineMaterial, {}});
-    return chunks;
 }
 
 }
@@ -0,0 +1,245 @@
+#include "SoftBoxSurface.hpp"
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include "easylogging++.h"
+#include "ControlPointStream.hpp"
+
+namespace application
+{
+
+namespace
+{
+
+const int cPatchVertices = 16;
+
+/** Locations of the attributes of bezierPatch.vert. */
+const GLuint cLatticeAttribute = 0;
+const GLuint cCountAttribute = 1;
+const GLuint cWeightsUAttribute = 2;
+const GLuint cWeightsVAttribute = 3;
+
+int getStepAxis(glm::ivec3 step)
+{
+    assert(std::abs(step.x) + std::abs(step.y) + std::abs(step.z) == 1);
+    return step.x != 0 ? 0 : (step.y != 0 ? 1 : 2);
+}
+
+/** Index into the stream, x fastest; linear, so steps map to strides. */
+GLint getLatticeIndex(glm::ivec3 latticeSize, glm::ivec3 point)
+{
+    return point.x + latticeSize.x * (point.y + latticeSize.y * point.z);
+}
+
+}
+
+SoftBoxSurface::SoftBoxSurface():
+    _latticeSize{},
+    _vao{},
+    _vbo{},
+    _ebo{},
+    _indexCount{}
+{
+}
+
+SoftBoxSurface::~SoftBoxSurface()
+{
+}
+
+void SoftBoxSurface::destroy()
+{
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteBuffers(1, &_vbo);
+    glDeleteBuffers(1, &_ebo);
+    _vao = 0;
+    _vbo = 0;
+    _ebo = 0;
+    _indexCount = 0;
+    _latticeSize = {};
+}
+
+void SoftBoxSurface::update(const ControlPointStream& stream)
+{
+    if (stream.getLatticeSize() != _latticeSize || _vao == 0)
+    {
+        rebuild(stream.getLatticeSize());
+    }
+}
+
+void SoftBoxSurface::draw() const
+{
+    glBindVertexArray(_vao);
+    glPatchParameteri(GL_PATCH_VERTICES, cPatchVertices);
+    glDrawElements(GL_PATCHES, _indexCount, GL_UNSIGNED_INT, nullptr);
+    glBindVertexArray(0);
+}
+
+std::size_t SoftBoxSurface::getPatchCount() const
+{
+    return static_cast<std::size_t>(_indexCount / cPatchVertices);
+}
+
+void SoftBoxSurface::rebuild(glm::ivec3 latticeSize)
+{
+    _latticeSize = latticeSize;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        _axisWeights[axis] = getBSplineToBezierWeights(latticeSize[axis]);
+    }
+
+    // Same sides and orientations as the former per-side drawing.
+    const auto last = latticeSize - glm::ivec3{1};
+    const glm::ivec3 x{1, 0, 0};
+    const glm::ivec3 y{0, 1, 0};
+    const glm::ivec3 z{0, 0, 1};
+
+    std::vector<PointVertex> points;
+    std::vector<GLuint> indices;
+    addSide({0, 0, 0}, x, y, points, indices);
+    addSide({last.x, 0, last.z}, -x, y, points, indices);
+    addSide({0, 0, 0}, y, z, points, indices);
+    addSide({last.x, last.y, 0}, -y, z, points, indices);
+    addSide({last.x, 0, 0}, -x, z, points, indices);
+    addSide({0, last.y, 0}, x, z, points, indices);
+
+    _indexCount = static_cast<GLsizei>(indices.size());
+
+    if (_vao == 0)
+    {
+        glGenVertexArrays(1, &_vao);
+        glGenBuffers(1, &_vbo);
+        glGenBuffers(1, &_ebo);
+    }
+
+    glBindVertexArray(_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    glBufferData(
+        GL_ARRAY_BUFFER,
+        sizeof(PointVertex) * points.size(),
+        points.data(),
+        GL_STATIC_DRAW
+    );
+
+    glEnableVertexAttribArray(cLatticeAttribute);
+    glVertexAttribIPointer(
+        cLatticeAttribute,
+        3,
+        GL_INT,
+        sizeof(PointVertex),
+        reinterpret_cast<void*>(offsetof(PointVertex, lattice))
+    );
+
+    glEnableVertexAttribArray(cCountAttribute);
+    glVertexAttribIPointer(
+        cCountAttribute,
+        2,
+        GL_INT,
+        sizeof(PointVertex),
+        reinterpret_cast<void*>(offsetof(PointVertex, count))
+    );
+
+    glEnableVertexAttribArray(cWeightsUAttribute);
+    glVertexAttribPointer(
+        cWeightsUAttribute,
+        4,
+        GL_FLOAT,
+        GL_FALSE,
+        sizeof(PointVertex),
+        reinterpret_cast<void*>(offsetof(PointVertex, weightsU))
+    );
+
+    glEnableVertexAttribArray(cWeightsVAttribute);
+    glVertexAttribPointer(
+        cWeightsVAttribute,
+        4,
+        GL_FLOAT,
+        GL_FALSE,
+        sizeof(PointVertex),
+        reinterpret_cast<void*>(offsetof(PointVertex, weightsV))
+    );
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER,
+        sizeof(GLuint) * indices.size(),
+        indices.data(),
+        GL_STATIC_DRAW
+    );
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    LOG(DEBUG) << "Soft box surface of " << getPatchCount() << " patches, "
+        << points.size() << " points";
+}
+
+void SoftBoxSurface::addSide(
+    glm::ivec3 origin,
+    glm::ivec3 stepU,
+    glm::ivec3 stepV,
+    std::vector<PointVertex>& points,
+    std::vector<GLuint>& indices
+)
+{
+    const auto& weightsU = _axisWeights[getStepAxis(stepU)];
+    const auto& weightsV = _axisWeights[getStepAxis(stepV)];
+    const auto bezierU = static_cast<int>(weightsU.size());
+    const auto bezierV = static_cast<int>(weightsV.size());
+    const auto strideU = getLatticeIndex(_latticeSize, stepU);
+    const auto strideV = getLatticeIndex(_latticeSize, stepV);
+    const auto firstPoint = points.size();
+
+    for (auto u = 0; u < bezierU; ++u)
+    {
+        const auto& pointU = weightsU[u];
+        for (auto v = 0; v < bezierV; ++v)
+        {
+            const auto& pointV = weightsV[v];
+            const auto first = origin
+                + pointU.first * stepU
+                + pointV.first * stepV;
+
+            PointVertex point{};
+            point.lattice = {
+                getLatticeIndex(_latticeSize, first),
+                strideU,
+                strideV
+            };
+            point.count = {pointU.count, pointV.count};
+            for (auto k = 0; k < pointU.count; ++k)
+            {
+                point.weightsU[k] = pointU.weights[k];
+            }
+
+            for (auto k = 0; k < pointV.count; ++k)
+            {
+                point.weightsV[k] = pointV.weights[k];
+            }
+
+            points.push_back(point);
+        }
+    }
+
+    // Neighbouring patches share their boundary points.
+    for (auto patchU = 0; patchU + 1 < bezierU; patchU += 3)
+    {
+        for (auto patchV = 0; patchV + 1 < bezierV; patchV += 3)
+        {
+            for (auto i = 0; i < 4; ++i)
+            {
+                for (auto j = 0; j < 4; ++j)
+                {
+                    indices.push_back(static_cast<GLuint>(
+                        firstPoint
+                            + (patchU + i) * bezierV
+                            + patchV + j
+                    ));
+                }
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,456 @@
+#include "SpatialHash.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace application
+{
+
+namespace
+{
+
+const double cMinimalContactLength = 10e-4;
+
+}
+
+void ParticleContacts::clear()
+{
+    offsets.clear();
+    neighbour.clear();
+}
+
+template <typename TPrecision>
+SpatialHash<TPrecision>::SpatialHash():
+    _cellSize{1},
+    _gridOrigin{},
+    _gridSize{},
+    _tableSize{}
+{
+}
+
+template <typename TPrecision>
+void SpatialHash<TPrecision>::update(
+    const TPrecision* const position[3],
+    std::size_t count,
+    TPrecision cellSize,
+    ThreadPool& threadPool
+)
+{
+    std::atomic<std::size_t> changedCells{0};
+    if (count != _particleKeys.size())
+    {
+        _particleKeys.assign(count, 0);
+        _sortedParticles.resize(count);
+        _previousOrder.resize(count);
+        _sortedSlot.resize(count);
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            _sortedPosition[axis].resize(count);
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            _sortedParticles[i] = static_cast<int>(i);
+        }
+
+        changedCells = count;
+    }
+
+    _cellSize = cellSize;
+    if (chooseTable(position, count))
+    {
+        changedCells += count;
+    }
+
+    threadPool.parallelFor(count, [&](std::size_t begin, std::size_t end) {
+        std::size_t changed = 0;
+        for (auto i = begin; i < end; ++i)
+        {
+            auto key = getKey(getCell(
+                position[0][i],
+                position[1][i],
+                position[2][i]
+            ));
+
+            changed += key != _particleKeys[i];
+            _particleKeys[i] = key;
+        }
+
+        changedCells += changed;
+    });
+
+    if (changedCells > 0)
+    {
+        // Stable counting sort over the table, starting from the last order.
+        _previousOrder.swap(_sortedParticles);
+        std::fill(_cellOffsets.begin(), _cellOffsets.end(), 0);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ++_cellOffsets[_particleKeys[i] + 1];
+        }
+
+        for (std::size_t k = 0; k + 1 < _cellOffsets.size(); ++k)
+        {
+            _cellOffsets[k + 1] += _cellOffsets[k];
+        }
+
+        for (auto particle: _previousOrder)
+        {
+            auto slot = _cellOffsets[_particleKeys[particle]]++;
+            _sortedParticles[slot] = particle;
+            _sortedSlot[particle] = slot;
+        }
+
+        // Filling moved every offset to the end of its cell.
+        for (auto k = _cellOffsets.size() - 1; k > 0; --k)
+        {
+            _cellOffsets[k] = _cellOffsets[k - 1];
+        }
+
+        _cellOffsets[0] = 0;
+    }
+
+    threadPool.parallelFor(count, [&](std::size_t begin, std::size_t end) {
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            for (auto slot = begin; slot < end; ++slot)
+            {
+                _sortedPosition[axis][slot] =
+                    position[axis][_sortedParticles[slot]];
+            }
+        }
+    });
+}
+
+template <typename TPrecision>
+void SpatialHash<TPrecision>::findContacts(
+    TPrecision distance,
+    ThreadPool& threadPool,
+    ParticleContacts& contacts
+) const
+{
+    const auto count = _particleKeys.size();
+
+    // Rows follow particle order, sweeps follow sorted order.
+    contacts.offsets.resize(count + 1);
+    contacts.offsets[0] = 0;
+    threadPool.parallelFor(count, [&](std::size_t begin, std::size_t end) {
+        auto row = begin;
+        std::size_t neighbours = 0;
+        forEachNeighbour(begin, end, distance, [&](std::uint32_t slot, int) {
+            if (slot != row)
+            {
+                contacts.offsets[_sortedParticles[row] + 1] = neighbours;
+                for (++row; row < slot; ++row)
+                {
+                    contacts.offsets[_sortedParticles[row] + 1] = 0;
+                }
+
+                neighbours = 0;
+            }
+
+            ++neighbours;
+        });
+
+        if (row < end)
+        {
+            contacts.offsets[_sortedParticles[row] + 1] = neighbours;
+        }
+
+        for (++row; row < end; ++row)
+        {
+            contacts.offsets[_sortedParticles[row] + 1] = 0;
+        }
+    });
+
+    for (std::size_t p = 0; p < count; ++p)
+    {
+        contacts.offsets[p + 1] += contacts.offsets[p];
+    }
+
+    contacts.neighbour.resize(contacts.offsets[count]);
+    threadPool.parallelFor(count, [&](std::size_t begin, std::size_t end) {
+        auto row = count;
+        std::size_t next = 0;
+        forEachNeighbour(begin, end, distance, [&](std::uint32_t slot, int q) {
+            if (slot != row)
+            {
+                row = slot;
+                next = contacts.offsets[_sortedParticles[slot]];
+            }
+
+            contacts.neighbour[next++] = q;
+        });
+    });
+}
+
+template <typename TPrecision>
+bool SpatialHash<TPrecision>::chooseTable(
+    const TPrecision* const position[3],
+    std::size_t count
+)
+{
+    const std::size_t cMaxCellsPerParticle = 32;
+
+    auto previousOrigin = _gridOrigin;
+    auto previousSize = _gridSize;
+    auto previousTableSize = _tableSize;
+
+    _gridSize = glm::ivec3{};
+    if (count > 0)
+    {
+        glm::tvec3<TPrecision> low{
+            position[0][0],
+            position[1][0],
+            position[2][0]
+        };
+        auto high = low;
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            for (std::size_t i = 1; i < count; ++i)
+            {
+                low[axis] = std::min(low[axis], position[axis][i]);
+                high[axis] = std::max(high[axis], position[axis][i]);
+            }
+        }
+
+        // One empty cell on each side keeps all neighbour rows in the box.
+        auto origin = getCell(low.x, low.y, low.z) - glm::ivec3{1};
+        auto size = getCell(high.x, high.y, high.z) - origin + glm::ivec3{2};
+        auto cells = static_cast<double>(size.x) * size.y * size.z;
+        if (cells <= static_cast<double>(cMaxCellsPerParticle * count))
+        {
+            _gridOrigin = origin;
+            _gridSize = size;
+            _tableSize = static_cast<std::uint32_t>(cells);
+        }
+    }
+
+    if (_gridSize.x == 0)
+    {
+        _tableSize = 1;
+        while (_tableSize < 2 * count)
+        {
+            _tableSize *= 2;
+        }
+    }
+
+    _cellOffsets.resize(_tableSize + 1);
+    return _gridOrigin != previousOrigin
+        || _gridSize != previousSize
+        || _tableSize != previousTableSize;
+}
+
+template <typename TPrecision>
+glm::ivec3 SpatialHash<TPrecision>::getCell(
+    TPrecision x,
+    TPrecision y,
+    TPrecision z
+) const
+{
+    return {
+        static_cast<int>(std::floor(x / _cellSize)),
+        static_cast<int>(std::floor(y / _cellSize)),
+        static_cast<int>(std::floor(z / _cellSize))
+    };
+}
+
+template <typename TPrecision>
+glm::ivec3 SpatialHash<TPrecision>::getCell(std::uint32_t slot) const
+{
+    return getCell(
+        _sortedPosition[0][slot],
+        _sortedPosition[1][slot],
+        _sortedPosition[2][slot]
+    );
+}
+
+template <typename TPrecision>
+std::uint32_t SpatialHash<TPrecision>::getKey(const glm::ivec3& cell) const
+{
+    if (_gridSize.x > 0)
+    {
+        const auto local = cell - _gridOrigin;
+        return (static_cast<std::uint32_t>(local.z) * _gridSize.y + local.y)
+            * _gridSize.x + local.x;
+    }
+
+    // Cells along x get consecutive keys here too.
+    const auto hash = static_cast<std::uint32_t>(cell.y) * 73856093u
+        ^ static_cast<std::uint32_t>(cell.z) * 19349663u;
+
+    return (hash + static_cast<std::uint32_t>(cell.x)) & (_tableSize - 1);
+}
+
+template <typename TPrecision>
+void SpatialHash<TPrecision>::findNeighbourCells(
+    const glm::ivec3& cell,
+    NeighbourCells& cells
+) const
+{
+    // Key intervals [first, last) of the 9 rows, split where they wrap.
+    std::uint32_t first[18];
+    std::uint32_t last[18];
+    auto intervals = 0;
+    for (auto dz = -1; dz <= 1; ++dz)
+    for (auto dy = -1; dy <= 1; ++dy)
+    {
+        auto key = getKey(cell + glm::ivec3{-1, dy, dz});
+        auto end = key + 3;
+        if (end > _tableSize)
+        {
+            first[intervals] = 0;
+            last[intervals++] = end - _tableSize;
+            end = _tableSize;
+        }
+
+        first[intervals] = key;
+        last[intervals++] = end;
+    }
+
+    for (auto i = 1; i < intervals; ++i)
+    {
+        for (auto j = i; j > 0 && first[j] < first[j - 1]; --j)
+        {
+            std::swap(first[j], first[j - 1]);
+            std::swap(last[j], last[j - 1]);
+        }
+    }
+
+    cells.cell = cell;
+    cells.count = 0;
+    for (auto i = 0; i < intervals;)
+    {
+        auto end = last[i];
+        auto j = i + 1;
+        for (; j < intervals && first[j] <= end; ++j)
+        {
+            end = std::max(end, last[j]);
+        }
+
+        if (_cellOffsets[first[i]] != _cellOffsets[end])
+        {
+            cells.begin[cells.count] = _cellOffsets[first[i]];
+            cells.end[cells.count] = _cellOffsets[end];
+            ++cells.count;
+        }
+
+        i = j;
+    }
+}
+
+template <typename TPrecision>
+template <typename TFunction>
+void SpatialHash<TPrecision>::forEachNeighbour(
+    std::uint32_t begin,
+    std::uint32_t end,
+    TPrecision distance,
+    const TFunction& function
+) const
+{
+    const auto squaredDistance = distance * distance;
+
+    NeighbourCells cells;
+    for (auto slot = begin; slot < end; ++slot)
+    {
+        const auto cell = getCell(slot);
+        if (slot == begin || cell != cells.cell)
+        {
+            findNeighbourCells(cell, cells);
+        }
+
+        const auto x = _sortedPosition[0][slot];
+        const auto y = _sortedPosition[1][slot];
+        const auto z = _sortedPosition[2][slot];
+        for (auto c = 0; c < cells.count; ++c)
+        {
+            for (auto other = cells.begin[c]; other < cells.end[c]; ++other)
+            {
+                const auto relationX = _sortedPosition[0][other] - x;
+                const auto relationY = _sortedPosition[1][other] - y;
+                const auto relationZ = _sortedPosition[2][other] - z;
+                if (other != slot
+                    && relationX * relationX
+                        + relationY * relationY
+                        + relationZ * relationZ < squaredDistance)
+                {
+                    function(slot, _sortedParticles[other]);
+                }
+            }
+        }
+    }
+}
+
+template <typename TPrecision>
+void accumulateContactForces(
+    const ParticleContacts& contacts,
+    std::size_t begin,
+    std::size_t end,
+    TPrecision distance,
+    TPrecision stiffness,
+    const SpringKernelFields<TPrecision>& fields
+)
+{
+    const auto positionX = fields.position[0];
+    const auto positionY = fields.position[1];
+    const auto positionZ = fields.position[2];
+
+    for (auto p = begin; p < end; ++p)
+    {
+        TPrecision sumX = 0;
+        TPrecision sumY = 0;
+        TPrecision sumZ = 0;
+
+        for (auto e = contacts.offsets[p]; e < contacts.offsets[p + 1]; ++e)
+        {
+            const auto q = contacts.neighbour[e];
+            const auto relationX = positionX[p] - positionX[q];
+            const auto relationY = positionY[p] - positionY[q];
+            const auto relationZ = positionZ[p] - positionZ[q];
+            const auto length = std::sqrt(
+                relationX * relationX
+                + relationY * relationY
+                + relationZ * relationZ
+            );
+
+            // Coincident particles have no direction to be pushed apart in.
+            if (length >= distance
+                || length < static_cast<TPrecision>(cMinimalContactLength))
+            {
+                continue;
+            }
+
+            const auto scale = stiffness * (distance - length) / length;
+            sumX += scale * relationX;
+            sumY += scale * relationY;
+            sumZ += scale * relationZ;
+        }
+
+        fields.force[0][p] += sumX;
+        fields.force[1][p] += sumY;
+        fields.force[2][p] += sumZ;
+    }
+}
+
+template class SpatialHash<float>;
+template class SpatialHash<double>;
+
+template void accumulateContactForces(
+    const ParticleContacts&,
+    std::size_t,
+    std::size_t,
+    float,
+    float,
+    const SpringKernelFields<float>&
+);
+
+template void accumulateContactForces(
+    const ParticleContacts&,
+    std::size_t,
+    std::size_t,
+    double,
+    double,
+    const SpringKernelFields<double>&
+);
+
+}
@@ -0,0 +1,1332 @@
+#include "SpringKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "ParticleState.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPRING_KERNELS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace application
+{
+
+namespace
+{
+
+const double cMinimalSpringLength = 10e-4;
+
+template <typename TPrecision>
+inline void linearizeSpring(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t spring,
+    const TPrecision relation[3],
+    TPrecision step,
+    SpringLinearization<TPrecision>& linearization
+)
+{
+    const auto length = std::sqrt(
+        relation[0] * relation[0]
+        + relation[1] * relation[1]
+        + relation[2] * relation[2]
+    );
+
+    TPrecision direction[] = {1, 0, 0};
+    if (length > cMinimalSpringLength)
+    {
+        const auto invLength = 1 / length;
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            direction[axis] = relation[axis] * invLength;
+        }
+    }
+
+    const auto stiffness = step * step * springs.stiffness[spring];
+    const auto stretch = length > cMinimalSpringLength
+        ? 1 - springs.restLength[spring] / length
+        : TPrecision{0};
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        linearization.direction[axis][spring] = direction[axis];
+    }
+
+    linearization.stiffness[spring] = stiffness;
+    linearization.geometric[spring] =
+        stiffness * std::max(stretch, TPrecision{0});
+    linearization.damping[spring] = step * springs.damping[spring];
+}
+
+template <typename TPrecision>
+inline void applySpringBlock(
+    const SpringLinearization<TPrecision>& linearization,
+    std::size_t spring,
+    const TPrecision input[3],
+    bool includeDamping,
+    TPrecision output[3]
+)
+{
+    const auto directionX = linearization.direction[0][spring];
+    const auto directionY = linearization.direction[1][spring];
+    const auto directionZ = linearization.direction[2][spring];
+    const auto geometric = linearization.geometric[spring];
+    const auto along = linearization.stiffness[spring] - geometric
+        + (includeDamping ? linearization.damping[spring] : TPrecision{0});
+
+    const auto projection = along * (
+        directionX * input[0]
+        + directionY * input[1]
+        + directionZ * input[2]
+    );
+
+    output[0] = geometric * input[0] + projection * directionX;
+    output[1] = geometric * input[1] + projection * directionY;
+    output[2] = geometric * input[2] + projection * directionZ;
+}
+
+template <typename TPrecision>
+inline void addSpringBlockDiagonal(
+    const SpringLinearization<TPrecision>& linearization,
+    std::size_t spring,
+    int particle,
+    TPrecision* const diagonal[3]
+)
+{
+    const auto along = linearization.stiffness[spring]
+        + linearization.damping[spring]
+        - linearization.geometric[spring];
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        const auto direction = linearization.direction[axis][spring];
+        diagonal[axis][particle] += linearization.geometric[spring]
+            + along * direction * direction;
+    }
+}
+
+template <typename TPrecision>
+inline void accumulateInternalSpringForcesScalar(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<TPrecision>& fields
+)
+{
+    const auto positionX = fields.position[0];
+    const auto positionY = fields.position[1];
+    const auto positionZ = fields.position[2];
+    const auto velocityX = fields.velocity[0];
+    const auto velocityY = fields.velocity[1];
+    const auto velocityZ = fields.velocity[2];
+    const auto forceX = fields.force[0];
+    const auto forceY = fields.force[1];
+    const auto forceZ = fields.force[2];
+
+    for (auto i = begin; i < end; ++i)
+    {
+        const auto a = springs.a[i];
+        const auto b = springs.b[i];
+
+        const auto relationX = positionX[b] - positionX[a];
+        const auto relationY = positionY[b] - positionY[a];
+        const auto relationZ = positionZ[b] - positionZ[a];
+        const auto length = std::sqrt(
+            relationX * relationX
+            + relationY * relationY
+            + relationZ * relationZ
+        );
+
+        TPrecision directionX = 1;
+        TPrecision directionY = 0;
+        TPrecision directionZ = 0;
+        if (length > cMinimalSpringLength)
+        {
+            const auto invLength = 1 / length;
+            directionX = relationX * invLength;
+            directionY = relationY * invLength;
+            directionZ = relationZ * invLength;
+        }
+
+        const auto approachSpeed =
+            (velocityX[b] - velocityX[a]) * directionX
+            + (velocityY[b] - velocityY[a]) * directionY
+            + (velocityZ[b] - velocityZ[a]) * directionZ;
+
+        const auto magnitude =
+            springs.stiffness[i] * (length - springs.restLength[i])
+            + springs.damping[i] * approachSpeed;
+
+        forceX[a] += magnitude * directionX;
+        forceY[a] += magnitude * directionY;
+        forceZ[a] += magnitude * directionZ;
+        forceX[b] -= magnitude * directionX;
+        forceY[b] -= magnitude * directionY;
+        forceZ[b] -= magnitude * directionZ;
+    }
+}
+
+#ifdef SPRING_KERNELS_X86_DISPATCH
+
+__attribute__((target("avx2")))
+void accumulateInternalSpringForcesAVX2(
+    const SpringBatch<double>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<double>& fields
+)
+{
+    const int cLanes = 4;
+    const auto minimalLength = _mm256_set1_pd(cMinimalSpringLength);
+    const auto one = _mm256_set1_pd(1.0);
+    const auto zero = _mm256_setzero_pd();
+
+    alignas(32) double force[3][cLanes];
+
+    auto i = begin;
+    for (; i + cLanes <= end; i += cLanes)
+    {
+        auto a = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(springs.a.data() + i)
+        );
+
+        auto b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(springs.b.data() + i)
+        );
+
+        __m256d relation[3];
+        __m256d relativeVelocity[3];
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            relation[axis] = _mm256_sub_pd(
+                _mm256_i32gather_pd(fields.position[axis], b, 8),
+                _mm256_i32gather_pd(fields.position[axis], a, 8)
+            );
+
+            relativeVelocity[axis] = _mm256_sub_pd(
+                _mm256_i32gather_pd(fields.velocity[axis], b, 8),
+                _mm256_i32gather_pd(fields.velocity[axis], a, 8)
+            );
+        }
+
+        auto length = _mm256_sqrt_pd(_mm256_add_pd(
+            _mm256_mul_pd(relation[0], relation[0]),
+            _mm256_add_pd(
+                _mm256_mul_pd(relation[1], relation[1]),
+                _mm256_mul_pd(relation[2], relation[2])
+            )
+        ));
+
+        auto valid = _mm256_cmp_pd(length, minimalLength, _CMP_GT_OQ);
+        auto invLength = _mm256_div_pd(one, length);
+
+        __m256d direction[] = {
+            _mm256_blendv_pd(
+                one,
+                _mm256_mul_pd(relation[0], invLength),
+                valid
+            ),
+            _mm256_blendv_pd(
+                zero,
+                _mm256_mul_pd(relation[1], invLength),
+                valid
+            ),
+            _mm256_blendv_pd(
+                zero,
+                _mm256_mul_pd(relation[2], invLength),
+                valid
+            )
+        };
+
+        auto approachSpeed = _mm256_add_pd(
+            _mm256_mul_pd(relativeVelocity[0], direction[0]),
+            _mm256_add_pd(
+                _mm256_mul_pd(relativeVelocity[1], direction[1]),
+                _mm256_mul_pd(relativeVelocity[2], direction[2])
+            )
+        );
+
+        auto magnitude = _mm256_add_pd(
+            _mm256_mul_pd(
+                _mm256_loadu_pd(springs.stiffness.data() + i),
+                _mm256_sub_pd(
+                    length,
+                    _mm256_loadu_pd(springs.restLength.data() + i)
+                )
+            ),
+            _mm256_mul_pd(
+                _mm256_loadu_pd(springs.damping.data() + i),
+                approachSpeed
+            )
+        );
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            _mm256_store_pd(
+                force[axis],
+                _mm256_mul_pd(magnitude, direction[axis])
+            );
+        }
+
+        // Springs of one group may share a particle, so the scatter is
+        // serial.
+        for (auto lane = 0; lane < cLanes; ++lane)
+        {
+            auto particleA = springs.a[i + lane];
+            auto particleB = springs.b[i + lane];
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                fields.force[axis][particleA] += force[axis][lane];
+                fields.force[axis][particleB] -= force[axis][lane];
+            }
+        }
+    }
+
+    accumulateInternalSpringForcesScalar(springs, i, end, fields);
+}
+
+__attribute__((target("avx2")))
+void accumulateInternalSpringForcesAVX2(
+    const SpringBatch<float>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<float>& fields
+)
+{
+    const int cLanes = 8;
+    const auto minimalLength =
+        _mm256_set1_ps(static_cast<float>(cMinimalSpringLength));
+    const auto one = _mm256_set1_ps(1.0f);
+    const auto zero = _mm256_setzero_ps();
+
+    alignas(32) float force[3][cLanes];
+
+    auto i = begin;
+    for (; i + cLanes <= end; i += cLanes)
+    {
+        auto a = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(springs.a.data() + i)
+        );
+
+        auto b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(springs.b.data() + i)
+        );
+
+        __m256 relation[3];
+        __m256 relativeVelocity[3];
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            relation[axis] = _mm256_sub_ps(
+                _mm256_i32gather_ps(fields.position[axis], b, 4),
+                _mm256_i32gather_ps(fields.position[axis], a, 4)
+            );
+
+            relativeVelocity[axis] = _mm256_sub_ps(
+                _mm256_i32gather_ps(fields.velocity[axis], b, 4),
+                _mm256_i32gather_ps(fields.velocity[axis], a, 4)
+            );
+        }
+
+        auto length = _mm256_sqrt_ps(_mm256_add_ps(
+            _mm256_mul_ps(relation[0], relation[0]),
+            _mm256_add_ps(
+                _mm256_mul_ps(relation[1], relation[1]),
+                _mm256_mul_ps(relation[2], relation[2])
+            )
+        ));
+
+        auto valid = _mm256_cmp_ps(length, minimalLength, _CMP_GT_OQ);
+        auto invLength = _mm256_div_ps(one, length);
+
+        __m256 direction[] = {
+            _mm256_blendv_ps(
+                one,
+                _mm256_mul_ps(relation[0], invLength),
+                valid
+            ),
+            _mm256_blendv_ps(
+                zero,
+                _mm256_mul_ps(relation[1], invLength),
+                valid
+            ),
+            _mm256_blendv_ps(
+                zero,
+                _mm256_mul_ps(relation[2], invLength),
+                valid
+            )
+        };
+
+        auto approachSpeed = _mm256_add_ps(
+            _mm256_mul_ps(relativeVelocity[0], direction[0]),
+            _mm256_add_ps(
+                _mm256_mul_ps(relativeVelocity[1], direction[1]),
+                _mm256_mul_ps(relativeVelocity[2], direction[2])
+            )
+        );
+
+        auto magnitude = _mm256_add_ps(
+            _mm256_mul_ps(
+                _mm256_loadu_ps(springs.stiffness.data() + i),
+                _mm256_sub_ps(
+                    length,
+                    _mm256_loadu_ps(springs.restLength.data() + i)
+                )
+            ),
+            _mm256_mul_ps(
+                _mm256_loadu_ps(springs.damping.data() + i),
+                approachSpeed
+            )
+        );
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            _mm256_store_ps(
+                force[axis],
+                _mm256_mul_ps(magnitude, direction[axis])
+            );
+        }
+
+        // Springs of one group may share a particle, so the scatter is
+        // serial.
+        for (auto lane = 0; lane < cLanes; ++lane)
+        {
+            auto particleA = springs.a[i + lane];
+            auto particleB = springs.b[i + lane];
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                fields.force[axis][particleA] += force[axis][lane];
+                fields.force[axis][particleB] -= force[axis][lane];
+            }
+        }
+    }
+
+    accumulateInternalSpringForcesScalar(springs, i, end, fields);
+}
+
+__attribute__((target("avx512f")))
+void accumulateInternalSpringForcesAVX512(
+    const SpringBatch<double>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<double>& fields
+)
+{
+    const int cLanes = 8;
+    const auto minimalLength = _mm512_set1_pd(cMinimalSpringLength);
+    const auto one = _mm512_set1_pd(1.0);
+    const auto zero = _mm512_setzero_pd();
+
+    alignas(64) double force[3][cLanes];
+
+    auto i = begin;
+    for (; i + cLanes <= end; i += cLanes)
+    {
+        auto a = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(springs.a.data() + i)
+        );
+
+        auto b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(springs.b.data() + i)
+        );
+
+        __m512d relation[3];
+        __m512d relativeVelocity[3];
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            relation[axis] = _mm512_sub_pd(
+                _mm512_i32gather_pd(b, fields.position[axis], 8),
+                _mm512_i32gather_pd(a, fields.position[axis], 8)
+            );
+
+            relativeVelocity[axis] = _mm512_sub_pd(
+                _mm512_i32gather_pd(b, fields.velocity[axis], 8),
+                _mm512_i32gather_pd(a, fields.velocity[axis], 8)
+            );
+        }
+
+        auto length = _mm512_sqrt_pd(_mm512_add_pd(
+            _mm512_mul_pd(relation[0], relation[0]),
+            _mm512_add_pd(
+                _mm512_mul_pd(relation[1], relation[1]),
+                _mm512_mul_pd(relation[2], relation[2])
+            )
+        ));
+
+        auto valid = _mm512_cmp_pd_mask(length, minimalLength, _CMP_GT_OQ);
+        auto invLength = _mm512_div_pd(one, length);
+
+        __m512d direction[] = {
+            _mm512_mask_blend_pd(
+                valid,
+                one,
+                _mm512_mul_pd(relation[0], invLength)
+            ),
+            _mm512_mask_blend_pd(
+                valid,
+                zero,
+                _mm512_mul_pd(relation[1], invLength)
+            ),
+            _mm512_mask_blend_pd(
+                valid,
+                zero,
+                _mm512_mul_pd(relation[2], invLength)
+            )
+        };
+
+        auto approachSpeed = _mm512_add_pd(
+            _mm512_mul_pd(relativeVelocity[0], direction[0]),
+            _mm512_add_pd(
+                _mm512_mul_pd(relativeVelocity[1], direction[1]),
+                _mm512_mul_pd(relativeVelocity[2], direction[2])
+            )
+        );
+
+        auto magnitude = _mm512_add_pd(
+            _mm512_mul_pd(
+                _mm512_loadu_pd(springs.stiffness.data() + i),
+                _mm512_sub_pd(
+                    length,
+                    _mm512_loadu_pd(springs.restLength.data() + i)
+                )
+            ),
+            _mm512_mul_pd(
+                _mm512_loadu_pd(springs.damping.data() + i),
+                approachSpeed
+            )
+        );
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            _mm512_store_pd(
+                force[axis],
+                _mm512_mul_pd(magnitude, direction[axis])
+            );
+        }
+
+        for (auto lane = 0; lane < cLanes; ++lane)
+        {
+            auto particleA = springs.a[i + lane];
+            auto particleB = springs.b[i + lane];
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                fields.force[axis][particleA] += force[axis][lane];
+                fields.force[axis][particleB] -= force[axis][lane];
+            }
+        }
+    }
+
+    accumulateInternalSpringForcesScalar(springs, i, end, fields);
+}
+
+__attribute__((target("avx512f")))
+void accumulateInternalSpringForcesAVX512(
+    const SpringBatch<float>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<float>& fields
+)
+{
+    const int cLanes = 16;
+    const auto minimalLength =
+        _mm512_set1_ps(static_cast<float>(cMinimalSpringLength));
+    const auto one = _mm512_set1_ps(1.0f);
+    const auto zero = _mm512_setzero_ps();
+
+    alignas(64) float force[3][cLanes];
+
+    auto i = begin;
+    for (; i + cLanes <= end; i += cLanes)
+    {
+        auto a = _mm512_loadu_si512(springs.a.data() + i);
+
+        auto b = _mm512_loadu_si512(springs.b.data() + i);
+
+        __m512 relation[3];
+        __m512 relativeVelocity[3];
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            relation[axis] = _mm512_sub_ps(
+                _mm512_i32gather_ps(b, fields.position[axis], 4),
+                _mm512_i32gather_ps(a, fields.position[axis], 4)
+            );
+
+            relativeVelocity[axis] = _mm512_sub_ps(
+                _mm512_i32gather_ps(b, fields.velocity[axis], 4),
+                _mm512_i32gather_ps(a, fields.velocity[axis], 4)
+            );
+        }
+
+        auto length = _mm512_sqrt_ps(_mm512_add_ps(
+            _mm512_mul_ps(relation[0], relation[0]),
+            _mm512_add_ps(
+                _mm512_mul_ps(relation[1], relation[1]),
+                _mm512_mul_ps(relation[2], relation[2])
+            )
+        ));
+
+        auto valid = _mm512_cmp_ps_mask(length, minimalLength, _CMP_GT_OQ);
+        auto invLength = _mm512_div_ps(one, length);
+
+        __m512 direction[] = {
+            _mm512_mask_blend_ps(
+                valid,
+                one,
+                _mm512_mul_ps(relation[0], invLength)
+            ),
+            _mm512_mask_blend_ps(
+                valid,
+                zero,
+                _mm512_mul_ps(relation[1], invLength)
+            ),
+            _mm512_mask_blend_ps(
+                valid,
+                zero,
+                _mm512_mul_ps(relation[2], invLength)
+            )
+        };
+
+        auto approachSpeed = _mm512_add_ps(
+            _mm512_mul_ps(relativeVelocity[0], direction[0]),
+            _mm512_add_ps(
+                _mm512_mul_ps(relativeVelocity[1], direction[1]),
+                _mm512_mul_ps(relativeVelocity[2], direction[2])
+            )
+        );
+
+        auto magnitude = _mm512_add_ps(
+            _mm512_mul_ps(
+                _mm512_loadu_ps(springs.stiffness.data() + i),
+                _mm512_sub_ps(
+                    length,
+                    _mm512_loadu_ps(springs.restLength.data() + i)
+                )
+            ),
+            _mm512_mul_ps(
+                _mm512_loadu_ps(springs.damping.data() + i),
+                approachSpeed
+            )
+        );
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            _mm512_store_ps(
+                force[axis],
+                _mm512_mul_ps(magnitude, direction[axis])
+            );
+        }
+
+        for (auto lane = 0; lane < cLanes; ++lane)
+        {
+            auto particleA = springs.a[i + lane];
+            auto particleB = springs.b[i + lane];
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                fields.force[axis][particleA] += force[axis][lane];
+                fields.force[axis][particleB] -= force[axis][lane];
+            }
+        }
+    }
+
+    accumulateInternalSpringForcesScalar(springs, i, end, fields);
+}
+
+
+__attribute__((target("avx2")))
+inline void storeFloat4Positions(__m128 x, __m128 y, __m128 z, float* output)
+{
+    auto w = _mm_set1_ps(1.0f);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(output, x);
+    _mm_storeu_ps(output + 4, y);
+    _mm_storeu_ps(output + 8, z);
+    _mm_storeu_ps(output + 12, w);
+}
+
+/** Four particles per step, converted and transposed to x, y, z, 1. */
+__attribute__((target("avx2")))
+std::size_t interleavePositionsToFloat4AVX2(
+    const double* const current[3],
+    const double* const previous[3],
+    double factor,
+    std::size_t begin,
+    std::size_t end,
+    float* output
+)
+{
+    const auto weight = _mm256_set1_pd(factor);
+
+    auto i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 position[3];
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            auto value = _mm256_loadu_pd(current[axis] + i);
+            if (previous != nullptr)
+            {
+                const auto old = _mm256_loadu_pd(previous[axis] + i);
+                value = _mm256_add_pd(
+                    old,
+                    _mm256_mul_pd(weight, _mm256_sub_pd(value, old))
+                );
+            }
+
+            position[axis] = _mm256_cvtpd_ps(value);
+        }
+
+        storeFloat4Positions(
+            position[0],
+            position[1],
+            position[2],
+            output + 4 * i
+        );
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+std::size_t interleavePositionsToFloat4AVX2(
+    const float* const current[3],
+    const float* const previous[3],
+    float factor,
+    std::size_t begin,
+    std::size_t end,
+    float* output
+)
+{
+    const auto weight = _mm_set1_ps(factor);
+
+    auto i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 position[3];
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            position[axis] = _mm_loadu_ps(current[axis] + i);
+            if (previous != nullptr)
+            {
+                const auto old = _mm_loadu_ps(previous[axis] + i);
+                position[axis] = _mm_add_ps(
+                    old,
+                    _mm_mul_ps(weight, _mm_sub_ps(position[axis], old))
+                );
+            }
+        }
+
+        storeFloat4Positions(
+            position[0],
+            position[1],
+            position[2],
+            output + 4 * i
+        );
+    }
+
+    return i;
+}
+
+#endif
+
+}
+
+template <typename TPrecision>
+void SpringLinearization<TPrecision>::resize(std::size_t count)
+{
+    for (auto& component: direction)
+    {
+        component.resize(count);
+    }
+
+    stiffness.resize(count);
+    geometric.resize(count);
+    damping.resize(count);
+}
+
+template <typename TPrecision>
+void SpringBatch<TPrecision>::clear()
+{
+    a.clear();
+    b.clear();
+    restLength.clear();
+    stiffness.clear();
+    damping.clear();
+}
+
+template <typename TPrecision>
+void SpringBatch<TPrecision>::reserve(std::size_t count)
+{
+    a.reserve(count);
+    b.reserve(count);
+    restLength.reserve(count);
+    stiffness.reserve(count);
+    damping.reserve(count);
+}
+
+template <typename TPrecision>
+void SpringBatch<TPrecision>::resize(std::size_t count)
+{
+    a.resize(count);
+    b.resize(count);
+    restLength.resize(count);
+    stiffness.resize(count);
+    damping.resize(count);
+}
+
+template <typename TPrecision>
+void SpringBatch<TPrecision>::add(
+    int a,
+    int b,
+    TPrecision length,
+    TPrecision constant,
+    TPrecision damping
+)
+{
+    this->a.push_back(a);
+    this->b.push_back(b);
+    this->restLength.push_back(length);
+    this->stiffness.push_back(constant);
+    this->damping.push_back(damping);
+}
+
+SimdLevel detectSimdLevel()
+{
+#ifdef SPRING_KERNELS_X86_DISPATCH
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return SimdLevel::AVX512;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SimdLevel::AVX2;
+    }
+#endif
+
+    return SimdLevel::Scalar;
+}
+
+const char* getSimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::AVX512: return "AVX-512";
+    case SimdLevel::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+template <typename TPrecision>
+void accumulateInternalSpringForces(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<TPrecision>& fields,
+    SimdLevel level
+)
+{
+    static const auto supportedLevel = detectSimdLevel();
+    if (level > supportedLevel)
+    {
+        level = supportedLevel;
+    }
+
+#ifdef SPRING_KERNELS_X86_DISPATCH
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+        accumulateInternalSpringForcesAVX512(springs, begin, end, fields);
+        return;
+    case SimdLevel::AVX2:
+        accumulateInternalSpringForcesAVX2(springs, begin, end, fields);
+        return;
+    default:
+        break;
+    }
+#endif
+
+    accumulateInternalSpringForcesScalar(springs, begin, end, fields);
+}
+
+template <typename TPrecision>
+void interleavePositionsToFloat4(
+    const TPrecision* const current[3],
+    const TPrecision* const previous[3],
+    TPrecision factor,
+    std::size_t begin,
+    std::size_t end,
+    float* output,
+    SimdLevel level
+)
+{
+    static const auto supportedLevel = detectSimdLevel();
+
+#ifdef SPRING_KERNELS_X86_DISPATCH
+    if (std::min(level, supportedLevel) != SimdLevel::Scalar)
+    {
+        begin = interleavePositionsToFloat4AVX2(
+            current,
+            previous,
+            factor,
+            begin,
+            end,
+            output
+        );
+    }
+#endif
+
+    for (auto i = begin; i < end; ++i)
+    {
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            auto value = current[axis][i];
+            if (previous != nullptr)
+            {
+                value = previous[axis][i]
+                    + factor * (value - previous[axis][i]);
+            }
+
+            output[4 * i + axis] = static_cast<float>(value);
+        }
+
+        output[4 * i + 3] = 1.0f;
+    }
+}
+
+void SpringAdjacency::clear()
+{
+    offsets.clear();
+    spring.clear();
+    neighbour.clear();
+}
+
+template <typename TPrecision>
+void buildSpringAdjacency(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t particleCount,
+    SpringAdjacency& adjacency
+)
+{
+    adjacency.offsets.assign(particleCount + 1, 0);
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        ++adjacency.offsets[springs.a[i] + 1];
+        ++adjacency.offsets[springs.b[i] + 1];
+    }
+
+    for (std::size_t p = 0; p < particleCount; ++p)
+    {
+        adjacency.offsets[p + 1] += adjacency.offsets[p];
+    }
+
+    adjacency.spring.resize(2 * springs.size());
+    adjacency.neighbour.resize(2 * springs.size());
+
+    // Filling in spring order keeps each particle's entries sorted.
+    std::vector<std::size_t> next(
+        adjacency.offsets.begin(),
+        adjacency.offsets.end() - 1
+    );
+
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        const auto a = springs.a[i];
+        const auto b = springs.b[i];
+
+        adjacency.spring[next[a]] = static_cast<int>(i);
+        adjacency.neighbour[next[a]++] = b;
+        adjacency.spring[next[b]] = static_cast<int>(i);
+        adjacency.neighbour[next[b]++] = a;
+    }
+}
+
+template <typename TPrecision>
+void gatherInternalSpringForces(
+    const SpringBatch<TPrecision>& springs,
+    const SpringAdjacency& adjacency,
+    std::size_t begin,
+    std::size_t end,
+    const SpringKernelFields<TPrecision>& fields
+)
+{
+    const auto positionX = fields.position[0];
+    const auto positionY = fields.position[1];
+    const auto positionZ = fields.position[2];
+    const auto velocityX = fields.velocity[0];
+    const auto velocityY = fields.velocity[1];
+    const auto velocityZ = fields.velocity[2];
+
+    for (auto p = begin; p < end; ++p)
+    {
+        TPrecision sumX = 0;
+        TPrecision sumY = 0;
+        TPrecision sumZ = 0;
+
+        for (auto entry = adjacency.offsets[p];
+            entry < adjacency.offsets[p + 1];
+            ++entry)
+        {
+            const auto i = adjacency.spring[entry];
+            const auto q = adjacency.neighbour[entry];
+
+            const auto relationX = positionX[q] - positionX[p];
+            const auto relationY = positionY[q] - positionY[p];
+            const auto relationZ = positionZ[q] - positionZ[p];
+            const auto length = std::sqrt(
+                relationX * relationX
+                + relationY * relationY
+                + relationZ * relationZ
+            );
+
+            // The fallback direction points from a to b, as in the scatter
+            // kernels, so degenerate springs still push both ends apart.
+            TPrecision directionX =
+                springs.a[i] == static_cast<int>(p) ? 1 : -1;
+            TPrecision directionY = 0;
+            TPrecision directionZ = 0;
+            if (length > cMinimalSpringLength)
+            {
+                const auto invLength = 1 / length;
+                directionX = relationX * invLength;
+                directionY = relationY * invLength;
+                directionZ = relationZ * invLength;
+            }
+
+            const auto approachSpeed =
+                (velocityX[q] - velocityX[p]) * directionX
+                + (velocityY[q] - velocityY[p]) * directionY
+                + (velocityZ[q] - velocityZ[p]) * directionZ;
+
+            const auto magnitude =
+                springs.stiffness[i] * (length - springs.restLength[i])
+                + springs.damping[i] * approachSpeed;
+
+            sumX += magnitude * directionX;
+            sumY += magnitude * directionY;
+            sumZ += magnitude * directionZ;
+        }
+
+        fields.force[0][p] += sumX;
+        fields.force[1][p] += sumY;
+        fields.force[2][p] += sumZ;
+    }
+}
+
+template <typename TPrecision>
+std::vector<std::size_t> partitionIntoConflictFreeClasses(
+    SpringBatch<TPrecision>& springs,
+    std::size_t particleCount
+)
+{
+    // Greedy edge coloring with one 64-bit mask of taken colors per
+    // particle. Springs left without a free color are retried in the next
+    // round against fresh masks and the next 64 colors.
+    const int cColorsPerRound = 64;
+
+    std::vector<int> springColor(springs.size(), -1);
+    std::vector<std::size_t> uncolored(springs.size());
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        uncolored[i] = i;
+    }
+
+    std::vector<std::uint64_t> takenColors;
+    std::vector<std::size_t> retry;
+    auto colorCount = 0;
+    for (auto round = 0; !uncolored.empty(); ++round)
+    {
+        takenColors.assign(particleCount, 0);
+        retry.clear();
+
+        for (auto spring: uncolored)
+        {
+            auto a = springs.a[spring];
+            auto b = springs.b[spring];
+            auto taken = takenColors[a] | takenColors[b];
+
+            auto color = 0;
+            while (color < cColorsPerRound && ((taken >> color) & 1))
+            {
+                ++color;
+            }
+
+            if (color == cColorsPerRound)
+            {
+                retry.push_back(spring);
+                continue;
+            }
+
+            takenColors[a] |= std::uint64_t{1} << color;
+            takenColors[b] |= std::uint64_t{1} << color;
+            springColor[spring] = round * cColorsPerRound + color;
+            colorCount = std::max(colorCount, springColor[spring] + 1);
+        }
+
+        uncolored.swap(retry);
+    }
+
+    std::vector<std::size_t> offsets(colorCount + 1, 0);
+    for (auto color: springColor)
+    {
+        ++offsets[color + 1];
+    }
+
+    for (auto color = 0; color < colorCount; ++color)
+    {
+        offsets[color + 1] += offsets[color];
+    }
+
+    SpringBatch<TPrecision> sorted;
+    sorted.a.resize(springs.size());
+    sorted.b.resize(springs.size());
+    sorted.restLength.resize(springs.size());
+    sorted.stiffness.resize(springs.size());
+    sorted.damping.resize(springs.size());
+
+    auto next = offsets;
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        auto target = next[springColor[i]]++;
+        sorted.a[target] = springs.a[i];
+        sorted.b[target] = springs.b[i];
+        sorted.restLength[target] = springs.restLength[i];
+        sorted.stiffness[target] = springs.stiffness[i];
+        sorted.damping[target] = springs.damping[i];
+    }
+
+    std::swap(springs, sorted);
+
+    // Drop classes that ended up empty.
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    return offsets;
+}
+
+template <typename TPrecision>
+void accumulateAnchorSpringForces(
+    const SpringBatch<TPrecision>& springs,
+    const std::vector<ParticleState>& anchors,
+    const SpringKernelFields<TPrecision>& fields
+)
+{
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        const auto& anchor = anchors[springs.a[i]];
+        auto particle = springs.b[i];
+
+        auto anchorVelocity = anchor.invMass * anchor.momentum;
+        glm::dvec3 relation{
+            fields.position[0][particle] - anchor.position.x,
+            fields.position[1][particle] - anchor.position.y,
+            fields.position[2][particle] - anchor.position.z
+        };
+
+        glm::dvec3 relativeVelocity{
+            fields.velocity[0][particle] - anchorVelocity.x,
+            fields.velocity[1][particle] - anchorVelocity.y,
+            fields.velocity[2][particle] - anchorVelocity.z
+        };
+
+        auto length = glm::length(relation);
+        auto direction = length > cMinimalSpringLength
+            ? relation / length
+            : glm::dvec3{1.0, 0.0, 0.0};
+
+        auto magnitude =
+            springs.stiffness[i] * (length - springs.restLength[i])
+            + springs.damping[i] * glm::dot(relativeVelocity, direction);
+
+        fields.force[0][particle] -= magnitude * direction.x;
+        fields.force[1][particle] -= magnitude * direction.y;
+        fields.force[2][particle] -= magnitude * direction.z;
+    }
+}
+
+template <typename TPrecision>
+void linearizeInternalSprings(
+    const SpringBatch<TPrecision>& springs,
+    std::size_t begin,
+    std::size_t end,
+    const TPrecision* const position[3],
+    TPrecision step,
+    SpringLinearization<TPrecision>& linearization,
+    TPrecision* const diagonal[3]
+)
+{
+    for (auto i = begin; i < end; ++i)
+    {
+        const auto a = springs.a[i];
+        const auto b = springs.b[i];
+        const TPrecision relation[] = {
+            position[0][b] - position[0][a],
+            position[1][b] - position[1][a],
+            position[2][b] - position[2][a]
+        };
+
+        linearizeSpring(springs, i, relation, step, linearization);
+        addSpringBlockDiagonal(linearization, i, a, diagonal);
+        addSpringBlockDiagonal(linearization, i, b, diagonal);
+    }
+}
+
+template <typename TPrecision>
+void linearizeAnchorSprings(
+    const SpringBatch<TPrecision>& springs,
+    const std::vector<ParticleState>& anchors,
+    const TPrecision* const position[3],
+    TPrecision step,
+    SpringLinearization<TPrecision>& linearization,
+    TPrecision* const diagonal[3]
+)
+{
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        const auto& anchor = anchors[springs.a[i]];
+        const auto particle = springs.b[i];
+        const TPrecision relation[] = {
+            static_cast<TPrecision>(position[0][particle] - anchor.position.x),
+            static_cast<TPrecision>(position[1][particle] - anchor.position.y),
+            static_cast<TPrecision>(position[2][particle] - anchor.position.z)
+        };
+
+        linearizeSpring(springs, i, relation, step, linearization);
+        addSpringBlockDiagonal(linearization, i, particle, diagonal);
+    }
+}
+
+template <typename TPrecision>
+void accumulateInternalSpringJacobianProduct(
+    const SpringBatch<TPrecision>& springs,
+    const SpringLinearization<TPrecision>& linearization,
+    std::size_t begin,
+    std::size_t end,
+    const TPrecision* const input[3],
+    TPrecision* const output[3],
+    bool includeDamping
+)
+{
+    for (auto i = begin; i < end; ++i)
+    {
+        const auto a = springs.a[i];
+        const auto b = springs.b[i];
+        const TPrecision relative[] = {
+            input[0][a] - input[0][b],
+            input[1][a] - input[1][b],
+            input[2][a] - input[2][b]
+        };
+
+        TPrecision product[3];
+        applySpringBlock(linearization, i, relative, includeDamping, product);
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            output[axis][a] += product[axis];
+            output[axis][b] -= product[axis];
+        }
+    }
+}
+
+template <typename TPrecision>
+void accumulateAnchorSpringJacobianProduct(
+    const SpringBatch<TPrecision>& springs,
+    const SpringLinearization<TPrecision>& linearization,
+    const TPrecision* const input[3],
+    TPrecision* const output[3],
+    bool includeDamping
+)
+{
+    for (std::size_t i = 0; i < springs.size(); ++i)
+    {
+        const auto particle = springs.b[i];
+        const TPrecision value[] = {
+            input[0][particle],
+            input[1][particle],
+            input[2][particle]
+        };
+
+        TPrecision product[3];
+        applySpringBlock(linearization, i, value, includeDamping, product);
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            output[axis][particle] += product[axis];
+        }
+    }
+}
+
+#define INSTANTIATE_SPRING_KERNELS(TPrecision) \
+    template struct SpringBatch<TPrecision>; \
+    template struct SpringLinearization<TPrecision>; \
+    template void accumulateInternalSpringForces( \
+        const SpringBatch<TPrecision>&, \
+        std::size_t, \
+        std::size_t, \
+        const SpringKernelFields<TPrecision>&, \
+        SimdLevel \
+    ); \
+    template std::vector<std::size_t> partitionIntoConflictFreeClasses( \
+        SpringBatch<TPrecision>&, \
+        std::size_t \
+    ); \
+    template void buildSpringAdjacency( \
+        const SpringBatch<TPrecision>&, \
+        std::size_t, \
+        SpringAdjacency& \
+    ); \
+    template void gatherInternalSpringForces( \
+        const SpringBatch<TPrecision>&, \
+        const SpringAdjacency&, \
+        std::size_t, \
+        std::size_t, \
+        const SpringKernelFields<TPrecision>& \
+    ); \
+    template void accumulateAnchorSpringForces( \
+        const SpringBatch<TPrecision>&, \
+        const std::vector<ParticleState>&, \
+        const SpringKernelFields<TPrecision>& \
+    ); \
+    template void linearizeInternalSprings( \
+        const SpringBatch<TPrecision>&, \
+        std::size_t, \
+        std::size_t, \
+        const TPrecision* const[3], \
+        TPrecision, \
+        SpringLinearization<TPrecision>&, \
+        TPrecision* const[3] \
+    ); \
+    template void linearizeAnchorSprings( \
+        const SpringBatch<TPrecision>&, \
+        const std::vector<ParticleState>&, \
+        const TPrecision* const[3], \
+        TPrecision, \
+        SpringLinearization<TPrecision>&, \
+        TPrecision* const[3] \
+    ); \
+    template void accumulateInternalSpringJacobianProduct( \
+        const SpringBatch<TPrecision>&, \
+        const SpringLinearization<TPrecision>&, \
+        std::size_t, \
+        std::size_t, \
+        const TPrecision* const[3], \
+        TPrecision* const[3], \
+        bool \
+    ); \
+    template void accumulateAnchorSpringJacobianProduct( \
+        const SpringBatch<TPrecision>&, \
+        const SpringLinearization<TPrecision>&, \
+        const TPrecision* const[3], \
+        TPrecision* const[3], \
+        bool \
+    ); \
+    template void interleavePositionsToFloat4( \
+        const TPrecision* const[3], \
+        const TPrecision* const[3], \
+        TPrecision, \
+        std::size_t, \
+        std::size_t, \
+        float*, \
+        SimdLevel \
+    );
+
+INSTANTIATE_SPRING_KERNELS(float)
+INSTANTIATE_SPRING_KERNELS(double)
+
+#undef INSTANTIATE_SPRING_KERNELS
+
+}
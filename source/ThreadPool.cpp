@@ -0,0 +1,134 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+namespace application
+{
+
+ThreadPool::ThreadPool(int threadCount):
+    _task{nullptr},
+    _invoker{nullptr},
+    _count{},
+    _chunks{1},
+    _generation{},
+    _pendingChunks{},
+    _stopping{false}
+{
+    setThreadCount(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+void ThreadPool::setThreadCount(int threadCount)
+{
+    threadCount = std::max(threadCount, 1);
+    if (threadCount == getThreadCount())
+    {
+        return;
+    }
+
+    stopWorkers();
+
+    _stopping = false;
+    _workers.reserve(threadCount - 1);
+    for (auto chunk = 1; chunk < threadCount; ++chunk)
+    {
+        _workers.emplace_back(
+            &ThreadPool::workerLoop,
+            this,
+            chunk,
+            _generation
+        );
+    }
+}
+
+int ThreadPool::getThreadCount() const
+{
+    return static_cast<int>(_workers.size()) + 1;
+}
+
+void ThreadPool::dispatch(
+    std::size_t count,
+    const void* task,
+    TaskInvoker invoker
+)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = task;
+        _invoker = invoker;
+        _count = count;
+        _chunks = _workers.size() + 1;
+        _pendingChunks = static_cast<int>(_workers.size());
+        ++_generation;
+    }
+
+    _taskAvailable.notify_all();
+    runChunk(0);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _taskFinished.wait(lock, [this]() { return _pendingChunks == 0; });
+}
+
+void ThreadPool::runChunk(int chunk)
+{
+    auto begin = _count * chunk / _chunks;
+    auto end = _count * (chunk + 1) / _chunks;
+    if (begin < end)
+    {
+        _invoker(_task, begin, end);
+    }
+}
+
+void ThreadPool::workerLoop(int chunk, unsigned seenGeneration)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _taskAvailable.wait(lock, [this, seenGeneration]() {
+                return _stopping || _generation != seenGeneration;
+            });
+
+            if (_stopping)
+            {
+                return;
+            }
+
+            seenGeneration = _generation;
+        }
+
+        runChunk(chunk);
+
+        bool lastChunk = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            lastChunk = --_pendingChunks == 0;
+        }
+
+        if (lastChunk)
+        {
+            _taskFinished.notify_one();
+        }
+    }
+}
+
+void ThreadPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+
+    _taskAvailable.notify_all();
+    for (auto& worker: _workers)
+    {
+        worker.join();
+    }
+
+    _workers.clear();
+}
+
+}
@@ -0,0 +1,557 @@
+#include "Trajectory.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "easylogging++.h"
+
+namespace application
+{
+
+namespace
+{
+
+const char cTrajectoryMagic[] = {'S', 'B', 'T', 'R', 'A', 'J', '\r', '\n'};
+const char cTrajectoryIndexMagic[] = {'S', 'B', 'T', 'I', 'N', 'D', 'E', 'X'};
+
+const double cQuantizationLevels = 65535.0;
+const double cMaxQuantizedChange = 32767.0;
+const double cMinimalExtent = 10e-9;
+
+/** Largest power of two not above extent / cQuantizationLevels. */
+double getQuantizationStep(double extent)
+{
+    const auto step = std::max(extent, cMinimalExtent) / cQuantizationLevels;
+    auto exponent = 0;
+    std::frexp(step, &exponent);
+    return std::ldexp(1.0, exponent - 1);
+}
+
+}
+
+TrajectoryFrame::TrajectoryFrame():
+    index{},
+    time{},
+    keyframe{false}
+{
+}
+
+TrajectoryRecorder::TrajectoryRecorder():
+    _file{nullptr},
+    _particleCount{},
+    _keyframeInterval{1},
+    _recordedFrames{},
+    _closing{false},
+    _offset{},
+    _failed{false}
+{
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    close();
+}
+
+bool TrajectoryRecorder::open(
+    const std::string& path,
+    std::size_t particleCount,
+    int keyframeInterval
+)
+{
+    close();
+
+    _file = std::fopen(path.c_str(), "wb");
+    if (!_file)
+    {
+        LOG(ERROR) << "Cannot open " << path << " for writing.";
+        return false;
+    }
+
+    _particleCount = particleCount;
+    _keyframeInterval = std::max(keyframeInterval, 1);
+    _recordedFrames = 0;
+    _closing = false;
+    _offset = 0;
+    _index.clear();
+    _failed = false;
+
+    TrajectoryHeader header{};
+    std::memcpy(header.magic, cTrajectoryMagic, sizeof(header.magic));
+    header.version = TrajectoryHeader::cVersion;
+    header.byteOrder = TrajectoryHeader::cByteOrder;
+    header.particleCount = particleCount;
+    header.keyframeInterval = static_cast<std::uint32_t>(_keyframeInterval);
+    writeBytes(&header, sizeof(header));
+
+    _writer = std::thread{&TrajectoryRecorder::writerLoop, this};
+    return true;
+}
+
+bool TrajectoryRecorder::close()
+{
+    if (_file == nullptr)
+    {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _closing = true;
+    }
+
+    _frameQueued.notify_one();
+    _writer.join();
+
+    TrajectoryTrailer trailer{};
+    trailer.indexOffset = _offset;
+    trailer.frameCount = _index.size();
+    std::memcpy(trailer.magic, cTrajectoryIndexMagic, sizeof(trailer.magic));
+    writeBytes(_index.data(), _index.size() * sizeof(TrajectoryIndexEntry));
+    writeBytes(&trailer, sizeof(trailer));
+
+    const auto succeeded = std::fclose(_file) == 0 && !_failed;
+    _file = nullptr;
+    _pending.clear();
+    _freeFrames.clear();
+
+    if (!succeeded)
+    {
+        LOG(ERROR) << "Cannot write trajectory.";
+    }
+
+    return succeeded;
+}
+
+template <typename TPrecision>
+void TrajectoryRecorder::record(
+    const TPrecision* state,
+    std::size_t stride,
+    double time
+)
+{
+    if (_file == nullptr)
+    {
+        return;
+    }
+
+    PendingFrame frame;
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        _frameWritten.wait(lock, [this]() {
+            return _pending.size() < cMaxPendingFrames;
+        });
+
+        if (!_freeFrames.empty())
+        {
+            frame = std::move(_freeFrames.back());
+            _freeFrames.pop_back();
+        }
+    }
+
+    // Momenta are kept only for keyframes.
+    frame.time = time;
+    frame.keyframe = _recordedFrames % _keyframeInterval == 0;
+    const auto fields = frame.keyframe ? ParticleStateFieldCount : MomentumX;
+    frame.values.resize(fields * _particleCount);
+    for (auto f = 0; f < fields; ++f)
+    {
+        std::copy(
+            state + f * stride,
+            state + f * stride + _particleCount,
+            frame.values.begin() + f * _particleCount
+        );
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _pending.push_back(std::move(frame));
+    }
+
+    _frameQueued.notify_one();
+    ++_recordedFrames;
+}
+
+void TrajectoryRecorder::writerLoop()
+{
+    for (;;)
+    {
+        PendingFrame frame;
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _frameQueued.wait(lock, [this]() {
+                return !_pending.empty() || _closing;
+            });
+
+            if (_pending.empty())
+            {
+                return;
+            }
+
+            frame = std::move(_pending.front());
+            _pending.pop_front();
+        }
+
+        writeFrame(frame);
+
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _freeFrames.push_back(std::move(frame));
+        }
+
+        _frameWritten.notify_one();
+    }
+}
+
+bool TrajectoryRecorder::writeFrame(const PendingFrame& frame)
+{
+    const auto count = _particleCount;
+
+    TrajectoryFrameHeader header{};
+    header.time = frame.time;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        const auto position = frame.values.data() + axis * count;
+        const auto bounds = std::minmax_element(position, position + count);
+        header.low[axis] = count > 0 ? *bounds.first : 0.0;
+        header.high[axis] = count > 0 ? *bounds.second : 0.0;
+        header.step[axis] = getQuantizationStep(
+            header.high[axis] - header.low[axis]
+        );
+    }
+
+    _index.push_back({_offset, frame.time});
+
+    if (frame.keyframe)
+    {
+        header.type = TrajectoryFrameHeader::cKeyframe;
+        header.payloadBytes = frame.values.size() * sizeof(double);
+        _reconstructed.assign(
+            frame.values.begin(),
+            frame.values.begin() + 3 * count
+        );
+
+        return writeBytes(&header, sizeof(header))
+            && writeBytes(frame.values.data(), header.payloadBytes);
+    }
+
+    header.type = TrajectoryFrameHeader::cDelta;
+    _quantized.resize(count);
+    _payload.resize(3 * count * sizeof(std::int16_t));
+
+    std::size_t bytes = 0;
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        const auto position = frame.values.data() + axis * count;
+        const auto reconstructed = _reconstructed.data() + axis * count;
+        const auto step = header.step[axis];
+        const auto inverseStep = 1.0 / step;
+
+        auto largest = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto exact = (position[i] - reconstructed[i]) * inverseStep;
+            const auto change = std::min(
+                std::max(std::round(exact), -cMaxQuantizedChange),
+                cMaxQuantizedChange
+            );
+
+            _quantized[i] = static_cast<std::int16_t>(change);
+            reconstructed[i] += change * step;
+            largest = std::max(largest, std::abs(int{_quantized[i]}));
+        }
+
+        if (largest <= 127)
+        {
+            header.deltaBytes[axis] = 1;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                _payload[bytes + i] = static_cast<unsigned char>(
+                    static_cast<std::int8_t>(_quantized[i])
+                );
+            }
+        }
+        else
+        {
+            header.deltaBytes[axis] = 2;
+            std::memcpy(
+                _payload.data() + bytes,
+                _quantized.data(),
+                count * sizeof(std::int16_t)
+            );
+        }
+
+        bytes += count * header.deltaBytes[axis];
+    }
+
+    header.payloadBytes = bytes;
+    return writeBytes(&header, sizeof(header))
+        && writeBytes(_payload.data(), bytes);
+}
+
+bool TrajectoryRecorder::writeBytes(const void* data, std::size_t bytes)
+{
+    if (bytes > 0 && std::fwrite(data, 1, bytes, _file) != bytes)
+    {
+        _failed = true;
+        return false;
+    }
+
+    _offset += bytes;
+    return true;
+}
+
+TrajectoryReader::TrajectoryReader():
+    _particleCount{},
+    _keyframeInterval{1}
+{
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+    close();
+
+    _file.open(path, std::ios::binary);
+    if (!_file)
+    {
+        LOG(ERROR) << "Cannot open trajectory " << path << ".";
+        return false;
+    }
+
+    _file.seekg(0, std::ios::end);
+    const auto size = static_cast<std::uint64_t>(_file.tellg());
+    _file.seekg(0);
+
+    TrajectoryHeader header;
+    if (!_file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, cTrajectoryMagic, sizeof(header.magic))
+        || header.version != TrajectoryHeader::cVersion
+        || header.byteOrder != TrajectoryHeader::cByteOrder
+        || header.keyframeInterval == 0)
+    {
+        LOG(ERROR) << "File " << path << " is not a trajectory.";
+        close();
+        return false;
+    }
+
+    _particleCount = static_cast<std::size_t>(header.particleCount);
+    _keyframeInterval = static_cast<int>(header.keyframeInterval);
+
+    TrajectoryTrailer trailer;
+    const auto indexed = size >= sizeof(header) + sizeof(trailer)
+        && _file.seekg(size - sizeof(trailer))
+        && _file.read(reinterpret_cast<char*>(&trailer), sizeof(trailer))
+        && !std::memcmp(
+            trailer.magic,
+            cTrajectoryIndexMagic,
+            sizeof(trailer.magic)
+        )
+        && trailer.indexOffset
+            + trailer.frameCount * sizeof(TrajectoryIndexEntry)
+            + sizeof(trailer) == size;
+
+    if (indexed)
+    {
+        _index.resize(static_cast<std::size_t>(trailer.frameCount));
+        _file.seekg(trailer.indexOffset);
+        _file.read(
+            reinterpret_cast<char*>(_index.data()),
+            _index.size() * sizeof(TrajectoryIndexEntry)
+        );
+
+        return true;
+    }
+
+    // Recording was cut short, only complete frames are listed.
+    _file.clear();
+    std::uint64_t offset = sizeof(header);
+    TrajectoryFrameHeader frame;
+    while (offset + sizeof(frame) <= size
+        && readFrameHeader(offset, frame)
+        && offset + sizeof(frame) + frame.payloadBytes <= size)
+    {
+        _index.push_back({offset, frame.time});
+        offset += sizeof(frame) + frame.payloadBytes;
+    }
+
+    _file.clear();
+    LOG(WARNING) << "Trajectory " << path << " has no index, found "
+        << _index.size() << " complete frames.";
+
+    return true;
+}
+
+void TrajectoryReader::close()
+{
+    _file.close();
+    _file.clear();
+    _particleCount = 0;
+    _keyframeInterval = 1;
+    _index.clear();
+}
+
+bool TrajectoryReader::readFrames(
+    std::size_t first,
+    std::size_t count,
+    const std::function<void(TrajectoryFrame&)>& function
+)
+{
+    if (first + count > _index.size())
+    {
+        return false;
+    }
+
+    const auto particles = _particleCount;
+    const auto keyframe = first - first % _keyframeInterval;
+
+    std::vector<double> reconstructed(3 * particles);
+    TrajectoryFrame frame;
+    for (auto f = keyframe; f < first + count; ++f)
+    {
+        TrajectoryFrameHeader header;
+        if (!readFrameHeader(_index[f].offset, header))
+        {
+            return false;
+        }
+
+        const auto isKeyframe =
+            header.type == TrajectoryFrameHeader::cKeyframe;
+        _payload.resize(static_cast<std::size_t>(header.payloadBytes));
+        if (isKeyframe != (f % _keyframeInterval == 0)
+            || !_file.read(
+                reinterpret_cast<char*>(_payload.data()),
+                _payload.size()
+            ))
+        {
+            _file.clear();
+            return false;
+        }
+
+        frame.momenta.clear();
+        if (isKeyframe)
+        {
+            const auto keyframeBytes =
+                ParticleStateFieldCount * particles * sizeof(double);
+            if (_payload.size() != keyframeBytes)
+            {
+                return false;
+            }
+
+            std::memcpy(
+                reconstructed.data(),
+                _payload.data(),
+                reconstructed.size() * sizeof(double)
+            );
+
+            if (f >= first)
+            {
+                const auto momentum = reinterpret_cast<const double*>(
+                    _payload.data()
+                ) + 3 * particles;
+
+                frame.momenta.resize(particles);
+                for (std::size_t i = 0; i < particles; ++i)
+                {
+                    frame.momenta[i] = {
+                        momentum[i],
+                        momentum[particles + i],
+                        momentum[2 * particles + i]
+                    };
+                }
+            }
+        }
+        else
+        {
+            std::size_t bytes = 0;
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                const auto width = header.deltaBytes[axis];
+                if ((width != 1 && width != 2)
+                    || bytes + particles * width > _payload.size())
+                {
+                    return false;
+                }
+
+                const auto step = header.step[axis];
+                const auto position = reconstructed.data() + axis * particles;
+                const auto data = _payload.data() + bytes;
+                for (std::size_t i = 0; i < particles; ++i)
+                {
+                    std::int16_t change;
+                    if (width == 1)
+                    {
+                        change = static_cast<std::int8_t>(data[i]);
+                    }
+                    else
+                    {
+                        std::memcpy(&change, data + 2 * i, sizeof(change));
+                    }
+
+                    position[i] += change * step;
+                }
+
+                bytes += particles * width;
+            }
+        }
+
+        if (f < first)
+        {
+            continue;
+        }
+
+        frame.index = f;
+        frame.time = header.time;
+        frame.keyframe = isKeyframe;
+        frame.low = {header.low[0], header.low[1], header.low[2]};
+        frame.high = {header.high[0], header.high[1], header.high[2]};
+        frame.positions.resize(particles);
+        for (std::size_t i = 0; i < particles; ++i)
+        {
+            frame.positions[i] = {
+                reconstructed[i],
+                reconstructed[particles + i],
+                reconstructed[2 * particles + i]
+            };
+        }
+
+        function(frame);
+    }
+
+    return true;
+}
+
+bool TrajectoryReader::readFrame(std::size_t frame, TrajectoryFrame& output)
+{
+    return readFrames(frame, 1, [&output](TrajectoryFrame& decoded) {
+        std::swap(output, decoded);
+    });
+}
+
+bool TrajectoryReader::readFrameHeader(
+    std::uint64_t offset,
+    TrajectoryFrameHeader& header
+)
+{
+    _file.seekg(offset);
+    if (!_file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        _file.clear();
+        return false;
+    }
+
+    return header.type == TrajectoryFrameHeader::cKeyframe
+        || header.type == TrajectoryFrameHeader::cDelta;
+}
+
+template void TrajectoryRecorder::record(
+    const float*,
+    std::size_t,
+    double
+);
+
+template void TrajectoryRecorder::record(
+    const double*,
+    std::size_t,
+    double
+);
+
+}